@@ -0,0 +1,306 @@
+#include "chip.hpp"
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+struct Token
+{
+  std::string text;
+  int line;
+};
+
+// Reading position in a chip's tokens, for error messages
+struct Tokens
+{
+  std::vector<Token> tokens;
+  size_t position;
+  std::string source;
+};
+
+static std::vector<Token> tokenize(std::istream &is, const std::string &source);
+static std::runtime_error parseError(const Tokens &tokens,
+                                     const std::string &message);
+static const std::string &peek(const Tokens &tokens);
+static std::string next(Tokens &tokens);
+static void expect(Tokens &tokens, const std::string &text);
+static std::string identifier(Tokens &tokens);
+static int number(Tokens &tokens);
+static std::vector<Pin> parsePins(Tokens &tokens);
+static void parseRange(Tokens &tokens, int &first, int &last);
+static Part parsePart(Tokens &tokens);
+
+Chip::Chip(std::string name, std::vector<Pin> inputs, std::vector<Pin> outputs,
+           std::vector<Part> parts, bool builtin, std::string source)
+    : name{std::move(name)}, inputs{std::move(inputs)},
+      outputs{std::move(outputs)}, parts{std::move(parts)}, builtin{builtin},
+      source{std::move(source)}
+{
+}
+
+const std::string &Chip::getName() const { return name; }
+
+const std::vector<Pin> &Chip::getInputs() const { return inputs; }
+
+const std::vector<Pin> &Chip::getOutputs() const { return outputs; }
+
+const std::vector<Part> &Chip::getParts() const { return parts; }
+
+bool Chip::isBuiltin() const { return builtin; }
+
+const std::string &Chip::getSource() const { return source; }
+
+const Pin *Chip::findInput(const std::string &name) const
+{
+  for (const Pin &pin : inputs)
+    if (pin.name == name)
+      return &pin;
+  return nullptr;
+}
+
+const Pin *Chip::findOutput(const std::string &name) const
+{
+  for (const Pin &pin : outputs)
+    if (pin.name == name)
+      return &pin;
+  return nullptr;
+}
+
+// CHIP Name { IN pins; OUT pins; PARTS: Part(pin=signal, ...); ... }, or
+// BUILTIN Name; (and CLOCKED pins;) in place of PARTS: for the builtin chip
+// stubs of the course's tools
+Chip Chip::parse(std::istream &is, const std::string &source)
+{
+  Tokens tokens{tokenize(is, source), 0, source};
+  expect(tokens, "CHIP");
+  const std::string name{identifier(tokens)};
+  expect(tokens, "{");
+
+  std::vector<Pin> inputs;
+  std::vector<Pin> outputs;
+  std::vector<Part> parts;
+  bool builtin{false};
+  if (peek(tokens) == "IN")
+  {
+    next(tokens);
+    inputs = parsePins(tokens);
+  }
+  if (peek(tokens) == "OUT")
+  {
+    next(tokens);
+    outputs = parsePins(tokens);
+  }
+
+  if (peek(tokens) == "BUILTIN")
+  {
+    next(tokens);
+    identifier(tokens);
+    expect(tokens, ";");
+    builtin = true;
+    if (peek(tokens) == "CLOCKED")
+    {
+      while (next(tokens) != ";")
+        ;
+    }
+  }
+  else
+  {
+    expect(tokens, "PARTS");
+    expect(tokens, ":");
+    while (peek(tokens) != "}")
+      parts.push_back(parsePart(tokens));
+  }
+  expect(tokens, "}");
+  if (!peek(tokens).empty())
+    throw parseError(tokens, "Unexpected '" + peek(tokens) + "' after chip");
+
+  return Chip{name, std::move(inputs), std::move(outputs), std::move(parts),
+              builtin, source};
+}
+
+Chip Chip::read(const std::string &inputFilename)
+{
+  std::ifstream inputFile{inputFilename};
+  if (!inputFile.is_open())
+    throw std::runtime_error("Could not open chip " + inputFilename);
+  return parse(inputFile, inputFilename);
+}
+
+// Splits the text into names, numbers, ".." and single punctuation
+// characters, dropping // and /* */ comments
+static std::vector<Token> tokenize(std::istream &is, const std::string &source)
+{
+  const std::string text{std::istreambuf_iterator<char>{is},
+                         std::istreambuf_iterator<char>{}};
+  std::vector<Token> tokens;
+  int line{1};
+  size_t i{0};
+  while (i < text.size())
+  {
+    const char c{text[i]};
+    if (c == '\n')
+    {
+      ++line;
+      ++i;
+    }
+    else if (std::isspace(static_cast<unsigned char>(c)))
+      ++i;
+    else if (text.compare(i, 2, "//") == 0)
+      i = text.find('\n', i) == std::string::npos ? text.size()
+                                                  : text.find('\n', i);
+    else if (text.compare(i, 2, "/*") == 0)
+    {
+      const size_t end{text.find("*/", i + 2)};
+      if (end == std::string::npos)
+        throw std::runtime_error(source + ":" + std::to_string(line) +
+                                 ": Unterminated comment");
+      for (; i < end + 2; i++)
+        line += text[i] == '\n';
+    }
+    else if (std::isalnum(static_cast<unsigned char>(c)) || c == '_')
+    {
+      size_t end{i};
+      while (end < text.size() &&
+             (std::isalnum(static_cast<unsigned char>(text[end])) ||
+              text[end] == '_'))
+        ++end;
+      tokens.push_back({text.substr(i, end - i), line});
+      i = end;
+    }
+    else if (text.compare(i, 2, "..") == 0)
+    {
+      tokens.push_back({"..", line});
+      i += 2;
+    }
+    else if (std::string{"{}()[],;=:"}.find(c) != std::string::npos)
+    {
+      tokens.push_back({std::string{c}, line});
+      ++i;
+    }
+    else
+      throw std::runtime_error(source + ":" + std::to_string(line) +
+                               ": Unexpected character '" + c + "'");
+  }
+  return tokens;
+}
+
+static std::runtime_error parseError(const Tokens &tokens,
+                                     const std::string &message)
+{
+  const int line{tokens.tokens.empty() ? 1
+                 : tokens.position < tokens.tokens.size()
+                     ? tokens.tokens[tokens.position].line
+                     : tokens.tokens.back().line};
+  return std::runtime_error(tokens.source + ":" + std::to_string(line) + ": " +
+                            message);
+}
+
+// The next token, or "" at the end
+static const std::string &peek(const Tokens &tokens)
+{
+  static const std::string END{};
+  return tokens.position < tokens.tokens.size()
+             ? tokens.tokens[tokens.position].text
+             : END;
+}
+
+static std::string next(Tokens &tokens)
+{
+  if (tokens.position == tokens.tokens.size())
+    throw parseError(tokens, "Unexpected end of chip");
+  return tokens.tokens[tokens.position++].text;
+}
+
+static void expect(Tokens &tokens, const std::string &text)
+{
+  if (peek(tokens) != text)
+    throw parseError(tokens, "Expected '" + text + "' but found '" +
+                                 peek(tokens) + "'");
+  next(tokens);
+}
+
+static std::string identifier(Tokens &tokens)
+{
+  const std::string &text{peek(tokens)};
+  if (text.empty() ||
+      !(std::isalpha(static_cast<unsigned char>(text[0])) || text[0] == '_'))
+    throw parseError(tokens, "Expected a name but found '" + text + "'");
+  return next(tokens);
+}
+
+static int number(Tokens &tokens)
+{
+  const std::string &text{peek(tokens)};
+  if (text.empty() || text.size() > 4 ||
+      text.find_first_not_of("0123456789") != std::string::npos)
+    throw parseError(tokens, "Expected a number but found '" + text + "'");
+  return std::stoi(next(tokens));
+}
+
+// "name, name[width], ...;"
+static std::vector<Pin> parsePins(Tokens &tokens)
+{
+  std::vector<Pin> pins;
+  while (true)
+  {
+    Pin pin{identifier(tokens), 1};
+    if (peek(tokens) == "[")
+    {
+      next(tokens);
+      pin.width = number(tokens);
+      if (pin.width < 1 || pin.width > Chip::MAX_WIDTH)
+        throw parseError(tokens, "Invalid width of pin " + pin.name);
+      expect(tokens, "]");
+    }
+    pins.push_back(pin);
+    if (next(tokens) == ";")
+      return pins;
+    --tokens.position;
+    expect(tokens, ",");
+  }
+}
+
+// An optional "[bit]" or "[first..last]"
+static void parseRange(Tokens &tokens, int &first, int &last)
+{
+  first = last = -1;
+  if (peek(tokens) != "[")
+    return;
+  next(tokens);
+  first = last = number(tokens);
+  if (peek(tokens) == "..")
+  {
+    next(tokens);
+    last = number(tokens);
+  }
+  if (first > last)
+    throw parseError(tokens, "Invalid range");
+  expect(tokens, "]");
+}
+
+// "Chip(pin=signal, ...);"
+static Part parsePart(Tokens &tokens)
+{
+  Part part{"", {}, tokens.position < tokens.tokens.size()
+                        ? tokens.tokens[tokens.position].line
+                        : 0};
+  part.chip = identifier(tokens);
+  expect(tokens, "(");
+  while (true)
+  {
+    Connection connection{};
+    connection.pin = identifier(tokens);
+    parseRange(tokens, connection.pinFirst, connection.pinLast);
+    expect(tokens, "=");
+    connection.signal = identifier(tokens);
+    parseRange(tokens, connection.signalFirst, connection.signalLast);
+    part.connections.push_back(connection);
+    if (peek(tokens) == ")")
+      break;
+    expect(tokens, ",");
+  }
+  expect(tokens, ")");
+  expect(tokens, ";");
+  return part;
+}
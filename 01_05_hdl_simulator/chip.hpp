@@ -0,0 +1,64 @@
+#ifndef CHIP_HPP
+#define CHIP_HPP
+
+#include <istream>
+#include <string>
+#include <vector>
+
+struct Pin
+{
+  std::string name;
+  int width;
+};
+
+// "pin[pinFirst..pinLast]=signal[signalFirst..signalLast]". A range of -1
+// is the whole pin or signal. The signal can be true or false.
+struct Connection
+{
+  std::string pin;
+  int pinFirst;
+  int pinLast;
+  std::string signal;
+  int signalFirst;
+  int signalLast;
+};
+
+struct Part
+{
+  std::string chip;
+  std::vector<Connection> connections;
+  int line;
+};
+
+// The interface and parts of a chip, as written in its .hdl file. Builtin
+// chips have pins but no parts.
+class Chip
+{
+public:
+  static constexpr int MAX_WIDTH{16};
+
+  Chip(std::string name, std::vector<Pin> inputs, std::vector<Pin> outputs,
+       std::vector<Part> parts, bool builtin, std::string source);
+  const std::string &getName() const;
+  const std::vector<Pin> &getInputs() const;
+  const std::vector<Pin> &getOutputs() const;
+  const std::vector<Part> &getParts() const;
+  bool isBuiltin() const;
+  const std::string &getSource() const;
+  const Pin *findInput(const std::string &name) const;
+  const Pin *findOutput(const std::string &name) const;
+
+  static Chip parse(std::istream &is, const std::string &source);
+  static Chip read(const std::string &inputFilename);
+
+private:
+  std::string name;
+  std::vector<Pin> inputs;
+  std::vector<Pin> outputs;
+  std::vector<Part> parts;
+  bool builtin;
+  // The .hdl file, for error messages
+  std::string source;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "chiplibrary.hpp"
+#include <filesystem>
+#include <stdexcept>
+
+// Nand and DFF, and the course simulator's builtin registers and memories,
+// which the Netlist turns into word arrays
+static const std::vector<Chip> BUILTINS{
+    {"Nand", {{"a", 1}, {"b", 1}}, {{"out", 1}}, {}, true, "builtin"},
+    {"DFF", {{"in", 1}}, {{"out", 1}}, {}, true, "builtin"},
+    {"Bit", {{"in", 1}, {"load", 1}}, {{"out", 1}}, {}, true, "builtin"},
+    {"Register", {{"in", 16}, {"load", 1}}, {{"out", 16}}, {}, true, "builtin"},
+    {"ARegister",
+     {{"in", 16}, {"load", 1}},
+     {{"out", 16}},
+     {},
+     true,
+     "builtin"},
+    {"DRegister",
+     {{"in", 16}, {"load", 1}},
+     {{"out", 16}},
+     {},
+     true,
+     "builtin"},
+    {"RAM8",
+     {{"in", 16}, {"load", 1}, {"address", 3}},
+     {{"out", 16}},
+     {},
+     true,
+     "builtin"},
+    {"RAM64",
+     {{"in", 16}, {"load", 1}, {"address", 6}},
+     {{"out", 16}},
+     {},
+     true,
+     "builtin"},
+    {"RAM512",
+     {{"in", 16}, {"load", 1}, {"address", 9}},
+     {{"out", 16}},
+     {},
+     true,
+     "builtin"},
+    {"RAM4K",
+     {{"in", 16}, {"load", 1}, {"address", 12}},
+     {{"out", 16}},
+     {},
+     true,
+     "builtin"},
+    {"RAM16K",
+     {{"in", 16}, {"load", 1}, {"address", 14}},
+     {{"out", 16}},
+     {},
+     true,
+     "builtin"},
+    {"Screen",
+     {{"in", 16}, {"load", 1}, {"address", 13}},
+     {{"out", 16}},
+     {},
+     true,
+     "builtin"},
+    {"Keyboard", {}, {{"out", 16}}, {}, true, "builtin"},
+    {"ROM32K", {{"address", 15}}, {{"out", 16}}, {}, true, "builtin"}};
+
+ChipLibrary::ChipLibrary(const std::vector<std::string> &directories,
+                         const std::vector<std::string> &builtins)
+    : paths{}, builtins{builtins.begin(), builtins.end()}, chips{}
+{
+  for (const std::string &name : builtins)
+    if (!findBuiltin(name))
+      throw std::invalid_argument("No builtin chip " + name);
+
+  for (const std::string &directory : directories)
+  {
+    if (!std::filesystem::is_directory(directory))
+      throw std::runtime_error("Could not open chip directory " + directory);
+    for (const std::filesystem::directory_entry &entry :
+         std::filesystem::recursive_directory_iterator{directory})
+      if (entry.is_regular_file() && entry.path().extension() == ".hdl")
+        paths.emplace(entry.path().stem().string(), entry.path().string());
+  }
+}
+
+// The chip's .hdl file, or its builtin if it was asked for or has no file
+const Chip &ChipLibrary::get(const std::string &name)
+{
+  auto chip{chips.find(name)};
+  if (chip != chips.end())
+    return chip->second;
+
+  const auto path{paths.find(name)};
+  if (builtins.count(name) || path == paths.end())
+  {
+    const Chip *builtin{findBuiltin(name)};
+    if (!builtin)
+      throw std::runtime_error("Could not find chip " + name);
+    return chips.emplace(name, *builtin).first->second;
+  }
+
+  Chip parsed{Chip::read(path->second)};
+  if (parsed.getName() != name)
+    throw std::runtime_error(path->second + " defines chip " +
+                             parsed.getName() + " instead of " + name);
+  // A BUILTIN stub only declares the pins
+  if (parsed.isBuiltin())
+  {
+    const Chip *builtin{findBuiltin(name)};
+    if (!builtin)
+      throw std::runtime_error("No builtin implementation of chip " + name);
+    return chips.emplace(name, *builtin).first->second;
+  }
+  return chips.emplace(name, std::move(parsed)).first->second;
+}
+
+// Uses the builtin implementation of name from now on, such as for a
+// memory chip proven to behave like it
+void ChipLibrary::addBuiltin(const std::string &name)
+{
+  if (!findBuiltin(name))
+    throw std::invalid_argument("No builtin chip " + name);
+  builtins.insert(name);
+  chips.erase(name);
+}
+
+bool ChipLibrary::hasBuiltin(const std::string &name)
+{
+  return findBuiltin(name) != nullptr;
+}
+
+const Chip *ChipLibrary::findBuiltin(const std::string &name)
+{
+  for (const Chip &chip : BUILTINS)
+    if (chip.getName() == name)
+      return &chip;
+  return nullptr;
+}
@@ -0,0 +1,32 @@
+#ifndef CHIP_LIBRARY_HPP
+#define CHIP_LIBRARY_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "chip.hpp"
+
+// Finds chips by name among the .hdl files under a list of directories, the
+// first directory taking precedence, and parses each once. Nand, DFF and the
+// chips with no .hdl file (ROM32K, Screen, Keyboard, ARegister, DRegister)
+// are builtin; the memory chips can be made builtin on request.
+class ChipLibrary
+{
+public:
+  ChipLibrary(const std::vector<std::string> &directories,
+              const std::vector<std::string> &builtins = {});
+  const Chip &get(const std::string &name);
+  void addBuiltin(const std::string &name);
+
+  static bool hasBuiltin(const std::string &name);
+  static const Chip *findBuiltin(const std::string &name);
+
+private:
+  // Chip name to .hdl path
+  std::map<std::string, std::string> paths;
+  std::set<std::string> builtins;
+  std::map<std::string, Chip> chips;
+};
+
+#endif
@@ -0,0 +1,220 @@
+#include "codegenerator.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+const char *const CodeGenerator::FUNCTION_NAME{"hdlEval"};
+
+CodeGenerator::CodeGenerator(const Netlist &netlist)
+    : source{}, literals{}, gates{}, gateNands{}, isLive{}, isMemoryLive{},
+      nandCount{0}, constantCount{0}, foldedCount{0}, deadCount{0}
+{
+  fold(netlist);
+  markLive(netlist);
+  emit(netlist);
+}
+
+const std::string &CodeGenerator::getSource() const { return source; }
+
+// The Nands in the generated function
+size_t CodeGenerator::getNandCount() const { return nandCount; }
+
+// Nands whose output is a constant
+size_t CodeGenerator::getConstantCount() const { return constantCount; }
+
+// Nands that are a Not, or compute what an earlier Nand does
+size_t CodeGenerator::getFoldedCount() const { return foldedCount; }
+
+// Nands nothing the Simulator reads depends on
+size_t CodeGenerator::getDeadCount() const { return deadCount; }
+
+// Works out every Nand's output as a constant, an earlier net or its
+// inverse, or a new gate
+void CodeGenerator::fold(const Netlist &netlist)
+{
+  literals.resize(netlist.getNetCount());
+  for (uint32_t net = 0; net < literals.size(); net++)
+    literals[net] = net << 1;
+  literals[Netlist::TRUE_NET] = 1;
+
+  const std::vector<Netlist::Nand> &nands{netlist.getNands()};
+  std::unordered_map<uint64_t, Literal> computed;
+  for (uint32_t nand = 0; nand < nands.size(); nand++)
+  {
+    Literal a{literals[nands[nand].a]};
+    Literal b{literals[nands[nand].b]};
+    if (a > b)
+      std::swap(a, b);
+    Literal &out{literals[nands[nand].out]};
+    if (a == 0 || a == (b ^ 1))
+      out = 1;
+    else if (a == 1 || a == b)
+      out = b ^ 1;
+    else
+    {
+      const auto found{computed.emplace(uint64_t{a} << 32 | b,
+                                        nands[nand].out << 1)};
+      out = found.first->second;
+      if (found.second)
+      {
+        gates.push_back({nands[nand].out, a, b});
+        gateNands.push_back(nand);
+      }
+      else
+        ++foldedCount;
+      continue;
+    }
+    if (out <= 1)
+      ++constantCount;
+    else
+      ++foldedCount;
+  }
+}
+
+// Marks the nets the pins, signals, DFFs and memories read, and the gates
+// and memory reads they depend on, walking the evaluation backwards
+void CodeGenerator::markLive(const Netlist &netlist)
+{
+  isLive.assign(netlist.getNetCount(), 0);
+  isMemoryLive.assign(netlist.getMemories().size(), 0);
+  const auto mark = [&](uint32_t net)
+  { isLive[literals[net] >> 1] = 1; };
+  for (const std::vector<Netlist::Port> *ports :
+       {&netlist.getOutputs(), &netlist.getSignals()})
+    for (const Netlist::Port &port : *ports)
+      for (uint32_t net : port.nets)
+        mark(net);
+  for (const Netlist::Flop &flop : netlist.getFlops())
+    mark(flop.in);
+  for (const Netlist::Memory &memory : netlist.getMemories())
+  {
+    for (uint32_t net : memory.address)
+      mark(net);
+    for (uint32_t net : memory.in)
+      mark(net);
+    if (!memory.in.empty())
+      mark(memory.load);
+  }
+
+  const std::vector<Netlist::Step> &steps{netlist.getSteps()};
+  const std::vector<Netlist::Memory> &memories{netlist.getMemories()};
+  size_t gate{gates.size()};
+  for (size_t step = steps.size(); step-- > 0;)
+  {
+    const int memory{steps[step].memory};
+    if (memory >= 0 &&
+        std::any_of(memories[memory].out.begin(), memories[memory].out.end(),
+                    [&](uint32_t net) { return isLive[net]; }))
+    {
+      isMemoryLive[memory] = 1;
+      for (uint32_t net : memories[memory].address)
+        mark(net);
+    }
+    const uint32_t first{step > 0 ? steps[step - 1].nandEnd : 0};
+    for (; gate > 0 && gateNands[gate - 1] >= first; gate--)
+      if (isLive[gates[gate - 1].out])
+      {
+        isLive[gates[gate - 1].a >> 1] = 1;
+        isLive[gates[gate - 1].b >> 1] = 1;
+      }
+  }
+  isLive[Netlist::FALSE_NET] = 0;
+}
+
+void CodeGenerator::emit(const Netlist &netlist)
+{
+  const std::vector<Netlist::Memory> &memories{netlist.getMemories()};
+  const std::vector<Netlist::Step> &steps{netlist.getSteps()};
+  // Nets the function computes; the others are read from values
+  std::vector<char> isComputed(netlist.getNetCount(), 0);
+  for (const Gate &gate : gates)
+    isComputed[gate.out] = 1;
+  for (const Netlist::Step &step : steps)
+    if (step.memory >= 0)
+      for (uint32_t net : memories[step.memory].out)
+        isComputed[net] = 1;
+
+  std::string body;
+  for (uint32_t net = 0; net < isLive.size(); net++)
+    if (isLive[net] && !isComputed[net])
+      body += "  const uint32_t n" + std::to_string(net) + "{values[" +
+              std::to_string(net) + "]};\n";
+
+  size_t gate{0};
+  for (const Netlist::Step &step : steps)
+  {
+    for (; gate < gates.size() && gateNands[gate] < step.nandEnd; gate++)
+      if (isLive[gates[gate].out])
+      {
+        body += "  const uint32_t n" + std::to_string(gates[gate].out) +
+                "{(" + read(gates[gate].a) + " & " + read(gates[gate].b) +
+                ") ^ 1};\n";
+        ++nandCount;
+      }
+    if (step.memory < 0 || !isMemoryLive[step.memory])
+      continue;
+
+    const Netlist::Memory &memory{memories[step.memory]};
+    const std::string word{"w" + std::to_string(step.memory)};
+    uint32_t constant{0};
+    std::string address;
+    for (size_t bit = 0; bit < memory.address.size(); bit++)
+    {
+      const Literal literal{literals[memory.address[bit]]};
+      if (literal <= 1)
+        constant |= literal << bit;
+      else
+        address += read(literal) + " << " + std::to_string(bit) + " | ";
+    }
+    body += "  const uint32_t " + word + "{words[" +
+            std::to_string(step.memory) + "][" + address +
+            std::to_string(constant) + "]};\n";
+    for (size_t bit = 0; bit < memory.out.size(); bit++)
+      if (isLive[memory.out[bit]])
+        body += "  const uint32_t n" + std::to_string(memory.out[bit]) +
+                "{" + word + " >> " + std::to_string(bit) + " & 1};\n";
+  }
+  deadCount = gates.size() - nandCount;
+
+  // Writes back what the Simulator reads, unless it is already there
+  std::vector<char> isWritten(netlist.getNetCount(), 0);
+  const auto write = [&](uint32_t net)
+  {
+    if (isWritten[net] || (literals[net] == net << 1 && !isComputed[net]))
+      return;
+    isWritten[net] = 1;
+    body += "  values[" + std::to_string(net) + "] = " +
+            read(literals[net]) + ";\n";
+  };
+  for (const std::vector<Netlist::Port> *ports :
+       {&netlist.getOutputs(), &netlist.getSignals()})
+    for (const Netlist::Port &port : *ports)
+      for (uint32_t net : port.nets)
+        write(net);
+  for (const Netlist::Flop &flop : netlist.getFlops())
+    write(flop.in);
+  for (const Netlist::Memory &memory : memories)
+  {
+    for (uint32_t net : memory.address)
+      write(net);
+    for (uint32_t net : memory.in)
+      write(net);
+    if (!memory.in.empty())
+      write(memory.load);
+  }
+
+  source = "// Generated by hdl_simulator from chip " + netlist.getChipName() +
+           ": " + std::to_string(nandCount) + " of " +
+           std::to_string(netlist.getNands().size()) + " Nands\n" +
+           "#include <cstdint>\n\n" + "extern \"C\" void " + FUNCTION_NAME +
+           "(uint8_t *values, uint16_t *const *words)\n{\n" + body + "}\n";
+}
+
+// A literal as a C++ expression of 0 or 1
+std::string CodeGenerator::read(Literal literal) const
+{
+  if (literal <= 1)
+    return std::to_string(literal) + "u";
+  const std::string net{"n" + std::to_string(literal >> 1)};
+  return literal & 1 ? "(" + net + " ^ 1)" : net;
+}
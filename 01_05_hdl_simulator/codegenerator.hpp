@@ -0,0 +1,58 @@
+#ifndef CODE_GENERATOR_HPP
+#define CODE_GENERATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "netlist.hpp"
+
+// Translates a Netlist's evaluation into one straight-line C++ function,
+//   extern "C" void hdlEval(uint8_t *values, uint16_t *const *words)
+// which does what Simulator::eval does on the same values and memory words.
+// Constants are propagated through the Nands, Nots are folded into the
+// Nands that read them, Nands of the same inputs are computed once, and
+// Nands no pin, signal, DFF or memory depends on are left out.
+class CodeGenerator
+{
+public:
+  static const char *const FUNCTION_NAME;
+
+  CodeGenerator(const Netlist &netlist);
+  const std::string &getSource() const;
+  size_t getNandCount() const;
+  size_t getConstantCount() const;
+  size_t getFoldedCount() const;
+  size_t getDeadCount() const;
+
+private:
+  // A net's value as twice the net it is computed in, plus 1 if inverted.
+  // FALSE_NET's literal 0 is false and 1 is true.
+  typedef uint32_t Literal;
+
+  struct Gate
+  {
+    uint32_t out;
+    Literal a;
+    Literal b;
+  };
+
+  void fold(const Netlist &netlist);
+  void markLive(const Netlist &netlist);
+  void emit(const Netlist &netlist);
+  std::string read(Literal literal) const;
+
+  std::string source;
+  std::vector<Literal> literals;
+  // The Nands left after folding, and the Nand they were before it
+  std::vector<Gate> gates;
+  std::vector<uint32_t> gateNands;
+  std::vector<char> isLive;
+  std::vector<char> isMemoryLive;
+  size_t nandCount;
+  size_t constantCount;
+  size_t foldedCount;
+  size_t deadCount;
+};
+
+#endif
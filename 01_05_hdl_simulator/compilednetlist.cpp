@@ -0,0 +1,138 @@
+#include "compilednetlist.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Larger chips take minutes to compile, for little gain over the Simulator
+const size_t MAX_NANDS{1 << 18};
+const char *const FLAGS{"-std=c++17 -O2 -shared -fPIC"};
+
+static std::filesystem::path findCacheDirectory();
+static std::string readFile(const std::string &path);
+
+CompiledNetlist::CompiledNetlist(const Netlist &netlist)
+    : generator{netlist}, libraryPath{}, cached{true}, library{nullptr},
+      function{nullptr}
+{
+  if (generator.getNandCount() > MAX_NANDS)
+    throw std::runtime_error("Chip " + netlist.getChipName() +
+                             " is too large to compile");
+
+  std::ostringstream name;
+  name << netlist.getChipName() << "-" << std::hex
+       << std::hash<std::string>{}(generator.getSource());
+  const std::filesystem::path directory{findCacheDirectory()};
+  const std::filesystem::path path{directory / (name.str() + ".so")};
+  const std::filesystem::path sourcePath{directory / (name.str() + ".cpp")};
+  libraryPath = path.string();
+
+  // The source is kept next to the shared object, and a hit only counts if
+  // it is the same source, not just the same hash
+  if (!std::filesystem::exists(path) ||
+      readFile(sourcePath.string()) != generator.getSource())
+  {
+    cached = false;
+    // Builds under a name of this process's own, then renames, so other
+    // processes never load a shared object that is being written. The
+    // source is renamed last, so it is never there without its object.
+    const std::string stem{(directory / name.str()).string() + "-" +
+                           std::to_string(getpid())};
+    std::ofstream{stem + ".cpp"} << generator.getSource();
+    const char *compiler{std::getenv("CXX")};
+    const std::string command{std::string{compiler ? compiler : "c++"} +
+                              " " + FLAGS + " -o '" + stem + ".so' '" +
+                              stem + ".cpp' 2> '" + stem + ".log'"};
+    const int status{std::system(command.c_str())};
+    const std::string log{readFile(stem + ".log")};
+    std::filesystem::remove(stem + ".log");
+    if (status != 0)
+    {
+      std::filesystem::remove(stem + ".cpp");
+      std::filesystem::remove(stem + ".so");
+      throw std::runtime_error("Could not compile chip " +
+                               netlist.getChipName() + " with " + command +
+                               (log.empty() ? "" : ":\n" + log));
+    }
+    std::filesystem::remove(sourcePath);
+    std::filesystem::rename(stem + ".so", path);
+    std::filesystem::rename(stem + ".cpp", sourcePath);
+  }
+
+  library = dlopen(libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!library)
+    throw std::runtime_error("Could not load " + libraryPath + ": " +
+                             dlerror());
+  function = reinterpret_cast<Function>(
+      dlsym(library, CodeGenerator::FUNCTION_NAME));
+  if (!function)
+  {
+    dlclose(library);
+    throw std::runtime_error(libraryPath + " has no function " +
+                             CodeGenerator::FUNCTION_NAME);
+  }
+}
+
+CompiledNetlist::~CompiledNetlist() { dlclose(library); }
+
+const CodeGenerator &CompiledNetlist::getGenerator() const
+{
+  return generator;
+}
+
+const std::string &CompiledNetlist::getLibraryPath() const
+{
+  return libraryPath;
+}
+
+// Whether the shared object was already compiled
+bool CompiledNetlist::isCached() const { return cached; }
+
+// Settles every net the Simulator reads, like Simulator::eval
+void CompiledNetlist::eval(uint8_t *values, uint16_t *const *words) const
+{
+  function(values, words);
+}
+
+// $XDG_CACHE_HOME/hdl_simulator or ~/.cache/hdl_simulator, created private
+// to the user. Shared objects in it are loaded into the process, so it must
+// be a directory of the user's own that nobody else can write to.
+static std::filesystem::path findCacheDirectory()
+{
+  const char *cacheHome{std::getenv("XDG_CACHE_HOME")};
+  const char *home{std::getenv("HOME")};
+  std::filesystem::path directory;
+  if (cacheHome && *cacheHome)
+    directory = cacheHome;
+  else if (home && *home)
+    directory = std::filesystem::path{home} / ".cache";
+  else
+    throw std::runtime_error(
+        "Neither XDG_CACHE_HOME nor HOME is set to cache compiled chips in");
+  directory /= "hdl_simulator";
+
+  std::filesystem::create_directories(directory);
+  struct stat status;
+  if (lstat(directory.c_str(), &status) != 0 || !S_ISDIR(status.st_mode) ||
+      status.st_uid != getuid())
+    throw std::runtime_error(directory.string() +
+                             " is not a directory of the user's own");
+  if ((status.st_mode & 077) != 0 && chmod(directory.c_str(), 0700) != 0)
+    throw std::runtime_error("Could not make " + directory.string() +
+                             " private");
+  return directory;
+}
+
+// The file's contents, or an empty string if it cannot be read
+static std::string readFile(const std::string &path)
+{
+  std::ifstream file{path, std::ios::binary};
+  return std::string{std::istreambuf_iterator<char>{file},
+                     std::istreambuf_iterator<char>{}};
+}
@@ -0,0 +1,35 @@
+#ifndef COMPILED_NETLIST_HPP
+#define COMPILED_NETLIST_HPP
+
+#include <cstdint>
+#include <string>
+#include "codegenerator.hpp"
+#include "netlist.hpp"
+
+// A Netlist's evaluation compiled to native code: the CodeGenerator's source
+// is built into a shared object with the host's C++ compiler, $CXX or c++,
+// and loaded. Shared objects are kept with their source in a cache directory
+// private to the user, so a chip is only compiled again when it changes.
+class CompiledNetlist
+{
+public:
+  typedef void (*Function)(uint8_t *values, uint16_t *const *words);
+
+  CompiledNetlist(const Netlist &netlist);
+  CompiledNetlist(const CompiledNetlist &) = delete;
+  CompiledNetlist &operator=(const CompiledNetlist &) = delete;
+  ~CompiledNetlist();
+  const CodeGenerator &getGenerator() const;
+  const std::string &getLibraryPath() const;
+  bool isCached() const;
+  void eval(uint8_t *values, uint16_t *const *words) const;
+
+private:
+  CodeGenerator generator;
+  std::string libraryPath;
+  bool cached;
+  void *library;
+  Function function;
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include "cosimulator.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "../05_cpu_emulator/cpu.hpp"
+#include "../05_cpu_emulator/program.hpp"
+#include "../05_cpu_emulator/rom.hpp"
+#include "simulator.hpp"
+
+const uint16_t ADDRESS_MASK{0x7FFF};
+// C instructions with M among their destinations
+const uint16_t WRITE_M_MASK{0x8008};
+
+CoSimulator::CoSimulator(std::shared_ptr<const Netlist> computer,
+                         std::shared_ptr<const CompiledNetlist> compiled)
+    : computer{std::move(computer)}, compiled{std::move(compiled)}, rom{-1},
+      aRegister{-1}, dRegister{-1}
+{
+  const Netlist &netlist{*this->computer};
+  rom = netlist.findMemory("ROM32K");
+  aRegister = netlist.findMemory("CPU/ARegister");
+  dRegister = netlist.findMemory("CPU/DRegister");
+  if (rom < 0 || aRegister < 0 || dRegister < 0 ||
+      !netlist.findInput("reset") || !netlist.findSignal("writeM") ||
+      !netlist.findSignal("addressM") || !netlist.findSignal("outM"))
+    throw std::invalid_argument(
+        "Co-simulation needs a chip like 05/Computer.hdl, with ROM32K, "
+        "CPU/ARegister and CPU/DRegister parts and writeM, addressM and "
+        "outM signals");
+}
+
+// Runs romPath from reset on both machines until the emulator halts, they
+// differ or maxCycles cycles pass, keeping the last contextCycles cycles
+CoSimulator::Result CoSimulator::run(const std::string &romPath,
+                                     uint64_t maxCycles,
+                                     size_t contextCycles) const
+{
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  Result result{romPath, true, false, 0, 0, "", {}};
+  const std::vector<uint16_t> words{loadRom(romPath)};
+
+  // Reset runs a clock cycle, which executes @0 while the ROM is still
+  // empty, so A starts at 0 as in the emulator
+  Simulator hardware{computer, compiled};
+  hardware.setInput("reset", 1);
+  hardware.tick();
+  hardware.setInput("reset", 0);
+  for (size_t address = 0; address < words.size(); address++)
+    hardware.poke(rom, address, words[address]);
+  hardware.eval();
+  // Executes one instruction per step, like the CPU
+  Cpu emulator{std::make_shared<const Program>(words, false)};
+  emulator.setFastForward(false);
+
+  std::deque<Cycle> recent;
+  while (result.cycles < maxCycles && !emulator.isHalted())
+  {
+    Cycle cycle{result.cycles, emulator.getPc(), 0, {}, {}};
+    cycle.instruction = emulator.getProgram().getWord(cycle.pc);
+    cycle.hardware.writeM = hardware.getSignal("writeM");
+    cycle.hardware.addressM = hardware.getSignal("addressM");
+    cycle.hardware.outM = hardware.getSignal("outM");
+    cycle.emulator.writeM =
+        (cycle.instruction & WRITE_M_MASK) == WRITE_M_MASK;
+    cycle.emulator.addressM = emulator.getA() & ADDRESS_MASK;
+
+    hardware.tick();
+    emulator.step();
+    ++result.cycles;
+
+    cycle.hardware.pc = hardware.getAddress(rom);
+    cycle.hardware.a = hardware.peek(aRegister, 0);
+    cycle.hardware.d = hardware.peek(dRegister, 0);
+    cycle.emulator.pc = emulator.getPc();
+    cycle.emulator.a = emulator.getA();
+    cycle.emulator.d = emulator.getD();
+    // The emulator ignores writes to the keyboard and above, as does
+    // 05/Memory.hdl, so what it wrote can only be read back below it
+    cycle.emulator.outM =
+        cycle.emulator.writeM && cycle.emulator.addressM < Cpu::KEYBOARD
+            ? emulator.peek(cycle.emulator.addressM)
+            : cycle.hardware.outM;
+
+    recent.push_back(cycle);
+    if (recent.size() > contextCycles)
+      recent.pop_front();
+    const std::string difference{compare(cycle.hardware, cycle.emulator)};
+    if (!difference.empty())
+    {
+      result.passed = false;
+      result.failure = "Cycle " + std::to_string(cycle.cycle) + " at PC " +
+                       std::to_string(cycle.pc) + ": " + difference;
+      result.context.assign(recent.begin(), recent.end());
+      break;
+    }
+  }
+
+  result.halted = emulator.isHalted();
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+  result.seconds = elapsed.count();
+  return result;
+}
+
+// Runs every ROM on up to threads threads, the calling one included, each
+// thread taking the next ROM when it is done with one. A ROM that cannot be
+// loaded fails with the error.
+std::vector<CoSimulator::Result>
+CoSimulator::runCorpus(const std::vector<std::string> &romPaths,
+                       uint64_t maxCycles, size_t contextCycles,
+                       unsigned threads) const
+{
+  std::vector<Result> results(romPaths.size());
+  std::atomic<size_t> next{0};
+  const auto worker = [&]()
+  {
+    for (size_t index = next++; index < romPaths.size(); index = next++)
+      try
+      {
+        results[index] = run(romPaths[index], maxCycles, contextCycles);
+      }
+      catch (const std::runtime_error &e)
+      {
+        results[index] = {romPaths[index], false, false, 0, 0, e.what(), {}};
+      }
+  };
+
+  threads = std::max<size_t>(1, std::min<size_t>(threads, romPaths.size()));
+  std::vector<std::thread> pool;
+  for (unsigned thread = 1; thread < threads; thread++)
+    pool.emplace_back(worker);
+  worker();
+  for (std::thread &thread : pool)
+    thread.join();
+  return results;
+}
+
+// The fields of two states that differ, or an empty string
+std::string CoSimulator::compare(const State &hardware, const State &emulator)
+{
+  std::string differences;
+  const auto check = [&](const char *name, int inHardware, int inEmulator)
+  {
+    if (inHardware == inEmulator)
+      return;
+    differences += (differences.empty() ? "" : ", ") + std::string{name} +
+                   " is " + std::to_string(inHardware) +
+                   " in the hardware and " + std::to_string(inEmulator) +
+                   " in the emulator";
+  };
+  check("PC", hardware.pc, emulator.pc);
+  check("A", hardware.a, emulator.a);
+  check("D", hardware.d, emulator.d);
+  check("writeM", hardware.writeM, emulator.writeM);
+  check("addressM", hardware.addressM, emulator.addressM);
+  if (hardware.writeM && emulator.writeM)
+    check("outM", hardware.outM, emulator.outM);
+  return differences;
+}
@@ -0,0 +1,71 @@
+#ifndef CO_SIMULATOR_HPP
+#define CO_SIMULATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "compilednetlist.hpp"
+#include "netlist.hpp"
+
+// Runs ROMs on a gate-level 05/Computer.hdl and on the CPU emulator of
+// 05_cpu_emulator side by side, one clock cycle at a time, and stops at the
+// first cycle where they differ. A corpus of ROMs is spread over a pool of
+// threads that share the Netlist, and its CompiledNetlist if given.
+class CoSimulator
+{
+public:
+  // One machine's clock cycle: the CPU's outputs during it, and PC, A and D
+  // after it. outM is only compared when writeM is set.
+  struct State
+  {
+    uint16_t pc;
+    uint16_t a;
+    uint16_t d;
+    bool writeM;
+    uint16_t addressM;
+    uint16_t outM;
+  };
+
+  struct Cycle
+  {
+    uint64_t cycle;
+    uint16_t pc;
+    uint16_t instruction;
+    State hardware;
+    State emulator;
+  };
+
+  struct Result
+  {
+    std::string romPath;
+    bool passed;
+    bool halted;
+    uint64_t cycles;
+    double seconds;
+    // The first difference, or why the ROM could not be run
+    std::string failure;
+    // The cycles leading up to the first difference, which is the last one
+    std::vector<Cycle> context;
+  };
+
+  CoSimulator(std::shared_ptr<const Netlist> computer,
+              std::shared_ptr<const CompiledNetlist> compiled = nullptr);
+  Result run(const std::string &romPath, uint64_t maxCycles,
+             size_t contextCycles) const;
+  std::vector<Result> runCorpus(const std::vector<std::string> &romPaths,
+                                uint64_t maxCycles, size_t contextCycles,
+                                unsigned threads) const;
+
+  static std::string compare(const State &hardware, const State &emulator);
+
+private:
+  std::shared_ptr<const Netlist> computer;
+  std::shared_ptr<const CompiledNetlist> compiled;
+  int rom;
+  int aRegister;
+  int dRegister;
+};
+
+#endif
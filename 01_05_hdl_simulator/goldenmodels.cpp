@@ -0,0 +1,122 @@
+#include "goldenmodels.hpp"
+
+static void notGate(const uint16_t *in, uint16_t *out) { out[0] = !in[0]; }
+
+static void andGate(const uint16_t *in, uint16_t *out)
+{
+  out[0] = in[0] & in[1];
+}
+
+static void orGate(const uint16_t *in, uint16_t *out)
+{
+  out[0] = in[0] | in[1];
+}
+
+static void xorGate(const uint16_t *in, uint16_t *out)
+{
+  out[0] = in[0] ^ in[1];
+}
+
+static void mux(const uint16_t *in, uint16_t *out)
+{
+  out[0] = in[2] ? in[1] : in[0];
+}
+
+static void dmux(const uint16_t *in, uint16_t *out)
+{
+  out[0] = in[1] ? 0 : in[0];
+  out[1] = in[1] ? in[0] : 0;
+}
+
+static void not16(const uint16_t *in, uint16_t *out) { out[0] = ~in[0]; }
+
+// A Mux16 when sel is 1 bit, and Mux4Way16 or Mux8Way16 with 2 or 3, the
+// words followed by sel
+template <int WAYS>
+static void muxWay16(const uint16_t *in, uint16_t *out)
+{
+  out[0] = in[in[WAYS]];
+}
+
+// DMux4Way or DMux8Way: in to the output sel selects, 0 to the others
+template <int WAYS>
+static void dmuxWay(const uint16_t *in, uint16_t *out)
+{
+  for (int way = 0; way < WAYS; way++)
+    out[way] = way == in[1] ? in[0] : 0;
+}
+
+static void or8Way(const uint16_t *in, uint16_t *out)
+{
+  out[0] = (in[0] & 0xFF) != 0;
+}
+
+static void halfAdder(const uint16_t *in, uint16_t *out)
+{
+  out[0] = (in[0] + in[1]) & 1;
+  out[1] = (in[0] + in[1]) >> 1;
+}
+
+static void fullAdder(const uint16_t *in, uint16_t *out)
+{
+  out[0] = (in[0] + in[1] + in[2]) & 1;
+  out[1] = (in[0] + in[1] + in[2]) >> 1;
+}
+
+static void add16(const uint16_t *in, uint16_t *out)
+{
+  out[0] = in[0] + in[1];
+}
+
+static void inc16(const uint16_t *in, uint16_t *out) { out[0] = in[0] + 1; }
+
+static void alu(const uint16_t *in, uint16_t *out)
+{
+  const uint16_t x = in[2] ? 0 : in[0];
+  const uint16_t y = in[4] ? 0 : in[1];
+  const uint16_t nx = in[3] ? ~x : x;
+  const uint16_t ny = in[5] ? ~y : y;
+  const uint16_t f = in[6] ? nx + ny : nx & ny;
+  out[0] = in[7] ? ~f : f;
+  out[1] = out[0] == 0;
+  out[2] = out[0] >> 15;
+}
+
+static const std::vector<GoldenModel> GOLDEN_MODELS{
+    {"Not", {"in"}, {"out"}, notGate},
+    {"And", {"a", "b"}, {"out"}, andGate},
+    {"Or", {"a", "b"}, {"out"}, orGate},
+    {"Xor", {"a", "b"}, {"out"}, xorGate},
+    {"Mux", {"a", "b", "sel"}, {"out"}, mux},
+    {"DMux", {"in", "sel"}, {"a", "b"}, dmux},
+    {"Not16", {"in"}, {"out"}, not16},
+    {"And16", {"a", "b"}, {"out"}, andGate},
+    {"Or16", {"a", "b"}, {"out"}, orGate},
+    {"Mux16", {"a", "b", "sel"}, {"out"}, muxWay16<2>},
+    {"Or8Way", {"in"}, {"out"}, or8Way},
+    {"Mux4Way16", {"a", "b", "c", "d", "sel"}, {"out"}, muxWay16<4>},
+    {"Mux8Way16",
+     {"a", "b", "c", "d", "e", "f", "g", "h", "sel"},
+     {"out"},
+     muxWay16<8>},
+    {"DMux4Way", {"in", "sel"}, {"a", "b", "c", "d"}, dmuxWay<4>},
+    {"DMux8Way",
+     {"in", "sel"},
+     {"a", "b", "c", "d", "e", "f", "g", "h"},
+     dmuxWay<8>},
+    {"HalfAdder", {"a", "b"}, {"sum", "carry"}, halfAdder},
+    {"FullAdder", {"a", "b", "c"}, {"sum", "carry"}, fullAdder},
+    {"Add16", {"a", "b"}, {"out"}, add16},
+    {"Inc16", {"in"}, {"out"}, inc16},
+    {"ALU",
+     {"x", "y", "zx", "nx", "zy", "ny", "f", "no"},
+     {"out", "zr", "ng"},
+     alu}};
+
+const GoldenModel *findGoldenModel(const std::string &chip)
+{
+  for (const GoldenModel &model : GOLDEN_MODELS)
+    if (model.chip == chip)
+      return &model;
+  return nullptr;
+}
@@ -0,0 +1,21 @@
+#ifndef GOLDEN_MODELS_HPP
+#define GOLDEN_MODELS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The behavior of a chip of 01 or 02 in plain C++, to verify its .hdl
+// against. compute reads the inputs and writes the outputs in the order of
+// the pin names.
+struct GoldenModel
+{
+  std::string chip;
+  std::vector<std::string> inputs;
+  std::vector<std::string> outputs;
+  void (*compute)(const uint16_t *inputs, uint16_t *outputs);
+};
+
+const GoldenModel *findGoldenModel(const std::string &chip);
+
+#endif
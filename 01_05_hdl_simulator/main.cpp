@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../05_cpu_emulator/rom.hpp"
+#include "chiplibrary.hpp"
+#include "compilednetlist.hpp"
+#include "cosimulator.hpp"
+#include "goldenmodels.hpp"
+#include "memoryprover.hpp"
+#include "netlist.hpp"
+#include "simulator.hpp"
+#include "verifier.hpp"
+
+static std::pair<std::string, uint16_t>
+parseSetting(const std::string &setting);
+static void proveMemories(ChipLibrary &library, const std::string &chip);
+static void findChips(ChipLibrary &library, const std::string &chip,
+                      std::set<std::string> &found);
+static void parseRange(const std::string &range, int &first, int &last);
+static void runComputer(Simulator &simulator, const std::string &romPath,
+                        uint64_t maxCycles, int dumpFirst, int dumpLast);
+static uint16_t peekComputer(const Simulator &simulator, int address);
+static int verify(std::shared_ptr<const Netlist> netlist, uint64_t samples,
+                  unsigned threads, uint64_t seed);
+static void printPins(const std::vector<std::string> &names,
+                      const std::vector<uint16_t> &values);
+static std::shared_ptr<const CompiledNetlist>
+compile(const Netlist &netlist);
+static int coSimulate(std::shared_ptr<const Netlist> computer,
+                      std::shared_ptr<const CompiledNetlist> compiled,
+                      const std::vector<std::string> &paths,
+                      uint64_t maxCycles, size_t contextCycles,
+                      unsigned threads);
+static void printCycle(const CoSimulator::Cycle &cycle);
+
+int main(int argc, const char *argv[])
+{
+  // Parse options
+  std::vector<std::string> directories;
+  std::vector<std::string> builtins;
+  bool gateLevel{false};
+  bool compiling{false};
+  std::vector<std::pair<std::string, uint16_t>> settings;
+  uint64_t ticks{0};
+  std::string romPath;
+  uint64_t maxCycles{std::numeric_limits<uint64_t>::max()};
+  int dumpFirst{0};
+  int dumpLast{-1};
+  bool verifying{false};
+  uint64_t samples{uint64_t{1} << 24};
+  unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+  uint64_t seed{0};
+  std::vector<std::string> coSimulated;
+  size_t contextCycles{8};
+  std::filesystem::path inputPath;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg{argv[i]};
+    if (arg == "--lib" && i + 1 < argc)
+      directories.push_back(argv[++i]);
+    else if (arg == "--builtin" && i + 1 < argc)
+      builtins.push_back(argv[++i]);
+    else if (arg == "--gates")
+      gateLevel = true;
+    else if (arg == "--compile")
+      compiling = true;
+    else if (arg == "--set" && i + 1 < argc)
+      settings.push_back(parseSetting(argv[++i]));
+    else if (arg == "--ticks" && i + 1 < argc)
+      ticks = std::stoull(argv[++i]);
+    else if (arg == "--rom" && i + 1 < argc)
+      romPath = argv[++i];
+    else if (arg == "--cycles" && i + 1 < argc)
+      maxCycles = std::stoull(argv[++i]);
+    else if (arg == "--dump" && i + 1 < argc)
+      parseRange(argv[++i], dumpFirst, dumpLast);
+    else if (arg == "--verify")
+      verifying = true;
+    else if (arg == "--samples" && i + 1 < argc)
+      samples = std::stoull(argv[++i]);
+    else if (arg == "--threads" && i + 1 < argc)
+      threads = std::stoul(argv[++i]);
+    else if (arg == "--seed" && i + 1 < argc)
+      seed = std::stoull(argv[++i]);
+    else if (arg == "--cosim" && i + 1 < argc)
+      coSimulated.push_back(argv[++i]);
+    else if (arg == "--context" && i + 1 < argc)
+      contextCycles = std::stoul(argv[++i]);
+    else
+      inputPath = arg;
+  }
+
+  if (inputPath.empty())
+    throw std::invalid_argument("No input file received");
+  if (inputPath.extension() != ".hdl")
+    throw std::invalid_argument("Input must be an .hdl file");
+
+  // Parts are looked up next to the chip first, then in the sibling
+  // project directories, as 05/Computer.hdl uses the chips of 01 to 03
+  if (directories.empty())
+  {
+    const std::filesystem::path directory{
+        inputPath.has_parent_path() ? inputPath.parent_path() : "."};
+    directories = {directory.string(), (directory / "..").string()};
+  }
+  ChipLibrary library{directories, builtins};
+  if (!gateLevel)
+    proveMemories(library, inputPath.stem().string());
+
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  std::shared_ptr<const Netlist> netlist{
+      std::make_shared<const Netlist>(library, inputPath.stem().string())};
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+  std::cerr << netlist->getChipName() << ": " << netlist->getNands().size()
+            << " Nands, " << netlist->getFlops().size() << " DFFs, "
+            << netlist->getMemories().size() << " memories, "
+            << netlist->getDepth() << " levels, built in " << elapsed.count()
+            << " s" << std::endl;
+
+  if (verifying)
+    return verify(netlist, samples, threads, seed);
+  const std::shared_ptr<const CompiledNetlist> compiled{
+      compiling ? compile(*netlist) : nullptr};
+  if (!coSimulated.empty())
+    return coSimulate(netlist, compiled, coSimulated, maxCycles,
+                      contextCycles, threads);
+
+  Simulator simulator{netlist, compiled};
+  if (!romPath.empty())
+  {
+    runComputer(simulator, romPath, maxCycles, dumpFirst, dumpLast);
+    return 0;
+  }
+
+  for (const std::pair<std::string, uint16_t> &setting : settings)
+    simulator.setInput(setting.first, setting.second);
+  simulator.eval();
+  for (uint64_t tick = 0; tick < ticks; tick++)
+    simulator.tick();
+  for (const Netlist::Port &port : netlist->getOutputs())
+  {
+    const uint16_t value{simulator.getOutput(port.name)};
+    std::cout << port.name << " = ";
+    if (port.nets.size() == 16)
+      std::cout << static_cast<int16_t>(value) << std::endl;
+    else
+      std::cout << value << std::endl;
+  }
+
+  return 0;
+}
+
+// Parses "pin=value", the value signed or unsigned
+static std::pair<std::string, uint16_t>
+parseSetting(const std::string &setting)
+{
+  const size_t equals{setting.find('=')};
+  if (equals == std::string::npos)
+    throw std::invalid_argument("Invalid setting " + setting);
+  const int value{std::stoi(setting.substr(equals + 1))};
+  if (value < INT16_MIN || value > UINT16_MAX)
+    throw std::invalid_argument("Invalid setting " + setting);
+  return {setting.substr(0, equals), value};
+}
+
+// Proves the memory chips of 03 the chip is made of equivalent to their
+// builtins, which the library then uses instead
+static void proveMemories(ChipLibrary &library, const std::string &chip)
+{
+  std::set<std::string> used;
+  findChips(library, chip, used);
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  MemoryProver prover{library};
+  for (const std::string &memory : MemoryProver::MEMORY_CHIPS)
+    if (used.count(memory))
+      prover.prove(memory);
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+  for (const std::pair<const std::string, std::string> &failure :
+       prover.getFailures())
+    std::cerr << failure.first << " is simulated gate by gate: "
+              << failure.second << std::endl;
+  if (prover.getProven().empty())
+    return;
+  std::cerr << "Proved";
+  for (const std::string &memory : prover.getProven())
+    std::cerr << " " << memory;
+  std::cerr << " equal to their builtins in " << elapsed.count() << " s"
+            << std::endl;
+}
+
+// Every chip used in chip's hierarchy. Chips that cannot be read are left
+// for the Netlist to report.
+static void findChips(ChipLibrary &library, const std::string &chip,
+                      std::set<std::string> &found)
+{
+  if (!found.insert(chip).second)
+    return;
+  try
+  {
+    for (const Part &part : library.get(chip).getParts())
+      findChips(library, part.chip, found);
+  }
+  catch (const std::runtime_error &)
+  {
+  }
+}
+
+// Parses "first-last" or a single address
+static void parseRange(const std::string &range, int &first, int &last)
+{
+  const size_t dash{range.find('-')};
+  first = std::stoi(range.substr(0, dash));
+  last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+  if (first < 0 || last > 0x6000 || first > last)
+    throw std::invalid_argument("Invalid RAM range " + range);
+}
+
+// Loads the ROM32K part of a chip such as 05/Computer.hdl, pulses reset and
+// runs it until the program halts or maxCycles clock cycles pass. It halts in
+// the `(END) @END 0;JMP` idiom, as in the CPU emulator.
+static void runComputer(Simulator &simulator, const std::string &romPath,
+                        uint64_t maxCycles, int dumpFirst, int dumpLast)
+{
+  const int romMemory{simulator.getNetlist().findMemory("ROM32K")};
+  if (romMemory < 0)
+    throw std::invalid_argument("--rom needs a chip with a ROM32K part");
+  const std::vector<uint16_t> rom{loadRom(romPath)};
+  for (size_t address = 0; address < rom.size(); address++)
+    simulator.poke(romMemory, address, rom[address]);
+
+  simulator.setInput("reset", 1);
+  simulator.tick();
+  simulator.setInput("reset", 0);
+  simulator.eval();
+
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  uint64_t cycles{0};
+  bool halted{false};
+  while (cycles < maxCycles && !halted)
+  {
+    const uint32_t pc{simulator.getAddress(romMemory)};
+    simulator.tick();
+    ++cycles;
+    const uint32_t next{simulator.getAddress(romMemory)};
+    halted = next + 1 == pc && simulator.peek(romMemory, next) == next &&
+             (simulator.peek(romMemory, pc) & 0xE03F) == 0xE007;
+  }
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+  for (int address = dumpFirst; address <= dumpLast; address++)
+    std::cout << "RAM[" << address << "] = "
+              << static_cast<int16_t>(peekComputer(simulator, address))
+              << std::endl;
+
+  std::cerr << (halted ? "Halted" : "Stopped") << " at PC "
+            << simulator.getAddress(romMemory) << " after " << cycles
+            << " cycles in " << elapsed.count() << " s";
+  if (elapsed.count() > 0)
+    std::cerr << " (" << cycles / elapsed.count() / 1e3 << " kHz)";
+  std::cerr << std::endl;
+}
+
+// A word of the Hack address space, from the builtin memories of
+// 05/Memory.hdl
+static uint16_t peekComputer(const Simulator &simulator, int address)
+{
+  const char *path{address < 0x4000   ? "Memory/RAM16K"
+                   : address < 0x6000 ? "Memory/Screen"
+                                      : "Memory/Keyboard"};
+  const int memory{simulator.getNetlist().findMemory(path)};
+  if (memory < 0)
+    throw std::invalid_argument(std::string{"--dump needs "} + path +
+                                " to be a builtin memory");
+  return simulator.peek(memory, address & (address < 0x4000 ? 0x3FFF : 0x1FFF));
+}
+
+// Checks the chip against its golden model. Returns 1 if it differs.
+static int verify(std::shared_ptr<const Netlist> netlist, uint64_t samples,
+                  unsigned threads, uint64_t seed)
+{
+  const GoldenModel *model{findGoldenModel(netlist->getChipName())};
+  if (!model)
+    throw std::invalid_argument("No golden model of chip " +
+                                netlist->getChipName());
+  Verifier verifier{netlist, *model};
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  const Verifier::Result result{verifier.run(samples, threads, seed)};
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+  if (!result.passed)
+  {
+    std::cout << "FAIL " << model->chip << ": ";
+    printPins(model->inputs, result.inputs);
+    std::cout << " gives ";
+    printPins(model->outputs, result.outputs);
+    std::cout << ", expected ";
+    printPins(model->outputs, result.expected);
+    std::cout << std::endl;
+    return 1;
+  }
+  std::cout << model->chip << ": " << result.vectors
+            << (result.exhaustive ? " vectors (all of them)"
+                                  : " random vectors")
+            << " passed in " << elapsed.count() << " s";
+  if (elapsed.count() > 0)
+    std::cout << " (" << result.vectors / elapsed.count() / 1e6
+              << " million vectors/s)";
+  std::cout << std::endl;
+  return 0;
+}
+
+static void printPins(const std::vector<std::string> &names,
+                      const std::vector<uint16_t> &values)
+{
+  for (size_t pin = 0; pin < names.size(); pin++)
+    std::cout << (pin ? ", " : "") << names[pin] << " = " << values[pin];
+}
+
+// Compiles the netlist to native code, printing what was left out
+static std::shared_ptr<const CompiledNetlist>
+compile(const Netlist &netlist)
+{
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  std::shared_ptr<const CompiledNetlist> compiled{
+      std::make_shared<const CompiledNetlist>(netlist)};
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+  const CodeGenerator &generator{compiled->getGenerator()};
+  std::cerr << "Compiled " << generator.getNandCount() << " Nands, "
+            << generator.getConstantCount() << " constant, "
+            << generator.getFoldedCount() << " folded and "
+            << generator.getDeadCount() << " dead left out, "
+            << (compiled->isCached() ? "loaded" : "built") << " in "
+            << elapsed.count() << " s" << std::endl;
+  return compiled;
+}
+
+// Runs the .hack files given and those under the directories given on the
+// chip and on the CPU emulator. Returns 1 if any differ.
+static int coSimulate(std::shared_ptr<const Netlist> computer,
+                      std::shared_ptr<const CompiledNetlist> compiled,
+                      const std::vector<std::string> &paths,
+                      uint64_t maxCycles, size_t contextCycles,
+                      unsigned threads)
+{
+  std::vector<std::string> romPaths;
+  for (const std::string &path : paths)
+  {
+    if (!std::filesystem::is_directory(path))
+    {
+      romPaths.push_back(path);
+      continue;
+    }
+    std::vector<std::string> found;
+    for (const std::filesystem::directory_entry &entry :
+         std::filesystem::recursive_directory_iterator{path})
+      if (entry.is_regular_file() && entry.path().extension() == ".hack")
+        found.push_back(entry.path().string());
+    std::sort(found.begin(), found.end());
+    romPaths.insert(romPaths.end(), found.begin(), found.end());
+  }
+
+  const CoSimulator coSimulator{computer, compiled};
+  const std::vector<CoSimulator::Result> results{
+      coSimulator.runCorpus(romPaths, maxCycles, contextCycles, threads)};
+  size_t failed{0};
+  for (const CoSimulator::Result &result : results)
+  {
+    if (result.passed)
+    {
+      std::cout << "PASS " << result.romPath << ": "
+                << (result.halted ? "halted" : "stopped") << " after "
+                << result.cycles << " cycles in " << result.seconds << " s"
+                << std::endl;
+      continue;
+    }
+    ++failed;
+    std::cout << "FAIL " << result.romPath << ": " << result.failure
+              << std::endl;
+    for (const CoSimulator::Cycle &cycle : result.context)
+      printCycle(cycle);
+  }
+  std::cout << results.size() - failed << " of " << results.size()
+            << " ROMs match the emulator" << std::endl;
+  return failed ? 1 : 0;
+}
+
+// A cycle's instruction, then PC, A, D and what was written in the hardware
+// and in the emulator
+static void printCycle(const CoSimulator::Cycle &cycle)
+{
+  const auto print = [](const char *name, const CoSimulator::State &state)
+  {
+    std::cout << "  " << name << " PC " << state.pc << " A " << state.a
+              << " D " << state.d;
+    if (state.writeM)
+      std::cout << " M[" << state.addressM << "] = " << state.outM;
+    std::cout << std::endl;
+  };
+  std::cout << "  cycle " << cycle.cycle << " PC " << cycle.pc << " "
+            << std::bitset<16>{cycle.instruction} << std::endl;
+  print("hardware", cycle.hardware);
+  print("emulator", cycle.emulator);
+}
@@ -0,0 +1,342 @@
+#include "memoryprover.hpp"
+#include <algorithm>
+#include <array>
+#include <set>
+#include <stdexcept>
+
+const int LANES{SlicedSimulator::LANES};
+const int WORDS{SlicedSimulator::WORDS};
+// Truth tables cover up to 8 nets, one combination per lane
+const size_t MAX_SUPPORT{8};
+// Larger netlists are not worth proving: their memory parts are not builtin
+const size_t MAX_NANDS{1 << 20};
+
+static std::array<SlicedSimulator::Slice, MAX_SUPPORT> lanePatterns();
+static SlicedSimulator::Slice broadcast(bool value);
+
+// Lane i of pattern k holds bit k of i
+static const std::array<SlicedSimulator::Slice, MAX_SUPPORT> PATTERNS{
+    lanePatterns()};
+
+const std::vector<std::string> MemoryProver::MEMORY_CHIPS{
+    "Bit", "Register", "RAM8", "RAM64", "RAM512", "RAM4K", "RAM16K"};
+
+MemoryProver::MemoryProver(ChipLibrary &library)
+    : library{library}, proven{}, failures{}, netlist{nullptr}, values{},
+      drivers{}, isAddress{}, cones{}
+{
+}
+
+// Proves the chip's memory parts, then the chip, and makes the library use
+// the builtin of every chip proven. Proofs that fail are kept with the
+// reason, and the chip stays as it is.
+bool MemoryProver::prove(const std::string &chip)
+{
+  if (std::find(proven.begin(), proven.end(), chip) != proven.end())
+    return true;
+  if (failures.count(chip))
+    return false;
+
+  try
+  {
+    const Chip &hdl{library.get(chip)};
+    if (hdl.isBuiltin())
+      return true;
+    const Chip *builtin{ChipLibrary::findBuiltin(chip)};
+    if (!builtin)
+      throw std::invalid_argument("No builtin chip " + chip);
+
+    failures[chip] = "Chip " + chip + " contains itself";
+    for (const Part &part : hdl.getParts())
+      if (std::find(MEMORY_CHIPS.begin(), MEMORY_CHIPS.end(), part.chip) !=
+          MEMORY_CHIPS.end())
+        prove(part.chip);
+    failures.erase(chip);
+
+    const Netlist netlist{library, chip};
+    proveNetlist(netlist, *builtin);
+  }
+  catch (const std::exception &e)
+  {
+    failures[chip] = e.what();
+    return false;
+  }
+  library.addBuiltin(chip);
+  proven.push_back(chip);
+  return true;
+}
+
+const std::vector<std::string> &MemoryProver::getProven() const
+{
+  return proven;
+}
+
+const std::map<std::string, std::string> &MemoryProver::getFailures() const
+{
+  return failures;
+}
+
+// For every address, with its bits fixed: when load is 1, every bit of in
+// must be written to one bit of state, each address to different ones, and
+// every bit of out must be the bit of state its bit of in is written to.
+// Every part's load is load or 0 and its address only depends on the chip's
+// address, and a DFF either holds its value or is loaded from a bit of in
+// when load is 1. The chip then stores words exactly like the builtin,
+// only at other places.
+void MemoryProver::proveNetlist(const Netlist &netlist, const Chip &builtin)
+{
+  for (const std::vector<Pin> *pins : {&builtin.getInputs(),
+                                       &builtin.getOutputs()})
+    for (const Pin &pin : *pins)
+    {
+      const Netlist::Port *port{pins == &builtin.getInputs()
+                                    ? netlist.findInput(pin.name)
+                                    : netlist.findOutput(pin.name)};
+      if (!port || static_cast<int>(port->nets.size()) != pin.width)
+        throw std::runtime_error("Chip " + netlist.getChipName() +
+                                 " has other pins than its builtin");
+    }
+  if (netlist.getInputs().size() != builtin.getInputs().size() ||
+      netlist.getOutputs().size() != builtin.getOutputs().size())
+    throw std::runtime_error("Chip " + netlist.getChipName() +
+                             " has other pins than its builtin");
+  if (netlist.getNands().size() > MAX_NANDS)
+    throw std::runtime_error("Chip " + netlist.getChipName() +
+                             " is too large to prove");
+
+  this->netlist = &netlist;
+  values.assign(netlist.getNetCount(), broadcast(false));
+  values[Netlist::TRUE_NET] = broadcast(true);
+  drivers.assign(netlist.getNetCount(), -1);
+  for (size_t nand = 0; nand < netlist.getNands().size(); nand++)
+    drivers[netlist.getNands()[nand].out] = nand;
+  cones.clear();
+
+  const std::vector<uint32_t> &in{netlist.findInput("in")->nets};
+  const uint32_t load{netlist.findInput("load")->nets[0]};
+  const std::vector<uint32_t> &out{netlist.findOutput("out")->nets};
+  const Netlist::Port *addressPort{netlist.findInput("address")};
+  const std::vector<uint32_t> address{addressPort ? addressPort->nets
+                                                  : std::vector<uint32_t>{}};
+  isAddress.assign(netlist.getNetCount(), 0);
+  for (uint32_t net : address)
+    isAddress[net] = 1;
+  const std::vector<Netlist::Memory> &memories{netlist.getMemories()};
+  const std::vector<Netlist::Flop> &flops{netlist.getFlops()};
+
+  // The address and bit of in written to each bit of state
+  std::map<Cell, std::pair<uint32_t, int>> owners;
+  for (uint32_t word = 0; word < uint32_t{1} << address.size(); word++)
+  {
+    const auto error = [&](const std::string &message)
+    {
+      return std::runtime_error("Chip " + netlist.getChipName() +
+                                " at address " + std::to_string(word) +
+                                ": " + message);
+    };
+    for (size_t bit = 0; bit < address.size(); bit++)
+      values[address[bit]] = broadcast((word >> bit) & 1);
+
+    // The net reading the bit of state each bit of in is stored in
+    std::vector<uint32_t> readers(in.size(), Netlist::FALSE_NET);
+    const auto inputBit = [&](const Function &function)
+    {
+      for (size_t bit = 0; bit < in.size(); bit++)
+        if (isNet(function, in[bit]))
+          return static_cast<int>(bit);
+      return -1;
+    };
+    const auto store = [&](int bit, const Cell &cell, uint32_t reader)
+    {
+      if (readers[bit] != Netlist::FALSE_NET)
+        throw error("bit " + std::to_string(bit) + " is stored twice");
+      const auto owner{owners.emplace(cell, std::make_pair(word, bit))};
+      if (!owner.second)
+        throw error("bit " + std::to_string(bit) + " is stored in bit " +
+                    std::to_string(owner.first->second.second) +
+                    " of address " +
+                    std::to_string(owner.first->second.first));
+      readers[bit] = reader;
+    };
+
+    for (size_t memory = 0; memory < memories.size(); memory++)
+    {
+      const Netlist::Memory &part{memories[memory]};
+      bool constant;
+      if (isConstant(evaluate(part.load), constant) && !constant)
+        continue;
+      if (!isNet(evaluate(part.load), load))
+        throw error("the load of " + part.path + " is neither load nor 0");
+      uint32_t partWord{0};
+      for (size_t bit = 0; bit < part.address.size(); bit++)
+      {
+        if (!isConstant(evaluate(part.address[bit]), constant))
+          throw error("the address of " + part.path +
+                      " depends on more than the address");
+        partWord |= uint32_t{constant} << bit;
+      }
+      for (size_t bit = 0; bit < part.in.size(); bit++)
+      {
+        const int inBit{inputBit(evaluate(part.in[bit]))};
+        if (inBit < 0)
+          throw error("bit " + std::to_string(bit) + " written to " +
+                      part.path + " is not a bit of in");
+        store(inBit,
+              {static_cast<uint32_t>(memory), partWord,
+               static_cast<int>(bit)},
+              part.out[bit]);
+      }
+    }
+
+    for (size_t flop = 0; flop < flops.size(); flop++)
+    {
+      const Function function{evaluate(flops[flop].in)};
+      if (isNet(function, flops[flop].out))
+        continue;
+      const auto bit{std::find_if(in.begin(), in.end(), [&](uint32_t net)
+                                  {
+                                    return isLoaded(function, load, net,
+                                                    flops[flop].out);
+                                  })};
+      if (bit == in.end())
+        throw error("DFF " + std::to_string(flop) +
+                    " neither holds its value nor loads a bit of in");
+      store(bit - in.begin(),
+            {static_cast<uint32_t>(memories.size() + flop), 0, 0},
+            flops[flop].out);
+    }
+
+    for (size_t bit = 0; bit < in.size(); bit++)
+    {
+      if (readers[bit] == Netlist::FALSE_NET)
+        throw error("bit " + std::to_string(bit) + " is not stored");
+      if (!isNet(evaluate(out[bit]), readers[bit]))
+        throw error("bit " + std::to_string(bit) +
+                    " of out is not the bit stored");
+    }
+  }
+}
+
+// The Nands between a net and the inputs and state outputs, worked out once
+// per net
+const MemoryProver::Cone &MemoryProver::findCone(uint32_t net)
+{
+  const auto found{cones.find(net)};
+  if (found != cones.end())
+    return found->second;
+
+  Cone cone;
+  std::set<uint32_t> visited{net};
+  std::vector<uint32_t> pending{net};
+  while (!pending.empty())
+  {
+    const uint32_t next{pending.back()};
+    pending.pop_back();
+    if (drivers[next] < 0)
+    {
+      if (next != Netlist::FALSE_NET && next != Netlist::TRUE_NET &&
+          !isAddress[next])
+        cone.support.push_back(next);
+      continue;
+    }
+    cone.nands.push_back(drivers[next]);
+    const Netlist::Nand &nand{netlist->getNands()[drivers[next]]};
+    for (uint32_t input : {nand.a, nand.b})
+      if (visited.insert(input).second)
+        pending.push_back(input);
+  }
+  std::sort(cone.nands.begin(), cone.nands.end());
+  std::sort(cone.support.begin(), cone.support.end());
+  if (cone.support.size() > MAX_SUPPORT)
+    throw std::runtime_error("Chip " + netlist->getChipName() +
+                             " has signals that depend on more than " +
+                             std::to_string(MAX_SUPPORT) + " bits");
+  return cones.emplace(net, std::move(cone)).first->second;
+}
+
+// Runs the net's Nands with its support set to the lane patterns
+MemoryProver::Function MemoryProver::evaluate(uint32_t net)
+{
+  const Cone &cone{findCone(net)};
+  for (size_t input = 0; input < cone.support.size(); input++)
+    values[cone.support[input]] = PATTERNS[input];
+  SlicedSimulator::Slice *value{values.data()};
+  for (uint32_t index : cone.nands)
+  {
+    const Netlist::Nand &nand{netlist->getNands()[index]};
+    for (int word = 0; word < WORDS; word++)
+      value[nand.out].words[word] =
+          ~(value[nand.a].words[word] & value[nand.b].words[word]);
+  }
+  return {&cone.support, values[net]};
+}
+
+bool MemoryProver::isConstant(const Function &function, bool &value) const
+{
+  value = function.table.words[0] & 1;
+  return matches(function, broadcast(value));
+}
+
+// Whether the function is the value of net, one of its support
+bool MemoryProver::isNet(const Function &function, uint32_t net) const
+{
+  const auto input{std::find(function.support->begin(),
+                             function.support->end(), net)};
+  return input != function.support->end() &&
+         matches(function, PATTERNS[input - function.support->begin()]);
+}
+
+// Whether the function is in when load is 1, and out otherwise
+bool MemoryProver::isLoaded(const Function &function, uint32_t load,
+                            uint32_t in, uint32_t out) const
+{
+  const std::vector<uint32_t> &support{*function.support};
+  const auto position = [&](uint32_t net)
+  { return std::find(support.begin(), support.end(), net) - support.begin(); };
+  if (std::find(support.begin(), support.end(), load) == support.end() ||
+      std::find(support.begin(), support.end(), in) == support.end() ||
+      std::find(support.begin(), support.end(), out) == support.end())
+    return false;
+  SlicedSimulator::Slice table;
+  for (int word = 0; word < WORDS; word++)
+  {
+    const uint64_t selected{PATTERNS[position(load)].words[word]};
+    table.words[word] = (selected & PATTERNS[position(in)].words[word]) |
+                        (~selected & PATTERNS[position(out)].words[word]);
+  }
+  return matches(function, table);
+}
+
+// Compares the lanes that hold a combination of the support
+bool MemoryProver::matches(const Function &function,
+                           const SlicedSimulator::Slice &table) const
+{
+  const int lanes{1 << function.support->size()};
+  for (int word = 0; word < WORDS && word * 64 < lanes; word++)
+  {
+    const uint64_t mask{lanes - word * 64 >= 64
+                            ? ~uint64_t{0}
+                            : (uint64_t{1} << (lanes - word * 64)) - 1};
+    if ((function.table.words[word] ^ table.words[word]) & mask)
+      return false;
+  }
+  return true;
+}
+
+static std::array<SlicedSimulator::Slice, MAX_SUPPORT> lanePatterns()
+{
+  std::array<SlicedSimulator::Slice, MAX_SUPPORT> patterns{};
+  for (size_t bit = 0; bit < MAX_SUPPORT; bit++)
+    for (int lane = 0; lane < LANES; lane++)
+      if ((lane >> bit) & 1)
+        patterns[bit].words[lane / 64] |= uint64_t{1} << (lane % 64);
+  return patterns;
+}
+
+static SlicedSimulator::Slice broadcast(bool value)
+{
+  SlicedSimulator::Slice slice;
+  for (uint64_t &word : slice.words)
+    word = value ? ~uint64_t{0} : 0;
+  return slice;
+}
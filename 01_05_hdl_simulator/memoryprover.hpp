@@ -0,0 +1,72 @@
+#ifndef MEMORY_PROVER_HPP
+#define MEMORY_PROVER_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "chiplibrary.hpp"
+#include "netlist.hpp"
+#include "slicedsimulator.hpp"
+
+// Proves that the .hdl files of 03's memory chips behave exactly like their
+// builtin word arrays, and makes the library use the builtins from then on.
+// A chip is proven after its memory parts, with those parts builtin, so each
+// proof only looks at one level of the hierarchy: Bit is a DFF and a Mux,
+// Register 16 Bits, RAM8 8 Registers and so on up to RAM16K.
+class MemoryProver
+{
+public:
+  static const std::vector<std::string> MEMORY_CHIPS;
+
+  MemoryProver(ChipLibrary &library);
+  bool prove(const std::string &chip);
+  const std::vector<std::string> &getProven() const;
+  const std::map<std::string, std::string> &getFailures() const;
+
+private:
+  // A bit of state: the memory, or the DFF after the memories, the word
+  // and the bit
+  typedef std::tuple<uint32_t, uint32_t, int> Cell;
+
+  // The Nands a net's value is computed by, in evaluation order, and the
+  // inputs and state outputs it depends on besides the address
+  struct Cone
+  {
+    std::vector<uint32_t> support;
+    std::vector<uint32_t> nands;
+  };
+
+  // A net's truth table for the current address, lane i holding its value
+  // with the support's nets set to the bits of i
+  struct Function
+  {
+    const std::vector<uint32_t> *support;
+    SlicedSimulator::Slice table;
+  };
+
+  void proveNetlist(const Netlist &netlist, const Chip &builtin);
+  const Cone &findCone(uint32_t net);
+  Function evaluate(uint32_t net);
+  bool isConstant(const Function &function, bool &value) const;
+  bool isNet(const Function &function, uint32_t net) const;
+  bool isLoaded(const Function &function, uint32_t load, uint32_t in,
+                uint32_t out) const;
+  bool matches(const Function &function,
+               const SlicedSimulator::Slice &table) const;
+
+  ChipLibrary &library;
+  std::vector<std::string> proven;
+  std::map<std::string, std::string> failures;
+
+  // State of the proof of one Netlist
+  const Netlist *netlist;
+  std::vector<SlicedSimulator::Slice> values;
+  // The Nand driving each net, or -1
+  std::vector<int> drivers;
+  std::vector<char> isAddress;
+  std::map<uint32_t, Cone> cones;
+};
+
+#endif
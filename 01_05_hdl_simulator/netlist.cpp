@@ -0,0 +1,506 @@
+#include "netlist.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+const uint32_t NO_NET{UINT32_MAX};
+const int FALSE_SIGNAL{-1};
+const int TRUE_SIGNAL{-2};
+
+Netlist::Netlist(ChipLibrary &library, const std::string &chipName)
+    : chipName{chipName}, netCount{0}, parents{FALSE_NET, TRUE_NET},
+      inputs{}, outputs{}, signals{}, nands{}, flops{}, memories{}, steps{},
+      depth{0}, layouts{}
+{
+  const Chip &chip{library.get(chipName)};
+  Signals pins;
+  for (const Pin &pin : chip.getInputs())
+  {
+    inputs.push_back({pin.name, {}});
+    for (int bit = 0; bit < pin.width; bit++)
+      inputs.back().nets.push_back(newNet());
+    pins.push_back(inputs.back().nets);
+  }
+  for (const Pin &pin : chip.getOutputs())
+  {
+    outputs.push_back({pin.name, {}});
+    for (int bit = 0; bit < pin.width; bit++)
+      outputs.back().nets.push_back(newNet());
+    pins.push_back(outputs.back().nets);
+  }
+
+  std::vector<const Chip *> stack;
+  instantiate(library, chip, pins, "", stack);
+  if (!chip.isBuiltin())
+  {
+    const Layout &layout{layouts.at(&chip)};
+    for (size_t signal = 0; signal < layout.internalNames.size(); signal++)
+      signals.push_back({layout.internalNames[signal],
+                         pins[inputs.size() + outputs.size() + signal]});
+  }
+  layouts.clear();
+  mergeNets();
+  levelize();
+  renumber();
+}
+
+const std::string &Netlist::getChipName() const { return chipName; }
+
+uint32_t Netlist::getNetCount() const { return netCount; }
+
+const std::vector<Netlist::Port> &Netlist::getInputs() const { return inputs; }
+
+const std::vector<Netlist::Port> &Netlist::getOutputs() const
+{
+  return outputs;
+}
+
+const Netlist::Port *Netlist::findInput(const std::string &name) const
+{
+  for (const Port &port : inputs)
+    if (port.name == name)
+      return &port;
+  return nullptr;
+}
+
+const Netlist::Port *Netlist::findOutput(const std::string &name) const
+{
+  for (const Port &port : outputs)
+    if (port.name == name)
+      return &port;
+  return nullptr;
+}
+
+const std::vector<Netlist::Port> &Netlist::getSignals() const
+{
+  return signals;
+}
+
+// A pin or internal signal of the top chip, such as 05/Computer.hdl's
+// addressM
+const Netlist::Port *Netlist::findSignal(const std::string &name) const
+{
+  for (const std::vector<Port> *ports : {&inputs, &outputs, &signals})
+    for (const Port &port : *ports)
+      if (port.name == name)
+        return &port;
+  return nullptr;
+}
+
+const std::vector<Netlist::Nand> &Netlist::getNands() const { return nands; }
+
+const std::vector<Netlist::Flop> &Netlist::getFlops() const { return flops; }
+
+const std::vector<Netlist::Memory> &Netlist::getMemories() const
+{
+  return memories;
+}
+
+const std::vector<Netlist::Step> &Netlist::getSteps() const { return steps; }
+
+int Netlist::getDepth() const { return depth; }
+
+// The memory at an instance path such as "Memory/RAM16K", or -1
+int Netlist::findMemory(const std::string &path) const
+{
+  for (size_t memory = 0; memory < memories.size(); memory++)
+    if (memories[memory].path == path)
+      return memory;
+  return -1;
+}
+
+// Resolves every connection of the chip's parts to signal numbers, checking
+// pin names, widths and ranges. Internal signals are as wide as the pins that
+// drive them, and every bit has exactly one driver.
+const Netlist::Layout &Netlist::layOut(ChipLibrary &library, const Chip &chip)
+{
+  const auto found{layouts.find(&chip)};
+  if (found != layouts.end())
+    return found->second;
+
+  const auto error = [&](const Part &part, const std::string &message)
+  {
+    return std::runtime_error(chip.getSource() + ":" +
+                              std::to_string(part.line) + ": " + message);
+  };
+  Layout layout;
+  std::map<std::string, int> numbers;
+  std::vector<int> widths;
+  for (const std::vector<Pin> *pins : {&chip.getInputs(), &chip.getOutputs()})
+    for (const Pin &pin : *pins)
+    {
+      numbers[pin.name] = widths.size();
+      widths.push_back(pin.width);
+    }
+
+  std::vector<const Chip *> subchips;
+  std::map<std::string, int> instances;
+  for (const Part &part : chip.getParts())
+  {
+    try
+    {
+      subchips.push_back(&library.get(part.chip));
+    }
+    catch (const std::runtime_error &e)
+    {
+      throw error(part, e.what());
+    }
+    ++instances[part.chip];
+
+    for (const Connection &connection : part.connections)
+    {
+      const Pin *pin{subchips.back()->findOutput(connection.pin)};
+      if (!pin)
+      {
+        if (!subchips.back()->findInput(connection.pin))
+          throw error(part, part.chip + " has no pin " + connection.pin);
+        continue;
+      }
+      if (connection.signal == "true" || connection.signal == "false")
+        throw error(part, "Output pin " + connection.pin +
+                              " cannot be connected to " + connection.signal);
+      if (chip.findInput(connection.signal))
+        throw error(part, "Input pin " + connection.signal +
+                              " cannot be driven by a part");
+      if (chip.findOutput(connection.signal))
+        continue;
+      if (connection.signalFirst >= 0)
+        throw error(part, "Internal signal " + connection.signal +
+                              " cannot be subscripted");
+      const int width{connection.pinFirst < 0
+                          ? pin->width
+                          : connection.pinLast - connection.pinFirst + 1};
+      const auto signal{numbers.emplace(connection.signal, widths.size())};
+      if (signal.second)
+      {
+        widths.push_back(width);
+        layout.internalNames.push_back(connection.signal);
+        layout.internalWidths.push_back(width);
+      }
+      else if (widths[signal.first->second] != width)
+        throw error(part, "Signal " + connection.signal + " is driven by " +
+                              std::to_string(widths[signal.first->second]) +
+                              " and " + std::to_string(width) + " bit pins");
+    }
+  }
+
+  std::vector<std::vector<char>> driven(widths.size());
+  for (size_t signal = 0; signal < widths.size(); signal++)
+    driven[signal].resize(widths[signal]);
+  std::map<std::string, int> seen;
+  for (size_t index = 0; index < subchips.size(); index++)
+  {
+    const Part &part{chip.getParts()[index]};
+    const Chip &subchip{*subchips[index]};
+    PartLayout partLayout{&subchip,
+                          instances[part.chip] > 1
+                              ? part.chip + "#" +
+                                    std::to_string(seen[part.chip]++)
+                              : part.chip,
+                          {}};
+
+    for (const Connection &connection : part.connections)
+    {
+      Wire wire{0, std::max(connection.pinFirst, 0), FALSE_SIGNAL, 0, 0,
+                subchip.findOutput(connection.pin) != nullptr};
+      const Pin *pin{wire.output ? subchip.findOutput(connection.pin)
+                                 : subchip.findInput(connection.pin)};
+      wire.pin = pin - (wire.output ? subchip.getOutputs().data()
+                                    : subchip.getInputs().data()) +
+                 (wire.output ? subchip.getInputs().size() : 0);
+      const int last{connection.pinFirst < 0 ? pin->width - 1
+                                             : connection.pinLast};
+      if (last >= pin->width)
+        throw error(part, "Pin " + connection.pin + " has no bit " +
+                              std::to_string(last));
+      wire.width = last - wire.pinFirst + 1;
+
+      int signalWidth{wire.width};
+      if (connection.signal == "true")
+        wire.signal = TRUE_SIGNAL;
+      else if (connection.signal != "false")
+      {
+        const auto signal{numbers.find(connection.signal)};
+        if (signal == numbers.end())
+          throw error(part, "Signal " + connection.signal +
+                                " is not driven by any part");
+        wire.signal = signal->second;
+        wire.signalFirst = std::max(connection.signalFirst, 0);
+        const int signalLast{connection.signalFirst < 0
+                                 ? widths[wire.signal] - 1
+                                 : connection.signalLast};
+        if (signalLast >= widths[wire.signal])
+          throw error(part, "Signal " + connection.signal + " has no bit " +
+                                std::to_string(signalLast));
+        signalWidth = signalLast - wire.signalFirst + 1;
+      }
+      if (signalWidth != wire.width)
+        throw error(part, "Signal " + connection.signal + " is " +
+                              std::to_string(signalWidth) +
+                              " bits wide, but pin " + connection.pin +
+                              " is " + std::to_string(wire.width));
+
+      if (wire.output)
+        for (int bit = wire.signalFirst; bit < wire.signalFirst + wire.width;
+             bit++)
+        {
+          if (driven[wire.signal][bit])
+            throw error(part, "Signal " + connection.signal +
+                                  " is driven more than once");
+          driven[wire.signal][bit] = 1;
+        }
+      partLayout.wires.push_back(wire);
+    }
+    layout.parts.push_back(std::move(partLayout));
+  }
+  return layouts.emplace(&chip, std::move(layout)).first->second;
+}
+
+// pins holds the nets of every pin of chip. Builtins become gates, flops or
+// memories; other chips are flattened part by part. A part's input pins take
+// the nets of the signals they are connected to, and its output pins get new
+// nets merged with the signals they drive, so an output connected to several
+// signals joins them into one net.
+void Netlist::instantiate(ChipLibrary &library, const Chip &chip,
+                          Signals &pins, const std::string &path,
+                          std::vector<const Chip *> &stack)
+{
+  if (chip.isBuiltin())
+  {
+    const auto pinNets = [&](const std::string &name)
+    {
+      for (size_t pin = 0; pin < chip.getInputs().size(); pin++)
+        if (chip.getInputs()[pin].name == name)
+          return pins[pin];
+      return std::vector<uint32_t>{};
+    };
+    // Builtins' outputs follow their inputs: out is the last pin
+    if (chip.getName() == "Nand")
+      nands.push_back({pins[0][0], pins[1][0], pins[2][0]});
+    else if (chip.getName() == "DFF")
+      flops.push_back({pins[0][0], pins[1][0]});
+    else
+      memories.push_back({path.empty() ? chip.getName() : path, chip.getName(),
+                          pinNets("address"), pinNets("in"),
+                          pinNets("load").empty() ? FALSE_NET
+                                                  : pinNets("load")[0],
+                          pins.back()});
+    return;
+  }
+
+  if (std::find(stack.begin(), stack.end(), &chip) != stack.end())
+    throw std::runtime_error("Chip " + chip.getName() + " contains itself");
+  const Layout &layout{layOut(library, chip)};
+  stack.push_back(&chip);
+  for (int width : layout.internalWidths)
+  {
+    pins.emplace_back();
+    for (int bit = 0; bit < width; bit++)
+      pins.back().push_back(newNet());
+  }
+
+  for (const PartLayout &part : layout.parts)
+  {
+    Signals subpins;
+    for (const Pin &pin : part.chip->getInputs())
+      subpins.emplace_back(pin.width, FALSE_NET);
+    for (const Pin &pin : part.chip->getOutputs())
+    {
+      subpins.emplace_back();
+      for (int bit = 0; bit < pin.width; bit++)
+        subpins.back().push_back(newNet());
+    }
+
+    for (const Wire &wire : part.wires)
+      for (int bit = 0; bit < wire.width; bit++)
+      {
+        uint32_t &pinNet{subpins[wire.pin][wire.pinFirst + bit]};
+        if (wire.signal < 0)
+          pinNet = wire.signal == TRUE_SIGNAL ? TRUE_NET : FALSE_NET;
+        else if (!wire.output)
+          pinNet = pins[wire.signal][wire.signalFirst + bit];
+        else
+          parents[findNet(pinNet)] =
+              findNet(pins[wire.signal][wire.signalFirst + bit]);
+      }
+
+    instantiate(library, *part.chip, subpins,
+                path.empty() ? part.instance : path + "/" + part.instance,
+                stack);
+  }
+  stack.pop_back();
+}
+
+uint32_t Netlist::newNet()
+{
+  parents.push_back(parents.size());
+  return parents.size() - 1;
+}
+
+uint32_t Netlist::findNet(uint32_t net)
+{
+  while (parents[net] != net)
+  {
+    parents[net] = parents[parents[net]];
+    net = parents[net];
+  }
+  return net;
+}
+
+// Points every reference at the net it was merged into
+void Netlist::mergeNets()
+{
+  const auto merge = [this](std::vector<uint32_t> &nets)
+  {
+    for (uint32_t &net : nets)
+      net = findNet(net);
+  };
+  for (Port &port : inputs)
+    merge(port.nets);
+  for (Port &port : outputs)
+    merge(port.nets);
+  for (Port &port : signals)
+    merge(port.nets);
+  for (Nand &nand : nands)
+  {
+    nand.a = findNet(nand.a);
+    nand.b = findNet(nand.b);
+    nand.out = findNet(nand.out);
+  }
+  for (Flop &flop : flops)
+  {
+    flop.in = findNet(flop.in);
+    flop.out = findNet(flop.out);
+  }
+  for (Memory &memory : memories)
+  {
+    merge(memory.address);
+    merge(memory.in);
+    memory.load = findNet(memory.load);
+    merge(memory.out);
+  }
+}
+
+// Sorts the Nands and memory reads topologically, a level at a time: the
+// first level only depends on inputs, constants and state, and every later
+// one on the levels before it
+void Netlist::levelize()
+{
+  // Nodes 0 to nands.size() - 1 are the Nands, then the memories
+  const uint32_t nodeCount = nands.size() + memories.size();
+  std::vector<uint32_t> drivers(parents.size(), NO_NET);
+  for (size_t nand = 0; nand < nands.size(); nand++)
+    drivers[nands[nand].out] = nand;
+  for (size_t memory = 0; memory < memories.size(); memory++)
+    if (!memories[memory].address.empty())
+      for (uint32_t net : memories[memory].out)
+        drivers[net] = nands.size() + memory;
+
+  // Every node's inputs driven by other nodes, as edges from the driver
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  for (size_t nand = 0; nand < nands.size(); nand++)
+    for (uint32_t net : {nands[nand].a, nands[nand].b})
+      if (drivers[net] != NO_NET)
+        edges.push_back({drivers[net], nand});
+  for (size_t memory = 0; memory < memories.size(); memory++)
+    for (uint32_t net : memories[memory].address)
+      if (drivers[net] != NO_NET)
+        edges.push_back({drivers[net], nands.size() + memory});
+  std::vector<uint32_t> pending(nodeCount, 0);
+  std::vector<uint32_t> firstEdges(nodeCount + 1, 0);
+  for (const std::pair<uint32_t, uint32_t> &edge : edges)
+  {
+    ++pending[edge.second];
+    ++firstEdges[edge.first + 1];
+  }
+  for (uint32_t node = 0; node < nodeCount; node++)
+    firstEdges[node + 1] += firstEdges[node];
+  // The nodes using each node's outputs, grouped by node
+  std::vector<uint32_t> users(edges.size());
+  std::vector<uint32_t> nextUser(firstEdges.begin(), firstEdges.end() - 1);
+  for (const std::pair<uint32_t, uint32_t> &edge : edges)
+    users[nextUser[edge.first]++] = edge.second;
+
+  std::vector<uint32_t> level;
+  for (uint32_t node = 0; node < nodeCount; node++)
+    if (pending[node] == 0)
+      level.push_back(node);
+  std::vector<Nand> ordered;
+  ordered.reserve(nands.size());
+  size_t done{0};
+  depth = 0;
+  while (!level.empty())
+  {
+    ++depth;
+    std::vector<uint32_t> nextLevel;
+    for (uint32_t node : level)
+      if (node < nands.size())
+        ordered.push_back(nands[node]);
+    for (uint32_t node : level)
+      if (node >= nands.size() &&
+          !memories[node - nands.size()].address.empty())
+        steps.push_back({static_cast<uint32_t>(ordered.size()),
+                         static_cast<int>(node - nands.size())});
+    for (uint32_t node : level)
+      for (uint32_t user = firstEdges[node]; user < firstEdges[node + 1];
+           user++)
+        if (--pending[users[user]] == 0)
+          nextLevel.push_back(users[user]);
+    done += level.size();
+    level.swap(nextLevel);
+  }
+  if (done != nodeCount)
+    throw std::runtime_error("Combinational loop in chip " + chipName);
+  steps.push_back({static_cast<uint32_t>(ordered.size()), -1});
+  nands.swap(ordered);
+}
+
+// Numbers the nets densely: the constants, then inputs and state outputs,
+// then the Nand outputs in evaluation order, so evaluation walks the values
+// mostly in order
+void Netlist::renumber()
+{
+  std::vector<uint32_t> numbers(parents.size(), NO_NET);
+  numbers[FALSE_NET] = FALSE_NET;
+  numbers[TRUE_NET] = TRUE_NET;
+  netCount = 2;
+  const auto number = [&](uint32_t &net)
+  {
+    if (numbers[net] == NO_NET)
+      numbers[net] = netCount++;
+    net = numbers[net];
+  };
+  const auto numberAll = [&](std::vector<uint32_t> &nets)
+  {
+    for (uint32_t &net : nets)
+      number(net);
+  };
+
+  for (Port &port : inputs)
+    numberAll(port.nets);
+  for (Flop &flop : flops)
+    number(flop.out);
+  for (Memory &memory : memories)
+    numberAll(memory.out);
+  for (Nand &nand : nands)
+    number(nand.out);
+  for (Nand &nand : nands)
+  {
+    number(nand.a);
+    number(nand.b);
+  }
+  for (Flop &flop : flops)
+    number(flop.in);
+  for (Memory &memory : memories)
+  {
+    numberAll(memory.address);
+    numberAll(memory.in);
+    number(memory.load);
+  }
+  for (Port &port : outputs)
+    numberAll(port.nets);
+  for (Port &port : signals)
+    numberAll(port.nets);
+  parents.clear();
+  parents.shrink_to_fit();
+}
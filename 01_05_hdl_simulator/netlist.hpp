@@ -0,0 +1,135 @@
+#ifndef NETLIST_HPP
+#define NETLIST_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "chip.hpp"
+#include "chiplibrary.hpp"
+
+// A chip flattened down to Nand gates, DFFs and builtin memories. Every bit
+// of every signal is a net; the nets a connection joins are merged into one.
+// The Nands are sorted into evaluation order, level by level from the
+// inputs, DFF outputs and memory outputs, so one pass settles every net.
+class Netlist
+{
+public:
+  static constexpr uint32_t FALSE_NET{0};
+  static constexpr uint32_t TRUE_NET{1};
+
+  struct Nand
+  {
+    uint32_t a;
+    uint32_t b;
+    uint32_t out;
+  };
+
+  struct Flop
+  {
+    uint32_t in;
+    uint32_t out;
+  };
+
+  // A builtin register or memory of 2^address.size() words out.size() bits
+  // wide. out is the word at address, and in is written to it at the clock
+  // edge when load is set. Read only memories have no in.
+  struct Memory
+  {
+    std::string path;
+    std::string chip;
+    std::vector<uint32_t> address;
+    std::vector<uint32_t> in;
+    uint32_t load;
+    std::vector<uint32_t> out;
+  };
+
+  // Evaluation runs the Nands up to nandEnd, then reads memory, if not -1
+  struct Step
+  {
+    uint32_t nandEnd;
+    int memory;
+  };
+
+  // A pin of the top chip, least significant bit first
+  struct Port
+  {
+    std::string name;
+    std::vector<uint32_t> nets;
+  };
+
+  Netlist(ChipLibrary &library, const std::string &chipName);
+  const std::string &getChipName() const;
+  uint32_t getNetCount() const;
+  const std::vector<Port> &getInputs() const;
+  const std::vector<Port> &getOutputs() const;
+  const Port *findInput(const std::string &name) const;
+  const Port *findOutput(const std::string &name) const;
+  const std::vector<Port> &getSignals() const;
+  const Port *findSignal(const std::string &name) const;
+  const std::vector<Nand> &getNands() const;
+  const std::vector<Flop> &getFlops() const;
+  const std::vector<Memory> &getMemories() const;
+  const std::vector<Step> &getSteps() const;
+  int getDepth() const;
+  int findMemory(const std::string &path) const;
+
+private:
+  // Nets of a chip's pins, inputs then outputs, followed by its internal
+  // signals while its parts are instantiated
+  typedef std::vector<std::vector<uint32_t>> Signals;
+
+  // A connection of a part's pin bits to bits of a signal of the chip, or to
+  // a constant when signal is FALSE_SIGNAL or TRUE_SIGNAL
+  struct Wire
+  {
+    int pin;
+    int pinFirst;
+    int signal;
+    int signalFirst;
+    int width;
+    bool output;
+  };
+
+  struct PartLayout
+  {
+    const Chip *chip;
+    std::string instance;
+    std::vector<Wire> wires;
+  };
+
+  // A chip's parts with every connection checked and resolved, worked out
+  // once per chip and reused for all its instances
+  struct Layout
+  {
+    std::vector<std::string> internalNames;
+    std::vector<int> internalWidths;
+    std::vector<PartLayout> parts;
+  };
+
+  const Layout &layOut(ChipLibrary &library, const Chip &chip);
+  void instantiate(ChipLibrary &library, const Chip &chip, Signals &pins,
+                   const std::string &path, std::vector<const Chip *> &stack);
+  uint32_t newNet();
+  uint32_t findNet(uint32_t net);
+  void mergeNets();
+  void levelize();
+  void renumber();
+
+  std::string chipName;
+  uint32_t netCount;
+  // Union-find forest of the nets while the chip is flattened
+  std::vector<uint32_t> parents;
+  std::vector<Port> inputs;
+  std::vector<Port> outputs;
+  // The top chip's internal signals
+  std::vector<Port> signals;
+  std::vector<Nand> nands;
+  std::vector<Flop> flops;
+  std::vector<Memory> memories;
+  std::vector<Step> steps;
+  int depth;
+  std::map<const Chip *, Layout> layouts;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "simulator.hpp"
+#include <stdexcept>
+#include <utility>
+
+Simulator::Simulator(std::shared_ptr<const Netlist> netlist,
+                     std::shared_ptr<const CompiledNetlist> compiled)
+    : netlist{std::move(netlist)}, compiled{std::move(compiled)}, values{},
+      latched{}, words{}, wordPointers{}, settled{false}, cycles{0}
+{
+  values.assign(this->netlist->getNetCount(), 0);
+  values[Netlist::TRUE_NET] = 1;
+  latched.assign(this->netlist->getFlops().size(), 0);
+  for (const Netlist::Memory &memory : this->netlist->getMemories())
+    words.emplace_back(size_t{1} << memory.address.size(), 0);
+  eval();
+}
+
+const Netlist &Simulator::getNetlist() const { return *netlist; }
+
+// Takes effect at the next eval or tick
+void Simulator::setInput(const std::string &name, uint16_t value)
+{
+  const Netlist::Port *port{netlist->findInput(name)};
+  if (!port)
+    throw std::invalid_argument("Chip " + netlist->getChipName() +
+                                " has no input " + name);
+  writeNets(port->nets, value);
+  settled = false;
+}
+
+uint16_t Simulator::getOutput(const std::string &name) const
+{
+  const Netlist::Port *port{netlist->findOutput(name)};
+  if (!port)
+    throw std::invalid_argument("Chip " + netlist->getChipName() +
+                                " has no output " + name);
+  return readNets(port->nets);
+}
+
+// Any pin or internal signal of the top chip
+uint16_t Simulator::getSignal(const std::string &name) const
+{
+  const Netlist::Port *port{netlist->findSignal(name)};
+  if (!port)
+    throw std::invalid_argument("Chip " + netlist->getChipName() +
+                                " has no signal " + name);
+  return readNets(port->nets);
+}
+
+// Runs the Nands in evaluation order, reading each memory once the level
+// that drives its address is done
+void Simulator::eval()
+{
+  if (compiled)
+  {
+    // The words are not kept from the constructor, as a copy of the
+    // Simulator has its own
+    wordPointers.resize(words.size());
+    for (size_t memory = 0; memory < words.size(); memory++)
+      wordPointers[memory] = words[memory].data();
+    compiled->eval(values.data(), wordPointers.data());
+    settled = true;
+    return;
+  }
+
+  const std::vector<Netlist::Nand> &nands{netlist->getNands()};
+  const std::vector<Netlist::Memory> &memories{netlist->getMemories()};
+  uint8_t *value{values.data()};
+  size_t nand{0};
+  for (const Netlist::Step &step : netlist->getSteps())
+  {
+    for (; nand < step.nandEnd; nand++)
+      value[nands[nand].out] = !(value[nands[nand].a] & value[nands[nand].b]);
+    if (step.memory >= 0)
+      writeNets(memories[step.memory].out,
+                words[step.memory][readNets(memories[step.memory].address)]);
+  }
+  settled = true;
+}
+
+// The clock edge: every DFF and memory takes its input from the settled nets
+// at once, then the logic settles on the new state
+void Simulator::tick()
+{
+  if (!settled)
+    eval();
+  const std::vector<Netlist::Flop> &flops{netlist->getFlops()};
+  const std::vector<Netlist::Memory> &memories{netlist->getMemories()};
+  for (size_t flop = 0; flop < flops.size(); flop++)
+    latched[flop] = values[flops[flop].in];
+  for (size_t memory = 0; memory < memories.size(); memory++)
+    if (!memories[memory].in.empty() && values[memories[memory].load])
+      words[memory][readNets(memories[memory].address)] =
+          readNets(memories[memory].in);
+
+  for (size_t flop = 0; flop < flops.size(); flop++)
+    values[flops[flop].out] = latched[flop];
+  for (size_t memory = 0; memory < memories.size(); memory++)
+    if (memories[memory].address.empty())
+      writeNets(memories[memory].out, words[memory][0]);
+  eval();
+  ++cycles;
+}
+
+uint64_t Simulator::getCycles() const { return cycles; }
+
+uint16_t Simulator::peek(int memory, uint32_t address) const
+{
+  return words.at(memory).at(address);
+}
+
+// Changes a memory word between clock cycles, such as the ROM's program or
+// the keyboard's key. Takes effect at the next eval or tick.
+void Simulator::poke(int memory, uint32_t address, uint16_t value)
+{
+  words.at(memory).at(address) = value;
+  if (netlist->getMemories()[memory].address.empty())
+    writeNets(netlist->getMemories()[memory].out, value);
+  settled = false;
+}
+
+// The address a memory is being read at, such as the PC at the ROM
+uint32_t Simulator::getAddress(int memory) const
+{
+  return readNets(netlist->getMemories().at(memory).address);
+}
+
+uint16_t Simulator::readNets(const std::vector<uint32_t> &nets) const
+{
+  uint16_t value{0};
+  for (size_t bit = 0; bit < nets.size(); bit++)
+    value |= values[nets[bit]] << bit;
+  return value;
+}
+
+void Simulator::writeNets(const std::vector<uint32_t> &nets, uint16_t value)
+{
+  for (size_t bit = 0; bit < nets.size(); bit++)
+    values[nets[bit]] = (value >> bit) & 1;
+}
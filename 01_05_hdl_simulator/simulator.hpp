@@ -0,0 +1,50 @@
+#ifndef SIMULATOR_HPP
+#define SIMULATOR_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "compilednetlist.hpp"
+#include "netlist.hpp"
+
+// Holds the value of every net of a Netlist and the contents of its DFFs and
+// memories. eval settles the combinational logic in one pass over the
+// levelized Nands, or in the native code of a CompiledNetlist of the same
+// Netlist; tick is a clock cycle.
+class Simulator
+{
+public:
+  Simulator(std::shared_ptr<const Netlist> netlist,
+            std::shared_ptr<const CompiledNetlist> compiled = nullptr);
+  const Netlist &getNetlist() const;
+  void setInput(const std::string &name, uint16_t value);
+  uint16_t getOutput(const std::string &name) const;
+  uint16_t getSignal(const std::string &name) const;
+  void eval();
+  void tick();
+  uint64_t getCycles() const;
+
+  uint16_t peek(int memory, uint32_t address) const;
+  void poke(int memory, uint32_t address, uint16_t value);
+  uint32_t getAddress(int memory) const;
+
+private:
+  uint16_t readNets(const std::vector<uint32_t> &nets) const;
+  void writeNets(const std::vector<uint32_t> &nets, uint16_t value);
+
+  std::shared_ptr<const Netlist> netlist;
+  std::shared_ptr<const CompiledNetlist> compiled;
+  // 0 or 1 per net
+  std::vector<uint8_t> values;
+  // DFF inputs sampled at the clock edge
+  std::vector<uint8_t> latched;
+  std::vector<std::vector<uint16_t>> words;
+  // The memories' words for the CompiledNetlist
+  std::vector<uint16_t *> wordPointers;
+  // False after inputs or memory words changed since the last eval
+  bool settled;
+  uint64_t cycles;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "slicedsimulator.hpp"
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+// eval is compiled for AVX2 and plain x86-64, and the loader picks the one
+// the host supports. With AVX2 a Slice is one register.
+#if defined(__x86_64__)
+#define SLICE_CLONES __attribute__((target_clones("arch=x86-64-v3", "default")))
+#else
+#define SLICE_CLONES
+#endif
+
+static std::array<uint64_t, 256> spreadBytes();
+
+SlicedSimulator::SlicedSimulator(std::shared_ptr<const Netlist> netlist)
+    : netlist{std::move(netlist)}, values{}
+{
+  if (!this->netlist->getFlops().empty() ||
+      !this->netlist->getMemories().empty())
+    throw std::invalid_argument("Chip " + this->netlist->getChipName() +
+                                " is not combinational");
+  values.assign(this->netlist->getNetCount(), Slice{});
+  for (uint64_t &word : values[Netlist::TRUE_NET].words)
+    word = ~uint64_t{0};
+}
+
+const Netlist &SlicedSimulator::getNetlist() const { return *netlist; }
+
+void SlicedSimulator::setNet(uint32_t net, const Slice &slice)
+{
+  values.at(net) = slice;
+}
+
+const SlicedSimulator::Slice &SlicedSimulator::getNet(uint32_t net) const
+{
+  return values.at(net);
+}
+
+uint16_t SlicedSimulator::readNets(const std::vector<uint32_t> &nets,
+                                   int lane) const
+{
+  uint16_t value{0};
+  for (size_t bit = 0; bit < nets.size(); bit++)
+    value |= ((values[nets[bit]].words[lane / 64] >> (lane % 64)) & 1) << bit;
+  return value;
+}
+
+// The value of nets in every lane, eight lanes at a time
+void SlicedSimulator::readLanes(const std::vector<uint32_t> &nets,
+                                uint16_t *lanes) const
+{
+  static const std::array<uint64_t, 256> SPREAD{spreadBytes()};
+  for (int group = 0; group < LANES / 8; group++)
+  {
+    // Byte i of low and high holds the low and high byte of lane i's value
+    uint64_t low{0};
+    uint64_t high{0};
+    for (size_t bit = 0; bit < nets.size(); bit++)
+    {
+      const uint64_t spread{
+          SPREAD[(values[nets[bit]].words[group / 8] >> (group % 8 * 8)) &
+                 0xFF]};
+      if (bit < 8)
+        low |= spread << bit;
+      else
+        high |= spread << (bit - 8);
+    }
+    for (int lane = 0; lane < 8; lane++)
+      lanes[group * 8 + lane] =
+          ((low >> (lane * 8)) & 0xFF) | ((high >> (lane * 8)) & 0xFF) << 8;
+  }
+}
+
+void SlicedSimulator::writeNets(const std::vector<uint32_t> &nets, int lane,
+                                uint16_t value)
+{
+  const uint64_t mask{uint64_t{1} << (lane % 64)};
+  for (size_t bit = 0; bit < nets.size(); bit++)
+  {
+    uint64_t &word{values[nets[bit]].words[lane / 64]};
+    word = (value >> bit) & 1 ? word | mask : word & ~mask;
+  }
+}
+
+void SlicedSimulator::setInput(const std::string &name, int lane,
+                               uint16_t value)
+{
+  const Netlist::Port *port{netlist->findInput(name)};
+  if (!port)
+    throw std::invalid_argument("Chip " + netlist->getChipName() +
+                                " has no input " + name);
+  writeNets(port->nets, lane, value);
+}
+
+uint16_t SlicedSimulator::getOutput(const std::string &name, int lane) const
+{
+  const Netlist::Port *port{netlist->findOutput(name)};
+  if (!port)
+    throw std::invalid_argument("Chip " + netlist->getChipName() +
+                                " has no output " + name);
+  return readNets(port->nets, lane);
+}
+
+// Runs the Nands in evaluation order on all lanes
+SLICE_CLONES void SlicedSimulator::eval()
+{
+  const std::vector<Netlist::Nand> &nands{netlist->getNands()};
+  Slice *value{values.data()};
+  for (const Netlist::Nand &nand : nands)
+  {
+    const Slice &a{value[nand.a]};
+    const Slice &b{value[nand.b]};
+    Slice &out{value[nand.out]};
+    for (int word = 0; word < WORDS; word++)
+      out.words[word] = ~(a.words[word] & b.words[word]);
+  }
+}
+
+// Bit i of a byte moved to bit 0 of byte i, for all 256 bytes
+static std::array<uint64_t, 256> spreadBytes()
+{
+  std::array<uint64_t, 256> spread{};
+  for (int byte = 0; byte < 256; byte++)
+    for (int bit = 0; bit < 8; bit++)
+      spread[byte] |= uint64_t((byte >> bit) & 1) << (bit * 8);
+  return spread;
+}
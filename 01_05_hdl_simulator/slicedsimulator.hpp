@@ -0,0 +1,41 @@
+#ifndef SLICED_SIMULATOR_HPP
+#define SLICED_SIMULATOR_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "netlist.hpp"
+
+// Evaluates a combinational Netlist for LANES independent input vectors at
+// once. Every net holds one bit per lane, so each Nand is a single bitwise
+// operation across all lanes.
+class SlicedSimulator
+{
+public:
+  static constexpr int LANES{256};
+  static constexpr int WORDS{LANES / 64};
+
+  // One net in every lane: lane i is bit i % 64 of words[i / 64]
+  struct alignas(32) Slice
+  {
+    uint64_t words[WORDS];
+  };
+
+  SlicedSimulator(std::shared_ptr<const Netlist> netlist);
+  const Netlist &getNetlist() const;
+  void setNet(uint32_t net, const Slice &slice);
+  const Slice &getNet(uint32_t net) const;
+  uint16_t readNets(const std::vector<uint32_t> &nets, int lane) const;
+  void readLanes(const std::vector<uint32_t> &nets, uint16_t *lanes) const;
+  void writeNets(const std::vector<uint32_t> &nets, int lane, uint16_t value);
+  void setInput(const std::string &name, int lane, uint16_t value);
+  uint16_t getOutput(const std::string &name, int lane) const;
+  void eval();
+
+private:
+  std::shared_ptr<const Netlist> netlist;
+  std::vector<Slice> values;
+};
+
+#endif
@@ -0,0 +1,653 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../05_cpu_emulator/rom.hpp"
+#include "chip.hpp"
+#include "chiplibrary.hpp"
+#include "codegenerator.hpp"
+#include "compilednetlist.hpp"
+#include "cosimulator.hpp"
+#include "goldenmodels.hpp"
+#include "memoryprover.hpp"
+#include "netlist.hpp"
+#include "simulator.hpp"
+#include "slicedsimulator.hpp"
+#include "verifier.hpp"
+
+/*
+These are the unit tests for the HDL parser, chip library, netlist,
+simulator, verifier, co-simulator, memory prover and code generator modules,
+run on the chips of projects 01 to 05.
+
+Each fuction performs unit tests on a specific module and returns 0 if they
+pass, and 1 otherwise.
+*/
+
+int fail(const std::string &reason);
+
+const std::vector<std::string> CHIP_DIRECTORIES{"../01", "../02", "../03",
+                                                "../05"};
+
+// The ALU of 02/ALU.hdl, one control bit at a time
+static uint16_t referenceAlu(int bits, uint16_t x, uint16_t y)
+{
+  if (bits & 0x20)
+    x = 0;
+  if (bits & 0x10)
+    x = ~x;
+  if (bits & 0x08)
+    y = 0;
+  if (bits & 0x04)
+    y = ~y;
+  uint16_t out = bits & 0x02 ? x + y : x & y;
+  if (bits & 0x01)
+    out = ~out;
+  return out;
+}
+
+static std::shared_ptr<const Netlist> build(const std::string &chip,
+                                            std::vector<std::string> builtins =
+                                                {})
+{
+  ChipLibrary library{CHIP_DIRECTORIES, builtins};
+  return std::make_shared<const Netlist>(library, chip);
+}
+
+// Whether building chip from the given .hdl sources fails with an error
+// mentioning message
+static bool buildFails(const std::vector<std::string> &sources,
+                       const std::string &chip, const std::string &message)
+{
+  const std::filesystem::path directory{"chips.test"};
+  std::filesystem::create_directory(directory);
+  for (const std::string &source : sources)
+  {
+    std::istringstream stream{source};
+    const std::string name{Chip::parse(stream, "test").getName()};
+    std::ofstream{directory / (name + ".hdl")} << source;
+  }
+  bool failed{false};
+  try
+  {
+    ChipLibrary library{{directory.string(), "../01"}};
+    Netlist netlist{library, chip};
+  }
+  catch (const std::runtime_error &e)
+  {
+    failed = std::string{e.what()}.find(message) != std::string::npos;
+    if (!failed)
+      printf("%s\n", e.what());
+  }
+  std::filesystem::remove_all(directory);
+  return failed;
+}
+
+int chipTest()
+{
+  std::istringstream source{"// A comment\n"
+                            "CHIP Test {\n"
+                            "    IN a[16], b; /* block\n"
+                            "                    comment */\n"
+                            "    OUT out[4];\n"
+                            "    PARTS:\n"
+                            "    And(a=a[3], b=true, out=x);\n"
+                            "    Foo(in[0..1]=a[2..3], out[2]=out[1]);\n"
+                            "}\n"};
+  const Chip chip{Chip::parse(source, "Test.hdl")};
+  if (chip.getName() != "Test" || chip.getInputs().size() != 2 ||
+      chip.getInputs()[0].width != 16 || chip.getOutputs()[0].width != 4 ||
+      chip.isBuiltin())
+    return fail("Chip pins were not parsed correctly");
+  if (chip.getParts().size() != 2 || chip.getParts()[0].line != 7 ||
+      chip.getParts()[1].connections.size() != 2)
+    return fail("Chip parts were not parsed correctly");
+  const Connection &connection{chip.getParts()[1].connections[0]};
+  if (connection.pin != "in" || connection.pinFirst != 0 ||
+      connection.pinLast != 1 || connection.signal != "a" ||
+      connection.signalFirst != 2 || connection.signalLast != 3 ||
+      chip.getParts()[0].connections[0].pinFirst != -1)
+    return fail("Connection ranges were not parsed correctly");
+
+  std::istringstream invalid{
+      "CHIP Bad {\n IN a;\n PARTS:\n Not(in=a out=b);\n}"};
+  try
+  {
+    Chip::parse(invalid, "Bad.hdl");
+    return fail("Invalid chip was parsed");
+  }
+  catch (const std::runtime_error &e)
+  {
+    if (std::string{e.what()}.find("Bad.hdl:4") != 0)
+      return fail("Parse error did not give the line");
+  }
+
+  std::istringstream builtin{"CHIP DFF { IN in; OUT out; BUILTIN DFF; "
+                             "CLOCKED in; }"};
+  if (!Chip::parse(builtin, "DFF.hdl").isBuiltin())
+    return fail("Builtin chip stub was not parsed");
+
+  return 0;
+}
+
+int netlistTest()
+{
+  std::shared_ptr<const Netlist> inverter{build("Not")};
+  if (inverter->getNands().size() != 1 || inverter->getDepth() != 1 ||
+      inverter->getNetCount() != 4)
+    return fail("Not did not flatten to one Nand");
+  std::shared_ptr<const Netlist> xorGate{build("Xor")};
+  if (xorGate->getNands().size() != 6 || !xorGate->findInput("b") ||
+      !xorGate->findOutput("out"))
+    return fail("Xor did not flatten to six Nands");
+  // Every Nand only reads nets settled before it
+  std::vector<char> settled(xorGate->getNetCount());
+  settled[Netlist::FALSE_NET] = settled[Netlist::TRUE_NET] = 1;
+  for (const Netlist::Port &port : xorGate->getInputs())
+    for (uint32_t net : port.nets)
+      settled[net] = 1;
+  for (const Netlist::Nand &nand : xorGate->getNands())
+  {
+    if (!settled[nand.a] || !settled[nand.b])
+      return fail("Nands are not in evaluation order");
+    settled[nand.out] = 1;
+  }
+
+  std::shared_ptr<const Netlist> computer{build("Computer", {"RAM16K"})};
+  if (computer->findMemory("ROM32K") < 0 ||
+      computer->findMemory("Memory/RAM16K") < 0 ||
+      computer->findMemory("Memory/Screen") < 0 ||
+      computer->findMemory("CPU/ARegister") < 0 ||
+      computer->getFlops().size() != 16)
+    return fail("Computer's builtin parts were not found");
+  if (!computer->findSignal("reset") || computer->findSignal("pc") ||
+      !computer->findSignal("addressM") ||
+      computer->findSignal("addressM")->nets.size() != 15 ||
+      computer->getSignals().size() != 6)
+    return fail("Computer's signals were not found");
+
+  if (!buildFails({"CHIP Loop { IN a; OUT out; PARTS: Nand(a=a, b=x, out=y); "
+                   "Not(in=y, out=x, out=out); }"},
+                  "Loop", "Combinational loop"))
+    return fail("Combinational loop was not detected");
+  if (!buildFails({"CHIP Twice { IN a; OUT out; PARTS: Not(in=a, out=x); "
+                   "Not(in=a, out=x); Not(in=x, out=out); }"},
+                  "Twice", "Twice.hdl:1: Signal x is driven more than once"))
+    return fail("Signal driven twice was not detected");
+  if (!buildFails({"CHIP Wide { IN a[2]; OUT out; PARTS: Not(in=a, out=out); "
+                   "}"},
+                  "Wide", "Signal a is 2 bits wide, but pin in is 1"))
+    return fail("Width mismatch was not detected");
+  if (!buildFails({"CHIP Open { IN a; OUT out; PARTS: And(a=a, b=x, out=out); "
+                   "}"},
+                  "Open", "Signal x is not driven by any part"))
+    return fail("Undriven signal was not detected");
+  if (!buildFails({"CHIP Self { IN a; OUT out; PARTS: Self(a=a, out=out); }"},
+                  "Self", "contains itself"))
+    return fail("Recursive chip was not detected");
+  if (!buildFails({"CHIP Missing { IN a; OUT out; PARTS: Foo(a=a, out=out); "
+                   "}"},
+                  "Missing", "Could not find chip Foo"))
+    return fail("Missing chip was not reported");
+
+  return 0;
+}
+
+// Every input combination of the small gates of 01, and random vectors of
+// the 16-bit chips of 01 and 02 against C++ versions
+int combinationalTest()
+{
+  Simulator mux{build("Mux")};
+  Simulator dmux{build("DMux")};
+  Simulator xorGate{build("Xor")};
+  for (int bits = 0; bits < 8; bits++)
+  {
+    const int a{bits & 1};
+    const int b{(bits >> 1) & 1};
+    const int sel{(bits >> 2) & 1};
+    mux.setInput("a", a);
+    mux.setInput("b", b);
+    mux.setInput("sel", sel);
+    mux.eval();
+    dmux.setInput("in", a);
+    dmux.setInput("sel", sel);
+    dmux.eval();
+    xorGate.setInput("a", a);
+    xorGate.setInput("b", b);
+    xorGate.eval();
+    if (mux.getOutput("out") != (sel ? b : a) ||
+        dmux.getOutput("a") != (sel ? 0 : a) ||
+        dmux.getOutput("b") != (sel ? a : 0) ||
+        xorGate.getOutput("out") != (a ^ b))
+      return fail("Gates of 01 give wrong outputs");
+  }
+
+  Simulator adder{build("Add16")};
+  Simulator alu{build("ALU")};
+  Simulator mux8{build("Mux8Way16")};
+  std::mt19937 random{46};
+  for (int i = 0; i < 2000; i++)
+  {
+    const uint16_t x = random();
+    const uint16_t y = random();
+    const int bits = random() % 64;
+    adder.setInput("a", x);
+    adder.setInput("b", y);
+    adder.eval();
+    if (adder.getOutput("out") != static_cast<uint16_t>(x + y))
+      return fail("Add16 gives wrong sums");
+
+    const char *controls[]{"no", "f", "ny", "zy", "nx", "zx"};
+    for (int bit = 0; bit < 6; bit++)
+      alu.setInput(controls[bit], (bits >> bit) & 1);
+    alu.setInput("x", x);
+    alu.setInput("y", y);
+    alu.eval();
+    const uint16_t out{referenceAlu(bits, x, y)};
+    if (alu.getOutput("out") != out || alu.getOutput("zr") != (out == 0) ||
+        alu.getOutput("ng") != (out >> 15))
+      return fail("ALU gives wrong outputs");
+
+    const char *inputs[]{"a", "b", "c", "d", "e", "f", "g", "h"};
+    for (int input = 0; input < 8; input++)
+      mux8.setInput(inputs[input], x + input);
+    mux8.setInput("sel", bits % 8);
+    mux8.eval();
+    if (mux8.getOutput("out") != static_cast<uint16_t>(x + bits % 8))
+      return fail("Mux8Way16 selects the wrong input");
+  }
+
+  return 0;
+}
+
+// Bit sliced lanes against the plain simulator, and the chips of 01 and 02
+// against their golden models, including chips with a bug
+int verifierTest()
+{
+  SlicedSimulator sliced{build("Add16")};
+  Simulator adder{build("Add16")};
+  std::mt19937 random{47};
+  std::vector<uint16_t> sums(SlicedSimulator::LANES);
+  for (int lane = 0; lane < SlicedSimulator::LANES; lane++)
+  {
+    sliced.setInput("a", lane, random());
+    sliced.setInput("b", lane, random());
+  }
+  sliced.eval();
+  const Netlist &netlist{sliced.getNetlist()};
+  sliced.readLanes(netlist.findOutput("out")->nets, sums.data());
+  for (int lane = 0; lane < SlicedSimulator::LANES; lane++)
+  {
+    adder.setInput("a", sliced.readNets(netlist.findInput("a")->nets, lane));
+    adder.setInput("b", sliced.readNets(netlist.findInput("b")->nets, lane));
+    adder.eval();
+    if (sums[lane] != adder.getOutput("out") ||
+        sliced.getOutput("out", lane) != adder.getOutput("out"))
+      return fail("Sliced Add16 differs from the simulator");
+  }
+
+  for (const char *chip : {"Not", "And", "Or", "Xor", "Mux", "DMux", "Not16",
+                           "And16", "Or16", "Mux16", "Or8Way", "Mux4Way16",
+                           "Mux8Way16", "DMux4Way", "DMux8Way", "HalfAdder",
+                           "FullAdder", "Add16", "Inc16", "ALU"})
+  {
+    Verifier verifier{build(chip), *findGoldenModel(chip)};
+    const Verifier::Result result{verifier.run(100000, 3, 1)};
+    if (!result.passed ||
+        result.exhaustive != (verifier.getInputBits() <= 16))
+      return fail(std::string{"Verifying "} + chip + " fails");
+  }
+
+  try
+  {
+    SlicedSimulator bit{build("Bit")};
+    return fail("Bit is bit sliced");
+  }
+  catch (const std::invalid_argument &)
+  {
+  }
+
+  // An And made of an Or first fails for a = 1, b = 0, and a Mux16 that
+  // ignores sel on the same random vector on any number of threads
+  const std::filesystem::path directory{"chips.test"};
+  std::filesystem::create_directory(directory);
+  std::ofstream{directory / "And.hdl"}
+      << "CHIP And { IN a, b; OUT out; PARTS: Or(a=a, b=b, out=out); }";
+  std::ofstream{directory / "Mux16.hdl"}
+      << "CHIP Mux16 { IN a[16], b[16], sel; OUT out[16]; "
+         "PARTS: Or16(a=a, b=b, out=out); }";
+  ChipLibrary library{{directory.string(), "../01"}};
+  std::shared_ptr<const Netlist> andGate{
+      std::make_shared<const Netlist>(library, "And")};
+  std::shared_ptr<const Netlist> mux{
+      std::make_shared<const Netlist>(library, "Mux16")};
+  std::filesystem::remove_all(directory);
+
+  const Verifier::Result badAnd{
+      Verifier{andGate, *findGoldenModel("And")}.run(4, 2, 0)};
+  if (badAnd.passed || badAnd.inputs != std::vector<uint16_t>{1, 0} ||
+      badAnd.outputs != std::vector<uint16_t>{1} ||
+      badAnd.expected != std::vector<uint16_t>{0})
+    return fail("Verifier misses the first bug of And");
+  Verifier badMux{mux, *findGoldenModel("Mux16")};
+  const Verifier::Result oneThread{badMux.run(1000000, 1, 5)};
+  const Verifier::Result threeThreads{badMux.run(1000000, 3, 5)};
+  if (oneThread.passed || oneThread.exhaustive ||
+      oneThread.inputs != threeThreads.inputs ||
+      oneThread.outputs != threeThreads.outputs)
+    return fail("Verifier results depend on the thread count");
+
+  return 0;
+}
+
+int sequentialTest()
+{
+  Simulator bit{build("Bit")};
+  bit.setInput("in", 1);
+  bit.setInput("load", 0);
+  bit.tick();
+  if (bit.getOutput("out") != 0)
+    return fail("Bit loaded without load");
+  bit.setInput("load", 1);
+  if (bit.getOutput("out") != 0)
+    return fail("Bit changed before the clock edge");
+  bit.tick();
+  bit.setInput("in", 0);
+  bit.setInput("load", 0);
+  bit.tick();
+  if (bit.getOutput("out") != 1 || bit.getCycles() != 3)
+    return fail("Bit did not keep its value");
+
+  // 03/a/PC.hdl: reset, load, inc and hold in that priority
+  Simulator pc{build("PC")};
+  pc.setInput("in", 1000);
+  pc.setInput("load", 1);
+  pc.tick();
+  pc.setInput("load", 0);
+  pc.setInput("inc", 1);
+  pc.tick();
+  pc.tick();
+  if (pc.getOutput("out") != 1002)
+    return fail("PC did not load and count");
+  pc.setInput("reset", 1);
+  pc.tick();
+  pc.setInput("reset", 0);
+  pc.setInput("inc", 0);
+  pc.tick();
+  if (pc.getOutput("out") != 0)
+    return fail("PC did not reset");
+
+  // 03/a/RAM64.hdl down to its DFFs
+  Simulator ram{build("RAM64")};
+  if (ram.getNetlist().getFlops().size() != 64 * 16)
+    return fail("RAM64 did not flatten to DFFs");
+  ram.setInput("load", 1);
+  for (int address = 0; address < 64; address++)
+  {
+    ram.setInput("address", address);
+    ram.setInput("in", address * 3 + 1);
+    ram.tick();
+  }
+  ram.setInput("load", 0);
+  for (int address = 0; address < 64; address++)
+  {
+    ram.setInput("address", address);
+    ram.eval();
+    if (ram.getOutput("out") != address * 3 + 1)
+      return fail("RAM64 did not keep its words");
+  }
+
+  return 0;
+}
+
+// 05/Computer.hdl multiplying R0 by R1, as in the CPU emulator's tests
+int computerTest()
+{
+  Simulator computer{build("Computer", {"RAM16K"})};
+  const int rom{computer.getNetlist().findMemory("ROM32K")};
+  const int ram{computer.getNetlist().findMemory("Memory/RAM16K")};
+  const std::vector<uint16_t> program{loadRom("../05_cpu_emulator/test.hack")};
+  for (size_t address = 0; address < program.size(); address++)
+    computer.poke(rom, address, program[address]);
+  computer.poke(ram, 0, 7);
+  computer.poke(ram, 1, 6);
+
+  computer.setInput("reset", 1);
+  computer.tick();
+  computer.setInput("reset", 0);
+  int cycles{0};
+  while (computer.getAddress(rom) != 18 && cycles < 1000)
+  {
+    computer.tick();
+    ++cycles;
+  }
+  if (computer.peek(ram, 2) != 42)
+    return fail("Computer did not multiply R0 by R1");
+  // The emulator's count without the halt loop's two instructions
+  if (cycles != 6 + 6 * 12 + 4)
+    return fail("Computer took the wrong number of cycles");
+
+  return 0;
+}
+
+// The chips of 05 against the CPU emulator, and a CPU with a broken JEQ
+int coSimulatorTest()
+{
+  const CoSimulator computer{build("Computer", {"RAM16K"})};
+  const std::vector<CoSimulator::Result> results{computer.runCorpus(
+      {"../05_cpu_emulator/test.hack", "missing.hack",
+       "../05_cpu_emulator/test.hack"},
+      1000, 4, 2)};
+  if (results.size() != 3 || !results[0].passed || !results[0].halted ||
+      results[0].cycles != 12 || !results[2].passed ||
+      results[1].passed || results[1].failure.find("missing.hack") ==
+                               std::string::npos)
+    return fail("Computer does not match the emulator");
+  if (computer.run("../05_cpu_emulator/test.hack", 5, 4).halted)
+    return fail("Co-simulation ignores the cycle limit");
+
+  const std::filesystem::path directory{"chips.test"};
+  std::filesystem::create_directory(directory);
+  std::ifstream cpuFile{"../05/CPU.hdl"};
+  std::string cpu{std::istreambuf_iterator<char>{cpuFile}, {}};
+  const std::string jeq{"And(a=zrOut, b=instruction[1], out=jeq)"};
+  if (cpu.find(jeq) == std::string::npos)
+    return fail("05/CPU.hdl has no JEQ part to break");
+  cpu.replace(cpu.find(jeq), jeq.size(),
+              "And(a=ngOut, b=instruction[1], out=jeq)");
+  std::ofstream{directory / "CPU.hdl"} << cpu;
+  std::vector<std::string> directories{directory.string()};
+  directories.insert(directories.end(), CHIP_DIRECTORIES.begin(),
+                     CHIP_DIRECTORIES.end());
+  ChipLibrary library{directories, {"RAM16K"}};
+  const CoSimulator broken{std::make_shared<const Netlist>(library,
+                                                           "Computer")};
+  std::filesystem::remove_all(directory);
+
+  // D is R1 = 0 at D;JEQ, which jumps to END
+  const CoSimulator::Result result{
+      broken.run("../05_cpu_emulator/test.hack", 1000, 4)};
+  if (result.passed || result.cycles != 10 || result.context.size() != 4 ||
+      result.context.back().pc != 9 ||
+      result.context.back().hardware.pc != 10 ||
+      result.context.back().emulator.pc != 18 ||
+      result.failure != "Cycle 9 at PC 9: PC is 10 in the hardware and 18 "
+                        "in the emulator")
+    return fail("Co-simulation misses a broken JEQ");
+
+  return 0;
+}
+
+int memoryProverTest()
+{
+  ChipLibrary library{CHIP_DIRECTORIES};
+  MemoryProver prover{library};
+  if (!prover.prove("RAM16K") || !prover.getFailures().empty() ||
+      prover.getProven() != MemoryProver::MEMORY_CHIPS)
+    return fail("03's memory chips are not proven");
+  for (const std::string &chip : MemoryProver::MEMORY_CHIPS)
+    if (!library.get(chip).isBuiltin())
+      return fail("Proven " + chip + " is not builtin");
+  const Netlist computer{library, "Computer"};
+  if (computer.findMemory("Memory/RAM16K") < 0 ||
+      computer.findMemory("CPU/PC/Register") < 0 ||
+      !computer.getFlops().empty())
+    return fail("Computer does not use the proven chips");
+
+  // Two Registers loaded at address 0, and the words of addresses 4 and 7
+  // read from each other's Register
+  std::ifstream ramFile{"../03/a/RAM8.hdl"};
+  const std::string ram{std::istreambuf_iterator<char>{ramFile}, {}};
+  const std::vector<std::pair<std::string, std::string>> breaks{
+      {"Register(in=in, load=loadb", "Register(in=in, load=loada"},
+      {"e=oute, f=outf, g=outg, h=outh", "e=outh, f=outf, g=outg, h=oute"}};
+  const std::vector<std::string> reasons{
+      "Chip RAM8 at address 0: bit 0 is stored twice",
+      "Chip RAM8 at address 4: bit 0 of out is not the bit stored"};
+  const std::filesystem::path directory{"chips.test"};
+  std::vector<std::string> directories{directory.string()};
+  directories.insert(directories.end(), CHIP_DIRECTORIES.begin(),
+                     CHIP_DIRECTORIES.end());
+  for (size_t i = 0; i < breaks.size(); i++)
+  {
+    std::string broken{ram};
+    if (broken.find(breaks[i].first) == std::string::npos)
+      return fail("03/a/RAM8.hdl has no part to break");
+    broken.replace(broken.find(breaks[i].first), breaks[i].first.size(),
+                   breaks[i].second);
+    std::filesystem::create_directory(directory);
+    std::ofstream{directory / "RAM8.hdl"} << broken;
+    ChipLibrary brokenLibrary{directories};
+    MemoryProver brokenProver{brokenLibrary};
+    const bool proved{brokenProver.prove("RAM64")};
+    std::filesystem::remove_all(directory);
+    if (proved || !brokenProver.getFailures().count("RAM8") ||
+        brokenProver.getFailures().at("RAM8") != reasons[i] ||
+        brokenLibrary.get("RAM8").isBuiltin() ||
+        brokenProver.getProven() !=
+            std::vector<std::string>{"Bit", "Register"})
+      return fail("A broken RAM8 is proven");
+  }
+
+  return 0;
+}
+
+int codeGeneratorTest()
+{
+  // DMux's b is dead, and Or with false is its input, which leaves the
+  // Nand of a and Not b
+  const std::filesystem::path directory{"chips.test"};
+  std::filesystem::create_directory(directory);
+  std::ofstream{directory / "Folded.hdl"}
+      << "CHIP Folded { IN a, b; OUT out; PARTS: "
+         "DMux(in=a, sel=b, a=x); Or(a=x, b=false, out=out); }";
+  std::vector<std::string> directories{directory.string()};
+  directories.insert(directories.end(), CHIP_DIRECTORIES.begin(),
+                     CHIP_DIRECTORIES.end());
+  ChipLibrary library{directories};
+  const std::shared_ptr<const Netlist> folded{
+      std::make_shared<const Netlist>(library, "Folded")};
+  std::filesystem::remove_all(directory);
+  const CodeGenerator generator{*folded};
+  if (generator.getNandCount() + generator.getConstantCount() +
+              generator.getFoldedCount() + generator.getDeadCount() !=
+          folded->getNands().size() ||
+      generator.getNandCount() != 1 || generator.getConstantCount() == 0 ||
+      generator.getFoldedCount() == 0 ||
+      generator.getDeadCount() == 0 ||
+      generator.getSource().find(CodeGenerator::FUNCTION_NAME) ==
+          std::string::npos)
+    return fail("Folded is not simplified");
+
+  // Shared objects are cached in a directory private to the user, and only
+  // reused with the source they were built from
+  const std::filesystem::path cache{"cache.test"};
+  setenv("XDG_CACHE_HOME", cache.c_str(), 1);
+  const std::shared_ptr<const Netlist> alu{build("ALU")};
+  const std::shared_ptr<const CompiledNetlist> compiledAlu{
+      std::make_shared<const CompiledNetlist>(*alu)};
+  if (compiledAlu->getGenerator().getNandCount() >= alu->getNands().size() ||
+      compiledAlu->isCached() || !CompiledNetlist{*alu}.isCached())
+    return fail("ALU is not compiled once");
+  const std::filesystem::path sourcePath{
+      std::filesystem::path{compiledAlu->getLibraryPath()}.replace_extension(
+          ".cpp")};
+  const std::filesystem::perms permissions{
+      std::filesystem::status(sourcePath.parent_path()).permissions()};
+  std::ofstream{sourcePath, std::ios::app} << "// Changed\n";
+  const bool rebuilt{!CompiledNetlist{*alu}.isCached()};
+  if (!rebuilt || (permissions & (std::filesystem::perms::group_all |
+                                  std::filesystem::perms::others_all)) !=
+                      std::filesystem::perms::none)
+    return fail("Compiled chips are not cached privately by their source");
+  Simulator interpreted{alu};
+  Simulator native{alu, compiledAlu};
+  const std::vector<std::string> pins{"x", "y", "zx", "nx", "zy", "ny", "f",
+                                      "no"};
+  std::mt19937 random{1};
+  for (int vector = 0; vector < 1000; vector++)
+  {
+    for (const std::string &pin : pins)
+    {
+      const uint16_t value = random();
+      interpreted.setInput(pin, value);
+      native.setInput(pin, value);
+    }
+    interpreted.eval();
+    native.eval();
+    for (const char *pin : {"out", "zr", "ng"})
+      if (native.getOutput(pin) != interpreted.getOutput(pin))
+        return fail("Compiled ALU differs");
+  }
+
+  // 05/Computer.hdl with the Memory's builtin RAM16K and 16 DFFs in the PC
+  const std::shared_ptr<const Netlist> computer{
+      build("Computer", {"RAM16K"})};
+  const CoSimulator coSimulator{
+      computer, std::make_shared<const CompiledNetlist>(*computer)};
+  const CoSimulator::Result result{
+      coSimulator.run("../05_cpu_emulator/test.hack", 1000, 4)};
+  std::filesystem::remove_all(cache);
+  if (!result.passed || !result.halted || result.cycles != 12)
+    return fail("Compiled Computer does not match the emulator");
+
+  return 0;
+}
+
+int main()
+{
+  if (chipTest())
+    return 1;
+  if (netlistTest())
+    return 1;
+  if (combinationalTest())
+    return 1;
+  if (verifierTest())
+    return 1;
+  if (sequentialTest())
+    return 1;
+  if (computerTest())
+    return 1;
+  if (coSimulatorTest())
+    return 1;
+  if (memoryProverTest())
+    return 1;
+  if (codeGeneratorTest())
+    return 1;
+
+  printf("Success");
+  return 0;
+}
+
+int fail(const std::string &reason)
+{
+  printf("%s\n", reason.c_str());
+  return 1;
+}
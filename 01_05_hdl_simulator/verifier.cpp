@@ -0,0 +1,177 @@
+#include "verifier.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+const int LANES{SlicedSimulator::LANES};
+// Vectors a thread takes at a time
+const uint64_t CHUNK_VECTORS{64 * LANES};
+// Bits 0 to 5 of the lane number, for the lanes of one word
+const uint64_t LANE_PATTERNS[6]{0xAAAAAAAAAAAAAAAA, 0xCCCCCCCCCCCCCCCC,
+                                0xF0F0F0F0F0F0F0F0, 0xFF00FF00FF00FF00,
+                                0xFFFF0000FFFF0000, 0xFFFFFFFF00000000};
+
+static uint64_t splitMix64(uint64_t &state);
+
+Verifier::Verifier(std::shared_ptr<const Netlist> netlist,
+                   const GoldenModel &model)
+    : netlist{std::move(netlist)}, model{model}, inputs{}, outputs{},
+      inputBits{0}, exhaustive{false}, vectors{0}, seed{0}, nextChunk{0},
+      mutex{}, firstFailure{0}, result{}
+{
+  const Netlist &chip{*this->netlist};
+  for (const std::string &name : model.inputs)
+  {
+    inputs.push_back(chip.findInput(name));
+    if (!inputs.back())
+      throw std::invalid_argument("Chip " + chip.getChipName() +
+                                  " has no input " + name);
+    inputBits += inputs.back()->nets.size();
+  }
+  for (const std::string &name : model.outputs)
+  {
+    outputs.push_back(chip.findOutput(name));
+    if (!outputs.back())
+      throw std::invalid_argument("Chip " + chip.getChipName() +
+                                  " has no output " + name);
+  }
+  if (inputs.size() != chip.getInputs().size() ||
+      outputs.size() != chip.getOutputs().size())
+    throw std::invalid_argument("The model of " + model.chip +
+                                " does not cover every pin of chip " +
+                                chip.getChipName());
+}
+
+int Verifier::getInputBits() const { return inputBits; }
+
+// Checks every input vector when there are at most samples of them, and
+// samples random vectors otherwise. The random vectors only depend on seed,
+// so a run reports the same result on any number of threads.
+Verifier::Result Verifier::run(uint64_t samples, unsigned threads,
+                               uint64_t seed)
+{
+  exhaustive = inputBits < 64 && (uint64_t{1} << inputBits) <= samples;
+  vectors = exhaustive ? uint64_t{1} << inputBits : samples;
+  this->seed = seed;
+  nextChunk = 0;
+  firstFailure = vectors;
+  result = {vectors, exhaustive, true, {}, {}, {}};
+
+  const uint64_t chunks{(vectors + CHUNK_VECTORS - 1) / CHUNK_VECTORS};
+  threads = std::max<uint64_t>(1, std::min<uint64_t>(threads, chunks));
+  std::vector<std::thread> pool;
+  for (unsigned thread = 1; thread < threads; thread++)
+    pool.emplace_back(&Verifier::worker, this);
+  worker();
+  for (std::thread &thread : pool)
+    thread.join();
+  return result;
+}
+
+void Verifier::worker()
+{
+  SlicedSimulator simulator{netlist};
+  while (true)
+  {
+    const uint64_t start{nextChunk++ * CHUNK_VECTORS};
+    // Chunks past a failure already found cannot hold the first one
+    if (start >= firstFailure)
+      return;
+    const uint64_t end{std::min(start + CHUNK_VECTORS, vectors)};
+    for (uint64_t first = start; first < end; first += LANES)
+    {
+      if (exhaustive)
+        fillExhaustive(simulator, first);
+      else
+        fillRandom(simulator, first / LANES);
+      simulator.eval();
+      check(simulator, first);
+    }
+  }
+}
+
+// Lane i gets input vector first + i, the bits of the model's inputs
+// concatenated, the first input's least significant bit lowest
+void Verifier::fillExhaustive(SlicedSimulator &simulator,
+                              uint64_t first) const
+{
+  int bit{0};
+  for (const Netlist::Port *port : inputs)
+    for (uint32_t net : port->nets)
+    {
+      SlicedSimulator::Slice slice;
+      for (int word = 0; word < SlicedSimulator::WORDS; word++)
+        slice.words[word] =
+            bit < 6 ? LANE_PATTERNS[bit]
+                    : -(((first | word * 64) >> bit) & 1);
+      simulator.setNet(net, slice);
+      bit++;
+    }
+}
+
+void Verifier::fillRandom(SlicedSimulator &simulator, uint64_t batch) const
+{
+  uint64_t state{seed + batch * 0x9E3779B97F4A7C15};
+  for (const Netlist::Port *port : inputs)
+    for (uint32_t net : port->nets)
+    {
+      SlicedSimulator::Slice slice;
+      for (uint64_t &word : slice.words)
+        word = splitMix64(state);
+      simulator.setNet(net, slice);
+    }
+}
+
+// Compares every lane holding one of the vectors with the model
+void Verifier::check(const SlicedSimulator &simulator, uint64_t first)
+{
+  const int lanes = std::min<uint64_t>(LANES, vectors - first);
+  // The pins' values in every lane, inputs then outputs
+  std::vector<uint16_t> values((inputs.size() + outputs.size()) * LANES);
+  for (size_t input = 0; input < inputs.size(); input++)
+    simulator.readLanes(inputs[input]->nets, &values[input * LANES]);
+  for (size_t output = 0; output < outputs.size(); output++)
+    simulator.readLanes(outputs[output]->nets,
+                        &values[(inputs.size() + output) * LANES]);
+
+  std::vector<uint16_t> in(inputs.size());
+  std::vector<uint16_t> out(outputs.size());
+  std::vector<uint16_t> expected(outputs.size());
+  for (int lane = 0; lane < lanes; lane++)
+  {
+    for (size_t input = 0; input < inputs.size(); input++)
+      in[input] = values[input * LANES + lane];
+    model.compute(in.data(), expected.data());
+    bool passed{true};
+    for (size_t output = 0; output < outputs.size(); output++)
+    {
+      out[output] = values[(inputs.size() + output) * LANES + lane];
+      expected[output] &= (1u << outputs[output]->nets.size()) - 1;
+      passed &= out[output] == expected[output];
+    }
+    if (passed)
+      continue;
+
+    std::lock_guard<std::mutex> lock{mutex};
+    if (first + lane < firstFailure)
+    {
+      firstFailure = first + lane;
+      result.passed = false;
+      result.inputs = in;
+      result.outputs = out;
+      result.expected = expected;
+    }
+    return;
+  }
+}
+
+// A fast generator whose state can start anywhere, so every batch of random
+// vectors is seeded on its own
+static uint64_t splitMix64(uint64_t &state)
+{
+  uint64_t z{state += 0x9E3779B97F4A7C15};
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
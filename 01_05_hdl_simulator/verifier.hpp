@@ -0,0 +1,58 @@
+#ifndef VERIFIER_HPP
+#define VERIFIER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "goldenmodels.hpp"
+#include "netlist.hpp"
+#include "slicedsimulator.hpp"
+
+// Checks a combinational chip against its GoldenModel on every input vector
+// or on random ones, SlicedSimulator::LANES vectors per evaluation. The
+// vectors are split into chunks that a pool of threads takes in turn.
+class Verifier
+{
+public:
+  struct Result
+  {
+    uint64_t vectors;
+    bool exhaustive;
+    bool passed;
+    // The first failing vector, in the order of the model's pins
+    std::vector<uint16_t> inputs;
+    std::vector<uint16_t> outputs;
+    std::vector<uint16_t> expected;
+  };
+
+  Verifier(std::shared_ptr<const Netlist> netlist, const GoldenModel &model);
+  int getInputBits() const;
+  Result run(uint64_t samples, unsigned threads, uint64_t seed);
+
+private:
+  void worker();
+  void fillExhaustive(SlicedSimulator &simulator, uint64_t first) const;
+  void fillRandom(SlicedSimulator &simulator, uint64_t batch) const;
+  void check(const SlicedSimulator &simulator, uint64_t first);
+
+  std::shared_ptr<const Netlist> netlist;
+  const GoldenModel &model;
+  // The netlist's ports in the model's order
+  std::vector<const Netlist::Port *> inputs;
+  std::vector<const Netlist::Port *> outputs;
+  int inputBits;
+
+  // State of a run
+  bool exhaustive;
+  uint64_t vectors;
+  uint64_t seed;
+  std::atomic<uint64_t> nextChunk;
+  std::mutex mutex;
+  // Index of the first failing vector found, or vectors
+  std::atomic<uint64_t> firstFailure;
+  Result result;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef ALU_HPP
+#define ALU_HPP
+
+#include <array>
+#include <cstdint>
+
+// The six ALU control bits (zx nx zy ny f no) folded into masks, so that
+// out = ((x & xAnd) ^ xXor) f ((y & yAnd) ^ yXor) ^ outXor
+struct AluControl
+{
+  uint16_t xAnd;
+  uint16_t xXor;
+  uint16_t yAnd;
+  uint16_t yXor;
+  uint16_t outXor;
+  bool add;
+};
+
+// Indexed by the comp field's c1..c6 bits, c1 being the most significant
+constexpr std::array<AluControl, 64> makeAluTable()
+{
+  std::array<AluControl, 64> table{};
+  for (int bits = 0; bits < 64; bits++)
+  {
+    table[bits].xAnd = (bits & 0x20) ? 0x0000 : 0xFFFF;
+    table[bits].xXor = (bits & 0x10) ? 0xFFFF : 0x0000;
+    table[bits].yAnd = (bits & 0x08) ? 0x0000 : 0xFFFF;
+    table[bits].yXor = (bits & 0x04) ? 0xFFFF : 0x0000;
+    table[bits].add = bits & 0x02;
+    table[bits].outXor = (bits & 0x01) ? 0xFFFF : 0x0000;
+  }
+  return table;
+}
+
+inline constexpr std::array<AluControl, 64> ALU_TABLE{makeAluTable()};
+
+inline uint16_t computeAlu(const AluControl &control, uint16_t x, uint16_t y)
+{
+  x = (x & control.xAnd) ^ control.xXor;
+  y = (y & control.yAnd) ^ control.yXor;
+  return (control.add ? x + y : x & y) ^ control.outXor;
+}
+
+#endif
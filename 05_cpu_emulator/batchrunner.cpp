@@ -0,0 +1,342 @@
+#include "batchrunner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "cpu.hpp"
+#include "keyboardscript.hpp"
+#include "rom.hpp"
+
+static std::pair<uint16_t, uint16_t> parseWord(const std::string &word,
+                                               const std::string &line);
+static std::string escapeJson(const std::string &text);
+static std::string escapeXml(const std::string &text);
+
+// ROMs are decoded here, once per path, so a ROM that fails to load only
+// fails its own cases
+BatchRunner::BatchRunner(std::vector<Case> cases, bool useJit)
+    : cases{std::move(cases)}, useJit{useJit && Jit::isSupported()},
+      programs{}, loadErrors{}, results{}, queues{}
+{
+  std::map<std::string, std::pair<std::shared_ptr<const Program>, std::string>>
+      loaded;
+  for (const Case &testCase : this->cases)
+  {
+    auto rom{loaded.find(testCase.romPath)};
+    if (rom == loaded.end())
+    {
+      std::pair<std::shared_ptr<const Program>, std::string> program{};
+      try
+      {
+        program.first =
+            std::make_shared<const Program>(loadRom(testCase.romPath));
+      }
+      catch (const std::exception &e)
+      {
+        program.second = e.what();
+      }
+      rom = loaded.emplace(testCase.romPath, std::move(program)).first;
+    }
+    programs.push_back(rom->second.first);
+    loadErrors.push_back(rom->second.second);
+  }
+}
+
+// Runs every case on up to threads threads, the calling one included, and
+// returns the results in manifest order
+std::vector<BatchRunner::Result> BatchRunner::run(unsigned threads)
+{
+  threads = std::max<size_t>(1, std::min<size_t>(threads, cases.size()));
+  results.assign(cases.size(), Result{false, false, 0, 0, {}});
+  queues.clear();
+  for (unsigned thread = 0; thread < threads; thread++)
+    queues.push_back(std::make_unique<Queue>());
+  for (size_t index = 0; index < cases.size(); index++)
+    queues[index % threads]->cases.push_back(index);
+
+  std::vector<std::thread> pool;
+  for (unsigned thread = 1; thread < threads; thread++)
+    pool.emplace_back(&BatchRunner::worker, this, thread);
+  worker(0);
+  for (std::thread &thread : pool)
+    thread.join();
+  return results;
+}
+
+const std::vector<BatchRunner::Case> &BatchRunner::getCases() const
+{
+  return cases;
+}
+
+// Each thread compiles the ROMs it runs with a Jit of its own, since
+// compiled code is patched as blocks get chained
+void BatchRunner::worker(size_t thread)
+{
+  std::map<const Program *, std::unique_ptr<Jit>> jits;
+  size_t index;
+  while (takeCase(thread, index))
+  {
+    if (!programs[index])
+    {
+      results[index] = {false, false, 0, 0, loadErrors[index]};
+      continue;
+    }
+
+    Jit *jit{nullptr};
+    if (useJit)
+    {
+      std::unique_ptr<Jit> &compiled{jits[programs[index].get()]};
+      if (!compiled)
+        compiled = std::make_unique<Jit>(programs[index]);
+      jit = compiled.get();
+    }
+    results[index] = runCase(cases[index], programs[index], jit);
+  }
+}
+
+// The thread's own newest case, or else the oldest case of another thread
+bool BatchRunner::takeCase(size_t thread, size_t &index)
+{
+  for (size_t offset = 0; offset < queues.size(); offset++)
+  {
+    Queue &queue{*queues[(thread + offset) % queues.size()]};
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    if (queue.cases.empty())
+      continue;
+    if (offset == 0)
+    {
+      index = queue.cases.back();
+      queue.cases.pop_back();
+    }
+    else
+    {
+      index = queue.cases.front();
+      queue.cases.pop_front();
+    }
+    return true;
+  }
+  return false;
+}
+
+// A case passes when the program halts within its budget with the expected
+// RAM. Key events cut the run into slices as in main.
+BatchRunner::Result BatchRunner::runCase(
+    const Case &testCase, const std::shared_ptr<const Program> &program,
+    Jit *jit) const
+{
+  Result result{false, false, 0, 0, {}};
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  try
+  {
+    Cpu cpu{program};
+    for (const std::pair<uint16_t, uint16_t> &word : testCase.inputs)
+      cpu.poke(word.first, word.second);
+    KeyboardScript keyboard{testCase.keysPath.empty()
+                                ? KeyboardScript{}
+                                : KeyboardScript::read(testCase.keysPath)};
+
+    uint64_t remaining{testCase.maxCycles};
+    while (remaining > 0 && !cpu.isHalted())
+    {
+      keyboard.apply(cpu);
+      const uint64_t cycles{
+          std::min(remaining, keyboard.getNextCycle() - cpu.getCycles())};
+      const uint64_t executed{jit ? jit->run(cpu, cycles) : cpu.run(cycles)};
+      remaining -= executed;
+      if (executed < cycles)
+        break;
+    }
+
+    result.halted = cpu.isHalted();
+    result.cycles = cpu.getCycles();
+    std::ostringstream failure;
+    if (!result.halted)
+      failure << "Did not halt within " << testCase.maxCycles << " cycles";
+    for (const std::pair<uint16_t, uint16_t> &word : testCase.expected)
+      if (cpu.peek(word.first) != word.second)
+        failure << (failure.tellp() > 0 ? "; " : "") << "RAM[" << word.first
+                << "] = " << static_cast<int16_t>(cpu.peek(word.first))
+                << ", expected " << static_cast<int16_t>(word.second);
+    result.failure = failure.str();
+    result.passed = result.failure.empty();
+  }
+  catch (const std::exception &e)
+  {
+    result.failure = e.what();
+  }
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return result;
+}
+
+void BatchRunner::writeJson(std::ostream &os,
+                            const std::vector<Result> &results,
+                            double seconds) const
+{
+  const size_t failures = std::count_if(
+      results.begin(), results.end(), [](const Result &result)
+      { return !result.passed; });
+  os << "{\n  \"tests\": " << results.size() << ",\n  \"failures\": "
+     << failures << ",\n  \"seconds\": " << seconds << ",\n  \"cases\": [";
+  for (size_t index = 0; index < results.size(); index++)
+  {
+    const Result &result{results[index]};
+    os << (index ? ",\n" : "\n") << "    {\"name\": \""
+       << escapeJson(cases[index].name) << "\", \"rom\": \""
+       << escapeJson(cases[index].romPath) << "\", \"passed\": "
+       << (result.passed ? "true" : "false")
+       << ", \"halted\": " << (result.halted ? "true" : "false")
+       << ", \"cycles\": " << result.cycles
+       << ", \"seconds\": " << result.seconds << ", \"failure\": \""
+       << escapeJson(result.failure) << "\"}";
+  }
+  os << "\n  ]\n}\n";
+}
+
+// JUnit has no place for cycle counts, so they go in a property
+void BatchRunner::writeJUnit(std::ostream &os,
+                             const std::vector<Result> &results,
+                             double seconds) const
+{
+  const size_t failures = std::count_if(
+      results.begin(), results.end(), [](const Result &result)
+      { return !result.passed; });
+  os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+     << "<testsuite name=\"cpu_emulator\" tests=\"" << results.size()
+     << "\" failures=\"" << failures << "\" time=\"" << seconds << "\">\n";
+  for (size_t index = 0; index < results.size(); index++)
+  {
+    const Result &result{results[index]};
+    os << "  <testcase name=\"" << escapeXml(cases[index].name)
+       << "\" classname=\"" << escapeXml(cases[index].romPath)
+       << "\" time=\"" << result.seconds << "\">\n"
+       << "    <properties><property name=\"cycles\" value=\""
+       << result.cycles << "\"/></properties>\n";
+    if (!result.passed)
+      os << "    <failure message=\"" << escapeXml(result.failure)
+         << "\"/>\n";
+    os << "  </testcase>\n";
+  }
+  os << "</testsuite>\n";
+}
+
+// Reads "name rom cycles [keys=script] [set:address=value ...]
+// [address=value ...]" lines: the ROM and keyboard script paths, relative to
+// directory unless absolute, the cycle budget, RAM words set before the run
+// and RAM words expected after it. Lines starting with '#' are comments.
+std::vector<BatchRunner::Case>
+BatchRunner::parseManifest(std::istream &is, const std::string &directory)
+{
+  std::vector<Case> cases;
+  const std::filesystem::path base{directory};
+  std::string line;
+  while (std::getline(is, line))
+  {
+    std::istringstream fields{line};
+    std::string name, rom, cycles;
+    if (!(fields >> name) || name[0] == '#')
+      continue;
+    if (!(fields >> rom >> cycles))
+      throw std::runtime_error("Invalid manifest line '" + line + "'");
+
+    Case testCase{name, (base / rom).string(), "", 0, {}, {}};
+    try
+    {
+      testCase.maxCycles = std::stoull(cycles);
+    }
+    catch (const std::logic_error &)
+    {
+      throw std::runtime_error("Invalid manifest line '" + line + "'");
+    }
+
+    std::string field;
+    while (fields >> field)
+    {
+      if (field.rfind("keys=", 0) == 0)
+        testCase.keysPath = (base / field.substr(5)).string();
+      else if (field.rfind("set:", 0) == 0)
+        testCase.inputs.push_back(parseWord(field.substr(4), line));
+      else
+        testCase.expected.push_back(parseWord(field, line));
+    }
+    cases.push_back(std::move(testCase));
+  }
+  return cases;
+}
+
+std::vector<BatchRunner::Case>
+BatchRunner::readManifest(const std::string &inputFilename)
+{
+  std::ifstream inputFile{inputFilename};
+  if (!inputFile.is_open())
+    throw std::runtime_error("Could not open manifest " + inputFilename);
+  return parseManifest(
+      inputFile, std::filesystem::path{inputFilename}.parent_path().string());
+}
+
+// "address=value", the value signed or unsigned
+static std::pair<uint16_t, uint16_t> parseWord(const std::string &word,
+                                               const std::string &line)
+{
+  const size_t equals{word.find('=')};
+  try
+  {
+    if (equals != std::string::npos)
+    {
+      const int address{std::stoi(word.substr(0, equals))};
+      const int value{std::stoi(word.substr(equals + 1))};
+      if (address >= 0 && address < static_cast<int>(Cpu::RAM_SIZE) &&
+          value >= INT16_MIN && value <= UINT16_MAX)
+        return {address, value};
+    }
+  }
+  catch (const std::logic_error &)
+  {
+  }
+  throw std::runtime_error("Invalid manifest line '" + line + "'");
+}
+
+static std::string escapeJson(const std::string &text)
+{
+  std::ostringstream escaped;
+  for (char c : text)
+    if (c == '"' || c == '\\')
+      escaped << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20)
+      escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+              << static_cast<int>(c) << std::dec << std::setfill(' ');
+    else
+      escaped << c;
+  return escaped.str();
+}
+
+static std::string escapeXml(const std::string &text)
+{
+  std::string escaped;
+  for (char c : text)
+    switch (c)
+    {
+    case '&':
+      escaped += "&amp;";
+      break;
+    case '<':
+      escaped += "&lt;";
+      break;
+    case '>':
+      escaped += "&gt;";
+      break;
+    case '"':
+      escaped += "&quot;";
+      break;
+    default:
+      escaped += c;
+    }
+  return escaped;
+}
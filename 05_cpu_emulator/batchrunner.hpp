@@ -0,0 +1,80 @@
+#ifndef BATCH_RUNNER_HPP
+#define BATCH_RUNNER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "jit.hpp"
+#include "program.hpp"
+
+// Runs the test cases of a manifest on a pool of threads. Every ROM is
+// decoded once into a Program the threads share; each case gets its own Cpu.
+// Cases are dealt out to per-thread queues, and a thread that runs out of
+// cases steals from the others, so long cases do not leave threads idle.
+class BatchRunner
+{
+public:
+  struct Case
+  {
+    std::string name;
+    std::string romPath;
+    std::string keysPath;
+    uint64_t maxCycles;
+    // RAM words set before the run, and checked after it
+    std::vector<std::pair<uint16_t, uint16_t>> inputs;
+    std::vector<std::pair<uint16_t, uint16_t>> expected;
+  };
+
+  struct Result
+  {
+    bool passed;
+    bool halted;
+    uint64_t cycles;
+    double seconds;
+    std::string failure;
+  };
+
+  BatchRunner(std::vector<Case> cases, bool useJit);
+  std::vector<Result> run(unsigned threads);
+  const std::vector<Case> &getCases() const;
+  void writeJson(std::ostream &os, const std::vector<Result> &results,
+                 double seconds) const;
+  void writeJUnit(std::ostream &os, const std::vector<Result> &results,
+                  double seconds) const;
+
+  static std::vector<Case> parseManifest(std::istream &is,
+                                         const std::string &directory);
+  static std::vector<Case> readManifest(const std::string &inputFilename);
+
+private:
+  // Indices of the cases a thread has left. The owner takes from the back,
+  // thieves from the front.
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<size_t> cases;
+  };
+
+  Result runCase(const Case &testCase,
+                 const std::shared_ptr<const Program> &program,
+                 Jit *jit) const;
+  void worker(size_t thread);
+  bool takeCase(size_t thread, size_t &index);
+
+  std::vector<Case> cases;
+  bool useJit;
+  // Decoded ROM of every case, or null with the error in loadErrors
+  std::vector<std::shared_ptr<const Program>> programs;
+  std::vector<std::string> loadErrors;
+  std::vector<Result> results;
+  std::vector<std::unique_ptr<Queue>> queues;
+};
+
+#endif
@@ -0,0 +1,496 @@
+#include "cpu.hpp"
+#include "alu.hpp"
+#include "intrinsics.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// A loop head is traced once its back edge was taken this many times, or
+// LOOP_RETRY_INTERVAL times after its loop turned out not to be skippable
+const uint16_t LOOP_THRESHOLD{64};
+const uint16_t LOOP_RETRY_INTERVAL{0xFFFF};
+
+// Maps an ALU output to the jump class it satisfies
+static inline uint8_t jumpClass(uint16_t out)
+{
+  const int16_t value = static_cast<int16_t>(out);
+  return value < 0    ? Program::JUMP_LT
+         : value == 0 ? Program::JUMP_EQ
+                      : Program::JUMP_GT;
+}
+
+// Computes a C instruction and stores its result, leaving the jump to the
+// caller. M is read and written with A's value from before the instruction.
+static inline uint16_t evaluate(const Program::Instruction &instruction,
+                                uint16_t *memory, uint8_t *dirtyRows,
+                                uint16_t &a, uint16_t &d)
+{
+  const uint16_t address = a & Cpu::ADDRESS_MASK;
+  const uint16_t y = (instruction.flags & Program::USE_M) ? memory[address]
+                                                          : a;
+  const uint16_t out = computeAlu(ALU_TABLE[instruction.alu], d, y);
+
+  if (instruction.flags & Program::DEST_M)
+    Cpu::store(memory, dirtyRows, address, out);
+  if (instruction.flags & Program::DEST_D)
+    d = out;
+  if (instruction.flags & Program::DEST_A)
+    a = out;
+  return out;
+}
+
+Cpu::Cpu(std::shared_ptr<const Program> program)
+    : program{std::move(program)}, ram{nullptr},
+      dirtyRows(SCREEN_HEIGHT, 0),
+      loopCountdowns(Program::ROM_SIZE, LOOP_THRESHOLD), fastForwarding{true},
+      pc{0}, a{0}, d{0}, cycles{0}, halted{false}
+{
+  if (!mapRam(-1, 0))
+    throw std::runtime_error("Could not allocate the CPU's RAM");
+}
+
+Cpu::~Cpu() { munmap(ram, RAM_SIZE * sizeof(uint16_t)); }
+
+// Equivalent to holding the reset pin: registers and RAM are cleared
+void Cpu::reset()
+{
+  // Fresh zero pages, which also drops a snapshot mapped over RAM
+  if (!mapRam(-1, 0))
+    std::fill(ram, ram + RAM_SIZE, 0);
+  std::fill(dirtyRows.begin(), dirtyRows.end(), 1);
+  std::fill(loopCountdowns.begin(), loopCountdowns.end(), LOOP_THRESHOLD);
+  pc = 0;
+  a = 0;
+  d = 0;
+  cycles = 0;
+  halted = false;
+}
+
+// Executes up to maxCycles instructions, stopping early when the program
+// reaches a halt loop. Returns the number of instructions executed.
+//
+// Dispatch is threaded through a table of label addresses (a GCC/Clang
+// extension): every handler jumps straight to the next one. A
+// superinstruction only runs when the remaining budget covers all its words,
+// otherwise its first word runs on its own, so cycle counts stay exact.
+// Loop back edges count down towards a fastForward attempt. A run stops
+// early before a trap, unless it starts at one.
+uint64_t Cpu::run(uint64_t maxCycles)
+{
+  if (halted)
+    return 0;
+
+  static const void *const handlers[]{
+      &&opA,     &&opC,     &&opAC,        &&opPushD, &&opPopD,
+      &&opIncSp, &&opDecSp, &&opAPushD, &&opBinary, &&opIntrinsic, &&opTrap};
+
+  const Program &rom{*program};
+  uint16_t *memory{ram};
+  uint8_t *dirty{dirtyRows.data()};
+  uint16_t pc{this->pc};
+  uint16_t a{this->a};
+  uint16_t d{this->d};
+  uint64_t remaining{maxCycles};
+  const Program::Instruction *instruction;
+
+#define DISPATCH()                                                             \
+  do                                                                           \
+  {                                                                            \
+    instruction = &rom[pc];                                                    \
+    if (remaining < instruction->length)                                       \
+      goto single;                                                             \
+    remaining -= instruction->length;                                          \
+    goto *handlers[instruction->op];                                           \
+  } while (0)
+
+  DISPATCH();
+
+single:
+  if (remaining == 0)
+    goto done;
+  --remaining;
+  if (instruction->flags & Program::A_INSTRUCTION)
+    goto opA;
+  goto opC;
+
+opA:
+  a = instruction->constant;
+  pc = (pc + 1) & ADDRESS_MASK;
+  DISPATCH();
+
+opAC:
+  a = instruction->constant;
+  pc = (pc + 1) & ADDRESS_MASK;
+  instruction = &rom[pc];
+  goto opC;
+
+opC:
+{
+  // The jump goes to A's value from before the instruction
+  const uint16_t address = a & ADDRESS_MASK;
+  const uint16_t out = evaluate(*instruction, memory, dirty, a, d);
+
+  if (instruction->jump & jumpClass(out))
+  {
+    if (instruction->flags & (Program::HALT_LOOP | Program::LOOP_EDGE))
+    {
+      if ((instruction->flags & Program::HALT_LOOP) && address == pc - 1)
+      {
+        halted = true;
+        pc = address;
+        goto done;
+      }
+      if ((instruction->flags & Program::LOOP_EDGE) && address < pc &&
+          --loopCountdowns[address] == 0)
+      {
+        this->pc = address;
+        this->a = a;
+        this->d = d;
+        remaining -= fastForward(remaining);
+        pc = this->pc;
+        a = this->a;
+        d = this->d;
+        if (halted)
+          goto done;
+        DISPATCH();
+      }
+    }
+    pc = address;
+  }
+  else
+    pc = (pc + 1) & ADDRESS_MASK;
+  DISPATCH();
+}
+
+opPushD:
+{
+  store(memory, dirty, memory[0] & ADDRESS_MASK, d);
+  // SP is read again in case the push overwrote it
+  ++memory[0];
+  a = 0;
+  pc = (pc + 5) & ADDRESS_MASK;
+  DISPATCH();
+}
+
+opPopD:
+  a = --memory[0];
+  d = memory[a & ADDRESS_MASK];
+  pc = (pc + 5) & ADDRESS_MASK;
+  DISPATCH();
+
+opIncSp:
+  ++memory[0];
+  a = 0;
+  pc = (pc + 2) & ADDRESS_MASK;
+  DISPATCH();
+
+opDecSp:
+  --memory[0];
+  a = 0;
+  pc = (pc + 2) & ADDRESS_MASK;
+  DISPATCH();
+
+opAPushD:
+{
+  a = instruction->constant;
+  evaluate(rom[(pc + 1) & ADDRESS_MASK], memory, dirty, a, d);
+  store(memory, dirty, memory[0] & ADDRESS_MASK, d);
+  ++memory[0];
+  a = 0;
+  pc = (pc + 7) & ADDRESS_MASK;
+  DISPATCH();
+}
+
+opBinary:
+  a = --memory[0];
+  d = memory[a & ADDRESS_MASK];
+  a = --memory[0];
+  evaluate(rom[(pc + 9) & ADDRESS_MASK], memory, dirty, a, d);
+  ++memory[0];
+  a = 0;
+  pc = (pc + 12) & ADDRESS_MASK;
+  DISPATCH();
+
+opIntrinsic:
+{
+  // Charges the intrinsic's own cost instead of its entry's instruction,
+  // and runs that instruction after all when the budget does not cover it
+  ++remaining;
+  const uint64_t cost{callIntrinsic(instruction->intrinsic, memory, dirty, pc,
+                                    a, d, remaining)};
+  if (cost)
+  {
+    remaining -= cost;
+    DISPATCH();
+  }
+  --remaining;
+  if (instruction->flags & Program::A_INSTRUCTION)
+    goto opA;
+  goto opC;
+}
+
+opTrap:
+  // Only the instruction a run starts with gets past a trap
+  if (remaining + 1 != maxCycles)
+  {
+    ++remaining;
+    goto done;
+  }
+  if (instruction->flags & Program::A_INSTRUCTION)
+    goto opA;
+  goto opC;
+
+#undef DISPATCH
+
+done:
+  this->pc = pc;
+  this->a = a;
+  this->d = d;
+  const uint64_t executed{maxCycles - remaining};
+  cycles += executed;
+  return executed;
+}
+
+void Cpu::step() { run(1); }
+
+// Affine maps compose into affine maps; & and | of two variables do not
+static bool isAffine(uint8_t alu)
+{
+  const uint8_t ZERO_X{0x20};
+  const uint8_t ZERO_Y{0x08};
+  const uint8_t ADD{0x02};
+  return alu & (ZERO_X | ZERO_Y | ADD);
+}
+
+// First iteration k at which out0 + k * delta (as int16) has another jump
+// class than out0, or UINT64_MAX when it never does
+static uint64_t classChange(int16_t out0, int16_t delta)
+{
+  const int64_t out{out0};
+  const int64_t step{delta};
+  if (step == 0)
+    return UINT64_MAX;
+  if (out == 0)
+    return 1;
+  if (step > 0)
+    return out < 0 ? (-out + step - 1) / step : (INT16_MAX - out) / step + 1;
+  return out > 0 ? (out - step - 1) / -step : (out - INT16_MIN) / -step + 1;
+}
+
+// Called with pc at the head of a loop whose back edge is taken over and
+// over. Two iterations are traced; when they took the same path, accessed
+// memory at the same addresses and computed nothing but affine functions, the
+// loop body is an affine map of A, D and the words it writes, and equal
+// deltas across both iterations mean every further iteration adds the same
+// deltas until a jump's ALU output changes class. Those iterations are
+// applied at once. Words the loop only reads, the keyboard included, stay
+// constant since callers end their budget at every input event. Returns the
+// cycles used, at most maxCycles.
+uint64_t Cpu::fastForward(uint64_t maxCycles)
+{
+  const uint16_t head{pc};
+  loopCountdowns[head] = LOOP_RETRY_INTERVAL;
+  if (!fastForwarding)
+    return 0;
+
+  uint64_t used{0};
+  std::vector<TraceStep> first;
+  std::vector<TraceStep> second;
+  // Every written word with its value before the first iteration
+  std::vector<std::pair<uint16_t, uint16_t>> writes;
+  const uint16_t a0{a};
+  const uint16_t d0{d};
+  if (!traceIteration(head, maxCycles, used, first, &writes))
+  {
+    if (used == maxCycles)
+      loopCountdowns[head] = LOOP_THRESHOLD;
+    return used;
+  }
+  const uint16_t a1{a};
+  const uint16_t d1{d};
+  std::vector<uint16_t> words1;
+  for (const std::pair<uint16_t, uint16_t> &write : writes)
+    words1.push_back(ram[write.first]);
+  if (!traceIteration(head, maxCycles, used, second, nullptr))
+  {
+    if (used == maxCycles)
+      loopCountdowns[head] = LOOP_THRESHOLD;
+    return used;
+  }
+
+  if (first.size() != second.size())
+    return used;
+  if (static_cast<uint16_t>(a - a1) != static_cast<uint16_t>(a1 - a0) ||
+      static_cast<uint16_t>(d - d1) != static_cast<uint16_t>(d1 - d0))
+    return used;
+  for (size_t i = 0; i < writes.size(); i++)
+    if (static_cast<uint16_t>(ram[writes[i].first] - words1[i]) !=
+        static_cast<uint16_t>(words1[i] - writes[i].second))
+      return used;
+
+  const Program &rom{*program};
+  uint64_t change{UINT64_MAX};
+  for (size_t i = 0; i < first.size(); i++)
+  {
+    const Program::Instruction &instruction{rom[first[i].pc]};
+    if (first[i].pc != second[i].pc)
+      return used;
+    if (instruction.flags & Program::A_INSTRUCTION)
+      continue;
+    if (!isAffine(instruction.alu))
+      return used;
+    if ((instruction.flags & (Program::USE_M | Program::DEST_M)) ||
+        instruction.jump)
+      if (first[i].address != second[i].address)
+        return used;
+    if (instruction.jump &&
+        instruction.jump != (Program::JUMP_GT | Program::JUMP_EQ |
+                             Program::JUMP_LT))
+      change = std::min(
+          change, classChange(first[i].out,
+                              static_cast<int16_t>(second[i].out -
+                                                   first[i].out)));
+  }
+
+  // Iterations 2 to change - 1 take the traced path
+  const uint64_t length{first.size()};
+  uint64_t skipped{(maxCycles - used) / length};
+  if (change != UINT64_MAX)
+    skipped = std::min(skipped, change <= 2 ? 0 : change - 2);
+
+  // Words wrap around, so only the count modulo 2^16 matters. Products are
+  // taken in uint32_t, as uint16_t operands would be promoted to int and
+  // could overflow it.
+  const uint32_t n = static_cast<uint16_t>(skipped);
+  a += static_cast<uint16_t>(n * static_cast<uint16_t>(a1 - a0));
+  d += static_cast<uint16_t>(n * static_cast<uint16_t>(d1 - d0));
+  for (size_t i = 0; i < writes.size(); i++)
+  {
+    const uint16_t address{writes[i].first};
+    const uint32_t delta = static_cast<uint16_t>(words1[i] - writes[i].second);
+    store(ram, dirtyRows.data(), address,
+          ram[address] + static_cast<uint16_t>(n * delta));
+  }
+  loopCountdowns[head] = LOOP_THRESHOLD;
+  return used + skipped * length;
+}
+
+// Runs from the loop head until pc is back at it, appending every step.
+// False when that takes more than MAX_LOOP_LENGTH instructions, more than the
+// budget or the CPU halts on the way.
+bool Cpu::traceIteration(uint16_t head, uint64_t maxCycles, uint64_t &used,
+                         std::vector<TraceStep> &steps,
+                         std::vector<std::pair<uint16_t, uint16_t>> *writes)
+{
+  const Program &rom{*program};
+  do
+  {
+    // Intrinsics would run differently from the traced instructions, and
+    // traps must stop the run
+    const Program::Instruction &instruction{rom[pc]};
+    if (used == maxCycles || steps.size() == Program::MAX_LOOP_LENGTH ||
+        halted || instruction.op == Program::OP_INTRINSIC ||
+        instruction.op == Program::OP_TRAP)
+      return false;
+
+    const uint16_t address = a & ADDRESS_MASK;
+    if (writes && !(instruction.flags & Program::A_INSTRUCTION) &&
+        (instruction.flags & Program::DEST_M) && address < KEYBOARD &&
+        std::none_of(writes->begin(), writes->end(),
+                     [address](const std::pair<uint16_t, uint16_t> &write)
+                     { return write.first == address; }))
+      writes->emplace_back(address, ram[address]);
+
+    steps.push_back(traceStep());
+    ++used;
+  } while (pc != head);
+  return !halted;
+}
+
+// Executes the instruction at pc on its own, exactly like run
+Cpu::TraceStep Cpu::traceStep()
+{
+  const Program::Instruction &instruction{(*program)[pc]};
+  TraceStep step{pc, static_cast<uint16_t>(a & ADDRESS_MASK), 0};
+  if (instruction.flags & Program::A_INSTRUCTION)
+  {
+    a = instruction.constant;
+    pc = (pc + 1) & ADDRESS_MASK;
+    return step;
+  }
+
+  step.out = evaluate(instruction, ram, dirtyRows.data(), a, d);
+  if (instruction.jump & jumpClass(step.out))
+  {
+    if ((instruction.flags & Program::HALT_LOOP) && step.address == pc - 1)
+      halted = true;
+    pc = step.address;
+  }
+  else
+    pc = (pc + 1) & ADDRESS_MASK;
+  return step;
+}
+
+// True once the program entered a halt loop; it would spin there forever
+bool Cpu::isHalted() const { return halted; }
+
+// Whether run and the JIT skip ahead through loops fastForward can predict,
+// on by default. Results and cycle counts are the same either way.
+void Cpu::setFastForward(bool enabled) { fastForwarding = enabled; }
+
+uint16_t Cpu::getPc() const { return pc; }
+
+uint16_t Cpu::getA() const { return a; }
+
+uint16_t Cpu::getD() const { return d; }
+
+uint64_t Cpu::getCycles() const { return cycles; }
+
+uint16_t Cpu::peek(uint16_t address) const
+{
+  return ram[address & ADDRESS_MASK];
+}
+
+// Unlike the CPU, poke can write the keyboard register
+void Cpu::poke(uint16_t address, uint16_t value)
+{
+  address &= ADDRESS_MASK;
+  ram[address] = value;
+  if (address >= SCREEN && address < KEYBOARD)
+    dirtyRows[(address - SCREEN) / SCREEN_ROW_WORDS] = 1;
+}
+
+// The screen rows written since the last call, in order, clearing their
+// flags
+std::vector<int> Cpu::takeDirtyRows()
+{
+  std::vector<int> rows;
+  for (int row = 0; row < SCREEN_HEIGHT; row++)
+    if (dirtyRows[row])
+    {
+      rows.push_back(row);
+      dirtyRows[row] = 0;
+    }
+  return rows;
+}
+
+const Program &Cpu::getProgram() const { return *program; }
+
+// Maps RAM privately from fd at offset, or as zero pages when fd is
+// negative, in place of the current mapping. On failure the current
+// mapping is left as it was.
+bool Cpu::mapRam(int fd, long offset)
+{
+  const size_t bytes{RAM_SIZE * sizeof(uint16_t)};
+  if (offset % sysconf(_SC_PAGESIZE) != 0)
+    return false;
+  const int flags{(fd < 0 ? MAP_ANONYMOUS : 0) | MAP_PRIVATE |
+                  (ram ? MAP_FIXED : 0)};
+  void *mapping{mmap(ram, bytes, PROT_READ | PROT_WRITE, flags, fd, offset)};
+  if (mapping == MAP_FAILED)
+    return false;
+  ram = static_cast<uint16_t *>(mapping);
+  return true;
+}
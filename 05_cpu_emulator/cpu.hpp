@@ -0,0 +1,106 @@
+#ifndef CPU_HPP
+#define CPU_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "program.hpp"
+
+class Jit;
+class Snapshot;
+
+// The Hack computer of 05/Computer.hdl: CPU, data memory with its memory
+// mapped screen and keyboard, and a ROM holding a decoded Program
+class Cpu
+{
+public:
+  static constexpr size_t RAM_SIZE{0x8000};
+  static constexpr uint16_t SCREEN{0x4000};
+  static constexpr uint16_t KEYBOARD{0x6000};
+  static constexpr int SCREEN_WIDTH{512};
+  static constexpr int SCREEN_HEIGHT{256};
+  static constexpr int SCREEN_ROW_WORDS{SCREEN_WIDTH / 16};
+  static constexpr uint16_t ADDRESS_MASK{0x7FFF};
+  // The VM translator's pointers and temporaries, which the intrinsics and
+  // the heap profiler read and write
+  static constexpr uint16_t SP{0};
+  static constexpr uint16_t LCL{1};
+  static constexpr uint16_t ARG{2};
+  static constexpr uint16_t THIS{3};
+  static constexpr uint16_t THAT{4};
+  static constexpr uint16_t R13{13};
+  static constexpr uint16_t R14{14};
+
+  Cpu(std::shared_ptr<const Program> program);
+  Cpu(const Cpu &) = delete;
+  Cpu &operator=(const Cpu &) = delete;
+  ~Cpu();
+  void reset();
+  uint64_t run(uint64_t maxCycles);
+  void step();
+  bool isHalted() const;
+  void setFastForward(bool enabled);
+
+  uint16_t getPc() const;
+  uint16_t getA() const;
+  uint16_t getD() const;
+  uint64_t getCycles() const;
+  uint16_t peek(uint16_t address) const;
+  void poke(uint16_t address, uint16_t value);
+  std::vector<int> takeDirtyRows();
+  const Program &getProgram() const;
+
+  static void store(uint16_t *ram, uint8_t *dirtyRows, uint16_t address,
+                    uint16_t value);
+
+private:
+  friend class Jit;
+  friend class Snapshot;
+
+  // One instruction executed while tracing a loop, with A's value from
+  // before it and the ALU output of a C instruction
+  struct TraceStep
+  {
+    uint16_t pc;
+    uint16_t address;
+    uint16_t out;
+  };
+
+  uint64_t fastForward(uint64_t maxCycles);
+  bool traceIteration(uint16_t head, uint64_t maxCycles, uint64_t &used,
+                      std::vector<TraceStep> &steps,
+                      std::vector<std::pair<uint16_t, uint16_t>> *writes);
+  TraceStep traceStep();
+  bool mapRam(int fd, long offset);
+
+  std::shared_ptr<const Program> program;
+  // RAM_SIZE words in a mapping of their own, which a snapshot file can
+  // replace copy-on-write
+  uint16_t *ram;
+  // One flag per screen row, set by every write to the row
+  std::vector<uint8_t> dirtyRows;
+  // Times each loop head is still jumped back to before fastForward tries it
+  std::vector<uint16_t> loopCountdowns;
+  bool fastForwarding;
+  uint16_t pc;
+  uint16_t a;
+  uint16_t d;
+  uint64_t cycles;
+  bool halted;
+};
+
+// Writes RAM below RAM_SIZE the way the CPU does: the keyboard register and
+// above are read only, and writes to the screen mark their row dirty
+inline void Cpu::store(uint16_t *ram, uint8_t *dirtyRows, uint16_t address,
+                       uint16_t value)
+{
+  if (address >= KEYBOARD)
+    return;
+  ram[address] = value;
+  if (address >= SCREEN)
+    dirtyRows[(address - SCREEN) / SCREEN_ROW_WORDS] = 1;
+}
+
+#endif
@@ -0,0 +1,262 @@
+#include "framerenderer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+// Frames the Cpu can run ahead of the renderer before it waits
+const size_t MAX_QUEUED_FRAMES{64};
+const uint8_t PNG_SIGNATURE[8]{0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+// Largest stored deflate block
+const size_t MAX_STORED_BLOCK{0xFFFF};
+
+static void writeU32BigEndian(std::vector<uint8_t> &bytes, uint32_t value);
+static void writePngChunk(std::ostream &os, const char *type,
+                          const std::vector<uint8_t> &data);
+static std::array<uint32_t, 256> makeCrcTable();
+static uint32_t crc32(const uint8_t *bytes, size_t size);
+
+FrameRenderer::FrameRenderer(const std::string &outputDirectory,
+                             IMAGE_FORMATS format)
+    : outputDirectory{outputDirectory}, format{format}, captured{false},
+      rows(Cpu::SCREEN_HEIGHT, Row{}), image{}, rowBytes{0}, mutex{},
+      updated{}, drained{}, updates{}, stopping{false}, frameCount{0},
+      error{}, thread{}
+{
+  std::filesystem::create_directories(outputDirectory);
+
+  // Unset pixels are white in both formats: 255 in PPM, a 1 bit in 1-bit
+  // grayscale PNG, whose rows start with a filter type byte of 0
+  if (format == PPM_FORMAT)
+  {
+    rowBytes = Cpu::SCREEN_WIDTH * 3;
+    image.assign(rowBytes * Cpu::SCREEN_HEIGHT, 0xFF);
+  }
+  else
+  {
+    rowBytes = 1 + Cpu::SCREEN_WIDTH / 8;
+    image.assign(rowBytes * Cpu::SCREEN_HEIGHT, 0xFF);
+    for (int row = 0; row < Cpu::SCREEN_HEIGHT; row++)
+      image[row * rowBytes] = 0;
+  }
+
+  thread = std::thread{&FrameRenderer::renderLoop, this};
+}
+
+FrameRenderer::~FrameRenderer()
+{
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  updated.notify_one();
+  if (thread.joinable())
+    thread.join();
+}
+
+// Queues a frame holding the rows that changed since the last one. Only
+// rows written since then are compared, and frames where nothing changed are
+// skipped, except for the first.
+void FrameRenderer::capture(Cpu &cpu, uint64_t frame)
+{
+  Update update{frame, {}};
+  for (int row : cpu.takeDirtyRows())
+  {
+    Row words;
+    for (int word = 0; word < Cpu::SCREEN_ROW_WORDS; word++)
+      words[word] = cpu.peek(Cpu::SCREEN + row * Cpu::SCREEN_ROW_WORDS + word);
+    if (words == rows[row])
+      continue;
+    rows[row] = words;
+    update.rows.emplace_back(row, words);
+  }
+  if (update.rows.empty() && captured)
+    return;
+  captured = true;
+
+  std::unique_lock<std::mutex> lock{mutex};
+  drained.wait(lock, [this]
+               { return updates.size() < MAX_QUEUED_FRAMES; });
+  updates.push_back(std::move(update));
+  lock.unlock();
+  updated.notify_one();
+}
+
+// Waits until every queued frame is written
+void FrameRenderer::finish()
+{
+  std::unique_lock<std::mutex> lock{mutex};
+  drained.wait(lock, [this]
+               { return updates.empty(); });
+  if (!error.empty())
+    throw std::runtime_error(error);
+}
+
+// Number of image files written so far
+size_t FrameRenderer::getFrameCount()
+{
+  std::lock_guard<std::mutex> lock{mutex};
+  return frameCount;
+}
+
+FrameRenderer::IMAGE_FORMATS FrameRenderer::parseFormat(const std::string &name)
+{
+  if (name == "ppm")
+    return PPM_FORMAT;
+  if (name == "png")
+    return PNG_FORMAT;
+  throw std::invalid_argument("Unknown frame format " + name);
+}
+
+// An update stays at the front of the queue until its image is written, so
+// finish() returns only once the last file is complete
+void FrameRenderer::renderLoop()
+{
+  std::unique_lock<std::mutex> lock{mutex};
+  while (true)
+  {
+    updated.wait(lock, [this]
+                 { return stopping || !updates.empty(); });
+    if (updates.empty())
+      return;
+
+    const Update &update{updates.front()};
+    lock.unlock();
+    for (const std::pair<int, Row> &row : update.rows)
+      drawRow(row.first, row.second);
+    const bool written{writeImage(update.frame)};
+    lock.lock();
+
+    if (!written && error.empty())
+      error = "Could not write frame " + std::to_string(update.frame);
+
+    updates.pop_front();
+    ++frameCount;
+    drained.notify_all();
+  }
+}
+
+// Pixels are stored 16 to a word, the least significant bit leftmost, and a
+// set bit is black
+void FrameRenderer::drawRow(int row, const Row &words)
+{
+  uint8_t *pixels{image.data() + row * rowBytes};
+  for (int x = 0; x < Cpu::SCREEN_WIDTH; x++)
+  {
+    const bool black = (words[x / 16] >> (x % 16)) & 1;
+    if (format == PPM_FORMAT)
+      std::fill(pixels + x * 3, pixels + x * 3 + 3, black ? 0 : 0xFF);
+    else
+    {
+      uint8_t &byte{pixels[1 + x / 8]};
+      const uint8_t mask = 0x80 >> (x % 8);
+      byte = black ? byte & ~mask : byte | mask;
+    }
+  }
+}
+
+bool FrameRenderer::writeImage(uint64_t frame) const
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "frame_%06llu.%s",
+                static_cast<unsigned long long>(frame),
+                format == PPM_FORMAT ? "ppm" : "png");
+  const std::filesystem::path path{std::filesystem::path{outputDirectory} /
+                                   name};
+  std::ofstream file{path, std::ios::binary};
+  if (format == PPM_FORMAT)
+    writePpm(file);
+  else
+    writePng(file);
+  return file.good();
+}
+
+void FrameRenderer::writePpm(std::ostream &os) const
+{
+  os << "P6\n"
+     << Cpu::SCREEN_WIDTH << ' ' << Cpu::SCREEN_HEIGHT << "\n255\n";
+  os.write(reinterpret_cast<const char *>(image.data()), image.size());
+}
+
+// The image is small, so its scanlines are stored in uncompressed deflate
+// blocks, which needs no zlib
+void FrameRenderer::writePng(std::ostream &os) const
+{
+  os.write(reinterpret_cast<const char *>(PNG_SIGNATURE),
+           sizeof(PNG_SIGNATURE));
+
+  std::vector<uint8_t> header;
+  writeU32BigEndian(header, Cpu::SCREEN_WIDTH);
+  writeU32BigEndian(header, Cpu::SCREEN_HEIGHT);
+  // 1-bit grayscale, deflate, per row filter types, no interlacing
+  header.insert(header.end(), {1, 0, 0, 0, 0});
+  writePngChunk(os, "IHDR", header);
+
+  std::vector<uint8_t> data{0x78, 0x01};
+  uint32_t adlerLow{1};
+  uint32_t adlerHigh{0};
+  for (size_t start = 0; start < image.size(); start += MAX_STORED_BLOCK)
+  {
+    const size_t size{std::min(MAX_STORED_BLOCK, image.size() - start)};
+    const bool last{start + size == image.size()};
+    data.insert(data.end(),
+                {static_cast<uint8_t>(last), static_cast<uint8_t>(size),
+                 static_cast<uint8_t>(size >> 8),
+                 static_cast<uint8_t>(~size), static_cast<uint8_t>(~size >> 8)});
+    data.insert(data.end(), image.begin() + start,
+                image.begin() + start + size);
+  }
+  for (uint8_t byte : image)
+  {
+    adlerLow = (adlerLow + byte) % 65521;
+    adlerHigh = (adlerHigh + adlerLow) % 65521;
+  }
+  writeU32BigEndian(data, (adlerHigh << 16) | adlerLow);
+  writePngChunk(os, "IDAT", data);
+
+  writePngChunk(os, "IEND", {});
+}
+
+static void writeU32BigEndian(std::vector<uint8_t> &bytes, uint32_t value)
+{
+  bytes.insert(bytes.end(),
+               {static_cast<uint8_t>(value >> 24),
+                static_cast<uint8_t>(value >> 16),
+                static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)});
+}
+
+// Length, type, data and a CRC of the type and data
+static void writePngChunk(std::ostream &os, const char *type,
+                          const std::vector<uint8_t> &data)
+{
+  std::vector<uint8_t> chunk;
+  writeU32BigEndian(chunk, data.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  writeU32BigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+  os.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
+static std::array<uint32_t, 256> makeCrcTable()
+{
+  std::array<uint32_t, 256> table{};
+  for (uint32_t n = 0; n < table.size(); n++)
+  {
+    uint32_t crc{n};
+    for (int bit = 0; bit < 8; bit++)
+      crc = crc & 1 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+    table[n] = crc;
+  }
+  return table;
+}
+
+// The CRC-32 PNG chunks end with
+static uint32_t crc32(const uint8_t *bytes, size_t size)
+{
+  static const std::array<uint32_t, 256> table{makeCrcTable()};
+  uint32_t crc{0xFFFFFFFF};
+  for (size_t i = 0; i < size; i++)
+    crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
@@ -0,0 +1,74 @@
+#ifndef FRAME_RENDERER_HPP
+#define FRAME_RENDERER_HPP
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "cpu.hpp"
+
+// Writes the screen as numbered image files without a display. The Cpu's
+// thread copies the rows written since the last frame, a background thread
+// redraws only those rows of its image and writes the file, so the Cpu keeps
+// running while frames are encoded.
+class FrameRenderer
+{
+public:
+  enum IMAGE_FORMATS
+  {
+    PPM_FORMAT,
+    PNG_FORMAT
+  };
+
+  FrameRenderer(const std::string &outputDirectory, IMAGE_FORMATS format);
+  FrameRenderer(const FrameRenderer &) = delete;
+  FrameRenderer &operator=(const FrameRenderer &) = delete;
+  ~FrameRenderer();
+  void capture(Cpu &cpu, uint64_t frame);
+  void finish();
+  size_t getFrameCount();
+
+  static IMAGE_FORMATS parseFormat(const std::string &name);
+
+private:
+  using Row = std::array<uint16_t, Cpu::SCREEN_ROW_WORDS>;
+
+  struct Update
+  {
+    uint64_t frame;
+    std::vector<std::pair<int, Row>> rows;
+  };
+
+  void renderLoop();
+  void drawRow(int row, const Row &words);
+  bool writeImage(uint64_t frame) const;
+  void writePpm(std::ostream &os) const;
+  void writePng(std::ostream &os) const;
+
+  std::string outputDirectory;
+  IMAGE_FORMATS format;
+  bool captured;
+  // The screen as of the last frame, only touched by the Cpu's thread
+  std::vector<Row> rows;
+  // The image in the format's own row layout, only touched by the thread
+  std::vector<uint8_t> image;
+  size_t rowBytes;
+
+  std::mutex mutex;
+  std::condition_variable updated;
+  std::condition_variable drained;
+  std::deque<Update> updates;
+  bool stopping;
+  size_t frameCount;
+  std::string error;
+  std::thread thread;
+};
+
+#endif
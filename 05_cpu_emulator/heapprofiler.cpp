@@ -0,0 +1,313 @@
+#include "heapprofiler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include "../06_assembler/littleendian.hpp"
+
+// The end of the VM translator's return sequence: @R14; A=M; 0;JMP
+const uint16_t AT_R14{Cpu::R14};
+const uint16_t A_EQ_M{0xFC20};
+const uint16_t JMP{0xEA87};
+const int TIMELINE_SAMPLES{10};
+const int HISTOGRAM_BUCKETS{16};
+
+// Traces are laid out as:
+//   "HHTR", version, reserved, event count, site count
+//   per event: kind, varint cycles since the previous event, address, size,
+//              varint site + 1 (0 for unknown)
+//   per site: name length, name
+// Fixed size integers are little endian.
+const char TRACE_MAGIC[4]{'H', 'H', 'T', 'R'};
+const uint16_t TRACE_VERSION{1};
+
+enum TRACE_KINDS : uint8_t
+{
+  TRACE_ALLOC,
+  TRACE_FREE,
+  TRACE_INVALID_FREE
+};
+
+static int histogramBucket(uint16_t size);
+
+HeapProfiler::HeapProfiler(const std::vector<uint16_t> &rom, SymbolMap symbols)
+    : symbols{std::move(symbols)}, traps{}, allocEntry{-1}, deAllocEntry{-1},
+      pending{}, live{}, events{}, liveWords{0}, peakWords{0}, peakBlocks{0},
+      peakCycle{0}
+{
+  for (const SymbolMap::Function &function : this->symbols.getFunctions())
+  {
+    if (function.start >= function.end)
+      continue;
+    if (function.name == "Memory.alloc")
+    {
+      allocEntry = function.start;
+      traps.push_back(function.start);
+      // Every return of Memory.alloc, where its result is on the stack
+      const int end = std::min<size_t>(function.end, rom.size());
+      for (int address = function.start + 2; address < end; address++)
+        if (rom[address] == JMP && rom[address - 1] == A_EQ_M &&
+            rom[address - 2] == AT_R14)
+          traps.push_back(address);
+    }
+    else if (function.name == "Memory.deAlloc")
+    {
+      deAllocEntry = function.start;
+      traps.push_back(function.start);
+    }
+  }
+
+  if (allocEntry < 0)
+    throw std::invalid_argument("Symbol map has no Memory.alloc");
+}
+
+// Addresses the Program must trap for run to see every heap operation
+const std::vector<int> &HeapProfiler::getTraps() const { return traps; }
+
+// Runs up to maxCycles instructions on the JIT when there is one, or the
+// interpreter, stopping at every trap to record what it does
+uint64_t HeapProfiler::run(Cpu &cpu, Jit *jit, uint64_t maxCycles)
+{
+  const Program &rom{cpu.getProgram()};
+  uint64_t remaining{maxCycles};
+
+  while (remaining > 0 && !cpu.isHalted())
+  {
+    // Runs stop before traps and pass them when they start there, so every
+    // arrival is recorded once, even across calls
+    if (rom[cpu.getPc()].op == Program::OP_TRAP)
+      trap(cpu);
+
+    const uint64_t executed{jit ? jit->run(cpu, remaining)
+                                : cpu.run(remaining)};
+    remaining -= executed;
+    if (executed == 0)
+      break;
+  }
+  return maxCycles - remaining;
+}
+
+const std::vector<HeapProfiler::Event> &HeapProfiler::getEvents() const
+{
+  return events;
+}
+
+size_t HeapProfiler::getLiveBlockCount() const { return live.size(); }
+
+uint32_t HeapProfiler::getPeakWords() const { return peakWords; }
+
+void HeapProfiler::trap(const Cpu &cpu)
+{
+  const int pc{cpu.getPc()};
+  const uint16_t arguments{cpu.peek(Cpu::ARG)};
+  if (pc == allocEntry)
+    pending.push_back({cpu.peek(arguments), callSite(cpu)});
+  else if (pc == deAllocEntry)
+  {
+    const uint16_t address{cpu.peek(arguments)};
+    const auto block{live.find(address)};
+    if (block == live.end())
+      record(cpu.getCycles(), address, 0, callSite(cpu), true);
+    else
+      record(cpu.getCycles(), address, block->second.size, block->second.site,
+             true);
+  }
+  // A return of Memory.alloc, with its result replacing the arguments
+  else if (!pending.empty())
+  {
+    const PendingAlloc alloc{pending.back()};
+    pending.pop_back();
+    record(cpu.getCycles(), cpu.peek(cpu.peek(Cpu::SP) - 1), alloc.size,
+           alloc.site, false);
+  }
+}
+
+// The function that called the one whose entry point pc is at, from the
+// return address the call pushed below LCL
+int HeapProfiler::callSite(const Cpu &cpu) const
+{
+  const uint16_t returnAddress{cpu.peek(cpu.peek(Cpu::LCL) - 5)};
+  const int function{
+      symbols.functionContaining(returnAddress & Cpu::ADDRESS_MASK)};
+  return function < 0 ? UNKNOWN_SITE : function;
+}
+
+void HeapProfiler::record(uint64_t cycle, uint16_t address, uint16_t size,
+                          int site, bool free)
+{
+  if (free && size > 0)
+  {
+    live.erase(address);
+    liveWords -= size;
+  }
+  else if (!free)
+  {
+    // A block handed out again without being freed replaces the old one
+    const auto old{live.find(address)};
+    if (old != live.end())
+      liveWords -= old->second.size;
+    live[address] = {size, site};
+    liveWords += size;
+    if (liveWords > peakWords)
+    {
+      peakWords = liveWords;
+      peakBlocks = live.size();
+      peakCycle = cycle;
+    }
+  }
+
+  uint32_t span{0};
+  if (!live.empty())
+    span = std::prev(live.end())->first + std::prev(live.end())->second.size -
+           live.begin()->first;
+  events.push_back({cycle, address, size, site, free, liveWords, span});
+}
+
+void HeapProfiler::print(std::ostream &os) const
+{
+  struct SiteProfile
+  {
+    uint64_t allocations;
+    uint64_t words;
+    uint64_t frees;
+    uint64_t leaked;
+  };
+
+  uint64_t allocations{0};
+  uint64_t frees{0};
+  uint64_t invalidFrees{0};
+  std::vector<uint64_t> histogram(HISTOGRAM_BUCKETS, 0);
+  std::map<int, SiteProfile> sites;
+  for (const Event &event : events)
+  {
+    SiteProfile &site{sites[event.site]};
+    if (!event.free)
+    {
+      ++allocations;
+      ++histogram[histogramBucket(event.size)];
+      ++site.allocations;
+      site.words += event.size;
+    }
+    else if (event.size == 0)
+      ++invalidFrees;
+    else
+    {
+      ++frees;
+      ++site.frees;
+    }
+  }
+  for (const std::pair<const uint16_t, Block> &block : live)
+    sites[block.second.site].leaked += block.second.size;
+
+  os << "Heap: " << allocations << " allocations, " << frees << " frees, "
+     << invalidFrees << " invalid frees\n";
+  os << "Peak: " << peakWords << " words in " << peakBlocks
+     << " blocks at cycle " << peakCycle << '\n';
+  os << "Live: " << liveWords << " words in " << live.size() << " blocks\n";
+
+  os << '\n'
+     << std::left << std::setw(16) << "Size" << std::right << std::setw(12)
+     << "Allocations" << '\n';
+  for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    if (histogram[bucket])
+    {
+      const int low{bucket == 0 ? 0 : 1 << bucket};
+      const std::string range{
+          std::to_string(low) + "-" + std::to_string((2 << bucket) - 1)};
+      os << std::left << std::setw(16) << range << std::right << std::setw(12)
+         << histogram[bucket] << '\n';
+    }
+
+  // Fragmentation is the share of the span between the lowest and highest
+  // live word that is not allocated
+  os << '\n'
+     << std::setw(16) << "Cycle" << std::setw(12) << "Live" << std::setw(12)
+     << "Span" << std::setw(16) << "Fragmentation" << '\n';
+  os << std::fixed << std::setprecision(2);
+  const uint64_t lastCycle{events.empty() ? 0 : events.back().cycle};
+  size_t next{0};
+  for (int sample = 1; sample <= TIMELINE_SAMPLES && !events.empty(); sample++)
+  {
+    const uint64_t cycle{lastCycle * sample / TIMELINE_SAMPLES};
+    while (next < events.size() && events[next].cycle <= cycle)
+      ++next;
+    if (next == 0)
+      continue;
+    const Event &event{events[next - 1]};
+    const double fragmentation{
+        event.span ? 100.0 * (event.span - event.liveWords) / event.span : 0};
+    os << std::setw(16) << cycle << std::setw(12) << event.liveWords
+       << std::setw(12) << event.span << std::setw(16) << fragmentation
+       << '\n';
+  }
+  os << std::defaultfloat;
+
+  // Call sites by words allocated
+  std::vector<std::pair<int, SiteProfile>> bySite{sites.begin(), sites.end()};
+  std::stable_sort(bySite.begin(), bySite.end(),
+                   [](const std::pair<int, SiteProfile> &left,
+                      const std::pair<int, SiteProfile> &right)
+                   { return left.second.words > right.second.words; });
+  os << '\n'
+     << std::left << std::setw(32) << "Call site" << std::right
+     << std::setw(12) << "Allocations" << std::setw(12) << "Words"
+     << std::setw(12) << "Frees" << std::setw(12) << "Leaked" << '\n';
+  for (const std::pair<int, SiteProfile> &site : bySite)
+    if (site.second.allocations)
+      os << std::left << std::setw(32) << siteName(site.first) << std::right
+         << std::setw(12) << site.second.allocations << std::setw(12)
+         << site.second.words << std::setw(12) << site.second.frees
+         << std::setw(12) << site.second.leaked << '\n';
+}
+
+void HeapProfiler::writeTrace(const std::string &outputFilename) const
+{
+  std::ofstream outputFile{outputFilename, std::ios::binary};
+  if (!outputFile.is_open())
+    throw std::runtime_error("Could not write heap trace " + outputFilename);
+
+  const std::vector<SymbolMap::Function> &functions{symbols.getFunctions()};
+  outputFile.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  writeU16(outputFile, TRACE_VERSION);
+  writeU16(outputFile, 0);
+  writeU32(outputFile, events.size());
+  writeU32(outputFile, functions.size());
+
+  uint64_t cycle{0};
+  for (const Event &event : events)
+  {
+    outputFile.put(!event.free         ? TRACE_ALLOC
+                   : event.size == 0 ? TRACE_INVALID_FREE
+                                     : TRACE_FREE);
+    writeVarint(outputFile, event.cycle - cycle);
+    writeU16(outputFile, event.address);
+    writeU16(outputFile, event.size);
+    writeVarint(outputFile, event.site + 1);
+    cycle = event.cycle;
+  }
+
+  for (const SymbolMap::Function &function : functions)
+  {
+    writeU16(outputFile, function.name.size());
+    outputFile.write(function.name.data(), function.name.size());
+  }
+  if (!outputFile)
+    throw std::runtime_error("Could not write heap trace " + outputFilename);
+}
+
+std::string HeapProfiler::siteName(int site) const
+{
+  return site == UNKNOWN_SITE ? "(unknown)"
+                              : symbols.getFunctions()[site].name;
+}
+
+// Power of two buckets: 0-1, 2-3, 4-7, ...
+static int histogramBucket(uint16_t size)
+{
+  int bucket{0};
+  while (size >> (bucket + 1))
+    ++bucket;
+  return bucket;
+}
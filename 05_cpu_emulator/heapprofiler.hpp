@@ -0,0 +1,78 @@
+#ifndef HEAP_PROFILER_HPP
+#define HEAP_PROFILER_HPP
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "cpu.hpp"
+#include "jit.hpp"
+#include "symbolmap.hpp"
+
+// Follows the Jack OS heap by trapping the entry points of Memory.alloc and
+// Memory.deAlloc and the return jumps of Memory.alloc. Every block is
+// attributed to the function that called Memory.alloc.
+class HeapProfiler
+{
+public:
+  static constexpr int UNKNOWN_SITE{-1};
+
+  struct Event
+  {
+    uint64_t cycle;
+    uint16_t address;
+    // Words requested; 0 for a free of an address that is not allocated
+    uint16_t size;
+    // Function index in the symbol map, or UNKNOWN_SITE
+    int site;
+    bool free;
+    // Heap state right after the event: allocated words, and the words
+    // from the lowest to the end of the highest allocated block
+    uint32_t liveWords;
+    uint32_t span;
+  };
+
+  HeapProfiler(const std::vector<uint16_t> &rom, SymbolMap symbols);
+  const std::vector<int> &getTraps() const;
+  uint64_t run(Cpu &cpu, Jit *jit, uint64_t maxCycles);
+  const std::vector<Event> &getEvents() const;
+  size_t getLiveBlockCount() const;
+  uint32_t getPeakWords() const;
+  void print(std::ostream &os) const;
+  void writeTrace(const std::string &outputFilename) const;
+
+private:
+  struct Block
+  {
+    uint16_t size;
+    int site;
+  };
+
+  // A Memory.alloc call waiting for its return
+  struct PendingAlloc
+  {
+    uint16_t size;
+    int site;
+  };
+
+  void trap(const Cpu &cpu);
+  int callSite(const Cpu &cpu) const;
+  void record(uint64_t cycle, uint16_t address, uint16_t size, int site,
+              bool free);
+  std::string siteName(int site) const;
+
+  SymbolMap symbols;
+  std::vector<int> traps;
+  int allocEntry;
+  int deAllocEntry;
+  std::vector<PendingAlloc> pending;
+  std::map<uint16_t, Block> live;
+  std::vector<Event> events;
+  uint32_t liveWords;
+  uint32_t peakWords;
+  size_t peakBlocks;
+  uint64_t peakCycle;
+};
+
+#endif
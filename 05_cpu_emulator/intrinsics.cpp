@@ -0,0 +1,120 @@
+#include "intrinsics.hpp"
+#include <algorithm>
+#include <cstring>
+#include "cpu.hpp"
+
+// Instructions in the VM translator's return sequence, which every
+// intrinsic replays exactly
+const uint64_t RETURN_CYCLES{55};
+
+struct Intrinsic
+{
+  const char *name;
+  INTRINSICS intrinsic;
+  // Modeled cost of the body: roughly what a plain Jack implementation
+  // executes, so timings stay in proportion
+  uint64_t cycles;
+};
+
+// In INTRINSICS order
+static const Intrinsic INTRINSIC_TABLE[]{
+    {"Math.abs", MATH_ABS, 40},
+    {"Math.multiply", MATH_MULTIPLY, 1200},
+    {"Math.divide", MATH_DIVIDE, 1500},
+    {"Math.min", MATH_MIN, 50},
+    {"Math.max", MATH_MAX, 50},
+    {"Math.sqrt", MATH_SQRT, 2500},
+    {"Memory.peek", MEMORY_PEEK, 30},
+    {"Memory.poke", MEMORY_POKE, 40},
+    {"Screen.clearScreen", SCREEN_CLEAR_SCREEN, 8192 * 40}};
+
+// Entry point and intrinsic of every function in the symbol map that has
+// one
+std::vector<std::pair<int, uint8_t>> findIntrinsics(const SymbolMap &symbols)
+{
+  std::vector<std::pair<int, uint8_t>> intrinsics;
+  for (const SymbolMap::Function &function : symbols.getFunctions())
+    for (const Intrinsic &intrinsic : INTRINSIC_TABLE)
+      if (function.name == intrinsic.name && function.start < function.end)
+        intrinsics.emplace_back(function.start, intrinsic.intrinsic);
+  return intrinsics;
+}
+
+// Runs an intrinsic with pc at its function's entry point, right after the
+// call: computes the result from the arguments, then replays the return
+// sequence, leaving RAM up to SP, R13, R14, A, D and pc exactly as the VM
+// code would. RAM above SP, where the function's locals and working stack
+// would have been, is left as the call left it. Returns the modeled cycles,
+// or 0 without doing anything when they exceed maxCycles or the arguments
+// make the VM code call Sys.error, so the VM code runs instead.
+uint64_t callIntrinsic(uint8_t intrinsic, uint16_t *ram, uint8_t *dirtyRows,
+                       uint16_t &pc, uint16_t &a, uint16_t &d,
+                       uint64_t maxCycles)
+{
+  if (intrinsic == NO_INTRINSIC ||
+      intrinsic > sizeof(INTRINSIC_TABLE) / sizeof(INTRINSIC_TABLE[0]))
+    return 0;
+  const uint64_t cycles{INTRINSIC_TABLE[intrinsic - 1].cycles +
+                        RETURN_CYCLES};
+  if (cycles > maxCycles)
+    return 0;
+
+  const uint16_t arguments{ram[Cpu::ARG]};
+  const int16_t x = ram[arguments & Cpu::ADDRESS_MASK];
+  const int16_t y = ram[(arguments + 1) & Cpu::ADDRESS_MASK];
+  int16_t result{0};
+  switch (intrinsic)
+  {
+  case MATH_ABS:
+    result = x < 0 ? -x : x;
+    break;
+  case MATH_MULTIPLY:
+    result = static_cast<int16_t>(x * y);
+    break;
+  case MATH_DIVIDE:
+    // Division by zero is an OS error, and -32768 has no absolute value for
+    // the usual implementations to divide
+    if (y == 0 || x == INT16_MIN || y == INT16_MIN)
+      return 0;
+    result = x / y;
+    break;
+  case MATH_MIN:
+    result = std::min(x, y);
+    break;
+  case MATH_MAX:
+    result = std::max(x, y);
+    break;
+  case MATH_SQRT:
+    if (x < 0)
+      return 0;
+    while ((result + 1) * (result + 1) <= x)
+      ++result;
+    break;
+  case MEMORY_PEEK:
+    result = ram[x & Cpu::ADDRESS_MASK];
+    break;
+  case MEMORY_POKE:
+    Cpu::store(ram, dirtyRows, x & Cpu::ADDRESS_MASK, y);
+    break;
+  case SCREEN_CLEAR_SCREEN:
+    std::memset(ram + Cpu::SCREEN, 0, (Cpu::KEYBOARD - Cpu::SCREEN) * 2);
+    std::fill(dirtyRows, dirtyRows + Cpu::SCREEN_HEIGHT, 1);
+    break;
+  }
+
+  // The translator's return: R13 = LCL, R14 = return address, *ARG = result,
+  // SP = ARG + 1, then THAT, THIS, ARG and LCL from the frame
+  const uint16_t frame{ram[Cpu::LCL]};
+  ram[Cpu::R13] = frame;
+  ram[Cpu::R14] = ram[(frame - 5) & Cpu::ADDRESS_MASK];
+  Cpu::store(ram, dirtyRows, ram[Cpu::ARG] & Cpu::ADDRESS_MASK, result);
+  ram[Cpu::SP] = ram[Cpu::ARG] + 1;
+  ram[Cpu::THAT] = ram[(frame - 1) & Cpu::ADDRESS_MASK];
+  ram[Cpu::THIS] = ram[(frame - 2) & Cpu::ADDRESS_MASK];
+  ram[Cpu::ARG] = ram[(frame - 3) & Cpu::ADDRESS_MASK];
+  ram[Cpu::LCL] = ram[(frame - 4) & Cpu::ADDRESS_MASK];
+  a = ram[Cpu::R14];
+  d = ram[Cpu::LCL];
+  pc = a & Cpu::ADDRESS_MASK;
+  return cycles;
+}
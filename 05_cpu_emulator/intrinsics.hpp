@@ -0,0 +1,30 @@
+#ifndef INTRINSICS_HPP
+#define INTRINSICS_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "symbolmap.hpp"
+
+// Jack OS functions whose effects only depend on their arguments, which the
+// CPU runs natively at their entry points instead of their VM code
+enum INTRINSICS : uint8_t
+{
+  NO_INTRINSIC,
+  MATH_ABS,
+  MATH_MULTIPLY,
+  MATH_DIVIDE,
+  MATH_MIN,
+  MATH_MAX,
+  MATH_SQRT,
+  MEMORY_PEEK,
+  MEMORY_POKE,
+  SCREEN_CLEAR_SCREEN
+};
+
+std::vector<std::pair<int, uint8_t>> findIntrinsics(const SymbolMap &symbols);
+uint64_t callIntrinsic(uint8_t intrinsic, uint16_t *ram, uint8_t *dirtyRows,
+                       uint16_t &pc, uint16_t &a, uint16_t &d,
+                       uint64_t maxCycles);
+
+#endif
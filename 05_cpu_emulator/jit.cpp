@@ -0,0 +1,619 @@
+#include "jit.hpp"
+#include "alu.hpp"
+#include "intrinsics.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+/*
+Register assignment inside generated code:
+  rbx - RAM base       r12d - A        r14 - remaining cycle budget
+  rbp - block entries  r13d - D        r15 - State
+  eax - ALU output, ecx - ALU y operand, edx/esi - addresses
+A and D always hold zero extended 16-bit values.
+*/
+
+const size_t CODE_SIZE{32 << 20};
+const size_t MAX_BLOCK_LENGTH{256};
+// Upper bound on the code one block compiles to
+const size_t MAX_BLOCK_BYTES{256 + MAX_BLOCK_LENGTH * 128};
+const uint16_t ADDRESS_MASK{0x7FFF};
+
+enum EXITS : uint32_t
+{
+  // The budget does not cover the block at nextPc
+  EXIT_BUDGET,
+  // A chained jump to nextPc has not been linked yet
+  EXIT_LINK,
+  // A computed jump to a block that is not compiled yet
+  EXIT_INDIRECT,
+  EXIT_HALT,
+  // A loop back edge to nextPc counted down to zero
+  EXIT_LOOP,
+  // nextPc is an intrinsic's entry point
+  EXIT_INTRINSIC,
+  // nextPc is a trap
+  EXIT_TRAP
+};
+
+// Displacements for [r15 + disp8]
+const uint8_t RAM_OFFSET = offsetof(Jit::State, ram);
+const uint8_t ENTRIES_OFFSET = offsetof(Jit::State, entries);
+const uint8_t A_OFFSET = offsetof(Jit::State, a);
+const uint8_t D_OFFSET = offsetof(Jit::State, d);
+const uint8_t BUDGET_OFFSET = offsetof(Jit::State, budget);
+const uint8_t NEXT_PC_OFFSET = offsetof(Jit::State, nextPc);
+const uint8_t PATCH_SITE_OFFSET = offsetof(Jit::State, patchSite);
+const uint8_t DIRTY_ROWS_OFFSET = offsetof(Jit::State, dirtyRows);
+const uint8_t LOOP_COUNTDOWNS_OFFSET = offsetof(Jit::State, loopCountdowns);
+
+// Screen rows are found by shifting a screen address right
+static_assert(Cpu::SCREEN_ROW_WORDS == 1 << 5);
+
+// jcc rel32 second opcode byte for each jump field, valid after test ax, ax
+const uint8_t CONDITIONS[8]{0x00, 0x8F, 0x84, 0x8D, 0x8C, 0x85, 0x8E, 0x00};
+
+Jit::Jit(std::shared_ptr<const Program> program)
+    : program{std::move(program)}, code{nullptr}, capacity{0}, used{0},
+      enterStub{nullptr}, exitStub{nullptr},
+      entries(Program::ROM_SIZE, nullptr), blockCount{0}, flushCount{0}
+{
+#if JIT_SUPPORTED
+  void *mapping{mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("Could not map the JIT code buffer");
+  code = static_cast<uint8_t *>(mapping);
+  capacity = CODE_SIZE;
+  flush();
+#else
+  throw std::runtime_error("The JIT needs an x86-64 Linux host");
+#endif
+}
+
+Jit::~Jit()
+{
+#if JIT_SUPPORTED
+  if (code)
+    munmap(code, capacity);
+#endif
+}
+
+bool Jit::isSupported() { return JIT_SUPPORTED; }
+
+// Number of blocks compiled since the code buffer was last flushed
+size_t Jit::getBlockCount() const { return blockCount; }
+
+// Runs up to maxCycles instructions exactly like Cpu::run
+uint64_t Jit::run(Cpu &cpu, uint64_t maxCycles)
+{
+  if (&cpu.getProgram() != program.get())
+    throw std::invalid_argument("CPU runs a different program than the JIT");
+  if (cpu.halted)
+    return 0;
+
+  // Only the instruction a run starts with gets past a trap
+  uint64_t trapped{0};
+  if ((*program)[cpu.pc].op == Program::OP_TRAP && maxCycles > 0)
+  {
+    trapped = cpu.run(1);
+    maxCycles -= trapped;
+    if (cpu.halted)
+      return trapped;
+  }
+
+  State state{};
+  state.ram = cpu.ram;
+  state.entries = entries.data();
+  state.dirtyRows = cpu.dirtyRows.data();
+  state.loopCountdowns = cpu.loopCountdowns.data();
+  state.a = cpu.a;
+  state.d = cpu.d;
+  state.budget = std::min<uint64_t>(maxCycles,
+                                    std::numeric_limits<int64_t>::max());
+  const int64_t initialBudget{state.budget};
+
+  uint16_t pc{cpu.pc};
+  bool running{true};
+  bool atTrap{false};
+  while (running)
+  {
+    void *block{entry(pc)};
+    uint32_t (*enter)(State *, void *){
+        reinterpret_cast<uint32_t (*)(State *, void *)>(enterStub)};
+
+    switch (enter(&state, block))
+    {
+    case EXIT_BUDGET:
+      pc = state.nextPc;
+      running = false;
+      break;
+    case EXIT_LINK:
+    {
+      pc = state.nextPc;
+      // Patch the jump unless compiling the target flushed the code holding it
+      const size_t flushes{flushCount};
+      void *target{entry(pc)};
+      if (flushes == flushCount)
+        patchRel32(state.patchSite + 1, target);
+      break;
+    }
+    case EXIT_INDIRECT:
+      pc = state.nextPc;
+      break;
+    case EXIT_HALT:
+      pc = state.nextPc;
+      cpu.halted = true;
+      running = false;
+      break;
+    case EXIT_LOOP:
+      cpu.pc = state.nextPc;
+      cpu.a = state.a;
+      cpu.d = state.d;
+      state.budget -= cpu.fastForward(state.budget);
+      pc = cpu.pc;
+      state.a = cpu.a;
+      state.d = cpu.d;
+      running = !cpu.halted;
+      break;
+    case EXIT_TRAP:
+      pc = state.nextPc;
+      atTrap = true;
+      running = false;
+      break;
+    case EXIT_INTRINSIC:
+    {
+      pc = state.nextPc;
+      uint16_t a = state.a;
+      uint16_t d = state.d;
+      const uint64_t cost{callIntrinsic((*program)[pc].intrinsic, cpu.ram,
+                                        cpu.dirtyRows.data(), pc, a, d,
+                                        state.budget)};
+      state.a = a;
+      state.d = d;
+      state.budget -= cost;
+      // Declined when the budget is short or the arguments are an OS error:
+      // the interpreter runs the function's code for the rest of the budget
+      running = cost != 0;
+      break;
+    }
+    }
+  }
+
+  cpu.pc = pc;
+  cpu.a = state.a;
+  cpu.d = state.d;
+  uint64_t executed = initialBudget - state.budget;
+  cpu.cycles += executed;
+
+  // Fewer cycles are left than the next block holds
+  if (!cpu.halted && !atTrap && state.budget > 0)
+    executed += cpu.run(state.budget);
+  return executed + trapped;
+}
+
+void Jit::reserve(size_t bytes)
+{
+  if (used + bytes > capacity)
+    flush();
+}
+
+// Throws every block away and starts over with only the entry and exit stubs
+void Jit::flush()
+{
+  used = 0;
+  std::fill(entries.begin(), entries.end(), nullptr);
+  blockCount = 0;
+  ++flushCount;
+
+  // uint32_t enter(State *state, void *block)
+  enterStub = position();
+  emit({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+  emit({0x49, 0x89, 0xFF});                   // mov r15, rdi
+  emit({0x49, 0x8B, 0x5F, RAM_OFFSET});       // mov rbx, [r15 + ram]
+  emit({0x49, 0x8B, 0x6F, ENTRIES_OFFSET});   // mov rbp, [r15 + entries]
+  emit({0x45, 0x8B, 0x67, A_OFFSET});         // mov r12d, [r15 + a]
+  emit({0x45, 0x8B, 0x6F, D_OFFSET});         // mov r13d, [r15 + d]
+  emit({0x4D, 0x8B, 0x77, BUDGET_OFFSET});    // mov r14, [r15 + budget]
+  emit({0xFF, 0xE6});                         // jmp rsi
+
+  // Blocks jump here with the exit reason in eax
+  exitStub = position();
+  emit({0x45, 0x89, 0x67, A_OFFSET});         // mov [r15 + a], r12d
+  emit({0x45, 0x89, 0x6F, D_OFFSET});         // mov [r15 + d], r13d
+  emit({0x4D, 0x89, 0x77, BUDGET_OFFSET});    // mov [r15 + budget], r14
+  emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3});
+}
+
+void *Jit::entry(uint16_t pc)
+{
+  if (!entries[pc])
+    return compile(pc);
+  return entries[pc];
+}
+
+// A block runs from pc up to and including the first instruction that can
+// jump, so it always executes all of its instructions
+void *Jit::compile(uint16_t pc)
+{
+  reserve(MAX_BLOCK_BYTES);
+  const Program &rom{*program};
+
+  // Intrinsics leave the generated code to run natively, traps to stop
+  if (rom[pc].op == Program::OP_INTRINSIC || rom[pc].op == Program::OP_TRAP)
+  {
+    uint8_t *start{position()};
+    compileExit(pc, rom[pc].op == Program::OP_TRAP ? EXIT_TRAP
+                                                   : EXIT_INTRINSIC);
+    entries[pc] = start;
+    ++blockCount;
+    return start;
+  }
+
+  size_t length{0};
+  bool endsInJump{false};
+  for (uint16_t address = pc;; address++)
+  {
+    const Program::Instruction &instruction{rom[address]};
+    ++length;
+    if (!(instruction.flags & Program::A_INSTRUCTION) && instruction.jump)
+    {
+      endsInJump = true;
+      break;
+    }
+    if (length == MAX_BLOCK_LENGTH || address == ADDRESS_MASK ||
+        rom[address + 1].op == Program::OP_INTRINSIC ||
+        rom[address + 1].op == Program::OP_TRAP)
+      break;
+  }
+
+  uint8_t *start{position()};
+
+  // cmp r14, length; jge body; exit; body: sub r14, length
+  emit({0x49, 0x81, 0xFE});
+  emit32(length);
+  emit({0x0F, 0x8D});
+  uint8_t *bodyField{position()};
+  emit32(0);
+  compileExit(pc, EXIT_BUDGET);
+  patchRel32(bodyField, position());
+  emit({0x49, 0x81, 0xEE});
+  emit32(length);
+
+  // A is tracked while it holds a constant, which turns M accesses into
+  // fixed addresses and jumps into chained branches
+  bool aKnown{false};
+  uint16_t aValue{0};
+  for (size_t i = 0; i < length; i++)
+  {
+    const uint16_t address = pc + i;
+    const Program::Instruction &instruction{rom[address]};
+
+    if (instruction.flags & Program::A_INSTRUCTION)
+    {
+      emit({0x41, 0xBC}); // mov r12d, constant
+      emit32(instruction.constant);
+      aKnown = true;
+      aValue = instruction.constant;
+    }
+    else if (instruction.jump)
+      compileJump(instruction, address, aKnown, aValue);
+    else
+    {
+      compileC(instruction, aKnown, aValue);
+      if (instruction.flags & Program::DEST_A)
+        aKnown = false;
+    }
+  }
+
+  if (!endsInJump)
+    compileChain((pc + length) & ADDRESS_MASK);
+
+  entries[pc] = start;
+  ++blockCount;
+  return start;
+}
+
+// Computes the ALU output into eax and stores it to the destinations
+void Jit::compileC(const Program::Instruction &instruction, bool aKnown,
+                   uint16_t aValue)
+{
+  const uint16_t address = aValue & ADDRESS_MASK;
+  const int bits{instruction.alu};
+  const bool usesY{!(bits & 0x08)};
+
+  if (usesY && (instruction.flags & Program::USE_M))
+  {
+    if (aKnown)
+    {
+      emit({0x0F, 0xB7, 0x8B}); // movzx ecx, word [rbx + address * 2]
+      emit32(address * 2);
+    }
+    else
+    {
+      emit({0x44, 0x89, 0xE2}); // mov edx, r12d
+      emit({0x81, 0xE2});       // and edx, ADDRESS_MASK
+      emit32(ADDRESS_MASK);
+      emit({0x0F, 0xB7, 0x0C, 0x53}); // movzx ecx, word [rbx + rdx * 2]
+    }
+  }
+  else if (usesY)
+    emit({0x44, 0x89, 0xE1}); // mov ecx, r12d
+
+  // The 18 computations of the Hack spec map to one or two host
+  // instructions, anything else goes through the generic mask formula
+  switch (bits)
+  {
+  case 0x2A: // 0
+    emit({0x31, 0xC0});
+    break;
+  case 0x3F: // 1
+    emit({0xB8});
+    emit32(1);
+    break;
+  case 0x3A: // -1
+    emit({0xB8});
+    emit32(0xFFFF);
+    break;
+  case 0x0C: // D
+    emit({0x44, 0x89, 0xE8});
+    break;
+  case 0x30: // A, M
+    emit({0x89, 0xC8});
+    break;
+  case 0x0D: // !D
+    emit({0x44, 0x89, 0xE8, 0xF7, 0xD0});
+    break;
+  case 0x31: // !A, !M
+    emit({0x89, 0xC8, 0xF7, 0xD0});
+    break;
+  case 0x0F: // -D
+    emit({0x44, 0x89, 0xE8, 0xF7, 0xD8});
+    break;
+  case 0x33: // -A, -M
+    emit({0x89, 0xC8, 0xF7, 0xD8});
+    break;
+  case 0x1F: // D+1
+    emit({0x41, 0x8D, 0x45, 0x01});
+    break;
+  case 0x37: // A+1, M+1
+    emit({0x8D, 0x41, 0x01});
+    break;
+  case 0x0E: // D-1
+    emit({0x41, 0x8D, 0x45, 0xFF});
+    break;
+  case 0x32: // A-1, M-1
+    emit({0x8D, 0x41, 0xFF});
+    break;
+  case 0x02: // D+A, D+M
+    emit({0x41, 0x8D, 0x44, 0x0D, 0x00});
+    break;
+  case 0x13: // D-A, D-M
+    emit({0x44, 0x89, 0xE8, 0x29, 0xC8});
+    break;
+  case 0x07: // A-D, M-D
+    emit({0x89, 0xC8, 0x44, 0x29, 0xE8});
+    break;
+  case 0x00: // D&A, D&M
+    emit({0x44, 0x89, 0xE8, 0x21, 0xC8});
+    break;
+  case 0x15: // D|A, D|M
+    emit({0x44, 0x89, 0xE8, 0x09, 0xC8});
+    break;
+  default:
+  {
+    const AluControl &control{ALU_TABLE[bits]};
+    emit({0x44, 0x89, 0xE8}); // mov eax, r13d
+    emit({0x25});             // and eax, xAnd
+    emit32(control.xAnd);
+    emit({0x35}); // xor eax, xXor
+    emit32(control.xXor);
+    emit({0x89, 0xCA}); // mov edx, ecx
+    emit({0x81, 0xE2}); // and edx, yAnd
+    emit32(control.yAnd);
+    emit({0x81, 0xF2}); // xor edx, yXor
+    emit32(control.yXor);
+    if (control.add)
+      emit({0x01, 0xD0}); // add eax, edx
+    else
+      emit({0x21, 0xD0}); // and eax, edx
+    emit({0x35});         // xor eax, outXor
+    emit32(control.outXor);
+    break;
+  }
+  }
+  emit({0x0F, 0xB7, 0xC0}); // movzx eax, ax
+
+  // M is written at A's value from before the instruction
+  if (instruction.flags & Program::DEST_M)
+  {
+    if (aKnown)
+    {
+      if (address < Cpu::KEYBOARD)
+      {
+        emit({0x66, 0x89, 0x83}); // mov [rbx + address * 2], ax
+        emit32(address * 2);
+      }
+      if (address >= Cpu::SCREEN && address < Cpu::KEYBOARD)
+      {
+        emit({0x49, 0x8B, 0x57, DIRTY_ROWS_OFFSET}); // mov rdx, [dirtyRows]
+        emit({0xC6, 0x82});                          // mov byte [rdx + row], 1
+        emit32((address - Cpu::SCREEN) / Cpu::SCREEN_ROW_WORDS);
+        emit({0x01});
+      }
+    }
+    else
+    {
+      emit({0x44, 0x89, 0xE2}); // mov edx, r12d
+      emit({0x81, 0xE2});       // and edx, ADDRESS_MASK
+      emit32(ADDRESS_MASK);
+      emit({0x81, 0xFA}); // cmp edx, KEYBOARD
+      emit32(Cpu::KEYBOARD);
+      emit({0x73, 0x1A});             // jae past the store
+      emit({0x66, 0x89, 0x04, 0x53}); // mov [rbx + rdx * 2], ax
+      emit({0x81, 0xFA});             // cmp edx, SCREEN
+      emit32(Cpu::SCREEN);
+      emit({0x72, 0x0E});                          // jb past the dirty flag
+      emit({0xC1, 0xEA, 0x05});                    // shr edx, 5
+      emit({0x49, 0x03, 0x57, DIRTY_ROWS_OFFSET}); // add rdx, [dirtyRows]
+      emit({0xC6, 0x82});                          // mov byte [rdx - 0x200], 1
+      emit32(static_cast<uint32_t>(-(Cpu::SCREEN / Cpu::SCREEN_ROW_WORDS)));
+      emit({0x01});
+    }
+  }
+  if (instruction.flags & Program::DEST_D)
+    emit({0x41, 0x89, 0xC5}); // mov r13d, eax
+  if (instruction.flags & Program::DEST_A)
+    emit({0x41, 0x89, 0xC4}); // mov r12d, eax
+}
+
+// Ends a block: falls through to pc + 1 when the jump is not taken, and
+// goes to A's value from before the instruction when it is
+void Jit::compileJump(const Program::Instruction &instruction, uint16_t pc,
+                      bool aKnown, uint16_t aValue)
+{
+  const uint16_t target = aValue & ADDRESS_MASK;
+  if (!aKnown)
+  {
+    emit({0x44, 0x89, 0xE6}); // mov esi, r12d
+    emit({0x81, 0xE6});       // and esi, ADDRESS_MASK
+    emit32(ADDRESS_MASK);
+  }
+
+  compileC(instruction, aKnown, aValue);
+
+  if (instruction.jump != (Program::JUMP_GT | Program::JUMP_EQ |
+                           Program::JUMP_LT))
+  {
+    emit({0x66, 0x85, 0xC0}); // test ax, ax
+    emit({0x0F, CONDITIONS[instruction.jump]});
+    uint8_t *takenField{position()};
+    emit32(0);
+    compileChain((pc + 1) & ADDRESS_MASK);
+    patchRel32(takenField, position());
+  }
+
+  if (instruction.flags & Program::HALT_LOOP)
+  {
+    if (aKnown && target == pc - 1)
+    {
+      compileExit(target, EXIT_HALT);
+      return;
+    }
+    if (!aKnown)
+    {
+      emit({0x81, 0xFE}); // cmp esi, pc - 1
+      emit32(pc - 1);
+      emit({0x75, 0x00}); // jne past the exit
+      uint8_t *skipField{position() - 1};
+      compileExit(pc - 1, EXIT_HALT);
+      *skipField = position() - (skipField + 1);
+    }
+  }
+
+  // Same countdown as the interpreter's, in the Cpu's array
+  if ((instruction.flags & Program::LOOP_EDGE) && aKnown && target < pc)
+  {
+    emit({0x49, 0x8B, 0x57, LOOP_COUNTDOWNS_OFFSET}); // mov rdx, [countdowns]
+    emit({0x66, 0x83, 0xAA}); // sub word [rdx + target * 2], 1
+    emit32(target * 2);
+    emit({0x01});
+    emit({0x75, 0x00}); // jnz past the exit
+    uint8_t *skipField{position() - 1};
+    compileExit(target, EXIT_LOOP);
+    *skipField = position() - (skipField + 1);
+  }
+
+  if (aKnown)
+    compileChain(target);
+  else
+    compileIndirect();
+}
+
+// Jumps to target's block, through a stub that asks run() to compile and
+// link it when it does not exist yet
+void Jit::compileChain(uint16_t target)
+{
+  if (entries[target])
+  {
+    jumpTo(entries[target]);
+    return;
+  }
+
+  // Until it is patched the jump lands on the stub right after it
+  uint8_t *site{position()};
+  jumpTo(site + 5);
+  emit({0x41, 0xC7, 0x47, NEXT_PC_OFFSET}); // mov [r15 + nextPc], target
+  emit32(target);
+  emit({0x48, 0xB8}); // mov rax, site
+  emit64(reinterpret_cast<uint64_t>(site));
+  emit({0x49, 0x89, 0x47, PATCH_SITE_OFFSET}); // mov [r15 + patchSite], rax
+  emit({0xB8});                                // mov eax, EXIT_LINK
+  emit32(EXIT_LINK);
+  jumpTo(exitStub);
+}
+
+// Looks the block up at run time for targets only known then (esi)
+void Jit::compileIndirect()
+{
+  emit({0x48, 0x8B, 0x44, 0xF5, 0x00}); // mov rax, [rbp + rsi * 8]
+  emit({0x48, 0x85, 0xC0});             // test rax, rax
+  emit({0x74, 0x02});                   // jz past the jump
+  emit({0xFF, 0xE0});                   // jmp rax
+  emit({0x41, 0x89, 0x77, NEXT_PC_OFFSET}); // mov [r15 + nextPc], esi
+  emit({0xB8});                             // mov eax, EXIT_INDIRECT
+  emit32(EXIT_INDIRECT);
+  jumpTo(exitStub);
+}
+
+void Jit::compileExit(uint16_t nextPc, uint32_t reason)
+{
+  emit({0x41, 0xC7, 0x47, NEXT_PC_OFFSET}); // mov [r15 + nextPc], nextPc
+  emit32(nextPc);
+  emit({0xB8}); // mov eax, reason
+  emit32(reason);
+  jumpTo(exitStub);
+}
+
+void Jit::jumpTo(const void *target)
+{
+  emit({0xE9});
+  uint8_t *field{position()};
+  emit32(0);
+  patchRel32(field, target);
+}
+
+void Jit::patchRel32(uint8_t *field, const void *target)
+{
+  const int32_t offset = static_cast<const uint8_t *>(target) - (field + 4);
+  std::memcpy(field, &offset, sizeof(offset));
+}
+
+void Jit::emit(std::initializer_list<uint8_t> bytes)
+{
+  for (uint8_t byte : bytes)
+    code[used++] = byte;
+}
+
+void Jit::emit32(uint32_t value)
+{
+  std::memcpy(code + used, &value, sizeof(value));
+  used += sizeof(value);
+}
+
+void Jit::emit64(uint64_t value)
+{
+  std::memcpy(code + used, &value, sizeof(value));
+  used += sizeof(value);
+}
+
+uint8_t *Jit::position() const { return code + used; }
@@ -0,0 +1,75 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+#include "cpu.hpp"
+#include "program.hpp"
+
+// Translates a Program's basic blocks to x86-64 code on first use and runs
+// them, keeping A, D and the cycle budget in host registers. Blocks that end
+// in a jump with a known target are chained straight to each other. Whatever
+// a block cannot finish exactly (a budget smaller than the block) is left to
+// the Cpu's interpreter, and so are loops the Cpu can fast forward.
+class Jit
+{
+public:
+  // Register state shared with the generated code; offsets are baked into it
+  struct State
+  {
+    uint16_t *ram;
+    void **entries;
+    uint32_t a;
+    uint32_t d;
+    int64_t budget;
+    uint32_t nextPc;
+    uint32_t padding;
+    uint8_t *patchSite;
+    uint8_t *dirtyRows;
+    uint16_t *loopCountdowns;
+  };
+
+  Jit(std::shared_ptr<const Program> program);
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+  ~Jit();
+  uint64_t run(Cpu &cpu, uint64_t maxCycles);
+  size_t getBlockCount() const;
+
+  static bool isSupported();
+
+private:
+  void reserve(size_t bytes);
+  void flush();
+  void *compile(uint16_t pc);
+  void *entry(uint16_t pc);
+  void compileC(const Program::Instruction &instruction, bool aKnown,
+                uint16_t aValue);
+  void compileJump(const Program::Instruction &instruction, uint16_t pc,
+                   bool aKnown, uint16_t aValue);
+  void compileChain(uint16_t target);
+  void compileExit(uint16_t nextPc, uint32_t reason);
+  void compileIndirect();
+  void jumpTo(const void *target);
+  void patchRel32(uint8_t *field, const void *target);
+
+  void emit(std::initializer_list<uint8_t> bytes);
+  void emit32(uint32_t value);
+  void emit64(uint64_t value);
+  uint8_t *position() const;
+
+  std::shared_ptr<const Program> program;
+  uint8_t *code;
+  size_t capacity;
+  size_t used;
+  uint8_t *enterStub;
+  uint8_t *exitStub;
+  std::vector<void *> entries;
+  size_t blockCount;
+  size_t flushCount;
+};
+
+#endif
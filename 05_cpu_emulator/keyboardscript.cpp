@@ -0,0 +1,114 @@
+#include "keyboardscript.hpp"
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+// The codes of 12/Keyboard.jack's special keys
+static const std::unordered_map<std::string, uint16_t> KEY_NAMES{
+    {"NONE", 0},        {"SPACE", ' '},      {"NEWLINE", 128},
+    {"BACKSPACE", 129}, {"LEFT", 130},       {"UP", 131},
+    {"RIGHT", 132},     {"DOWN", 133},       {"HOME", 134},
+    {"END", 135},       {"PAGEUP", 136},     {"PAGEDOWN", 137},
+    {"INSERT", 138},    {"DELETE", 139},     {"ESC", 140},
+    {"F1", 141},        {"F2", 142},         {"F3", 143},
+    {"F4", 144},        {"F5", 145},         {"F6", 146},
+    {"F7", 147},        {"F8", 148},         {"F9", 149},
+    {"F10", 150},       {"F11", 151},        {"F12", 152}};
+
+KeyboardScript::KeyboardScript() : events{}, next{0} {}
+
+// Events must be added in cycle order. A key stays in the register until the
+// next event, so releasing it is an event with key 0.
+void KeyboardScript::addEvent(uint64_t cycle, uint16_t key)
+{
+  if (!events.empty() && cycle < events.back().cycle)
+    throw std::invalid_argument("Keyboard events must be in cycle order");
+  events.push_back({cycle, key});
+}
+
+// Writes every event due by the Cpu's cycle count to the keyboard register.
+// Running the Cpu no further than getNextCycle() between calls makes every
+// key arrive exactly at its cycle.
+void KeyboardScript::apply(Cpu &cpu)
+{
+  while (next < events.size() && events[next].cycle <= cpu.getCycles())
+    cpu.poke(Cpu::KEYBOARD, events[next++].key);
+}
+
+// Cycle of the next event that is not applied yet, or the largest cycle count
+// if there is none
+uint64_t KeyboardScript::getNextCycle() const
+{
+  return next < events.size() ? events[next].cycle
+                              : std::numeric_limits<uint64_t>::max();
+}
+
+const std::vector<KeyboardScript::Event> &KeyboardScript::getEvents() const
+{
+  return events;
+}
+
+// Reads "cycle key" lines, where cycle is absolute or "+N" after the previous
+// event, and key is a code, a quoted character or a special key's name.
+// Lines starting with '#' are comments.
+KeyboardScript KeyboardScript::parse(std::istream &is)
+{
+  KeyboardScript script{};
+  uint64_t previous{0};
+  std::string line;
+  while (std::getline(is, line))
+  {
+    std::istringstream fields{line};
+    std::string cycle, key;
+    if (!(fields >> cycle) || cycle[0] == '#')
+      continue;
+    if (!(fields >> key) || cycle == "+")
+      throw std::runtime_error("Invalid keyboard script line '" + line + "'");
+
+    try
+    {
+      previous = cycle[0] == '+' ? previous + std::stoull(cycle.substr(1))
+                                 : std::stoull(cycle);
+    }
+    catch (const std::logic_error &)
+    {
+      throw std::runtime_error("Invalid keyboard script line '" + line + "'");
+    }
+    script.addEvent(previous, parseKey(key));
+  }
+  return script;
+}
+
+KeyboardScript KeyboardScript::read(const std::string &inputFilename)
+{
+  std::ifstream inputFile{inputFilename};
+  if (!inputFile.is_open())
+    throw std::runtime_error("Invalid keyboard script " + inputFilename);
+  return parse(inputFile);
+}
+
+uint16_t KeyboardScript::parseKey(const std::string &key)
+{
+  if (key.size() == 3 && key.front() == '\'' && key.back() == '\'')
+    return static_cast<unsigned char>(key[1]);
+
+  const std::unordered_map<std::string, uint16_t>::const_iterator name{
+      KEY_NAMES.find(key)};
+  if (name != KEY_NAMES.end())
+    return name->second;
+
+  size_t end{0};
+  int code{-1};
+  try
+  {
+    code = std::stoi(key, &end);
+  }
+  catch (const std::logic_error &)
+  {
+  }
+  if (end != key.size() || code < 0 || code > 0xFFFF)
+    throw std::runtime_error("Invalid key '" + key + "'");
+  return code;
+}
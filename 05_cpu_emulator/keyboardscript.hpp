@@ -0,0 +1,37 @@
+#ifndef KEYBOARD_SCRIPT_HPP
+#define KEYBOARD_SCRIPT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+#include "cpu.hpp"
+
+// Key presses replayed into the keyboard register at exact cycle counts, so
+// interactive programs run the same way every time
+class KeyboardScript
+{
+public:
+  struct Event
+  {
+    uint64_t cycle;
+    uint16_t key;
+  };
+
+  KeyboardScript();
+  void addEvent(uint64_t cycle, uint16_t key);
+  void apply(Cpu &cpu);
+  uint64_t getNextCycle() const;
+  const std::vector<Event> &getEvents() const;
+
+  static KeyboardScript parse(std::istream &is);
+  static KeyboardScript read(const std::string &inputFilename);
+  static uint16_t parseKey(const std::string &key);
+
+private:
+  std::vector<Event> events;
+  size_t next;
+};
+
+#endif
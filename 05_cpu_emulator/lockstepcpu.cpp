@@ -0,0 +1,289 @@
+#include "lockstepcpu.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "alu.hpp"
+#include "cpu.hpp"
+
+const uint16_t ADDRESS_MASK{0x7FFF};
+
+// runLanes is compiled for AVX-512, AVX2 and plain x86-64, and the loader
+// picks the widest the host supports
+#if defined(__x86_64__)
+#define LANE_CLONES                                                            \
+  __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define LANE_CLONES
+#endif
+
+template <int LANES>
+struct Lanes
+{
+  // One word per lane. Comparisons give -1 in the lanes where they hold.
+  typedef int16_t Vector __attribute__((vector_size(LANES * 2)));
+};
+
+LockstepCpu::LockstepCpu(std::shared_ptr<const Program> program, int lanes)
+    : program{std::move(program)}, lanes{lanes}, ram{}, pcs{}, as{}, ds{},
+      cycles{}, halted{}, groupCount{0}
+{
+  if (lanes != 8 && lanes != 16 && lanes != 32)
+    throw std::invalid_argument("Lockstep lanes must be 8, 16 or 32");
+  reset();
+}
+
+void LockstepCpu::reset()
+{
+  ram.assign(Cpu::RAM_SIZE * lanes, 0);
+  pcs.assign(lanes, 0);
+  as.assign(lanes, 0);
+  ds.assign(lanes, 0);
+  cycles.assign(lanes, 0);
+  halted.assign(lanes, 0);
+  groupCount = 0;
+}
+
+// Runs every lane for up to maxCycles more instructions or until it halts.
+// Returns the instructions executed over all lanes.
+uint64_t LockstepCpu::run(uint64_t maxCycles)
+{
+  switch (lanes)
+  {
+  case 8:
+    return runLanes<8>(maxCycles);
+  case 16:
+    return runLanes<16>(maxCycles);
+  default:
+    return runLanes<32>(maxCycles);
+  }
+}
+
+int LockstepCpu::getLaneCount() const { return lanes; }
+
+size_t LockstepCpu::getHaltedCount() const
+{
+  return std::count(halted.begin(), halted.end(), 1);
+}
+
+uint64_t LockstepCpu::getGroupCount() const { return groupCount; }
+
+bool LockstepCpu::isHalted(int lane) const { return halted.at(lane); }
+
+uint16_t LockstepCpu::getPc(int lane) const { return pcs.at(lane); }
+
+uint16_t LockstepCpu::getA(int lane) const { return as.at(lane); }
+
+uint16_t LockstepCpu::getD(int lane) const { return ds.at(lane); }
+
+uint64_t LockstepCpu::getCycles(int lane) const { return cycles.at(lane); }
+
+uint16_t LockstepCpu::peek(int lane, uint16_t address) const
+{
+  return ram[wordIndex(lane, address)];
+}
+
+void LockstepCpu::poke(int lane, uint16_t address, uint16_t value)
+{
+  ram[wordIndex(lane, address)] = value;
+}
+
+size_t LockstepCpu::wordIndex(int lane, uint16_t address) const
+{
+  if (lane < 0 || lane >= lanes)
+    throw std::out_of_range("No lane " + std::to_string(lane));
+  return (address & (Cpu::RAM_SIZE - 1)) * lanes + lane;
+}
+
+// Picks the lowest PC of the lanes still running and runs the lanes there as
+// a group, with every instruction applied to the group's lanes of A, D and
+// RAM under a mask. The group stays together while A, and so the jump
+// target, is the same in all its lanes; a jump only some of them take, a
+// computed jump to different targets or a halt ends it. While other lanes
+// wait, the group also ends when it reaches the next waiting lane's PC, so
+// the two join up, and after a taken jump, so lanes it jumped back past can
+// catch up. M is loaded and stored as one vector while the group's lanes
+// address the same word.
+template <int LANES>
+LANE_CLONES uint64_t LockstepCpu::runLanes(uint64_t maxCycles)
+{
+  using Vector = typename Lanes<LANES>::Vector;
+  const Program &rom{*program};
+  uint16_t *memory{ram.data()};
+  Vector a;
+  Vector d;
+  std::memcpy(&a, as.data(), sizeof(a));
+  std::memcpy(&d, ds.data(), sizeof(d));
+  uint64_t budgets[LANES];
+  std::fill(budgets, budgets + LANES, maxCycles);
+  uint64_t total{0};
+
+  while (true)
+  {
+    uint32_t running{0};
+    uint16_t pc{0xFFFF};
+    for (int lane = 0; lane < LANES; lane++)
+      if (!halted[lane] && budgets[lane] > 0)
+      {
+        running |= 1u << lane;
+        pc = std::min(pc, pcs[lane]);
+      }
+    if (!running)
+      break;
+
+    uint32_t active{0};
+    uint64_t steps{maxCycles};
+    Vector mask{};
+    for (int lane = 0; lane < LANES; lane++)
+      if (((running >> lane) & 1) && pcs[lane] == pc)
+      {
+        active |= 1u << lane;
+        steps = std::min(steps, budgets[lane]);
+        mask[lane] = -1;
+      }
+    const int first{__builtin_ctz(active)};
+    ++groupCount;
+    // Waiting lanes are all past pc, and the group only moves forward until
+    // it jumps
+    const bool waiting{running != active};
+    uint16_t joinPc{0xFFFF};
+    for (int lane = 0; lane < LANES; lane++)
+      if (((running & ~active) >> lane) & 1)
+        joinPc = std::min(joinPc, pcs[lane]);
+
+    uint64_t executed{0};
+    bool together{true};
+    while (together && executed < steps && pc != joinPc)
+    {
+      const Program::Instruction &instruction{rom[pc]};
+      ++executed;
+      if (instruction.flags & Program::A_INSTRUCTION)
+      {
+        const Vector constant = Vector{} + static_cast<int16_t>(
+                                               instruction.constant);
+        a = (mask & constant) | (~mask & a);
+        pc = (pc + 1) & ADDRESS_MASK;
+        continue;
+      }
+
+      // M and the jump target are at A's value from before the instruction
+      const Vector addresses = a & static_cast<int16_t>(ADDRESS_MASK);
+      const uint16_t address = addresses[first];
+      const Vector spread =
+          (addresses ^ (Vector{} + static_cast<int16_t>(address))) & mask;
+      uint64_t spreadWords[LANES / 4];
+      std::memcpy(spreadWords, &spread, sizeof(spread));
+      uint64_t differing{0};
+      for (uint64_t word : spreadWords)
+        differing |= word;
+      const bool uniform{differing == 0};
+
+      Vector y{a};
+      if (instruction.flags & Program::USE_M)
+      {
+        if (uniform)
+          std::memcpy(&y, memory + address * LANES, sizeof(y));
+        else
+          for (int lane = 0; lane < LANES; lane++)
+            y[lane] = memory[static_cast<uint16_t>(addresses[lane]) * LANES +
+                             lane];
+      }
+
+      const AluControl &control{ALU_TABLE[instruction.alu]};
+      const Vector x = (d & static_cast<int16_t>(control.xAnd)) ^
+                       static_cast<int16_t>(control.xXor);
+      y = (y & static_cast<int16_t>(control.yAnd)) ^
+          static_cast<int16_t>(control.yXor);
+      const Vector out =
+          (control.add ? x + y : x & y) ^ static_cast<int16_t>(control.outXor);
+
+      // Writes to the keyboard register and above are ignored
+      if (instruction.flags & Program::DEST_M)
+      {
+        if (uniform && address < Cpu::KEYBOARD)
+        {
+          Vector words;
+          std::memcpy(&words, memory + address * LANES, sizeof(words));
+          words = (mask & out) | (~mask & words);
+          std::memcpy(memory + address * LANES, &words, sizeof(words));
+        }
+        else if (!uniform)
+          for (int lane = 0; lane < LANES; lane++)
+          {
+            const uint16_t laneAddress = addresses[lane];
+            if (((active >> lane) & 1) && laneAddress < Cpu::KEYBOARD)
+              memory[laneAddress * LANES + lane] = out[lane];
+          }
+      }
+      if (instruction.flags & Program::DEST_A)
+        a = (mask & out) | (~mask & a);
+      if (instruction.flags & Program::DEST_D)
+        d = (mask & out) | (~mask & d);
+
+      const uint16_t next = (pc + 1) & ADDRESS_MASK;
+      if (!instruction.jump)
+      {
+        pc = next;
+        continue;
+      }
+
+      Vector taken{};
+      if (instruction.jump & Program::JUMP_LT)
+        taken |= out < 0;
+      if (instruction.jump & Program::JUMP_EQ)
+        taken |= out == 0;
+      if (instruction.jump & Program::JUMP_GT)
+        taken |= out > 0;
+      taken &= mask;
+      uint32_t takenLanes{0};
+      for (int lane = 0; lane < LANES; lane++)
+        if (taken[lane])
+          takenLanes |= 1u << lane;
+
+      const bool halts{(instruction.flags & Program::HALT_LOOP) &&
+                       address == pc - 1};
+      if (takenLanes == 0)
+        pc = next;
+      else if (takenLanes == active && uniform && !halts)
+      {
+        pc = address;
+        if (waiting)
+          break;
+      }
+      else
+      {
+        // The group splits up or halts, so every lane keeps its own PC
+        for (int lane = 0; lane < LANES; lane++)
+        {
+          if (!((active >> lane) & 1))
+            continue;
+          if (!((takenLanes >> lane) & 1))
+          {
+            pcs[lane] = next;
+            continue;
+          }
+          pcs[lane] = addresses[lane];
+          if ((instruction.flags & Program::HALT_LOOP) &&
+              pcs[lane] == pc - 1)
+            halted[lane] = 1;
+        }
+        together = false;
+      }
+    }
+
+    for (int lane = 0; lane < LANES; lane++)
+      if ((active >> lane) & 1)
+      {
+        if (together)
+          pcs[lane] = pc;
+        budgets[lane] -= executed;
+        cycles[lane] += executed;
+      }
+    total += executed * __builtin_popcount(active);
+  }
+
+  std::memcpy(as.data(), &a, sizeof(a));
+  std::memcpy(ds.data(), &d, sizeof(d));
+  return total;
+}
@@ -0,0 +1,51 @@
+#ifndef LOCKSTEP_CPU_HPP
+#define LOCKSTEP_CPU_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "program.hpp"
+
+// 8, 16 or 32 Hack computers running the same Program on their own RAM, one
+// per SIMD lane. The lanes at the lowest PC execute each instruction together
+// under a mask; lanes whose jumps went elsewhere wait until the others
+// arrive at their PC, so lanes re-converge wherever their paths meet.
+class LockstepCpu
+{
+public:
+  LockstepCpu(std::shared_ptr<const Program> program, int lanes);
+  void reset();
+  uint64_t run(uint64_t maxCycles);
+  int getLaneCount() const;
+  size_t getHaltedCount() const;
+  uint64_t getGroupCount() const;
+
+  bool isHalted(int lane) const;
+  uint16_t getPc(int lane) const;
+  uint16_t getA(int lane) const;
+  uint16_t getD(int lane) const;
+  uint64_t getCycles(int lane) const;
+  uint16_t peek(int lane, uint16_t address) const;
+  void poke(int lane, uint16_t address, uint16_t value);
+
+private:
+  template <int LANES>
+  uint64_t runLanes(uint64_t maxCycles);
+  size_t wordIndex(int lane, uint16_t address) const;
+
+  std::shared_ptr<const Program> program;
+  int lanes;
+  // Word address * lanes + lane, so the lanes' copies of a word form one
+  // vector
+  std::vector<uint16_t> ram;
+  std::vector<uint16_t> pcs;
+  std::vector<uint16_t> as;
+  std::vector<uint16_t> ds;
+  std::vector<uint64_t> cycles;
+  std::vector<uint8_t> halted;
+  // Times a set of lanes at the same PC started running together
+  uint64_t groupCount;
+};
+
+#endif
@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "batchrunner.hpp"
+#include "cpu.hpp"
+#include "framerenderer.hpp"
+#include "heapprofiler.hpp"
+#include "intrinsics.hpp"
+#include "jit.hpp"
+#include "keyboardscript.hpp"
+#include "lockstepcpu.hpp"
+#include "profiler.hpp"
+#include "rom.hpp"
+#include "snapshot.hpp"
+#include "tracereader.hpp"
+#include "tracewriter.hpp"
+
+const size_t HOT_LINE_COUNT{20};
+const uint64_t DEFAULT_FRAME_CYCLES{1000000};
+
+// RAM[address] = first + lane * step in every lockstep lane
+struct Sweep
+{
+  int address;
+  int first;
+  int step;
+};
+
+static void parseRange(const std::string &range, int &first, int &last);
+static Sweep parseSweep(const std::string &sweep);
+static void runLockstep(std::shared_ptr<const Program> program, int lanes,
+                        const std::vector<Sweep> &sweeps, uint64_t maxCycles,
+                        int dumpFirst, int dumpLast);
+static void parseCycleRange(const std::string &range, uint64_t &first,
+                            uint64_t &last);
+static void printTrace(const TraceReader &reader, uint64_t first,
+                       uint64_t last);
+static bool runBatch(const std::string &manifestPath, bool useJit,
+                     unsigned threads, const std::string &junitPath,
+                     const std::string &jsonPath);
+
+int main(int argc, const char *argv[])
+{
+  // Parse options
+  uint64_t maxCycles{std::numeric_limits<uint64_t>::max()};
+  int dumpFirst{0};
+  int dumpLast{-1};
+  bool fuse{true};
+  bool useJit{Jit::isSupported()};
+  bool fastForward{true};
+  bool useIntrinsics{true};
+  std::string intrinsicsPath;
+  std::string symbolPath;
+  std::string foldedPath;
+  std::string sourceMapPath;
+  std::string framesPath;
+  std::string keysPath;
+  std::string snapshotPath;
+  std::string saveSnapshotPath;
+  std::string heapPath;
+  std::string heapTracePath;
+  std::string tracePath;
+  bool showTrace{false};
+  uint64_t traceFirst{0};
+  uint64_t traceLast{0};
+  int lanes{0};
+  std::vector<Sweep> sweeps;
+  bool batch{false};
+  unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+  std::string junitPath;
+  std::string jsonPath;
+  uint64_t frameCycles{DEFAULT_FRAME_CYCLES};
+  FrameRenderer::IMAGE_FORMATS frameFormat{FrameRenderer::PPM_FORMAT};
+  std::string inputPath;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg{argv[i]};
+    if (arg == "--cycles" && i + 1 < argc)
+      maxCycles = std::stoull(argv[++i]);
+    else if (arg == "--no-jit")
+      useJit = false;
+    else if (arg == "--no-fusion")
+      fuse = false;
+    else if (arg == "--no-fast-forward")
+      fastForward = false;
+    else if (arg == "--sym" && i + 1 < argc)
+      intrinsicsPath = argv[++i];
+    else if (arg == "--no-intrinsics")
+      useIntrinsics = false;
+    else if (arg == "--profile" && i + 1 < argc)
+      symbolPath = argv[++i];
+    else if (arg == "--folded" && i + 1 < argc)
+      foldedPath = argv[++i];
+    else if (arg == "--source-map" && i + 1 < argc)
+      sourceMapPath = argv[++i];
+    else if (arg == "--snapshot" && i + 1 < argc)
+      snapshotPath = argv[++i];
+    else if (arg == "--save-snapshot" && i + 1 < argc)
+      saveSnapshotPath = argv[++i];
+    else if (arg == "--heap" && i + 1 < argc)
+      heapPath = argv[++i];
+    else if (arg == "--heap-trace" && i + 1 < argc)
+      heapTracePath = argv[++i];
+    else if (arg == "--trace" && i + 1 < argc)
+      tracePath = argv[++i];
+    else if (arg == "--show-trace" && i + 1 < argc)
+    {
+      showTrace = true;
+      parseCycleRange(argv[++i], traceFirst, traceLast);
+    }
+    else if (arg == "--lanes" && i + 1 < argc)
+      lanes = std::stoi(argv[++i]);
+    else if (arg == "--sweep" && i + 1 < argc)
+      sweeps.push_back(parseSweep(argv[++i]));
+    else if (arg == "--batch")
+      batch = true;
+    else if (arg == "--threads" && i + 1 < argc)
+      threads = std::stoul(argv[++i]);
+    else if (arg == "--junit" && i + 1 < argc)
+      junitPath = argv[++i];
+    else if (arg == "--json" && i + 1 < argc)
+      jsonPath = argv[++i];
+    else if (arg == "--keys" && i + 1 < argc)
+      keysPath = argv[++i];
+    else if (arg == "--frames" && i + 1 < argc)
+      framesPath = argv[++i];
+    else if (arg == "--frame-cycles" && i + 1 < argc)
+      frameCycles = std::stoull(argv[++i]);
+    else if (arg == "--frame-format" && i + 1 < argc)
+      frameFormat = FrameRenderer::parseFormat(argv[++i]);
+    else if (arg == "--dump" && i + 1 < argc)
+      parseRange(argv[++i], dumpFirst, dumpLast);
+    else
+      inputPath = arg;
+  }
+
+  if (inputPath.empty())
+    throw std::invalid_argument("No input file received");
+  if (frameCycles == 0)
+    throw std::invalid_argument("--frame-cycles must be positive");
+  if (!heapPath.empty() + !symbolPath.empty() + !tracePath.empty() > 1)
+    throw std::invalid_argument(
+        "Only one of --profile, --heap and --trace can be given");
+
+  if (lanes && (!symbolPath.empty() || !heapPath.empty() ||
+                !tracePath.empty() || !framesPath.empty() || !keysPath.empty() ||
+                !snapshotPath.empty() || !saveSnapshotPath.empty()))
+    throw std::invalid_argument("--lanes only combines with --cycles, --sweep "
+                                "and --dump");
+  if (!sweeps.empty() && !lanes)
+    throw std::invalid_argument("--sweep needs --lanes");
+  if (threads == 0)
+    throw std::invalid_argument("--threads must be positive");
+  if ((!junitPath.empty() || !jsonPath.empty()) && !batch)
+    throw std::invalid_argument("--junit and --json need --batch");
+
+  // input_path is a manifest of test cases, each naming its own ROM
+  if (batch)
+    return runBatch(inputPath, useJit, threads, junitPath, jsonPath) ? 0 : 1;
+
+  // input_path is a trace file written by --trace
+  if (showTrace)
+  {
+    printTrace(TraceReader::read(inputPath), traceFirst, traceLast);
+    return 0;
+  }
+
+  // The profiler attributes time to the functions' VM code, so it runs
+  // without intrinsics
+  std::vector<std::pair<int, uint8_t>> intrinsics;
+  if (!intrinsicsPath.empty() && useIntrinsics && symbolPath.empty())
+    intrinsics = findIntrinsics(SymbolMap::read(intrinsicsPath));
+  // The heap profiler stops the CPU at the heap functions' traps
+  const std::vector<uint16_t> rom{loadRom(inputPath)};
+  std::unique_ptr<HeapProfiler> heapProfiler;
+  if (!heapPath.empty())
+    heapProfiler =
+        std::make_unique<HeapProfiler>(rom, SymbolMap::read(heapPath));
+  std::shared_ptr<const Program> program{std::make_shared<const Program>(
+      rom, fuse, intrinsics,
+      heapProfiler ? heapProfiler->getTraps() : std::vector<int>{})};
+  if (lanes)
+  {
+    runLockstep(program, lanes, sweeps, maxCycles, dumpFirst, dumpLast);
+    return 0;
+  }
+  Cpu cpu{program};
+  cpu.setFastForward(fastForward);
+  if (!snapshotPath.empty())
+    Snapshot::read(snapshotPath).restore(cpu);
+  // Cycles count on from a snapshot's, but only this run's are timed
+  const uint64_t startCycles{cpu.getCycles()};
+
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  // Profiling needs to see every jump, so it always uses the interpreter
+  std::unique_ptr<Profiler> profiler;
+  std::unique_ptr<Jit> jit;
+  if (!symbolPath.empty())
+    profiler = std::make_unique<Profiler>(program, SymbolMap::read(symbolPath));
+  else if (useJit)
+    jit = std::make_unique<Jit>(program);
+  // Tracing records every instruction, so it steps the interpreter
+  std::unique_ptr<TraceWriter> tracer;
+  if (!tracePath.empty())
+    tracer = std::make_unique<TraceWriter>(tracePath, cpu.getCycles());
+
+  std::unique_ptr<KeyboardScript> keyboard;
+  if (!keysPath.empty())
+    keyboard = std::make_unique<KeyboardScript>(KeyboardScript::read(keysPath));
+
+  // Frames are captured every frameCycles instructions of emulated time,
+  // so the same program always produces the same frames
+  std::unique_ptr<FrameRenderer> renderer;
+  if (!framesPath.empty())
+  {
+    renderer = std::make_unique<FrameRenderer>(framesPath, frameFormat);
+    renderer->capture(cpu, 0);
+  }
+
+  // The program runs in slices that end at every key event and frame
+  uint64_t remaining{maxCycles};
+  while (remaining > 0 && !cpu.isHalted())
+  {
+    uint64_t cycles{remaining};
+    if (keyboard)
+    {
+      keyboard->apply(cpu);
+      cycles = std::min(cycles, keyboard->getNextCycle() - cpu.getCycles());
+    }
+    if (renderer)
+      cycles = std::min(cycles, frameCycles - cpu.getCycles() % frameCycles);
+
+    const uint64_t executed{
+        profiler       ? profiler->run(cpu, cycles)
+        : heapProfiler ? heapProfiler->run(cpu, jit.get(), cycles)
+        : tracer       ? tracer->run(cpu, cycles)
+        : jit          ? jit->run(cpu, cycles)
+                       : cpu.run(cycles)};
+    remaining -= executed;
+    if (renderer && cpu.getCycles() % frameCycles == 0)
+      renderer->capture(cpu, cpu.getCycles() / frameCycles);
+    if (executed < cycles)
+      break;
+  }
+
+  if (tracer)
+  {
+    tracer->finish();
+    std::cerr << "Wrote " << tracer->getRecordCount() << " instructions to "
+              << tracePath << std::endl;
+  }
+
+  if (!saveSnapshotPath.empty())
+    Snapshot::capture(cpu).write(saveSnapshotPath);
+
+  if (renderer)
+  {
+    // A last partial frame is numbered after the frame boundary it precedes
+    renderer->capture(cpu, (cpu.getCycles() + frameCycles - 1) / frameCycles);
+    renderer->finish();
+    std::cerr << "Wrote " << renderer->getFrameCount() << " frames to "
+              << framesPath << std::endl;
+  }
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+  if (profiler)
+  {
+    profiler->print(std::cerr);
+    if (!sourceMapPath.empty())
+      profiler->printSourceLines(std::cerr, SourceMap::read(sourceMapPath),
+                                 HOT_LINE_COUNT);
+    if (!foldedPath.empty())
+    {
+      std::ofstream folded{foldedPath};
+      if (!folded)
+        throw std::runtime_error("Could not open " + foldedPath);
+      profiler->printFolded(folded);
+    }
+  }
+
+  if (heapProfiler)
+  {
+    heapProfiler->print(std::cerr);
+    if (!heapTracePath.empty())
+      heapProfiler->writeTrace(heapTracePath);
+  }
+
+  for (int address = dumpFirst; address <= dumpLast; address++)
+    std::cout << "RAM[" << address << "] = "
+              << static_cast<int16_t>(cpu.peek(address)) << std::endl;
+
+  std::cerr << (cpu.isHalted() ? "Halted" : "Stopped") << " at PC "
+            << cpu.getPc() << " after " << cpu.getCycles() << " cycles in "
+            << elapsed.count() << " s";
+  if (elapsed.count() > 0)
+    std::cerr << " (" << (cpu.getCycles() - startCycles) / elapsed.count() / 1e6
+              << " MIPS)";
+  std::cerr << std::endl;
+
+  return 0;
+}
+
+// Parses "first-last" or a single address
+static void parseRange(const std::string &range, int &first, int &last)
+{
+  const size_t dash{range.find('-')};
+  first = std::stoi(range.substr(0, dash));
+  last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+  if (first < 0 || last >= static_cast<int>(Cpu::RAM_SIZE) || first > last)
+    throw std::invalid_argument("Invalid RAM range " + range);
+}
+
+// Parses "address:first" or "address:first:step", the step defaulting to 1
+static Sweep parseSweep(const std::string &sweep)
+{
+  const size_t colon{sweep.find(':')};
+  if (colon == std::string::npos)
+    throw std::invalid_argument("Invalid sweep " + sweep);
+  const size_t second{sweep.find(':', colon + 1)};
+  Sweep parsed{std::stoi(sweep.substr(0, colon)),
+               std::stoi(sweep.substr(colon + 1, second - colon - 1)),
+               second == std::string::npos
+                   ? 1
+                   : std::stoi(sweep.substr(second + 1))};
+  if (parsed.address < 0 || parsed.address >= static_cast<int>(Cpu::RAM_SIZE))
+    throw std::invalid_argument("Invalid sweep " + sweep);
+  return parsed;
+}
+
+// Runs lanes copies of the program side by side, each with its own sweep
+// values, and prints RAM[first] to RAM[last] of every lane
+static void runLockstep(std::shared_ptr<const Program> program, int lanes,
+                        const std::vector<Sweep> &sweeps, uint64_t maxCycles,
+                        int dumpFirst, int dumpLast)
+{
+  LockstepCpu cpu{std::move(program), lanes};
+  for (const Sweep &sweep : sweeps)
+    for (int lane = 0; lane < lanes; lane++)
+      cpu.poke(lane, sweep.address, sweep.first + lane * sweep.step);
+
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  const uint64_t executed{cpu.run(maxCycles)};
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+  for (int address = dumpFirst; address <= dumpLast; address++)
+  {
+    std::cout << "RAM[" << address << "] =";
+    for (int lane = 0; lane < lanes; lane++)
+      std::cout << ' ' << static_cast<int16_t>(cpu.peek(lane, address));
+    std::cout << std::endl;
+  }
+
+  std::cerr << cpu.getHaltedCount() << " of " << lanes << " lanes halted after "
+            << executed << " cycles in " << cpu.getGroupCount()
+            << " lane groups in " << elapsed.count() << " s";
+  if (elapsed.count() > 0)
+    std::cerr << " (" << executed / elapsed.count() / 1e6 << " MIPS)";
+  std::cerr << std::endl;
+}
+
+// Parses "first-last" or a single cycle
+static void parseCycleRange(const std::string &range, uint64_t &first,
+                            uint64_t &last)
+{
+  const size_t dash{range.find('-')};
+  first = std::stoull(range.substr(0, dash));
+  last = dash == std::string::npos ? first : std::stoull(range.substr(dash + 1));
+  if (first > last)
+    throw std::invalid_argument("Invalid cycle range " + range);
+}
+
+// One line per instruction: the cycle it ran at, its address, A and D after
+// it and the word it wrote
+static void printTrace(const TraceReader &reader, uint64_t first,
+                       uint64_t last)
+{
+  uint64_t cycle{first};
+  for (const TraceRecord &record :
+       reader.getRecords(first, last - first + 1))
+  {
+    std::cout << cycle++ << ": PC " << record.pc << " A " << record.a
+              << " D " << static_cast<int16_t>(record.d);
+    if (record.write)
+      std::cout << " RAM[" << record.address
+                << "] = " << static_cast<int16_t>(record.value);
+    std::cout << '\n';
+  }
+}
+
+// Runs the manifest's cases and reports the failures and totals. Returns
+// whether every case passed.
+static bool runBatch(const std::string &manifestPath, bool useJit,
+                     unsigned threads, const std::string &junitPath,
+                     const std::string &jsonPath)
+{
+  BatchRunner runner{BatchRunner::readManifest(manifestPath), useJit};
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  const std::vector<BatchRunner::Result> results{runner.run(threads)};
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+  if (!junitPath.empty())
+  {
+    std::ofstream junit{junitPath};
+    if (!junit)
+      throw std::runtime_error("Could not open " + junitPath);
+    runner.writeJUnit(junit, results, elapsed.count());
+  }
+  if (!jsonPath.empty())
+  {
+    std::ofstream json{jsonPath};
+    if (!json)
+      throw std::runtime_error("Could not open " + jsonPath);
+    runner.writeJson(json, results, elapsed.count());
+  }
+
+  size_t failures{0};
+  uint64_t cycles{0};
+  for (size_t index = 0; index < results.size(); index++)
+  {
+    cycles += results[index].cycles;
+    if (results[index].passed)
+      continue;
+    ++failures;
+    std::cerr << "FAIL " << runner.getCases()[index].name << ": "
+              << results[index].failure << std::endl;
+  }
+  std::cerr << results.size() - failures << " of " << results.size()
+            << " cases passed, " << cycles << " cycles in " << elapsed.count()
+            << " s";
+  if (elapsed.count() > 0)
+    std::cerr << " (" << cycles / elapsed.count() / 1e6 << " MIPS)";
+  std::cerr << std::endl;
+  return failures == 0;
+}
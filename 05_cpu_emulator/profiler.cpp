@@ -0,0 +1,224 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <utility>
+
+const uint16_t ADDRESS_MASK{0x7FFF};
+const char BOOTSTRAP_NAME[]{"(bootstrap)"};
+
+Profiler::Profiler(std::shared_ptr<const Program> program, SymbolMap symbols)
+    : program{std::move(program)}, symbols{std::move(symbols)},
+      runLengths(Program::ROM_SIZE, 1), runStarts(Program::ROM_SIZE + 1, 0),
+      runEnds(Program::ROM_SIZE + 1, 0), nodes{{-1, -1, 0}}, children{},
+      stack{}, calls(this->symbols.getFunctions().size(), 0),
+      inclusive(this->symbols.getFunctions().size(), 0),
+      activations(this->symbols.getFunctions().size(), 0), cycles{0}
+{
+  const Program &rom{*this->program};
+  for (int address = Program::ROM_SIZE - 2; address >= 0; address--)
+  {
+    const Program::Instruction &instruction{rom[address]};
+    if ((instruction.flags & Program::A_INSTRUCTION) || !instruction.jump)
+      runLengths[address] = runLengths[address + 1] + 1;
+  }
+}
+
+// Runs up to maxCycles instructions on the interpreter, straight line code
+// at a time, and checks where every taken jump landed
+uint64_t Profiler::run(Cpu &cpu, uint64_t maxCycles)
+{
+  const Program &rom{*program};
+  uint64_t remaining{maxCycles};
+
+  while (remaining > 0 && !cpu.isHalted())
+  {
+    const uint16_t pc{cpu.getPc()};
+    const uint64_t length{std::min<uint64_t>(runLengths[pc], remaining)};
+    const uint64_t executed{cpu.run(length)};
+    remaining -= executed;
+    cycles += executed;
+    nodes[stack.empty() ? 0 : stack.back().node].self += executed;
+    ++runStarts[pc];
+    ++runEnds[pc + executed];
+    if (executed < length)
+      break;
+
+    // A jump to the next address is only a transfer of control when it is
+    // unconditional, like the bootstrap's call to a Sys.init placed right
+    // after it
+    const uint16_t last = (pc + length - 1) & ADDRESS_MASK;
+    const uint16_t target{cpu.getPc()};
+    const Program::Instruction &jump{rom[last]};
+    if ((jump.flags & Program::A_INSTRUCTION) || !jump.jump ||
+        (target == ((last + 1) & ADDRESS_MASK) &&
+         jump.jump != (Program::JUMP_GT | Program::JUMP_EQ | Program::JUMP_LT)))
+      continue;
+
+    // Calls jump unconditionally to a constant loaded right before the jump
+    // and return to the address after it; a goto or if-goto to a loop label
+    // at a function's entry does neither. Returns jump to an address read
+    // from the stack frame.
+    const bool direct{last > 0 &&
+                      (rom[last - 1].flags & Program::A_INSTRUCTION) &&
+                      (rom[last - 1].constant & ADDRESS_MASK) == target};
+    const bool call{
+        direct &&
+        jump.jump == (Program::JUMP_GT | Program::JUMP_EQ | Program::JUMP_LT) &&
+        symbols.isReturnSite((last + 1) & ADDRESS_MASK)};
+    const int function{symbols.functionEntryAt(target)};
+    if (call && function >= 0)
+      enter(function);
+    else if (!direct && symbols.isReturnSite(target))
+      leave();
+  }
+  return maxCycles - remaining;
+}
+
+void Profiler::enter(int function)
+{
+  const int parent{stack.empty() ? 0 : stack.back().node};
+  const uint64_t key{(static_cast<uint64_t>(parent) << 32) |
+                     static_cast<uint32_t>(function)};
+  auto child{children.find(key)};
+  if (child == children.end())
+  {
+    child = children.emplace(key, nodes.size()).first;
+    nodes.push_back({parent, function, 0});
+  }
+
+  ++calls[function];
+  stack.push_back({child->second, function, cycles,
+                   activations[function]++ == 0});
+}
+
+void Profiler::leave()
+{
+  if (stack.empty())
+    return;
+
+  const Frame &frame{stack.back()};
+  if (frame.outermost)
+    inclusive[frame.function] += cycles - frame.entryCycle;
+  --activations[frame.function];
+  stack.pop_back();
+}
+
+// Per function totals, with functions still on the stack counted up to now,
+// sorted by exclusive instructions
+std::vector<Profiler::FunctionProfile> Profiler::getProfiles() const
+{
+  std::vector<FunctionProfile> profiles;
+  for (size_t function = 0; function < calls.size(); function++)
+    profiles.push_back(
+        {functionName(function), calls[function], 0, inclusive[function]});
+  for (const Frame &frame : stack)
+    if (frame.outermost)
+      profiles[frame.function].inclusive += cycles - frame.entryCycle;
+  for (size_t node = 1; node < nodes.size(); node++)
+    profiles[nodes[node].function].exclusive += nodes[node].self;
+
+  if (nodes[0].self > 0)
+    profiles.push_back({BOOTSTRAP_NAME, 0, nodes[0].self, cycles});
+
+  profiles.erase(std::remove_if(profiles.begin(), profiles.end(),
+                                [](const FunctionProfile &profile)
+                                { return profile.inclusive == 0; }),
+                 profiles.end());
+  std::stable_sort(profiles.begin(), profiles.end(),
+                   [](const FunctionProfile &left,
+                      const FunctionProfile &right)
+                   { return left.exclusive > right.exclusive; });
+  return profiles;
+}
+
+// How many times every ROM address executed
+std::vector<uint64_t> Profiler::getAddressCounts() const
+{
+  std::vector<uint64_t> counts(Program::ROM_SIZE, 0);
+  uint64_t active{0};
+  for (size_t address = 0; address < counts.size(); address++)
+  {
+    active += runStarts[address] - runEnds[address];
+    counts[address] = active;
+  }
+  return counts;
+}
+
+void Profiler::print(std::ostream &os) const
+{
+  const double total = cycles ? cycles : 1;
+  os << std::left << std::setw(32) << "Function" << std::right
+     << std::setw(12) << "Calls" << std::setw(16) << "Exclusive"
+     << std::setw(8) << "%" << std::setw(16) << "Inclusive" << std::setw(8)
+     << "%" << '\n';
+  os << std::fixed << std::setprecision(2);
+  for (const FunctionProfile &profile : getProfiles())
+    os << std::left << std::setw(32) << profile.name << std::right
+       << std::setw(12) << profile.calls << std::setw(16) << profile.exclusive
+       << std::setw(8) << profile.exclusive * 100 / total << std::setw(16)
+       << profile.inclusive << std::setw(8) << profile.inclusive * 100 / total
+       << '\n';
+  os << std::defaultfloat;
+}
+
+// One "caller;callee count" line per call stack, as flamegraph.pl reads
+void Profiler::printFolded(std::ostream &os) const
+{
+  for (size_t node = 0; node < nodes.size(); node++)
+  {
+    if (nodes[node].self == 0)
+      continue;
+
+    std::string stackNames;
+    for (int current = node; current > 0; current = nodes[current].parent)
+      stackNames = functionName(nodes[current].function) +
+                   (stackNames.empty() ? "" : ";") + stackNames;
+    os << (node == 0 ? BOOTSTRAP_NAME : stackNames) << ' ' << nodes[node].self
+       << '\n';
+  }
+}
+
+// The count .vm lines that executed the most instructions, from a source
+// map written by the VM translator or the assembler
+void Profiler::printSourceLines(std::ostream &os, const SourceMap &sourceMap,
+                                size_t count) const
+{
+  const std::vector<uint64_t> counts{getAddressCounts()};
+  std::map<std::pair<int, int>, uint64_t> lines;
+  for (size_t address = 0; address < counts.size(); address++)
+    if (counts[address])
+    {
+      const SourceMap::Location location{sourceMap.at(address)};
+      lines[{location.sourceFile, location.sourceLine}] += counts[address];
+    }
+
+  std::vector<std::pair<std::pair<int, int>, uint64_t>> hottest{
+      lines.begin(), lines.end()};
+  std::stable_sort(hottest.begin(), hottest.end(),
+                   [](const std::pair<std::pair<int, int>, uint64_t> &left,
+                      const std::pair<std::pair<int, int>, uint64_t> &right)
+                   { return left.second > right.second; });
+  hottest.resize(std::min(hottest.size(), count));
+
+  const double total = cycles ? cycles : 1;
+  os << std::left << std::setw(32) << "Source line" << std::right
+     << std::setw(16) << "Instructions" << std::setw(8) << "%" << '\n';
+  os << std::fixed << std::setprecision(2);
+  for (const std::pair<std::pair<int, int>, uint64_t> &line : hottest)
+  {
+    const std::string name{
+        line.first.first == SourceMap::NO_FILE
+            ? "(no source)"
+            : sourceMap.getFileName(line.first.first) + ":" +
+                  std::to_string(line.first.second)};
+    os << std::left << std::setw(32) << name << std::right << std::setw(16)
+       << line.second << std::setw(8) << line.second * 100 / total << '\n';
+  }
+  os << std::defaultfloat;
+}
+
+std::string Profiler::functionName(int function) const
+{
+  return function < 0 ? BOOTSTRAP_NAME : symbols.getFunctions()[function].name;
+}
@@ -0,0 +1,79 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cpu.hpp"
+#include "program.hpp"
+#include "symbolmap.hpp"
+#include "../06_assembler/sourcemap.hpp"
+
+// Runs a Cpu while attributing every executed instruction to the VM function
+// on top of a shadow call stack. A direct jump (@f; 0;JMP) to a function's
+// entry point, right before a return site, is a call, a computed jump to a
+// return site is a return.
+class Profiler
+{
+public:
+  struct FunctionProfile
+  {
+    std::string name;
+    uint64_t calls;
+    uint64_t exclusive;
+    uint64_t inclusive;
+  };
+
+  Profiler(std::shared_ptr<const Program> program, SymbolMap symbols);
+  uint64_t run(Cpu &cpu, uint64_t maxCycles);
+  std::vector<FunctionProfile> getProfiles() const;
+  std::vector<uint64_t> getAddressCounts() const;
+  void print(std::ostream &os) const;
+  void printFolded(std::ostream &os) const;
+  void printSourceLines(std::ostream &os, const SourceMap &sourceMap,
+                        size_t count) const;
+
+private:
+  // A node of the call tree, one per distinct call stack
+  struct Node
+  {
+    int parent;
+    int function;
+    uint64_t self;
+  };
+
+  struct Frame
+  {
+    int node;
+    int function;
+    uint64_t entryCycle;
+    // Recursive calls only count towards inclusive time once
+    bool outermost;
+  };
+
+  void enter(int function);
+  void leave();
+  std::string functionName(int function) const;
+
+  std::shared_ptr<const Program> program;
+  SymbolMap symbols;
+  // Instructions from every address up to and including the next one that
+  // can jump; no call or return can happen in between
+  std::vector<uint32_t> runLengths;
+  // Number of runs starting and ending at every address; their running
+  // difference is how often each address executed
+  std::vector<uint64_t> runStarts;
+  std::vector<uint64_t> runEnds;
+  std::vector<Node> nodes;
+  std::unordered_map<uint64_t, int> children;
+  std::vector<Frame> stack;
+  std::vector<uint64_t> calls;
+  std::vector<uint64_t> inclusive;
+  std::vector<int> activations;
+  uint64_t cycles;
+};
+
+#endif
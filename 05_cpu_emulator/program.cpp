@@ -0,0 +1,191 @@
+#include "program.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// Words of the idioms fused into superinstructions
+const uint16_t AT_SP{0x0000};
+const uint16_t A_EQ_M{0xFC20};
+const uint16_t D_EQ_M{0xFC10};
+const uint16_t M_EQ_D{0xE308};
+const uint16_t M_EQ_M_PLUS_1{0xFDC8};
+const uint16_t M_EQ_M_MINUS_1{0xFC88};
+
+// Pattern entries matching classes of words instead of one word
+const int32_t ANY_A{-1};
+const int32_t ANY_C{-2};
+const int32_t ANY_C_NO_JUMP{-3};
+const int32_t ANY_C_ONLY_M{-4};
+
+struct Idiom
+{
+  Program::OPS op;
+  std::vector<int32_t> pattern;
+};
+
+// Longest first, so the longest match wins
+static const std::vector<Idiom> IDIOMS{
+    // add, sub, and, or: pop into D, then apply D to the new top in place
+    {Program::OP_BINARY,
+     {AT_SP, M_EQ_M_MINUS_1, AT_SP, A_EQ_M, D_EQ_M, AT_SP, M_EQ_M_MINUS_1,
+      AT_SP, A_EQ_M, ANY_C_ONLY_M, AT_SP, M_EQ_M_PLUS_1}},
+    // push constant, push of a register or segment value already in D
+    {Program::OP_A_C_PUSH_D,
+     {ANY_A, ANY_C_NO_JUMP, AT_SP, A_EQ_M, M_EQ_D, AT_SP, M_EQ_M_PLUS_1}},
+    {Program::OP_PUSH_D, {AT_SP, A_EQ_M, M_EQ_D, AT_SP, M_EQ_M_PLUS_1}},
+    {Program::OP_POP_D, {AT_SP, M_EQ_M_MINUS_1, AT_SP, A_EQ_M, D_EQ_M}},
+    {Program::OP_INC_SP, {AT_SP, M_EQ_M_PLUS_1}},
+    {Program::OP_DEC_SP, {AT_SP, M_EQ_M_MINUS_1}},
+    {Program::OP_A_C, {ANY_A, ANY_C}}};
+
+static bool matches(const Program::Instruction &instruction, uint16_t word,
+                    int32_t entry)
+{
+  const bool isC{!(instruction.flags & Program::A_INSTRUCTION)};
+  const uint8_t dest{static_cast<uint8_t>(
+      instruction.flags &
+      (Program::DEST_A | Program::DEST_D | Program::DEST_M))};
+  switch (entry)
+  {
+  case ANY_A:
+    return !isC;
+  case ANY_C:
+    return isC;
+  case ANY_C_NO_JUMP:
+    return isC && !instruction.jump;
+  case ANY_C_ONLY_M:
+    return isC && !instruction.jump && dest == Program::DEST_M;
+  default:
+    return word == entry;
+  }
+}
+
+// With fuse set, every address also gets the longest superinstruction
+// starting there. Addresses inside a fused sequence keep their own op, so
+// jumping into the middle of one still executes the right instructions.
+// intrinsics pairs function entry points with the native version the CPU
+// runs in their place, and traps lists addresses runs stop at.
+Program::Program(const std::vector<uint16_t> &rom, bool fuse,
+                 const std::vector<std::pair<int, uint8_t>> &intrinsics,
+                 const std::vector<int> &traps)
+    : words(ROM_SIZE, 0), instructions{}, loadedSize{rom.size()},
+      hash{0xCBF29CE484222325}
+{
+  if (rom.size() > ROM_SIZE)
+    throw std::invalid_argument("ROM does not fit in 32K words");
+
+  for (uint16_t word : rom)
+    for (int byte = 0; byte < 2; byte++)
+      hash = (hash ^ ((word >> (byte * 8)) & 0xFF)) * 0x100000001B3;
+
+  std::copy(rom.begin(), rom.end(), words.begin());
+
+  instructions.reserve(ROM_SIZE);
+  for (uint16_t word : words)
+    instructions.push_back(decode(word));
+
+  for (size_t address = 1; address < ROM_SIZE; address++)
+  {
+    Instruction &instruction{instructions[address]};
+    const bool unconditional{instruction.jump ==
+                             (JUMP_GT | JUMP_EQ | JUMP_LT)};
+    const bool writes{(instruction.flags &
+                       (DEST_A | DEST_D | DEST_M)) != 0};
+    if (!(instruction.flags & A_INSTRUCTION) && unconditional && !writes &&
+        words[address - 1] == address - 1)
+      instruction.flags |= HALT_LOOP;
+
+    const size_t previous{words[address - 1]};
+    if (!(instruction.flags & A_INSTRUCTION) && instruction.jump &&
+        !(previous & 0x8000) && previous + 1 < address &&
+        address - previous <= MAX_LOOP_LENGTH)
+      instruction.flags |= LOOP_EDGE;
+  }
+
+  if (fuse)
+    for (size_t address = 0; address < ROM_SIZE; address++)
+      this->fuse(address);
+
+  for (const std::pair<int, uint8_t> &intrinsic : intrinsics)
+  {
+    Instruction &instruction{instructions.at(intrinsic.first)};
+    instruction.op = OP_INTRINSIC;
+    instruction.length = 1;
+    instruction.intrinsic = intrinsic.second;
+  }
+
+  for (int trap : traps)
+  {
+    Instruction &instruction{instructions.at(trap)};
+    instruction.op = OP_TRAP;
+    instruction.length = 1;
+
+    // Superinstructions running over a trap would not stop at it. IDIOMS
+    // starts with the longest.
+    const int longest = IDIOMS.front().pattern.size();
+    for (int address = std::max(trap - longest, 0); address < trap; address++)
+      if (address + instructions[address].length > trap)
+      {
+        instructions[address].op = decode(words[address]).op;
+        instructions[address].length = 1;
+      }
+  }
+}
+
+const Program::Instruction &Program::operator[](size_t address) const
+{
+  return instructions[address];
+}
+
+void Program::fuse(size_t address)
+{
+  for (const Idiom &idiom : IDIOMS)
+  {
+    if (address + idiom.pattern.size() > ROM_SIZE)
+      continue;
+
+    size_t i{0};
+    while (i < idiom.pattern.size() &&
+           matches(instructions[address + i], words[address + i],
+                   idiom.pattern[i]))
+      ++i;
+    if (i < idiom.pattern.size())
+      continue;
+
+    instructions[address].op = idiom.op;
+    instructions[address].length = idiom.pattern.size();
+    return;
+  }
+}
+
+uint16_t Program::getWord(size_t address) const { return words[address]; }
+
+// Number of words in the loaded image
+size_t Program::size() const { return loadedSize; }
+
+uint64_t Program::getHash() const { return hash; }
+
+Program::Instruction Program::decode(uint16_t word)
+{
+  Instruction instruction{};
+  instruction.length = 1;
+  if (!(word & 0x8000))
+  {
+    instruction.constant = word;
+    instruction.flags = A_INSTRUCTION;
+    instruction.op = OP_A;
+    return instruction;
+  }
+
+  instruction.op = OP_C;
+  instruction.alu = (word >> 6) & 0x3F;
+  if (word & 0x1000)
+    instruction.flags |= USE_M;
+  if (word & 0x0020)
+    instruction.flags |= DEST_A;
+  if (word & 0x0010)
+    instruction.flags |= DEST_D;
+  if (word & 0x0008)
+    instruction.flags |= DEST_M;
+  instruction.jump = word & 0x07;
+  return instruction;
+}
@@ -0,0 +1,102 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// A ROM image decoded once up front, so the CPU never picks instruction bits
+// apart while running
+class Program
+{
+public:
+  static constexpr size_t ROM_SIZE{0x8000};
+  // Longest loop, in instructions, the CPU tries to fast forward
+  static constexpr size_t MAX_LOOP_LENGTH{256};
+
+  enum FLAGS : uint8_t
+  {
+    A_INSTRUCTION = 0x01,
+    USE_M = 0x02,
+    DEST_A = 0x04,
+    DEST_D = 0x08,
+    DEST_M = 0x10,
+    // Jump that targets the A instruction right before it, which loads its
+    // own address: the "(END) @END 0;JMP" idiom programs halt with
+    HALT_LOOP = 0x20,
+    // Jump right after an A instruction that loads an earlier address at
+    // most MAX_LOOP_LENGTH back: the back edge of a short loop
+    LOOP_EDGE = 0x40
+  };
+
+  // Jump bits as a mask of ALU output classes to jump on
+  enum JUMPS : uint8_t
+  {
+    JUMP_GT = 0x01,
+    JUMP_EQ = 0x02,
+    JUMP_LT = 0x04
+  };
+
+  // Handler the CPU dispatches to. Everything past OP_C is a superinstruction
+  // fusing one of the Translator's idioms that starts at this address.
+  enum OPS : uint8_t
+  {
+    OP_A,
+    OP_C,
+    // @X followed by any C instruction
+    OP_A_C,
+    // @SP, A=M, M=D, @SP, M=M+1
+    OP_PUSH_D,
+    // @SP, M=M-1, @SP, A=M, D=M
+    OP_POP_D,
+    // @SP, M=M+1
+    OP_INC_SP,
+    // @SP, M=M-1
+    OP_DEC_SP,
+    // @X, C, then OP_PUSH_D
+    OP_A_C_PUSH_D,
+    // OP_POP_D, @SP, M=M-1, @SP, A=M, M=<comp>, OP_INC_SP
+    OP_BINARY,
+    // Entry point of an OS function the CPU can run natively
+    OP_INTRINSIC,
+    // Address a run stops before, so its caller can look at the state
+    OP_TRAP
+  };
+
+  struct Instruction
+  {
+    uint16_t constant;
+    uint8_t alu;
+    uint8_t flags;
+    uint8_t jump;
+    uint8_t op;
+    // Number of ROM words, and so cycles, op covers
+    uint8_t length;
+    // The INTRINSICS value of an OP_INTRINSIC
+    uint8_t intrinsic;
+  };
+
+  Program(const std::vector<uint16_t> &rom, bool fuse = true,
+          const std::vector<std::pair<int, uint8_t>> &intrinsics = {},
+          const std::vector<int> &traps = {});
+  const Instruction &operator[](size_t address) const;
+  uint16_t getWord(size_t address) const;
+  size_t size() const;
+  uint64_t getHash() const;
+
+  static Instruction decode(uint16_t word);
+
+private:
+  void fuse(size_t address);
+
+  // Always ROM_SIZE long; words past the loaded image are 0 (@0) like an
+  // empty ROM chip
+  std::vector<uint16_t> words;
+  std::vector<Instruction> instructions;
+  size_t loadedSize;
+  // FNV-1a of the loaded image, identifying the program in snapshots
+  uint64_t hash;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "rom.hpp"
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+static std::vector<uint16_t> loadHackRom(std::ifstream &inputFile);
+static std::vector<uint16_t> loadBinaryRom(std::ifstream &inputFile);
+
+const size_t MAX_ROM_SIZE{0x8000};
+
+// Loads a ROM image either in the assembler's .hack text format or as packed
+// little endian 16-bit words (.bin, as written by vm_translator.out --bin)
+std::vector<uint16_t> loadRom(const std::string &inputFilename)
+{
+  std::ifstream inputFile{inputFilename, std::ios::binary};
+  if (!inputFile.is_open())
+    throw std::runtime_error("Invalid ROM file " + inputFilename);
+
+  std::vector<uint16_t> rom{
+      std::filesystem::path(inputFilename).extension() == ".hack"
+          ? loadHackRom(inputFile)
+          : loadBinaryRom(inputFile)};
+
+  if (rom.size() > MAX_ROM_SIZE)
+    throw std::runtime_error("ROM does not fit in 32K words");
+
+  return rom;
+}
+
+static std::vector<uint16_t> loadHackRom(std::ifstream &inputFile)
+{
+  std::vector<uint16_t> rom;
+  std::string line;
+  while (std::getline(inputFile, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty())
+      continue;
+    if (line.size() != 16 ||
+        line.find_first_not_of("01") != std::string::npos)
+      throw std::runtime_error("Invalid machine instruction '" + line + "'");
+
+    rom.push_back(std::stoi(line, nullptr, 2));
+  }
+  return rom;
+}
+
+static std::vector<uint16_t> loadBinaryRom(std::ifstream &inputFile)
+{
+  std::vector<uint16_t> rom;
+  unsigned char bytes[2];
+  while (inputFile.read(reinterpret_cast<char *>(bytes), sizeof(bytes)))
+    rom.push_back(bytes[0] | (bytes[1] << 8));
+  return rom;
+}
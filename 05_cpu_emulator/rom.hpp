@@ -0,0 +1,10 @@
+#ifndef ROM_HPP
+#define ROM_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+std::vector<uint16_t> loadRom(const std::string &inputFilename);
+
+#endif
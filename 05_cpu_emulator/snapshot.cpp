@@ -0,0 +1,173 @@
+#include "snapshot.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../06_assembler/littleendian.hpp"
+
+// Snapshots are laid out as:
+//   "HSNP", version, reserved
+//   PC, A, D, halted flag
+//   cycle count
+//   program size, reserved, program hash
+//   zeros up to RAM_OFFSET, then RAM's 32K words
+// All integers are little endian.
+const char SNAPSHOT_MAGIC[4]{'H', 'S', 'N', 'P'};
+const uint16_t SNAPSHOT_VERSION{1};
+const size_t HEADER_SIZE{40};
+// Page aligned, so RAM can be mapped straight out of the file
+const size_t RAM_OFFSET{4096};
+const size_t FILE_SIZE{RAM_OFFSET + Cpu::RAM_SIZE * 2};
+
+static bool isLittleEndian();
+
+Snapshot::Snapshot()
+    : pc{0}, a{0}, d{0}, halted{false}, cycles{0}, programSize{0},
+      programHash{0}, words{}, fd{-1}, mapping{nullptr}, mappingSize{0}
+{
+}
+
+Snapshot::Snapshot(Snapshot &&other)
+    : pc{other.pc}, a{other.a}, d{other.d}, halted{other.halted},
+      cycles{other.cycles}, programSize{other.programSize},
+      programHash{other.programHash}, words{std::move(other.words)},
+      fd{other.fd}, mapping{other.mapping}, mappingSize{other.mappingSize}
+{
+  other.fd = -1;
+  other.mapping = nullptr;
+  other.mappingSize = 0;
+}
+
+Snapshot::~Snapshot()
+{
+  if (mapping)
+    munmap(const_cast<unsigned char *>(mapping), mappingSize);
+  if (fd >= 0)
+    close(fd);
+}
+
+Snapshot Snapshot::capture(const Cpu &cpu)
+{
+  Snapshot snapshot{};
+  snapshot.pc = cpu.pc;
+  snapshot.a = cpu.a;
+  snapshot.d = cpu.d;
+  snapshot.halted = cpu.halted;
+  snapshot.cycles = cpu.cycles;
+  snapshot.programSize = cpu.getProgram().size();
+  snapshot.programHash = cpu.getProgram().getHash();
+  snapshot.words.assign(cpu.ram, cpu.ram + Cpu::RAM_SIZE);
+  return snapshot;
+}
+
+// Puts cpu in the snapshot's state. The Cpu must run the same program.
+void Snapshot::restore(Cpu &cpu) const
+{
+  const Program &program{cpu.getProgram()};
+  if (program.size() != programSize || program.getHash() != programHash)
+    throw std::invalid_argument("Snapshot was taken of a different program");
+
+  if (!mapping)
+    std::copy(words.begin(), words.end(), cpu.ram);
+  else if (!isLittleEndian() || !cpu.mapRam(fd, RAM_OFFSET))
+    for (size_t address = 0; address < Cpu::RAM_SIZE; address++)
+      cpu.ram[address] = peek(address);
+
+  cpu.pc = pc;
+  cpu.a = a;
+  cpu.d = d;
+  cpu.halted = halted;
+  cpu.cycles = cycles;
+  std::fill(cpu.dirtyRows.begin(), cpu.dirtyRows.end(), 1);
+}
+
+// Writes to a temporary file renamed over outputFilename, so Cpus that
+// mapped the old file keep their contents
+void Snapshot::write(const std::string &outputFilename) const
+{
+  const std::string temporaryFilename{outputFilename + ".tmp"};
+  {
+    std::ofstream outputFile{temporaryFilename, std::ios::binary};
+    if (!outputFile.is_open())
+      throw std::runtime_error("Could not write snapshot " + outputFilename);
+
+    outputFile.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    writeU16(outputFile, SNAPSHOT_VERSION);
+    writeU16(outputFile, 0);
+    writeU16(outputFile, pc);
+    writeU16(outputFile, a);
+    writeU16(outputFile, d);
+    writeU16(outputFile, halted);
+    writeU64(outputFile, cycles);
+    writeU32(outputFile, programSize);
+    writeU32(outputFile, 0);
+    writeU64(outputFile, programHash);
+
+    const std::vector<char> padding(RAM_OFFSET - HEADER_SIZE, 0);
+    outputFile.write(padding.data(), padding.size());
+    for (size_t address = 0; address < Cpu::RAM_SIZE; address++)
+      writeU16(outputFile, peek(address));
+    if (!outputFile)
+      throw std::runtime_error("Could not write snapshot " + outputFilename);
+  }
+  if (std::rename(temporaryFilename.c_str(), outputFilename.c_str()) != 0)
+    throw std::runtime_error("Could not write snapshot " + outputFilename);
+}
+
+uint16_t Snapshot::getPc() const { return pc; }
+
+uint64_t Snapshot::getCycles() const { return cycles; }
+
+uint16_t Snapshot::peek(uint16_t address) const
+{
+  address &= Cpu::RAM_SIZE - 1;
+  if (!mapping)
+    return words[address];
+  return decodeU16(mapping + RAM_OFFSET + address * 2);
+}
+
+// Maps a snapshot file and keeps it open for restore to map RAM from
+Snapshot Snapshot::read(const std::string &inputFilename)
+{
+  Snapshot snapshot{};
+  snapshot.fd = open(inputFilename.c_str(), O_RDONLY);
+  if (snapshot.fd < 0)
+    throw std::runtime_error("Invalid snapshot " + inputFilename);
+
+  struct stat fileStat;
+  if (fstat(snapshot.fd, &fileStat) != 0 ||
+      static_cast<size_t>(fileStat.st_size) != FILE_SIZE)
+    throw std::runtime_error("Invalid snapshot " + inputFilename);
+
+  void *mapping{
+      mmap(nullptr, FILE_SIZE, PROT_READ, MAP_PRIVATE, snapshot.fd, 0)};
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("Could not map snapshot " + inputFilename);
+  snapshot.mapping = static_cast<const unsigned char *>(mapping);
+  snapshot.mappingSize = FILE_SIZE;
+
+  const unsigned char *data{snapshot.mapping};
+  if (!std::equal(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + 4, data) ||
+      decodeU16(data + 4) != SNAPSHOT_VERSION)
+    throw std::runtime_error("Invalid snapshot " + inputFilename);
+
+  snapshot.pc = decodeU16(data + 8);
+  snapshot.a = decodeU16(data + 10);
+  snapshot.d = decodeU16(data + 12);
+  snapshot.halted = decodeU16(data + 14);
+  snapshot.cycles = decodeU64(data + 16);
+  snapshot.programSize = decodeU32(data + 24);
+  snapshot.programHash = decodeU64(data + 32);
+  return snapshot;
+}
+
+// Mapped RAM is used as is, so its words must already be in host order
+static bool isLittleEndian()
+{
+  const uint16_t word{1};
+  return *reinterpret_cast<const unsigned char *>(&word) == 1;
+}
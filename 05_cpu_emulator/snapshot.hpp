@@ -0,0 +1,48 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cpu.hpp"
+
+// The complete state of a Cpu: registers, PC, cycle count and RAM, tied to
+// the Program it ran. Files keep RAM page aligned, so restoring one maps it
+// into the Cpu copy-on-write: runs started from the same file share its
+// pages, and each only copies the pages it writes.
+class Snapshot
+{
+public:
+  Snapshot(Snapshot &&other);
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+  ~Snapshot();
+  void restore(Cpu &cpu) const;
+  void write(const std::string &outputFilename) const;
+  uint16_t getPc() const;
+  uint64_t getCycles() const;
+  uint16_t peek(uint16_t address) const;
+
+  static Snapshot capture(const Cpu &cpu);
+  static Snapshot read(const std::string &inputFilename);
+
+private:
+  Snapshot();
+
+  uint16_t pc;
+  uint16_t a;
+  uint16_t d;
+  bool halted;
+  uint64_t cycles;
+  uint32_t programSize;
+  uint64_t programHash;
+  // RAM of a captured snapshot
+  std::vector<uint16_t> words;
+  // Set when read from a file, which stays open to map RAM from
+  int fd;
+  const unsigned char *mapping;
+  size_t mappingSize;
+};
+
+#endif
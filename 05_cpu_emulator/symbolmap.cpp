@@ -0,0 +1,87 @@
+#include "symbolmap.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "program.hpp"
+
+SymbolMap::SymbolMap()
+    : functions{}, entries(Program::ROM_SIZE, -1),
+      owners(Program::ROM_SIZE, -1), returnSites(Program::ROM_SIZE, false)
+{
+}
+
+void SymbolMap::addFunction(int start, int end, const std::string &name)
+{
+  if (start < 0 || end > static_cast<int>(Program::ROM_SIZE) || start > end)
+    throw std::invalid_argument("Invalid address range for " + name);
+
+  const int index = functions.size();
+  functions.push_back({start, end, name});
+  if (start < end)
+    entries[start] = index;
+  for (int address = start; address < end; address++)
+    owners[address] = index;
+}
+
+void SymbolMap::addReturnSite(int address)
+{
+  if (address < 0 || address >= static_cast<int>(Program::ROM_SIZE))
+    throw std::invalid_argument("Invalid return site address");
+  returnSites[address] = true;
+}
+
+const std::vector<SymbolMap::Function> &SymbolMap::getFunctions() const
+{
+  return functions;
+}
+
+// Index of the function whose entry point is address, or -1
+int SymbolMap::functionEntryAt(int address) const { return entries[address]; }
+
+// Index of the function whose code address is part of, or -1
+int SymbolMap::functionContaining(int address) const
+{
+  return owners[address];
+}
+
+bool SymbolMap::isReturnSite(int address) const
+{
+  return returnSites[address];
+}
+
+// Reads "F start end name" and "R address label" lines
+SymbolMap SymbolMap::read(const std::string &inputFilename)
+{
+  std::ifstream inputFile{inputFilename};
+  if (!inputFile.is_open())
+    throw std::runtime_error("Invalid symbol map " + inputFilename);
+
+  SymbolMap map{};
+  std::string line;
+  while (std::getline(inputFile, line))
+  {
+    std::istringstream fields{line};
+    std::string kind;
+    if (!(fields >> kind))
+      continue;
+
+    if (kind == "F")
+    {
+      int start, end;
+      std::string name;
+      if (!(fields >> start >> end >> name))
+        throw std::runtime_error("Invalid symbol map line '" + line + "'");
+      map.addFunction(start, end, name);
+    }
+    else if (kind == "R")
+    {
+      int address;
+      if (!(fields >> address))
+        throw std::runtime_error("Invalid symbol map line '" + line + "'");
+      map.addReturnSite(address);
+    }
+    else
+      throw std::runtime_error("Invalid symbol map line '" + line + "'");
+  }
+  return map;
+}
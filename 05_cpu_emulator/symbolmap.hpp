@@ -0,0 +1,38 @@
+#ifndef SYMBOL_MAP_HPP
+#define SYMBOL_MAP_HPP
+
+#include <string>
+#include <vector>
+
+// The VM translator's --sym output: the ROM address range of every VM
+// function and the return sites of every call, indexed by address
+class SymbolMap
+{
+public:
+  struct Function
+  {
+    int start;
+    int end;
+    std::string name;
+  };
+
+  SymbolMap();
+  void addFunction(int start, int end, const std::string &name);
+  void addReturnSite(int address);
+  const std::vector<Function> &getFunctions() const;
+  int functionEntryAt(int address) const;
+  int functionContaining(int address) const;
+  bool isReturnSite(int address) const;
+
+  static SymbolMap read(const std::string &inputFilename);
+
+private:
+  std::vector<Function> functions;
+  // Index of the function starting at, and containing, every ROM address,
+  // or -1
+  std::vector<int> entries;
+  std::vector<int> owners;
+  std::vector<bool> returnSites;
+};
+
+#endif
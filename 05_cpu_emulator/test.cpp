@@ -0,0 +1,1046 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "alu.hpp"
+#include "batchrunner.hpp"
+#include "cpu.hpp"
+#include "framerenderer.hpp"
+#include "heapprofiler.hpp"
+#include "intrinsics.hpp"
+#include "jit.hpp"
+#include "keyboardscript.hpp"
+#include "lockstepcpu.hpp"
+#include "profiler.hpp"
+#include "program.hpp"
+#include "rom.hpp"
+#include "snapshot.hpp"
+#include "symbolmap.hpp"
+#include "tracereader.hpp"
+#include "tracewriter.hpp"
+
+/*
+These are the unit tests for the ALU table, program decoder and fusion, ROM
+loader, CPU and JIT modules.
+
+Each fuction performs unit tests on a specific module and returns 0 if they
+pass, and 1 otherwise.
+*/
+
+int fail(const std::string &reason);
+
+// The ALU of 02/ALU.hdl, one control bit at a time
+static uint16_t referenceAlu(int bits, uint16_t x, uint16_t y)
+{
+  if (bits & 0x20)
+    x = 0;
+  if (bits & 0x10)
+    x = ~x;
+  if (bits & 0x08)
+    y = 0;
+  if (bits & 0x04)
+    y = ~y;
+  uint16_t out = (bits & 0x02) ? x + y : x & y;
+  if (bits & 0x01)
+    out = ~out;
+  return out;
+}
+
+int aluTest()
+{
+  const uint16_t values[]{0, 1, 2, 0x7FFF, 0x8000, 0xFFFF, 0x1234, 0xABCD};
+  for (int bits = 0; bits < 64; bits++)
+    for (uint16_t x : values)
+      for (uint16_t y : values)
+        if (computeAlu(ALU_TABLE[bits], x, y) != referenceAlu(bits, x, y))
+          return fail("ALU table entry " + std::to_string(bits) +
+                      " does not match the ALU's control bits");
+  return 0;
+}
+
+int programTest()
+{
+  // @21
+  Program::Instruction instruction{Program::decode(0x0015)};
+  if (!(instruction.flags & Program::A_INSTRUCTION) ||
+      instruction.constant != 21)
+    return fail("'@21' was not decoded as an A instruction");
+
+  // AM=M-1
+  instruction = Program::decode(0xFCA8);
+  if (instruction.flags != (Program::USE_M | Program::DEST_A |
+                            Program::DEST_M) ||
+      instruction.alu != 0x32 || instruction.jump != 0)
+    return fail("'AM=M-1' was decoded incorrectly");
+
+  // D;JLE
+  instruction = Program::decode(0xE306);
+  if (instruction.flags != 0 || instruction.alu != 0x0C ||
+      instruction.jump != (Program::JUMP_LT | Program::JUMP_EQ))
+    return fail("'D;JLE' was decoded incorrectly");
+
+  // @2, 0;JMP at address 2 is a halt loop, at address 1 it is not
+  Program program{{0x0000, 0x0002, 0x0002, 0xEA87}};
+  if (program.size() != 4 || program[2].flags & Program::HALT_LOOP ||
+      !(program[3].flags & Program::HALT_LOOP))
+    return fail("Halt loop was not detected");
+  if (program.getWord(4) != 0 || !(program[4].flags & Program::A_INSTRUCTION))
+    return fail("ROM past the loaded image is not zeroed");
+
+  return 0;
+}
+
+// push constant 7, push constant 5, sub, then pop into D and halt, as the VM
+// translator emits them
+static const std::vector<uint16_t> STACK_PROGRAM{
+    0x0100, 0xEC10, 0x0000, 0xE308,
+    0x0007, 0xEC10, 0x0000, 0xFC20, 0xE308, 0x0000, 0xFDC8,
+    0x0005, 0xEC10, 0x0000, 0xFC20, 0xE308, 0x0000, 0xFDC8,
+    0x0000, 0xFC88, 0x0000, 0xFC20, 0xFC10,
+    0x0000, 0xFC88, 0x0000, 0xFC20, 0xF1C8, 0x0000, 0xFDC8,
+    0x0000, 0xFC88, 0x0000, 0xFC20, 0xFC10,
+    0x0023, 0xEA87};
+
+int fusionTest()
+{
+  Program program{STACK_PROGRAM};
+  if (program[0].op != Program::OP_A_C || program[2].op != Program::OP_A_C ||
+      program[4].op != Program::OP_A_C_PUSH_D || program[4].length != 7 ||
+      program[18].op != Program::OP_BINARY || program[18].length != 12 ||
+      program[30].op != Program::OP_POP_D || program[35].op != Program::OP_A_C)
+    return fail("Translator idioms were not fused");
+  if (program[6].op != Program::OP_PUSH_D || program[9].op != Program::OP_INC_SP)
+    return fail("Addresses inside a fused sequence lost their own op");
+
+  Program plain{STACK_PROGRAM, false};
+  if (plain[4].op != Program::OP_A || plain[4].length != 1)
+    return fail("Program fused instructions with fusion disabled");
+
+  // Every cycle budget must stop both programs in the same state
+  std::shared_ptr<const Program> fused{
+      std::make_shared<const Program>(STACK_PROGRAM)};
+  std::shared_ptr<const Program> unfused{
+      std::make_shared<const Program>(STACK_PROGRAM, false)};
+  for (uint64_t budget = 0; budget <= STACK_PROGRAM.size() + 2; budget++)
+  {
+    Cpu fast{fused};
+    Cpu slow{unfused};
+    if (fast.run(budget) != slow.run(budget) || fast.getPc() != slow.getPc() ||
+        fast.getA() != slow.getA() || fast.getD() != slow.getD() ||
+        fast.peek(0) != slow.peek(0) || fast.peek(256) != slow.peek(256) ||
+        fast.peek(257) != slow.peek(257))
+      return fail("Fused run stopped in a different state after " +
+                  std::to_string(budget) + " cycles");
+  }
+
+  Cpu cpu{fused};
+  cpu.run(1000);
+  if (!cpu.isHalted() || cpu.getD() != 2 || cpu.peek(0) != 256 ||
+      cpu.getCycles() != STACK_PROGRAM.size())
+    return fail("Stack program did not compute 7 - 5");
+
+  // Stepping one instruction at a time never runs a superinstruction
+  Cpu stepped{fused};
+  for (size_t i = 0; i < STACK_PROGRAM.size(); i++)
+    stepped.step();
+  if (!stepped.isHalted() || stepped.getD() != 2)
+    return fail("Stepping through the stack program failed");
+
+  return 0;
+}
+
+int romTest()
+{
+  std::vector<uint16_t> rom{loadRom("test.hack")};
+  if (rom.size() != 20 || rom[0] != 0x0002 || rom[1] != 0xEA88)
+    return fail("test.hack was not loaded correctly");
+  return 0;
+}
+
+int cpuTest()
+{
+  Cpu cpu{std::make_shared<const Program>(loadRom("test.hack"))};
+  cpu.poke(0, 7);
+  cpu.poke(1, 6);
+  cpu.run(10000);
+  if (!cpu.isHalted() || cpu.peek(2) != 42)
+    return fail("test.hack did not halt with R2 = 42");
+  if (cpu.getPc() != 18 || cpu.getCycles() != 6 + 6 * 12 + 4 + 2)
+    return fail("test.hack halted at the wrong PC or cycle count");
+  if (cpu.run(100) != 0)
+    return fail("Halted CPU kept running");
+
+  // Registers update after M is written and the jump is taken:
+  // @100, M=1, @5, D=A, @3, AM=D+1;JMP
+  Cpu jump{std::make_shared<const Program>(
+      std::vector<uint16_t>{100, 0xEFC8, 5, 0xEC10, 3, 0xE7EF})};
+  jump.run(6);
+  if (jump.getPc() != 3 || jump.getA() != 6 || jump.peek(3) != 6 ||
+      jump.getD() != 5 || jump.peek(100) != 1)
+    return fail("M write or jump did not use A's previous value");
+
+  // Writes to the keyboard register are ignored: @24576, M=-1
+  Cpu keyboard{std::make_shared<const Program>(
+      std::vector<uint16_t>{0x6000, 0xEE88})};
+  keyboard.run(2);
+  if (keyboard.peek(Cpu::KEYBOARD) != 0)
+    return fail("CPU wrote the keyboard register");
+
+  return 0;
+}
+
+// Encodes a C instruction from its comp bits (c1..c6), a bit, dest and jump
+static uint16_t cInstruction(int bits, bool useM, int dest, int jump)
+{
+  return 0xE000 | (useM << 12) | (bits << 6) | (dest << 3) | jump;
+}
+
+// Runs every ALU computation on A and M, every jump condition on negative,
+// zero and positive values and a computed jump, storing results in RAM
+static std::vector<uint16_t> jitProgram()
+{
+  const int DEST_M{1};
+  const int DEST_D{2};
+  const uint16_t D_EQ_A{0xEC10};
+  const uint16_t M_EQ_D{0xE308};
+  std::vector<uint16_t> rom;
+
+  for (int bits = 0; bits < 64; bits++)
+    for (int useM = 0; useM < 2; useM++)
+      rom.insert(rom.end(), {0x1234, D_EQ_A, 0x2BCD,
+                             cInstruction(bits, useM, DEST_D, 0),
+                             static_cast<uint16_t>(1000 + bits * 2 + useM),
+                             M_EQ_D});
+
+  // @|value|; D=A; D=-D or D=D; @skip; D;Jxx; @counter; M=1; (skip)
+  uint16_t counter{2000};
+  for (int jump = 1; jump < 8; jump++)
+    for (int value = -1; value <= 1; value++)
+    {
+      const uint16_t skip = rom.size() + 7;
+      rom.insert(rom.end(),
+                 {static_cast<uint16_t>(value < 0 ? -value : value), D_EQ_A,
+                  cInstruction(value < 0 ? 0x0F : 0x0C, false, DEST_D, 0),
+                  skip, cInstruction(0x0C, false, 0, jump), counter++,
+                  cInstruction(0x3F, false, DEST_M, 0)});
+    }
+
+  // Computed jump through RAM[5] to the halt loop: @halt; D=A; @R5; M=D;
+  // A=M; 0;JMP; then writing the keyboard, which must be skipped
+  const uint16_t halt = rom.size() + 9;
+  rom.insert(rom.end(), {halt, D_EQ_A, 5, M_EQ_D, 0xFC20, 0xEA87, 0x6000,
+                         0xEE88, 0x0000, halt, 0xEA87});
+  return rom;
+}
+
+int jitTest()
+{
+  if (!Jit::isSupported())
+    return 0;
+
+  std::shared_ptr<const Program> program{
+      std::make_shared<const Program>(jitProgram())};
+  Cpu interpreted{program};
+  interpreted.poke(0x2BCD, 0x5555);
+  interpreted.run(100000);
+  if (!interpreted.isHalted())
+    return fail("JIT test program did not halt");
+
+  Jit jit{program};
+  Cpu compiled{program};
+  compiled.poke(0x2BCD, 0x5555);
+  jit.run(compiled, 100000);
+  if (!compiled.isHalted() || compiled.getPc() != interpreted.getPc() ||
+      compiled.getCycles() != interpreted.getCycles())
+    return fail("JIT halted at a different PC or cycle count");
+  for (int address = 0; address < 0x8000; address++)
+    if (compiled.peek(address) != interpreted.peek(address))
+      return fail("JIT left RAM[" + std::to_string(address) +
+                  "] different from the interpreter");
+
+  // Every budget must stop the JIT in the interpreter's state, including
+  // budgets that end inside a block
+  std::shared_ptr<const Program> stack{
+      std::make_shared<const Program>(STACK_PROGRAM)};
+  Jit stackJit{stack};
+  for (uint64_t budget = 0; budget <= STACK_PROGRAM.size() + 2; budget++)
+  {
+    Cpu fast{stack};
+    Cpu slow{stack};
+    if (stackJit.run(fast, budget) != slow.run(budget) ||
+        fast.getPc() != slow.getPc() || fast.getA() != slow.getA() ||
+        fast.getD() != slow.getD() || fast.peek(0) != slow.peek(0) ||
+        fast.peek(256) != slow.peek(256) || fast.peek(257) != slow.peek(257))
+      return fail("JIT stopped in a different state after " +
+                  std::to_string(budget) + " cycles");
+  }
+
+  // Running in slices through already chained blocks matches one long run
+  std::shared_ptr<const Program> mult{
+      std::make_shared<const Program>(loadRom("test.hack"))};
+  Jit multJit{mult};
+  Cpu sliced{mult};
+  sliced.poke(0, 7);
+  sliced.poke(1, 6);
+  while (!sliced.isHalted())
+    multJit.run(sliced, 5);
+  if (sliced.peek(2) != 42 || sliced.getCycles() != 6 + 6 * 12 + 4 + 2)
+    return fail("JIT run in slices did not halt with R2 = 42");
+
+  return 0;
+}
+
+int profilerTest()
+{
+  // Calls f twice through R13 the way the translator calls functions:
+  // @ret; D=A; @R13; M=D; @f; 0;JMP; (ret), then halts. f returns with
+  // @R13; A=M; 0;JMP
+  const uint16_t D_EQ_A{0xEC10};
+  const uint16_t M_EQ_D{0xE308};
+  const uint16_t A_EQ_M{0xFC20};
+  const uint16_t JMP{0xEA87};
+  std::shared_ptr<const Program> program{std::make_shared<const Program>(
+      std::vector<uint16_t>{6, D_EQ_A, 13, M_EQ_D, 14, JMP, 12, D_EQ_A, 13,
+                            M_EQ_D, 14, JMP, 12, JMP, 13, A_EQ_M, JMP})};
+  SymbolMap symbols{};
+  symbols.addFunction(14, 17, "f");
+  symbols.addReturnSite(6);
+  symbols.addReturnSite(12);
+
+  Cpu cpu{program};
+  Profiler profiler{program, symbols};
+  profiler.run(cpu, 1000);
+  if (!cpu.isHalted())
+    return fail("Profiler did not run the program to its halt loop");
+
+  const std::vector<Profiler::FunctionProfile> profiles{
+      profiler.getProfiles()};
+  if (profiles.size() != 2 || profiles[0].name != "(bootstrap)" ||
+      profiles[0].exclusive != cpu.getCycles() - 6 ||
+      profiles[0].inclusive != cpu.getCycles())
+    return fail("Profiler attributed the caller's instructions incorrectly");
+  if (profiles[1].name != "f" || profiles[1].calls != 2 ||
+      profiles[1].exclusive != 6 || profiles[1].inclusive != 6)
+    return fail("Profiler did not see two calls of three instructions");
+
+  const std::vector<uint64_t> counts{profiler.getAddressCounts()};
+  if (counts[0] != 1 || counts[11] != 1 || counts[14] != 2 ||
+      counts[16] != 2 || counts[17] != 0)
+    return fail("Profiler counted address executions incorrectly");
+
+  std::ostringstream folded;
+  profiler.printFolded(folded);
+  if (folded.str() != "(bootstrap) " + std::to_string(cpu.getCycles() - 6) +
+                          "\nf 6\n")
+    return fail("Folded stacks were printed incorrectly");
+
+  // g has no locals, so its loop label is its entry point. Its if-goto and
+  // goto back to it are not calls: R0 = 3, R1 = 2 loop 35 instructions in
+  // one call, then return to the halt loop
+  const uint16_t M_EQ_M_MINUS_1{0xFC88};
+  const uint16_t D_EQ_M{0xFC10};
+  const uint16_t D_JGT{0xE301};
+  const uint16_t D_JLE{0xE306};
+  std::shared_ptr<const Program> loop{std::make_shared<const Program>(
+      std::vector<uint16_t>{6, D_EQ_A, 13, M_EQ_D, 8, JMP, 6, JMP, 0,
+                            M_EQ_M_MINUS_1, D_EQ_M, 8, D_JGT, 1,
+                            M_EQ_M_MINUS_1, D_EQ_M, 20, D_JLE, 8, JMP, 13,
+                            A_EQ_M, JMP})};
+  SymbolMap loopSymbols{};
+  loopSymbols.addFunction(8, 23, "g");
+  loopSymbols.addReturnSite(6);
+
+  Cpu looping{loop};
+  looping.poke(0, 3);
+  looping.poke(1, 2);
+  Profiler loopProfiler{loop, loopSymbols};
+  loopProfiler.run(looping, 1000);
+  const std::vector<Profiler::FunctionProfile> loopProfiles{
+      loopProfiler.getProfiles()};
+  if (!looping.isHalted() || loopProfiles.size() != 2 ||
+      loopProfiles[0].name != "g" || loopProfiles[0].calls != 1 ||
+      loopProfiles[0].exclusive != 35 || loopProfiles[0].inclusive != 35)
+    return fail("Profiler counted jumps to a loop at a function's entry as "
+                "calls");
+
+  std::ostringstream loopFolded;
+  loopProfiler.printFolded(loopFolded);
+  if (loopFolded.str() != "(bootstrap) " +
+                              std::to_string(looping.getCycles() - 35) +
+                              "\ng 35\n")
+    return fail("Folded stacks nested loop iterations as calls");
+
+  return 0;
+}
+
+int screenTest()
+{
+  // @16417; M=-1 (row 1, at a known address); @5; A=M; M=1 (row 100 through
+  // RAM[5]); @KBD; M=1 (ignored); then halts
+  const uint16_t A_EQ_M{0xFC20};
+  const uint16_t M_EQ_ONE{0xEFC8};
+  const uint16_t M_EQ_MINUS_ONE{0xEE88};
+  std::shared_ptr<const Program> program{std::make_shared<const Program>(
+      std::vector<uint16_t>{Cpu::SCREEN + 33, M_EQ_MINUS_ONE, 5, A_EQ_M,
+                            M_EQ_ONE, Cpu::KEYBOARD, M_EQ_ONE, 7, 0xEA87})};
+  const std::vector<int> expectedRows{1, 100};
+
+  Cpu cpu{program};
+  cpu.poke(5, Cpu::SCREEN + 100 * Cpu::SCREEN_ROW_WORDS + 31);
+  cpu.run(100);
+  if (cpu.takeDirtyRows() != expectedRows)
+    return fail("Screen writes did not mark rows 1 and 100 dirty");
+  if (!cpu.takeDirtyRows().empty())
+    return fail("Taking dirty rows did not clear them");
+
+  if (Jit::isSupported())
+  {
+    Cpu jitCpu{program};
+    jitCpu.poke(5, Cpu::SCREEN + 100 * Cpu::SCREEN_ROW_WORDS + 31);
+    Jit jit{program};
+    jit.run(jitCpu, 100);
+    if (jitCpu.takeDirtyRows() != expectedRows)
+      return fail("JIT screen writes did not mark rows 1 and 100 dirty");
+  }
+
+  // Frames hold the rows that changed; the leftmost pixel is bit 0
+  const std::string directory{"frames.test"};
+  Cpu screen{program};
+  screen.poke(Cpu::SCREEN + 255 * Cpu::SCREEN_ROW_WORDS, 1);
+  {
+    FrameRenderer renderer{directory, FrameRenderer::PPM_FORMAT};
+    renderer.capture(screen, 7);
+    screen.poke(Cpu::SCREEN, 0);
+    renderer.capture(screen, 8);
+    renderer.finish();
+    if (renderer.getFrameCount() != 1)
+      return fail("Renderer wrote a frame where nothing changed");
+  }
+
+  std::ifstream frame{directory + "/frame_000007.ppm", std::ios::binary};
+  const std::string ppm{std::istreambuf_iterator<char>(frame),
+                        std::istreambuf_iterator<char>()};
+  const std::string header{"P6\n512 256\n255\n"};
+  const size_t lastRow{header.size() + 255 * Cpu::SCREEN_WIDTH * 3};
+  std::filesystem::remove_all(directory);
+  if (ppm.size() != header.size() + Cpu::SCREEN_WIDTH * Cpu::SCREEN_HEIGHT * 3 ||
+      ppm.compare(0, header.size(), header) != 0)
+    return fail("Frame is not a 512x256 PPM image");
+  if (ppm[lastRow] != 0 || ppm[lastRow + 3] != '\xFF' ||
+      ppm[header.size()] != '\xFF')
+    return fail("Frame pixels do not match the screen");
+
+  return 0;
+}
+
+// Runs a program with a keyboard script until it halts, stopping at every
+// event as main does
+static uint16_t runWithKeys(std::shared_ptr<const Program> program,
+                            KeyboardScript script)
+{
+  Cpu cpu{program};
+  while (!cpu.isHalted())
+  {
+    script.apply(cpu);
+    cpu.run(std::min<uint64_t>(script.getNextCycle() - cpu.getCycles(), 100));
+  }
+  return cpu.peek(0);
+}
+
+int keyboardTest()
+{
+  std::istringstream lines{"# cycle key\n"
+                           "10 'a'\n"
+                           "+5 NEWLINE\n"
+                           "  20 0\n"
+                           "20 '#'\n"};
+  const KeyboardScript script{KeyboardScript::parse(lines)};
+  const std::vector<KeyboardScript::Event> &events{script.getEvents()};
+  if (events.size() != 4 || events[0].cycle != 10 || events[0].key != 'a' ||
+      events[1].cycle != 15 || events[1].key != 128 || events[2].cycle != 20 ||
+      events[2].key != 0 || events[3].key != '#')
+    return fail("Keyboard script was parsed incorrectly");
+
+  std::istringstream unordered{"10 1\n5 2\n"};
+  std::istringstream unknownKey{"10 SHIFT\n"};
+  for (std::istringstream *invalid : {&unordered, &unknownKey})
+    try
+    {
+      KeyboardScript::parse(*invalid);
+      return fail("Invalid keyboard script was accepted");
+    }
+    catch (const std::exception &)
+    {
+    }
+
+  // @KBD; D=M; @R0; M=D; halt. A key pressed at cycle 1 is in the register
+  // when D=M runs, one pressed at cycle 2 is not.
+  std::shared_ptr<const Program> program{std::make_shared<const Program>(
+      std::vector<uint16_t>{Cpu::KEYBOARD, 0xFC10, 0, 0xE308, 4, 0xEA87})};
+  KeyboardScript early{};
+  early.addEvent(1, 'x');
+  KeyboardScript late{};
+  late.addEvent(2, 'x');
+  if (runWithKeys(program, early) != 'x' || runWithKeys(program, late) != 0)
+    return fail("Key events did not arrive at their exact cycle");
+
+  return 0;
+}
+
+// Counts RAM[1] down from 1000 while counting RAM[2] up and a screen word
+// down, sums 500 + 499 + ... + 1 into RAM[4] (59714 after wrapping), whose
+// growing steps fastForward must not extrapolate, then waits for a key to
+// store in RAM[3]
+static const std::vector<uint16_t> LOOP_PROGRAM{
+    1000,   0xEC10, 1,      0xE308, 2,      0xFDC8, 0x4028, 0xFC88, 1,
+    0xFC98, 4,      0xE301, 500,    0xEC10, 4,      0xF088, 0xE390, 14,
+    0xE301, 0x6000, 0xFC10, 19,     0xE302, 3,      0xE308, 25,     0xEA87};
+
+// Runs up to maxCycles, stopping at every key event as main does
+static void runLoops(Cpu &cpu, Jit *jit, KeyboardScript script,
+                     uint64_t maxCycles)
+{
+  while (!cpu.isHalted() && cpu.getCycles() < maxCycles)
+  {
+    script.apply(cpu);
+    const uint64_t cycles{std::min(script.getNextCycle(), maxCycles) -
+                          cpu.getCycles()};
+    if (jit)
+      jit->run(cpu, cycles);
+    else
+      cpu.run(cycles);
+  }
+}
+
+int fastForwardTest()
+{
+  std::shared_ptr<const Program> program{
+      std::make_shared<const Program>(LOOP_PROGRAM)};
+  if (!((*program)[11].flags & Program::LOOP_EDGE) ||
+      ((*program)[26].flags & Program::LOOP_EDGE))
+    return fail("Loop back edges were marked incorrectly");
+
+  KeyboardScript script{};
+  script.addEvent(40000, 'k');
+  std::unique_ptr<Jit> jit;
+  if (Jit::isSupported())
+    jit = std::make_unique<Jit>(program);
+
+  // Stopping anywhere, in or after a skipped stretch, leaves the same state
+  // and cycle count as running every iteration
+  for (uint64_t budget : {1, 100, 555, 4000, 7999, 8003, 9000, 10500, 20000,
+                          40003, 100000})
+    for (Jit *engine : {static_cast<Jit *>(nullptr), jit.get()})
+    {
+      Cpu fast{program};
+      Cpu slow{program};
+      slow.setFastForward(false);
+      runLoops(fast, engine, script, budget);
+      runLoops(slow, nullptr, script, budget);
+      if (fast.getPc() != slow.getPc() || fast.getA() != slow.getA() ||
+          fast.getD() != slow.getD() || fast.getCycles() != slow.getCycles() ||
+          fast.isHalted() != slow.isHalted() ||
+          fast.takeDirtyRows() != slow.takeDirtyRows())
+        return fail("Fast forward stopped in a different state after " +
+                    std::to_string(budget) + " cycles");
+      for (int address = 0; address < 0x8000; address++)
+        if (fast.peek(address) != slow.peek(address))
+          return fail("Fast forward left RAM[" + std::to_string(address) +
+                      "] different after " + std::to_string(budget) +
+                      " cycles");
+    }
+
+  Cpu cpu{program};
+  runLoops(cpu, nullptr, script, 100000);
+  if (!cpu.isHalted() || cpu.peek(2) != 1000 || cpu.peek(4) != 59714 ||
+      cpu.peek(3) != 'k' || cpu.getCycles() != 40010)
+    return fail("Loop test program did not halt with the expected results");
+
+  return 0;
+}
+
+int snapshotTest()
+{
+  std::shared_ptr<const Program> program{
+      std::make_shared<const Program>(loadRom("test.hack"))};
+  Cpu original{program};
+  original.poke(0, 7);
+  original.poke(1, 6);
+  original.poke(Cpu::SCREEN, 0x00FF);
+  // 6 setup instructions and 34 of the 12 instruction loop: R2 = 3 * 7
+  original.run(40);
+
+  const std::string path{"snapshot.test"};
+  Snapshot::capture(original).write(path);
+  original.run(1000);
+
+  // Two runs from the same file, the first of which writes the RAM it
+  // shares with the file until it copies the pages
+  const Snapshot snapshot{Snapshot::read(path)};
+  std::filesystem::remove(path);
+  if (snapshot.getCycles() != 40 || snapshot.peek(0) != 7)
+    return fail("Snapshot file does not hold the captured state");
+  for (int run = 0; run < 2; run++)
+  {
+    Cpu restored{program};
+    restored.poke(0, 1);
+    snapshot.restore(restored);
+    if (restored.peek(0) != 7 || restored.peek(2) != 21 ||
+        restored.getCycles() != 40 ||
+        restored.takeDirtyRows().size() != Cpu::SCREEN_HEIGHT)
+      return fail("Restoring a snapshot did not restore the captured state");
+    restored.poke(1, 100);
+    restored.reset();
+    if (restored.peek(Cpu::SCREEN) != 0)
+      return fail("Reset did not clear RAM restored from a snapshot");
+    snapshot.restore(restored);
+    restored.run(1000);
+    if (!restored.isHalted() || restored.peek(2) != 42 ||
+        restored.getCycles() != original.getCycles() ||
+        restored.peek(Cpu::SCREEN) != 0x00FF)
+      return fail("Run from a snapshot did not finish like the original");
+  }
+
+  Cpu other{std::make_shared<const Program>(STACK_PROGRAM)};
+  try
+  {
+    snapshot.restore(other);
+    return fail("Snapshot was restored into a different program");
+  }
+  catch (const std::invalid_argument &)
+  {
+  }
+
+  return 0;
+}
+
+// Calls the function at 10 with two arguments through a frame laid out as
+// the translator's call leaves it, returning to a halt loop at 4
+static void callWithFrame(Cpu &cpu, int16_t x, int16_t y)
+{
+  const std::vector<std::pair<int, int>> ram{
+      {0, 263},  {1, 263},  {2, 256},  {256, x},   {257, y},  {258, 4},
+      {259, 300}, {260, 400}, {261, 3000}, {262, 4000}};
+  for (const std::pair<int, int> &word : ram)
+    cpu.poke(word.first, word.second);
+}
+
+int intrinsicsTest()
+{
+  SymbolMap symbols{};
+  symbols.addFunction(10, 12, "Math.multiply");
+  symbols.addFunction(12, 14, "Main.main");
+  const std::vector<std::pair<int, uint8_t>> intrinsics{
+      findIntrinsics(symbols)};
+  if (intrinsics.size() != 1 || intrinsics[0].first != 10 ||
+      intrinsics[0].second != MATH_MULTIPLY)
+    return fail("Intrinsics were not found by function name");
+
+  // @10; 0;JMP; then halt loops at 4 (the return site) and 10 (the VM code)
+  const std::vector<uint16_t> rom{10, 0xEA87, 0, 0, 4, 0xEA87,
+                                  0,  0,      0, 0, 10, 0xEA87};
+  std::shared_ptr<const Program> program{
+      std::make_shared<const Program>(rom, true, intrinsics)};
+  std::unique_ptr<Jit> jit;
+  if (Jit::isSupported())
+    jit = std::make_unique<Jit>(program);
+
+  for (Jit *engine : {static_cast<Jit *>(nullptr), jit.get()})
+  {
+    Cpu cpu{program};
+    callWithFrame(cpu, -3, 7);
+    if (engine)
+      engine->run(cpu, 100000);
+    else
+      cpu.run(100000);
+    if (!cpu.isHalted() || cpu.getPc() != 4 || cpu.getA() != 4 ||
+        cpu.getD() != 300)
+      return fail("Intrinsic did not return to its caller");
+    if (static_cast<int16_t>(cpu.peek(256)) != -21 || cpu.peek(0) != 257 ||
+        cpu.peek(1) != 300 || cpu.peek(2) != 400 || cpu.peek(3) != 3000 ||
+        cpu.peek(4) != 4000 || cpu.peek(13) != 263 || cpu.peek(14) != 4)
+      return fail("Intrinsic left RAM different from the return sequence");
+  }
+
+  // Short budgets run the VM code, which here halts at the entry point
+  Cpu shortBudget{program};
+  callWithFrame(shortBudget, 6, 7);
+  shortBudget.run(100);
+  if (!shortBudget.isHalted() || shortBudget.getPc() != 10)
+    return fail("Intrinsic ran without the budget covering its cost");
+
+  return 0;
+}
+
+// Main.main calls a Memory.alloc stub at 20 returning 2048, then a
+// Memory.deAlloc stub at 30 with that address, then halts at 8
+const std::vector<uint16_t> HEAP_PROGRAM{
+    20, 0xEA87, 2048, 0xEC10, 280, 0xE308, 30, 0xEA87, 8, 0xEA87,
+    0,  0,      0,    0,      0,   0,      0,  0,      0, 0,
+    14, 0xFC20, 0xEA87, 0,    0,   0,      0,  0,      0, 0,
+    15, 0xFC20, 0xEA87};
+
+int heapTest()
+{
+  SymbolMap symbols{};
+  symbols.addFunction(0, 20, "Main.main");
+  symbols.addFunction(20, 30, "Memory.alloc");
+  symbols.addFunction(30, 40, "Memory.deAlloc");
+  const std::vector<int> traps{HeapProfiler{HEAP_PROGRAM, symbols}.getTraps()};
+  if (traps != std::vector<int>{20, 22, 30})
+    return fail("Heap profiler did not trap the heap functions");
+
+  std::shared_ptr<const Program> program{
+      std::make_shared<const Program>(HEAP_PROGRAM, true,
+                                      std::vector<std::pair<int, uint8_t>>{},
+                                      traps)};
+  std::unique_ptr<Jit> jit;
+  if (Jit::isSupported())
+    jit = std::make_unique<Jit>(program);
+
+  for (Jit *engine : {static_cast<Jit *>(nullptr), jit.get()})
+  {
+    // Runs stop before a trap, unless they start at it
+    Cpu stopped{program};
+    const uint64_t first{engine ? engine->run(stopped, 1000)
+                                : stopped.run(1000)};
+    const uint64_t second{engine ? engine->run(stopped, 1000)
+                                 : stopped.run(1000)};
+    if (first != 2 || second != 2 || stopped.getPc() != 22)
+      return fail("Run did not stop at a trap");
+
+    // SP, LCL and ARG of the call, with the size argument, the return
+    // address in the frame and alloc's result on the stack
+    Cpu cpu{program};
+    const std::vector<std::pair<int, int>> ram{
+        {0, 300},  {1, 290}, {2, 280}, {14, 2},
+        {15, 8},   {280, 5}, {285, 2}, {299, 2048}};
+    for (const std::pair<int, int> &word : ram)
+      cpu.poke(word.first, word.second);
+    HeapProfiler profiler{HEAP_PROGRAM, symbols};
+    profiler.run(cpu, engine, 1000);
+    if (!cpu.isHalted() || cpu.getCycles() != 16)
+      return fail("Heap profiler changed the program's run");
+
+    const std::vector<HeapProfiler::Event> &events{profiler.getEvents()};
+    if (events.size() != 2 || events[0].free || events[0].address != 2048 ||
+        events[0].size != 5 || events[0].site != 0 || events[0].cycle != 4 ||
+        events[0].liveWords != 5 || events[0].span != 5)
+      return fail("Heap profiler did not record the allocation");
+    if (!events[1].free || events[1].address != 2048 ||
+        events[1].size != 5 || events[1].cycle != 11 ||
+        events[1].liveWords != 0)
+      return fail("Heap profiler did not record the free");
+    if (profiler.getPeakWords() != 5 || profiler.getLiveBlockCount() != 0)
+      return fail("Heap profiler did not track live blocks");
+
+    // Header, two 7 byte events and three length prefixed names
+    const std::string path{"heap.test"};
+    profiler.writeTrace(path);
+    const uintmax_t size{std::filesystem::file_size(path)};
+    std::filesystem::remove(path);
+    if (size != 16 + 2 * 7 + 6 + 9 + 12 + 14)
+      return fail("Heap trace does not hold the events");
+  }
+
+  // A superinstruction over a trap falls back to its first word
+  const Program trapped{{0, 0xFDC8}, true, {}, {1}};
+  if (trapped[0].length != 1 || trapped[1].op != Program::OP_TRAP)
+    return fail("Superinstruction ran over a trap");
+
+  return 0;
+}
+
+int traceTest()
+{
+  // R2 = R0 * R1 by 6000 additions: over one chunk of records
+  std::shared_ptr<const Program> program{
+      std::make_shared<const Program>(loadRom("test.hack"))};
+  Cpu traced{program};
+  traced.poke(0, 3);
+  traced.poke(1, 6000);
+  const std::string path{"trace.test"};
+  {
+    TraceWriter writer{path, traced.getCycles()};
+    writer.run(traced, 1000);
+    writer.run(traced, 1000000);
+    writer.finish();
+  }
+  const TraceReader reader{TraceReader::read(path)};
+  std::filesystem::remove(path);
+  if (!traced.isHalted() || traced.peek(2) != 18000 ||
+      reader.getRecordCount() != traced.getCycles() ||
+      reader.getChunkCount() != 2)
+    return fail("Trace does not hold every instruction");
+
+  const std::vector<TraceRecord> records{
+      reader.getRecords(0, reader.getRecordCount())};
+  if (records.size() != traced.getCycles())
+    return fail("Trace did not decode every record");
+  Cpu reference{program};
+  reference.poke(0, 3);
+  reference.poke(1, 6000);
+  for (const TraceRecord &record : records)
+  {
+    const uint16_t pc{reference.getPc()};
+    const uint16_t address = reference.getA() & 0x7FFF;
+    const uint16_t before{reference.peek(address)};
+    reference.step();
+    if (record.pc != pc || record.a != reference.getA() ||
+        record.d != reference.getD())
+      return fail("Trace record does not match the instruction");
+    if (record.write ? record.address != address ||
+                           record.value != reference.peek(address)
+                     : reference.peek(address) != before)
+      return fail("Trace record does not match the RAM write");
+  }
+
+  // Seeking into the second chunk decodes from its start
+  const std::vector<TraceRecord> seek{reader.getRecords(70000, 3)};
+  if (seek.size() != 3 || seek[0].pc != records[70000].pc ||
+      seek[2].a != records[70002].a || seek[2].d != records[70002].d)
+    return fail("Trace did not seek to a cycle");
+  if (!reader.getRecords(traced.getCycles(), 1).empty())
+    return fail("Trace returned records past its end");
+
+  return 0;
+}
+
+// Jumps to RAM[0], which sets D to 1 at 3 or to -1 at 6, then stores D in
+// RAM[1] and in the word RAM[2] points to, and halts at 14
+const std::vector<uint16_t> SPLIT_PROGRAM{
+    0x0000, 0xFC20, 0xEA87, 0xEFD0, 0x0009, 0xEA87, 0xEE90, 0x0009,
+    0xEA87, 0x0001, 0xE308, 0x0002, 0xFC20, 0xE308, 0x000E, 0xEA87};
+
+// Counts RAM[1] down to 0, and on every pass increments RAM[2] at 10 if
+// RAM[0] is even or decrements RAM[3] at 14 if it is odd, rejoining at 16.
+// Halts at 20.
+const std::vector<uint16_t> JOIN_PROGRAM{
+    0x0001, 0xFC10, 0x0014, 0xE302, 0x0000, 0xFC10, 0x0001, 0xE010,
+    0x000E, 0xE305, 0x0002, 0xFDC8, 0x0010, 0xEA87, 0x0003, 0xFC88,
+    0x0001, 0xFC88, 0x0000, 0xEA87, 0x0014, 0xEA87};
+
+// Every lane must end exactly like a Cpu given the same RAM
+static int compareLanes(LockstepCpu &lockstep,
+                        std::shared_ptr<const Program> program,
+                        const std::vector<std::vector<std::pair<int, int>>> &rams,
+                        const std::vector<int> &addresses)
+{
+  for (int lane = 0; lane < lockstep.getLaneCount(); lane++)
+  {
+    Cpu cpu{program};
+    for (const std::pair<int, int> &word : rams[lane])
+      cpu.poke(word.first, word.second);
+    cpu.run(1000000);
+    if (lockstep.isHalted(lane) != cpu.isHalted() ||
+        lockstep.getPc(lane) != cpu.getPc() ||
+        lockstep.getA(lane) != cpu.getA() ||
+        lockstep.getD(lane) != cpu.getD() ||
+        lockstep.getCycles(lane) != cpu.getCycles())
+      return fail("Lockstep lane " + std::to_string(lane) +
+                  " stopped in another state than the Cpu");
+    for (int address : addresses)
+      if (lockstep.peek(lane, address) != cpu.peek(address))
+        return fail("Lockstep lane " + std::to_string(lane) +
+                    " has other RAM than the Cpu");
+  }
+  return 0;
+}
+
+int lockstepTest()
+{
+  // Loop counts differ in every lane, so lanes leave the loop one by one
+  std::shared_ptr<const Program> multiply{
+      std::make_shared<const Program>(loadRom("test.hack"), false)};
+  std::shared_ptr<const Program> split{
+      std::make_shared<const Program>(SPLIT_PROGRAM, false)};
+  for (int lanes : {8, 16, 32})
+  {
+    LockstepCpu lockstep{multiply, lanes};
+    std::vector<std::vector<std::pair<int, int>>> rams;
+    for (int lane = 0; lane < lanes; lane++)
+    {
+      rams.push_back({{0, lane + 3}, {1, 2 * lane + 1}});
+      for (const std::pair<int, int> &word : rams.back())
+        lockstep.poke(lane, word.first, word.second);
+    }
+    // Two runs, the first ending in the middle of the loop
+    lockstep.run(50);
+    lockstep.run(1000000);
+    if (lockstep.getHaltedCount() != static_cast<size_t>(lanes) ||
+        compareLanes(lockstep, multiply, rams, {0, 1, 2, 16}))
+      return fail("Lockstep lanes did not multiply like the Cpu");
+
+    // Computed jumps and M at different addresses in every lane
+    LockstepCpu pointers{split, lanes};
+    rams.clear();
+    for (int lane = 0; lane < lanes; lane++)
+    {
+      rams.push_back({{0, lane % 3 ? 3 : 6}, {2, 100 + lane}});
+      for (const std::pair<int, int> &word : rams.back())
+        pointers.poke(lane, word.first, word.second);
+    }
+    pointers.run(1000000);
+    std::vector<int> addresses{0, 1, 2};
+    for (int lane = 0; lane < lanes; lane++)
+      addresses.push_back(100 + lane);
+    if (compareLanes(pointers, split, rams, addresses))
+      return 1;
+  }
+
+  // Lanes at the same PC run as one group until their paths split
+  LockstepCpu uniform{multiply, 8};
+  for (int lane = 0; lane < 8; lane++)
+    uniform.poke(lane, 1, 5);
+  uniform.run(1000000);
+  if (uniform.getGroupCount() != 1 || uniform.getHaltedCount() != 8)
+    return fail("Uniform lanes did not run as one group");
+
+  // Even and odd lanes split and rejoin on every pass, so the groups grow
+  // with the passes, about three a pass, instead of staying at three
+  std::shared_ptr<const Program> join{
+      std::make_shared<const Program>(JOIN_PROGRAM, false)};
+  std::vector<uint64_t> groupCounts;
+  for (int passes : {10, 20})
+  {
+    LockstepCpu joined{join, 8};
+    std::vector<std::vector<std::pair<int, int>>> rams;
+    for (int lane = 0; lane < 8; lane++)
+    {
+      rams.push_back({{0, lane}, {1, passes}});
+      for (const std::pair<int, int> &word : rams.back())
+        joined.poke(lane, word.first, word.second);
+    }
+    joined.run(1000000);
+    if (compareLanes(joined, join, rams, {0, 1, 2, 3}))
+      return 1;
+    groupCounts.push_back(joined.getGroupCount());
+  }
+  if (groupCounts[0] < 2 * 10 || groupCounts[1] < groupCounts[0] + 2 * 10)
+    return fail("Lockstep lanes did not rejoin after splitting");
+
+  try
+  {
+    LockstepCpu invalid{multiply, 12};
+    return fail("Lockstep accepted 12 lanes");
+  }
+  catch (const std::invalid_argument &)
+  {
+  }
+
+  return 0;
+}
+
+int batchTest()
+{
+  std::istringstream manifest{"# R2 = R0 * R1\n"
+                              "multiply test.hack 1000 set:0=7 set:1=6 2=42\n"
+                              "\n"
+                              "negative test.hack 1000 set:0=-3 set:1=5 2=-15\n"
+                              "wrong test.hack 1000 set:0=7 set:1=6 2=41\n"
+                              "budget test.hack 100 set:0=7 set:1=6000\n"
+                              "missing missing.hack 1000\n"};
+  std::vector<BatchRunner::Case> cases{
+      BatchRunner::parseManifest(manifest, "")};
+  if (cases.size() != 5 || cases[0].inputs.size() != 2 ||
+      cases[1].inputs[0].second != 0xFFFD || cases[1].expected.size() != 1)
+    return fail("Manifest was not parsed correctly");
+  // Enough cases that threads run out and steal
+  for (int i = 0; i < 40; i++)
+    cases.push_back({"square" + std::to_string(i), "test.hack", "", 100000,
+                     {{0, i}, {1, i}}, {{2, i * i}}});
+
+  for (bool useJit : {false, true})
+  {
+    BatchRunner runner{cases, useJit};
+    const std::vector<BatchRunner::Result> results{runner.run(3)};
+    if (results.size() != cases.size())
+      return fail("Batch runner skipped cases");
+    if (!results[0].passed || !results[0].halted ||
+        results[0].cycles != 6 + 6 * 12 + 4 + 2 || !results[1].passed)
+      return fail("Batch case did not pass");
+    if (results[2].passed || results[2].failure != "RAM[2] = 42, expected 41")
+      return fail("Batch case with wrong RAM passed");
+    if (results[3].passed || results[3].halted || results[3].cycles != 100)
+      return fail("Batch case ran past its cycle budget");
+    if (results[4].passed || results[4].failure.empty())
+      return fail("Batch case with a missing ROM passed");
+    for (size_t index = 5; index < results.size(); index++)
+      if (!results[index].passed)
+        return fail("Batch case " + cases[index].name + " failed");
+
+    std::ostringstream json;
+    std::ostringstream junit;
+    runner.writeJson(json, results, 1);
+    runner.writeJUnit(junit, results, 1);
+    if (json.str().find("\"failures\": 3") == std::string::npos ||
+        json.str().find("\"name\": \"square39\"") == std::string::npos)
+      return fail("Batch JSON report is incomplete");
+    if (junit.str().find("tests=\"45\" failures=\"3\"") ==
+            std::string::npos ||
+        junit.str().find("<failure message=\"RAM[2] = 42, expected 41\"/>") ==
+            std::string::npos)
+      return fail("Batch JUnit report is incomplete");
+  }
+
+  std::istringstream invalid{"short test.hack\n"};
+  try
+  {
+    BatchRunner::parseManifest(invalid, "");
+    return fail("Invalid manifest line was accepted");
+  }
+  catch (const std::runtime_error &)
+  {
+  }
+
+  return 0;
+}
+
+int main()
+{
+  if (aluTest())
+    return 1;
+  if (programTest())
+    return 1;
+  if (fusionTest())
+    return 1;
+  if (romTest())
+    return 1;
+  if (cpuTest())
+    return 1;
+  if (jitTest())
+    return 1;
+  if (profilerTest())
+    return 1;
+  if (screenTest())
+    return 1;
+  if (keyboardTest())
+    return 1;
+  if (fastForwardTest())
+    return 1;
+  if (snapshotTest())
+    return 1;
+  if (intrinsicsTest())
+    return 1;
+  if (heapTest())
+    return 1;
+  if (traceTest())
+    return 1;
+  if (lockstepTest())
+    return 1;
+  if (batchTest())
+    return 1;
+
+  printf("Success");
+  return 0;
+}
+
+int fail(const std::string &reason)
+{
+  printf("%s\n", reason.c_str());
+  return 1;
+}
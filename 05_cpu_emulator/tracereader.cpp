@@ -0,0 +1,194 @@
+#include "tracereader.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../06_assembler/littleendian.hpp"
+
+const char TRACE_MAGIC[4]{'H', 'T', 'R', 'C'};
+const uint16_t ADDRESS_MASK{0x7FFF};
+
+static uint32_t decodeVarint(const unsigned char *&bytes,
+                             const unsigned char *end);
+static uint16_t decodeDelta(const unsigned char *&bytes,
+                            const unsigned char *end, uint16_t from);
+
+TraceReader::TraceReader()
+    : mapping{nullptr}, mappingSize{0}, startCycle{0}, recordCount{0},
+      chunkRecords{0}, index{nullptr}, chunkCount{0}
+{
+}
+
+TraceReader::TraceReader(TraceReader &&other)
+    : mapping{other.mapping}, mappingSize{other.mappingSize},
+      startCycle{other.startCycle}, recordCount{other.recordCount},
+      chunkRecords{other.chunkRecords}, index{other.index},
+      chunkCount{other.chunkCount}
+{
+  other.mapping = nullptr;
+  other.mappingSize = 0;
+}
+
+TraceReader::~TraceReader()
+{
+  if (mapping)
+    munmap(const_cast<unsigned char *>(mapping), mappingSize);
+}
+
+uint64_t TraceReader::getStartCycle() const { return startCycle; }
+
+uint64_t TraceReader::getRecordCount() const { return recordCount; }
+
+size_t TraceReader::getChunkCount() const { return chunkCount; }
+
+// Up to count records from the instruction executed at firstCycle on.
+// Cycles count from the trace's start cycle, as the Cpu's do.
+std::vector<TraceRecord> TraceReader::getRecords(uint64_t firstCycle,
+                                                 uint64_t count) const
+{
+  std::vector<TraceRecord> records;
+  if (firstCycle < startCycle || firstCycle - startCycle >= recordCount)
+    return records;
+
+  // Every chunk but the last holds chunkRecords records
+  uint64_t first{firstCycle - startCycle};
+  count = std::min(count, recordCount - first);
+  records.reserve(count);
+  for (size_t chunk = first / chunkRecords; records.size() < count; chunk++)
+  {
+    decodeChunk(chunk, first - chunk * chunkRecords, count - records.size(),
+                records);
+    first = (chunk + 1) * chunkRecords;
+  }
+  return records;
+}
+
+// Appends up to count records of a chunk, after skipping its first ones
+void TraceReader::decodeChunk(size_t chunk, uint64_t skip, uint64_t count,
+                              std::vector<TraceRecord> &records) const
+{
+  if (chunk >= chunkCount)
+    throw std::runtime_error("Trace index is missing chunks");
+  const uint64_t offset{decodeU64(index + chunk * TraceWriter::INDEX_ENTRY_SIZE)};
+  if (offset + TraceWriter::CHUNK_HEADER_SIZE > mappingSize)
+    throw std::runtime_error("Corrupt trace chunk");
+
+  const unsigned char *bytes{mapping + offset};
+  const uint32_t size{decodeU32(bytes)};
+  const uint32_t chunkSize{decodeU32(bytes + 4)};
+  uint16_t pc = decodeU16(bytes + 8) - 1;
+  uint16_t a{decodeU16(bytes + 10)};
+  uint16_t d{decodeU16(bytes + 12)};
+  bytes += TraceWriter::CHUNK_HEADER_SIZE;
+  if (offset + TraceWriter::CHUNK_HEADER_SIZE + size > mappingSize)
+    throw std::runtime_error("Corrupt trace chunk");
+  const unsigned char *end{bytes + size};
+
+  const uint64_t last{std::min<uint64_t>(chunkSize, skip + count)};
+  for (uint64_t record = 0; record < last; record++)
+  {
+    if (bytes == end)
+      throw std::runtime_error("Corrupt trace chunk");
+    const uint8_t tag{*bytes++};
+    TraceRecord decoded{};
+    decoded.address = a & ADDRESS_MASK;
+    decoded.pc = pc + 1;
+    if (tag & TraceWriter::TAG_JUMP)
+      decoded.pc = decodeDelta(bytes, end, pc + 1);
+    decoded.a = tag & TraceWriter::TAG_A ? decodeDelta(bytes, end, a) : a;
+    decoded.d = tag & TraceWriter::TAG_D ? decodeDelta(bytes, end, d) : d;
+    decoded.write = tag & (TraceWriter::TAG_WRITE_D | TraceWriter::TAG_WRITE);
+    if (tag & TraceWriter::TAG_WRITE_D)
+      decoded.value = decoded.d;
+    else if (tag & TraceWriter::TAG_WRITE)
+      decoded.value = decodeVarint(bytes, end);
+    if (!decoded.write)
+      decoded.address = 0;
+
+    pc = decoded.pc;
+    a = decoded.a;
+    d = decoded.d;
+    if (record >= skip)
+      records.push_back(decoded);
+  }
+}
+
+// Maps a trace file and checks its header and index
+TraceReader TraceReader::read(const std::string &inputFilename)
+{
+  TraceReader reader{};
+  const int fd{open(inputFilename.c_str(), O_RDONLY)};
+  if (fd < 0)
+    throw std::runtime_error("Could not open trace " + inputFilename);
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 ||
+      static_cast<size_t>(fileStat.st_size) <
+          TraceWriter::HEADER_SIZE + TraceWriter::FOOTER_SIZE)
+  {
+    close(fd);
+    throw std::runtime_error("Invalid trace " + inputFilename);
+  }
+
+  // The mapping stays valid once the file is closed
+  void *mapping{
+      mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0)};
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("Could not map trace " + inputFilename);
+  reader.mapping = static_cast<const unsigned char *>(mapping);
+  reader.mappingSize = fileStat.st_size;
+
+  const unsigned char *data{reader.mapping};
+  const unsigned char *footer{data + reader.mappingSize -
+                              TraceWriter::FOOTER_SIZE};
+  const uint64_t indexOffset{decodeU64(footer)};
+  if (!std::equal(TRACE_MAGIC, TRACE_MAGIC + 4, data) ||
+      decodeU16(data + 4) != TraceWriter::VERSION ||
+      indexOffset < TraceWriter::HEADER_SIZE ||
+      indexOffset > reader.mappingSize - TraceWriter::FOOTER_SIZE ||
+      (reader.mappingSize - TraceWriter::FOOTER_SIZE - indexOffset) %
+              TraceWriter::INDEX_ENTRY_SIZE !=
+          0)
+    throw std::runtime_error("Invalid trace " + inputFilename);
+
+  reader.chunkRecords = decodeU32(data + 8);
+  reader.startCycle = decodeU64(data + 16);
+  reader.recordCount = decodeU64(footer + 8);
+  reader.index = data + indexOffset;
+  reader.chunkCount =
+      (reader.mappingSize - TraceWriter::FOOTER_SIZE - indexOffset) /
+      TraceWriter::INDEX_ENTRY_SIZE;
+  if (reader.chunkRecords == 0 ||
+      reader.recordCount >
+          static_cast<uint64_t>(reader.chunkCount) * reader.chunkRecords)
+    throw std::runtime_error("Invalid trace " + inputFilename);
+  return reader;
+}
+
+static uint32_t decodeVarint(const unsigned char *&bytes,
+                             const unsigned char *end)
+{
+  uint32_t value{0};
+  for (int shift = 0; shift < 32; shift += 7)
+  {
+    if (bytes == end)
+      break;
+    const uint8_t byte{*bytes++};
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return value;
+  }
+  throw std::runtime_error("Corrupt trace chunk");
+}
+
+// Undoes the writer's zigzag encoded 16-bit difference
+static uint16_t decodeDelta(const unsigned char *&bytes,
+                            const unsigned char *end, uint16_t from)
+{
+  const uint16_t zigzag = decodeVarint(bytes, end);
+  const uint16_t delta = (zigzag >> 1) ^ -(zigzag & 1);
+  return from + delta;
+}
@@ -0,0 +1,44 @@
+#ifndef TRACE_READER_HPP
+#define TRACE_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tracewriter.hpp"
+
+// A trace file written by TraceWriter, mapped into memory. Records are
+// decoded straight out of the mapping, starting at the chunk holding the
+// first one asked for, so any cycle of a long trace is reached without
+// reading what comes before.
+class TraceReader
+{
+public:
+  TraceReader(TraceReader &&other);
+  TraceReader(const TraceReader &) = delete;
+  TraceReader &operator=(const TraceReader &) = delete;
+  ~TraceReader();
+  uint64_t getStartCycle() const;
+  uint64_t getRecordCount() const;
+  size_t getChunkCount() const;
+  std::vector<TraceRecord> getRecords(uint64_t firstCycle,
+                                      uint64_t count) const;
+
+  static TraceReader read(const std::string &inputFilename);
+
+private:
+  TraceReader();
+  void decodeChunk(size_t chunk, uint64_t skip, uint64_t count,
+                   std::vector<TraceRecord> &records) const;
+
+  const unsigned char *mapping;
+  size_t mappingSize;
+  uint64_t startCycle;
+  uint64_t recordCount;
+  uint32_t chunkRecords;
+  // The index inside the mapping
+  const unsigned char *index;
+  size_t chunkCount;
+};
+
+#endif
@@ -0,0 +1,220 @@
+#include "tracewriter.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include "../06_assembler/littleendian.hpp"
+
+// Traces are laid out as:
+//   "HTRC", version, reserved, records per chunk, reserved, start cycle
+//   chunks: encoded size, record count, PC of the first record, A and D
+//           from before it, reserved, then the encoded records
+//   index: file offset and first record number of every chunk
+//   footer: index offset, record count
+// Fixed size integers are little endian. Every chunk decodes on its own.
+const char TRACE_MAGIC[4]{'H', 'T', 'R', 'C'};
+const uint16_t ADDRESS_MASK{0x7FFF};
+// Chunks the Cpu can run ahead of the writer before it waits
+const size_t MAX_QUEUED_CHUNKS{8};
+
+static void appendDelta(std::vector<uint8_t> &bytes, uint16_t from,
+                        uint16_t to);
+
+TraceWriter::TraceWriter(const std::string &outputFilename,
+                         uint64_t startCycle)
+    : outputFilename{outputFilename}, startCycle{startCycle}, recordCount{0},
+      finished{false}, current{}, mutex{}, queued{}, drained{}, chunks{},
+      stopping{false}, error{}, outputFile{outputFilename, std::ios::binary},
+      index{}, thread{}
+{
+  if (!outputFile.is_open())
+    throw std::runtime_error("Could not write trace " + outputFilename);
+
+  outputFile.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  writeU16(outputFile, VERSION);
+  writeU16(outputFile, 0);
+  writeU32(outputFile, CHUNK_RECORDS);
+  writeU32(outputFile, 0);
+  writeU64(outputFile, startCycle);
+  current.records.reserve(CHUNK_RECORDS);
+
+  thread = std::thread{&TraceWriter::writeLoop, this};
+}
+
+TraceWriter::~TraceWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  queued.notify_one();
+  if (thread.joinable())
+    thread.join();
+}
+
+// Runs up to maxCycles instructions on the interpreter one at a time,
+// recording each
+uint64_t TraceWriter::run(Cpu &cpu, uint64_t maxCycles)
+{
+  if (finished)
+    throw std::logic_error("Trace " + outputFilename + " is finished");
+
+  const Program &rom{cpu.getProgram()};
+  uint64_t executed{0};
+  while (executed < maxCycles && !cpu.isHalted())
+  {
+    const uint16_t pc{cpu.getPc()};
+    const uint16_t address = cpu.getA() & ADDRESS_MASK;
+    if (current.records.empty())
+    {
+      current.a = cpu.getA();
+      current.d = cpu.getD();
+    }
+    if (cpu.run(1) == 0)
+      break;
+    ++executed;
+
+    // Writes to the keyboard register and above are ignored
+    const Program::Instruction &instruction{rom[pc]};
+    const bool write{!(instruction.flags & Program::A_INSTRUCTION) &&
+                     (instruction.flags & Program::DEST_M) &&
+                     address < Cpu::KEYBOARD};
+    current.records.push_back({pc, cpu.getA(), cpu.getD(),
+                               write ? address : uint16_t{0},
+                               write ? cpu.peek(address) : uint16_t{0},
+                               write});
+    if (current.records.size() == CHUNK_RECORDS)
+      queueChunk();
+  }
+  recordCount += executed;
+  return executed;
+}
+
+// Writes the last chunk and the index, and closes the file
+void TraceWriter::finish()
+{
+  if (finished)
+    return;
+  finished = true;
+  if (!current.records.empty())
+    queueChunk();
+
+  std::unique_lock<std::mutex> lock{mutex};
+  drained.wait(lock, [this]
+               { return chunks.empty(); });
+  if (!error.empty())
+    throw std::runtime_error(error);
+
+  // The thread only touches the file while chunks are queued
+  const uint64_t indexOffset = outputFile.tellp();
+  for (const std::pair<uint64_t, uint64_t> &entry : index)
+  {
+    writeU64(outputFile, entry.first);
+    writeU64(outputFile, entry.second);
+  }
+  writeU64(outputFile, indexOffset);
+  writeU64(outputFile, recordCount);
+  outputFile.close();
+  if (!outputFile)
+    throw std::runtime_error("Could not write trace " + outputFilename);
+}
+
+uint64_t TraceWriter::getRecordCount() const { return recordCount; }
+
+void TraceWriter::queueChunk()
+{
+  Chunk chunk{current.a, current.d, {}};
+  chunk.records.reserve(CHUNK_RECORDS);
+  std::swap(chunk, current);
+
+  std::unique_lock<std::mutex> lock{mutex};
+  drained.wait(lock, [this]
+               { return chunks.size() < MAX_QUEUED_CHUNKS; });
+  chunks.push_back(std::move(chunk));
+  lock.unlock();
+  queued.notify_one();
+}
+
+// A chunk stays at the front of the queue until it is written, so finish()
+// returns only once the file holds every chunk
+void TraceWriter::writeLoop()
+{
+  std::vector<uint8_t> bytes;
+  uint64_t firstRecord{0};
+  std::unique_lock<std::mutex> lock{mutex};
+  while (true)
+  {
+    queued.wait(lock, [this]
+                { return stopping || !chunks.empty(); });
+    if (chunks.empty())
+      return;
+
+    const Chunk &chunk{chunks.front()};
+    lock.unlock();
+    encodeChunk(chunk, bytes);
+    const uint64_t offset = outputFile.tellp();
+    index.emplace_back(offset, firstRecord);
+    outputFile.write(reinterpret_cast<const char *>(bytes.data()),
+                     bytes.size());
+    firstRecord += chunk.records.size();
+    lock.lock();
+
+    if (!outputFile && error.empty())
+      error = "Could not write trace " + outputFilename;
+
+    chunks.pop_front();
+    drained.notify_all();
+  }
+}
+
+// Most instructions follow the previous one and change A or D by a little,
+// so a record usually takes one or two bytes
+void TraceWriter::encodeChunk(const Chunk &chunk,
+                              std::vector<uint8_t> &bytes) const
+{
+  bytes.assign(CHUNK_HEADER_SIZE, 0);
+  uint16_t pc = chunk.records.front().pc - 1;
+  uint16_t a{chunk.a};
+  uint16_t d{chunk.d};
+  for (const TraceRecord &record : chunk.records)
+  {
+    uint8_t tag{0};
+    if (record.pc != static_cast<uint16_t>(pc + 1))
+      tag |= TAG_JUMP;
+    if (record.a != a)
+      tag |= TAG_A;
+    if (record.d != d)
+      tag |= TAG_D;
+    if (record.write)
+      tag |= record.value == record.d ? TAG_WRITE_D : TAG_WRITE;
+
+    bytes.push_back(tag);
+    if (tag & TAG_JUMP)
+      appendDelta(bytes, pc + 1, record.pc);
+    if (tag & TAG_A)
+      appendDelta(bytes, a, record.a);
+    if (tag & TAG_D)
+      appendDelta(bytes, d, record.d);
+    if (tag & TAG_WRITE)
+      appendVarint(bytes, record.value);
+    pc = record.pc;
+    a = record.a;
+    d = record.d;
+  }
+
+  std::vector<uint8_t> header;
+  appendU32(header, bytes.size() - CHUNK_HEADER_SIZE);
+  appendU32(header, chunk.records.size());
+  appendU16(header, chunk.records.front().pc);
+  appendU16(header, chunk.a);
+  appendU16(header, chunk.d);
+  appendU16(header, 0);
+  std::copy(header.begin(), header.end(), bytes.begin());
+}
+
+// The 16-bit difference, zigzag encoded so small negative steps stay small
+static void appendDelta(std::vector<uint8_t> &bytes, uint16_t from,
+                        uint16_t to)
+{
+  const int16_t delta = to - from;
+  appendVarint(bytes, static_cast<uint16_t>((delta << 1) ^ (delta >> 15)));
+}
@@ -0,0 +1,97 @@
+#ifndef TRACE_WRITER_HPP
+#define TRACE_WRITER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "cpu.hpp"
+
+// One executed instruction: its address, A and D after it and the RAM word
+// it wrote, if any. The written address is A from before the instruction, so
+// traces do not store it. address and value are 0 without a write.
+struct TraceRecord
+{
+  uint16_t pc;
+  uint16_t a;
+  uint16_t d;
+  uint16_t address;
+  uint16_t value;
+  bool write;
+};
+
+// Records every instruction a Cpu executes into a trace file. The Cpu's
+// thread fills fixed size chunks of records, and a background thread delta
+// and varint encodes them and writes them out, followed by an index of the
+// chunks that TraceReader seeks with.
+class TraceWriter
+{
+public:
+  static constexpr uint32_t CHUNK_RECORDS{1 << 16};
+  static constexpr uint16_t VERSION{1};
+  static constexpr size_t HEADER_SIZE{24};
+  static constexpr size_t CHUNK_HEADER_SIZE{16};
+  static constexpr size_t INDEX_ENTRY_SIZE{16};
+  static constexpr size_t FOOTER_SIZE{16};
+
+  // Tag byte of an encoded record, followed by the values its bits select
+  enum TAGS : uint8_t
+  {
+    // PC did not follow the previous one: zigzag varint PC delta
+    TAG_JUMP = 0x01,
+    // Zigzag varint deltas of A and D
+    TAG_A = 0x02,
+    TAG_D = 0x04,
+    // RAM was written, with D's new value
+    TAG_WRITE_D = 0x08,
+    // RAM was written with another value: varint value
+    TAG_WRITE = 0x10
+  };
+
+  TraceWriter(const std::string &outputFilename, uint64_t startCycle);
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+  ~TraceWriter();
+  uint64_t run(Cpu &cpu, uint64_t maxCycles);
+  void finish();
+  uint64_t getRecordCount() const;
+
+private:
+  struct Chunk
+  {
+    // Registers from before the chunk's first instruction
+    uint16_t a;
+    uint16_t d;
+    std::vector<TraceRecord> records;
+  };
+
+  void queueChunk();
+  void writeLoop();
+  void encodeChunk(const Chunk &chunk, std::vector<uint8_t> &bytes) const;
+
+  std::string outputFilename;
+  uint64_t startCycle;
+  uint64_t recordCount;
+  bool finished;
+  // The chunk being filled, only touched by the Cpu's thread
+  Chunk current;
+
+  std::mutex mutex;
+  std::condition_variable queued;
+  std::condition_variable drained;
+  std::deque<Chunk> chunks;
+  bool stopping;
+  std::string error;
+  // Only touched by the thread until it stops
+  std::ofstream outputFile;
+  // File offset and first record of every chunk written
+  std::vector<std::pair<uint64_t, uint64_t>> index;
+  std::thread thread;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef LITTLE_ENDIAN_HPP
+#define LITTLE_ENDIAN_HPP
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Little endian integers and varints, as the binary files of the assembler,
+// the VM translator and the CPU emulator store them
+
+inline void writeU16(std::ostream &os, uint16_t value)
+{
+  const char bytes[2]{static_cast<char>(value & 0xFF),
+                      static_cast<char>(value >> 8)};
+  os.write(bytes, sizeof(bytes));
+}
+
+inline void writeU32(std::ostream &os, uint32_t value)
+{
+  writeU16(os, value & 0xFFFF);
+  writeU16(os, value >> 16);
+}
+
+inline void writeU64(std::ostream &os, uint64_t value)
+{
+  writeU32(os, value & 0xFFFFFFFF);
+  writeU32(os, value >> 32);
+}
+
+inline void appendU16(std::vector<uint8_t> &bytes, uint16_t value)
+{
+  bytes.push_back(value & 0xFF);
+  bytes.push_back(value >> 8);
+}
+
+inline void appendU32(std::vector<uint8_t> &bytes, uint32_t value)
+{
+  appendU16(bytes, value & 0xFFFF);
+  appendU16(bytes, value >> 16);
+}
+
+// Zero when the stream ends early; callers check the stream afterwards
+inline uint16_t readU16(std::istream &is)
+{
+  unsigned char bytes[2]{0, 0};
+  is.read(reinterpret_cast<char *>(bytes), sizeof(bytes));
+  return bytes[0] | (bytes[1] << 8);
+}
+
+inline uint32_t readU32(std::istream &is)
+{
+  const uint32_t low{readU16(is)};
+  const uint32_t high{readU16(is)};
+  return low | (high << 16);
+}
+
+inline uint16_t decodeU16(const unsigned char *bytes)
+{
+  return bytes[0] | (bytes[1] << 8);
+}
+
+inline uint32_t decodeU32(const unsigned char *bytes)
+{
+  return decodeU16(bytes) | (static_cast<uint32_t>(decodeU16(bytes + 2)) << 16);
+}
+
+inline uint64_t decodeU64(const unsigned char *bytes)
+{
+  return decodeU32(bytes) | (static_cast<uint64_t>(decodeU32(bytes + 4)) << 32);
+}
+
+// Seven bits at a time, low bits first, with the top bit set on all but the
+// last byte
+inline void writeVarint(std::ostream &os, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    os.put(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  os.put(static_cast<char>(value));
+}
+
+inline void appendVarint(std::vector<uint8_t> &bytes, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    bytes.push_back((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  bytes.push_back(value);
+}
+
+#endif
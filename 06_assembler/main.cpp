@@ -4,20 +4,44 @@
 #include <iostream>
 #include <stdexcept>
 #include "parser.hpp"
+#include "sourcemap.hpp"
+#include "stats.hpp"
 #include "symboltable.hpp"
 
 const int VARIABLE_STACK_BASE_ADDRESS{0x10};
 
-int main(int, const char *argv[])
+int main(int argc, const char *argv[])
 {
-  if (!argv[1])
+  // Parse options
+  bool printStats{false};
+  bool printStatsJson{false};
+  bool writeSourceMap{false};
+  std::filesystem::path inputPath;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg{argv[i]};
+    if (arg == "--stats")
+      printStats = true;
+    else if (arg == "--stats=json")
+      printStatsJson = true;
+    else if (arg == "--source-map")
+      writeSourceMap = true;
+    else
+      inputPath = arg;
+  }
+
+  if (inputPath.empty())
     throw std::invalid_argument("No input file received");
 
   int nextVariableStackAddress{VARIABLE_STACK_BASE_ADDRESS};
 
-  const std::filesystem::path inputPath{argv[1]};
+  const bool collectStats{printStats || printStatsJson};
+  Stats stats{collectStats};
+  Stats::Clock::time_point phaseStart{stats.now()};
 
   SymbolTable symbolTable{};
+  const size_t predefinedSymbols{symbolTable.size()};
   Parser parser{inputPath};
 
   // First pass
@@ -29,45 +53,104 @@ int main(int, const char *argv[])
                             parser.getInstructionNumber() + 1);
   }
 
+  stats.addTime("read/parse", stats.now() - phaseStart);
+  stats.setValue("labels", symbolTable.size() - predefinedSymbols);
+
   std::filesystem::path outputPath{inputPath};
   outputPath.replace_extension(".hack");
   std::ofstream outputFile{outputPath};
 
-  // Second pass
+  // Second pass. Parsing, encoding and writing are interleaved, so each is
+  // timed separately per instruction.
+  Stats::Clock::duration parseTime{};
+  Stats::Clock::duration codegenTime{};
+  Stats::Clock::duration outputTime{};
+  long aInstructions{0};
+  long cInstructions{0};
+  long labelCommands{0};
+
+  SourceMap sourceMap{};
   std::string machineInstruction;
+  phaseStart = stats.now();
   for (parser.reset(); parser.moreCommands(); parser.advanceCommand())
   {
+    Stats::Clock::time_point codegenStart{stats.now()};
+    parseTime += codegenStart - phaseStart;
+
     if (parser.commandIsType(Parser::A_INSTRUCTION))
     {
       std::string symbol = parser.getCommandSymbol();
 
-      if (!symbolTable.contains(symbol))
-      {
-        symbolTable.addSymbol(symbol, nextVariableStackAddress);
-        ++nextVariableStackAddress;
-      }
-
       int symbolValue;
       if (!isdigit(symbol[0]))
+      {
+        if (!symbolTable.contains(symbol))
+        {
+          symbolTable.addSymbol(symbol, nextVariableStackAddress);
+          ++nextVariableStackAddress;
+        }
         symbolValue = symbolTable.getSymbolValue(symbol);
+      }
       else
         symbolValue = std::stoi(symbol);
 
       machineInstruction = "0" + std::bitset<15>(symbolValue).to_string();
-
-      outputFile << machineInstruction << std::endl;
+      ++aInstructions;
     }
     else if (parser.commandIsType(Parser::C_INSTRUCTION))
     {
       machineInstruction = "111" + parser.getInstructionCompField() +
                            parser.getInstructionDestField() +
                            parser.getInstructionJmpField();
-
-      outputFile << machineInstruction << std::endl;
+      ++cInstructions;
+    }
+    else
+    {
+      ++labelCommands;
+      phaseStart = stats.now();
+      codegenTime += phaseStart - codegenStart;
+      continue;
     }
+
+    Stats::Clock::time_point outputStart{stats.now()};
+    codegenTime += outputStart - codegenStart;
+
+    outputFile << machineInstruction << std::endl;
+    if (writeSourceMap)
+      sourceMap.addLocation(
+          {parser.getLineNumber(),
+           parser.getSourceFile().empty()
+               ? SourceMap::NO_FILE
+               : sourceMap.addFile(parser.getSourceFile()),
+           parser.getSourceLine()});
+
+    phaseStart = stats.now();
+    outputTime += phaseStart - outputStart;
   }
+  parseTime += stats.now() - phaseStart;
 
   outputFile.close();
 
+  if (writeSourceMap)
+  {
+    outputPath.replace_extension(".smap");
+    sourceMap.write(outputPath);
+  }
+
+  stats.addTime("read/parse", parseTime);
+  stats.addTime("codegen", codegenTime);
+  stats.addTime("output", outputTime);
+  stats.addCount("commands", "A instructions", aInstructions);
+  stats.addCount("commands", "C instructions", cInstructions);
+  stats.addCount("commands", "labels", labelCommands);
+  stats.setValue("symbols", symbolTable.size());
+  stats.setValue("variables",
+                 nextVariableStackAddress - VARIABLE_STACK_BASE_ADDRESS);
+
+  if (printStats)
+    stats.print(std::cerr);
+  if (printStatsJson)
+    stats.printJson(std::cerr);
+
   return 0;
 }
@@ -1,4 +1,5 @@
 #include "parser.hpp"
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <boost/algorithm/string.hpp>
@@ -6,6 +7,9 @@
 Parser::Parser(const std::string &inputFilename)
     : inputFile(std::ifstream(inputFilename)),
       instructionNumber(0),
+      lineNumber(0),
+      sourceFile(""),
+      sourceLine(0),
       _moreCommands{true},
       command(""),
       commandSymbol(""),
@@ -24,6 +28,15 @@ Parser::~Parser() { inputFile.close(); }
 
 int Parser::getInstructionNumber() const { return instructionNumber; }
 
+// Line of the current command in the input file, starting at 1
+int Parser::getLineNumber() const { return lineNumber; }
+
+// The .vm file and line the current command was translated from, if the
+// input carries source comments
+const std::string &Parser::getSourceFile() const { return sourceFile; }
+
+int Parser::getSourceLine() const { return sourceLine; }
+
 std::string Parser::getCommand() const { return command; }
 
 std::string Parser::getCommandSymbol() const { return commandSymbol; }
@@ -49,6 +62,9 @@ void Parser::reset()
   inputFile.clear();
   inputFile.seekg(0, std::ios::beg);
   instructionNumber = 0;
+  lineNumber = 0;
+  sourceFile = "";
+  sourceLine = 0;
   _moreCommands = true;
 
   advanceCommand(true);
@@ -61,6 +77,8 @@ void Parser::advanceCommand(bool init /*= false*/)
   std::string line;
   while (std::getline(inputFile, line))
   {
+    ++lineNumber;
+    parseSourceComment(line);
     line = stripComment(line);
     boost::trim(line);
 
@@ -137,6 +155,22 @@ void Parser::parseCommand(const std::string &line)
   }
 }
 
+// Remembers the location a "// @source file:line" comment points to
+void Parser::parseSourceComment(const std::string &line)
+{
+  const std::string marker{"// @source "};
+  const size_t start{line.find(marker)};
+  if (start == std::string::npos)
+    return;
+
+  const size_t colon{line.rfind(':')};
+  if (colon == std::string::npos || colon < start + marker.size())
+    return;
+  sourceFile = line.substr(start + marker.size(),
+                           colon - start - marker.size());
+  sourceLine = std::atoi(line.c_str() + colon + 1);
+}
+
 // Strips a comment off the end of a line
 std::string stripComment(const std::string &string)
 {
@@ -3,7 +3,7 @@
 
 #include <fstream>
 #include <string>
-#include <unordered_map>
+#include "code.hpp"
 
 class Parser
 {
@@ -19,6 +19,9 @@ public:
     Parser(const std::string &inputFilename);
     ~Parser();
     int getInstructionNumber() const;
+    int getLineNumber() const;
+    const std::string &getSourceFile() const;
+    int getSourceLine() const;
     std::string getCommand() const;
     std::string getCommandSymbol() const;
     std::string getInstructionCompField() const;
@@ -32,6 +35,10 @@ public:
 private:
     std::ifstream inputFile;
     int instructionNumber;
+    int lineNumber;
+    // Set by the VM translator's "// @source file:line" comments
+    std::string sourceFile;
+    int sourceLine;
     bool _moreCommands;
     std::string command;
     std::string commandSymbol;
@@ -41,45 +48,9 @@ private:
     Parser::commandTypes commandType;
 
     void parseCommand(const std::string &line);
+    void parseSourceComment(const std::string &line);
 };
 
-const std::unordered_map<std::string, std::string> compMap = {
-    {"0", "0101010"},
-    {"1", "0111111"},
-    {"-1", "0111010"},
-    {"D", "0001100"},
-    {"A", "0110000"},
-    {"M", "1110000"},
-    {"!D", "0001101"},
-    {"!A", "0110001"},
-    {"!M", "1110001"},
-    {"-D", "0001111"},
-    {"-A", "0110011"},
-    {"-M", "1110011"},
-    {"D+1", "0011111"},
-    {"A+1", "0110111"},
-    {"M+1", "1110111"},
-    {"D-1", "0001110"},
-    {"A-1", "0110010"},
-    {"M-1", "1110010"},
-    {"D+A", "0000010"},
-    {"D+M", "1000010"},
-    {"D-A", "0010011"},
-    {"D-M", "1010011"},
-    {"A-D", "0000111"},
-    {"M-D", "1000111"},
-    {"D&A", "0000000"},
-    {"D&M", "1000000"},
-    {"D|A", "0010101"},
-    {"D|M", "1010101"},
-};
-
-const std::unordered_map<std::string, std::string> destMap = {
-    {"M", "001"}, {"D", "010"}, {"MD", "011"}, {"A", "100"}, {"AM", "101"}, {"AD", "110"}, {"AMD", "111"}};
-
-const std::unordered_map<std::string, std::string> jmpMap = {
-    {"JGT", "001"}, {"JEQ", "010"}, {"JGE", "011"}, {"JLT", "100"}, {"JNE", "101"}, {"JLE", "110"}, {"JMP", "111"}};
-
 std::string stripComment(const std::string &string);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "sourcemap.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "littleendian.hpp"
+
+// Source maps are laid out as:
+//   "HSMP", version, reserved
+//   address count, file count
+//   address count records of (asm line, source line, file index, reserved)
+//   file count names
+// All integers are little endian, file indices are 16 bits with 0xFFFF for
+// none and names are prefixed with their 16-bit length.
+const char SOURCE_MAP_MAGIC[4]{'H', 'S', 'M', 'P'};
+const uint16_t SOURCE_MAP_VERSION{1};
+const size_t HEADER_SIZE{16};
+const size_t RECORD_SIZE{12};
+const uint16_t NO_FILE_INDEX{0xFFFF};
+
+SourceMap::SourceMap()
+    : locations{}, files{}, mapping{nullptr}, mappingSize{0}, recordCount{0}
+{
+}
+
+SourceMap::SourceMap(SourceMap &&other)
+    : locations{std::move(other.locations)}, files{std::move(other.files)},
+      mapping{other.mapping}, mappingSize{other.mappingSize},
+      recordCount{other.recordCount}
+{
+  other.mapping = nullptr;
+  other.mappingSize = 0;
+  other.recordCount = 0;
+}
+
+SourceMap::~SourceMap()
+{
+  if (mapping)
+    munmap(const_cast<unsigned char *>(mapping), mappingSize);
+}
+
+// Index of a source file, added the first time it is seen
+int SourceMap::addFile(const std::string &name)
+{
+  std::vector<std::string>::const_iterator file{
+      std::find(files.begin(), files.end(), name)};
+  if (file != files.end())
+    return file - files.begin();
+  if (files.size() >= NO_FILE_INDEX)
+    throw std::length_error("Too many source files");
+  files.push_back(name);
+  return files.size() - 1;
+}
+
+// Adds the location of the next ROM address
+void SourceMap::addLocation(const Location &location)
+{
+  if (mapping)
+    throw std::logic_error("Cannot add to a source map read from a file");
+  locations.push_back(location);
+}
+
+size_t SourceMap::size() const
+{
+  return mapping ? recordCount : locations.size();
+}
+
+// Location of a ROM address; addresses without one map to line 0
+SourceMap::Location SourceMap::at(int address) const
+{
+  if (address < 0 || static_cast<size_t>(address) >= size())
+    return {0, NO_FILE, 0};
+  if (!mapping)
+    return locations[address];
+
+  const unsigned char *record{mapping + HEADER_SIZE + address * RECORD_SIZE};
+  const uint16_t file{decodeU16(record + 8)};
+  return {static_cast<int>(decodeU32(record)),
+          file == NO_FILE_INDEX ? NO_FILE : file,
+          static_cast<int>(decodeU32(record + 4))};
+}
+
+const std::string &SourceMap::getFileName(int file) const
+{
+  return files.at(file);
+}
+
+void SourceMap::write(const std::string &outputFilename) const
+{
+  std::ofstream outputFile{outputFilename, std::ios::binary};
+  if (!outputFile.is_open())
+    throw std::runtime_error("Could not write source map " + outputFilename);
+
+  outputFile.write(SOURCE_MAP_MAGIC, sizeof(SOURCE_MAP_MAGIC));
+  writeU16(outputFile, SOURCE_MAP_VERSION);
+  writeU16(outputFile, 0);
+  writeU32(outputFile, size());
+  writeU32(outputFile, files.size());
+
+  for (size_t address = 0; address < size(); address++)
+  {
+    const Location location{at(address)};
+    writeU32(outputFile, location.asmLine);
+    writeU32(outputFile, location.sourceLine);
+    writeU16(outputFile, location.sourceFile == NO_FILE ? NO_FILE_INDEX
+                                                        : location.sourceFile);
+    writeU16(outputFile, 0);
+  }
+
+  for (const std::string &file : files)
+  {
+    writeU16(outputFile, file.size());
+    outputFile.write(file.data(), file.size());
+  }
+}
+
+// Maps a source map file. Only the file names are copied, records are read
+// straight out of the mapping.
+SourceMap SourceMap::read(const std::string &inputFilename)
+{
+  int fd{open(inputFilename.c_str(), O_RDONLY)};
+  if (fd < 0)
+    throw std::runtime_error("Invalid source map " + inputFilename);
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 ||
+      static_cast<size_t>(fileStat.st_size) < HEADER_SIZE)
+  {
+    close(fd);
+    throw std::runtime_error("Invalid source map " + inputFilename);
+  }
+
+  SourceMap map{};
+  map.mappingSize = fileStat.st_size;
+  void *mapping{
+      mmap(nullptr, map.mappingSize, PROT_READ, MAP_PRIVATE, fd, 0)};
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("Could not map source map " + inputFilename);
+  map.mapping = static_cast<const unsigned char *>(mapping);
+
+  const unsigned char *data{map.mapping};
+  map.recordCount = decodeU32(data + 8);
+  const size_t fileCount{decodeU32(data + 12)};
+  size_t position{HEADER_SIZE + map.recordCount * RECORD_SIZE};
+  if (!std::equal(SOURCE_MAP_MAGIC, SOURCE_MAP_MAGIC + 4, data) ||
+      decodeU16(data + 4) != SOURCE_MAP_VERSION || position > map.mappingSize)
+    throw std::runtime_error("Invalid source map " + inputFilename);
+
+  for (size_t file = 0; file < fileCount; file++)
+  {
+    if (position + 2 > map.mappingSize ||
+        position + 2 + decodeU16(data + position) > map.mappingSize)
+      throw std::runtime_error("Truncated source map " + inputFilename);
+    const size_t length{decodeU16(data + position)};
+    map.files.emplace_back(reinterpret_cast<const char *>(data + position + 2),
+                           length);
+    position += 2 + length;
+  }
+
+  return map;
+}
@@ -0,0 +1,47 @@
+#ifndef SOURCE_MAP_HPP
+#define SOURCE_MAP_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Maps every ROM address back to the .asm line it was assembled from and the
+// .vm file and line it was translated from. The file holds one fixed size
+// record per address, so a reader maps it and looks addresses up directly.
+class SourceMap
+{
+public:
+  static constexpr int NO_FILE{-1};
+
+  // Line numbers start at 1, 0 means unknown
+  struct Location
+  {
+    int asmLine;
+    int sourceFile;
+    int sourceLine;
+  };
+
+  SourceMap();
+  SourceMap(SourceMap &&other);
+  SourceMap(const SourceMap &) = delete;
+  SourceMap &operator=(const SourceMap &) = delete;
+  ~SourceMap();
+  int addFile(const std::string &name);
+  void addLocation(const Location &location);
+  size_t size() const;
+  Location at(int address) const;
+  const std::string &getFileName(int file) const;
+  void write(const std::string &outputFilename) const;
+
+  static SourceMap read(const std::string &inputFilename);
+
+private:
+  std::vector<Location> locations;
+  std::vector<std::string> files;
+  // Set when read from a file, whose records are decoded on lookup
+  const unsigned char *mapping;
+  size_t mappingSize;
+  size_t recordCount;
+};
+
+#endif
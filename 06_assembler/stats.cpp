@@ -0,0 +1,138 @@
+#include "stats.hpp"
+#include <iomanip>
+#include <sys/resource.h>
+
+static double toMilliseconds(Stats::Clock::duration duration);
+static std::string quote(const std::string &string);
+
+Stats::Stats(bool enabled /* = true */)
+    : enabled{enabled}, phases{}, counts{}, values{}
+{
+}
+
+bool Stats::isEnabled() const { return enabled; }
+
+// The time, or the epoch when disabled
+Stats::Clock::time_point Stats::now() const
+{
+  return enabled ? Clock::now() : Clock::time_point{};
+}
+
+// Adds to a phase's wall time. Phases are reported in the order they were
+// first timed.
+void Stats::addTime(const std::string &phase, Clock::duration duration)
+{
+  if (!enabled)
+    return;
+  for (std::pair<std::string, Clock::duration> &entry : phases)
+    if (entry.first == phase)
+    {
+      entry.second += duration;
+      return;
+    }
+  phases.emplace_back(phase, duration);
+}
+
+void Stats::addCount(const std::string &group, const std::string &key,
+                     long count /* = 1 */)
+{
+  if (!enabled)
+    return;
+  counts[group][key] += count;
+}
+
+void Stats::setValue(const std::string &name, long value)
+{
+  if (!enabled)
+    return;
+  values.emplace_back(name, value);
+}
+
+void Stats::print(std::ostream &os) const
+{
+  Clock::duration total{};
+  for (const std::pair<std::string, Clock::duration> &phase : phases)
+    total += phase.second;
+
+  os << "Phases:\n" << std::fixed << std::setprecision(3);
+  for (const std::pair<std::string, Clock::duration> &phase : phases)
+    os << "  " << std::left << std::setw(16) << phase.first << std::right
+       << std::setw(12) << toMilliseconds(phase.second) << " ms\n";
+  os << "  " << std::left << std::setw(16) << "total" << std::right
+     << std::setw(12) << toMilliseconds(total) << " ms\n";
+
+  for (const std::pair<const std::string, std::map<std::string, long>> &group :
+       counts)
+  {
+    os << group.first << ":\n";
+    for (const std::pair<const std::string, long> &count : group.second)
+      os << "  " << std::left << std::setw(24) << count.first << std::right
+         << std::setw(10) << count.second << '\n';
+  }
+
+  for (const std::pair<std::string, long> &value : values)
+    os << std::left << std::setw(26) << value.first << std::right
+       << std::setw(10) << value.second << '\n';
+  os << std::left << std::setw(26) << "peak memory (KB)" << std::right
+     << std::setw(10) << peakMemoryKb() << std::endl;
+}
+
+void Stats::printJson(std::ostream &os) const
+{
+  os << "{\"phases_ms\":{" << std::fixed << std::setprecision(3);
+  for (size_t i = 0; i < phases.size(); i++)
+    os << (i ? "," : "") << quote(phases[i].first) << ':'
+       << toMilliseconds(phases[i].second);
+
+  os << "},\"counts\":{";
+  bool firstGroup{true};
+  for (const std::pair<const std::string, std::map<std::string, long>> &group :
+       counts)
+  {
+    os << (firstGroup ? "" : ",") << quote(group.first) << ":{";
+    bool firstCount{true};
+    for (const std::pair<const std::string, long> &count : group.second)
+    {
+      os << (firstCount ? "" : ",") << quote(count.first) << ':'
+         << count.second;
+      firstCount = false;
+    }
+    os << '}';
+    firstGroup = false;
+  }
+
+  os << "},\"values\":{";
+  for (size_t i = 0; i < values.size(); i++)
+    os << (i ? "," : "") << quote(values[i].first) << ':' << values[i].second;
+
+  os << "},\"peak_memory_kb\":" << peakMemoryKb() << '}' << std::endl;
+}
+
+// Peak resident set size of the process
+long Stats::peakMemoryKb()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+static double toMilliseconds(Stats::Clock::duration duration)
+{
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static std::string quote(const std::string &string)
+{
+  std::string quoted{"\""};
+  for (char c : string)
+  {
+    if (c == '"' || c == '\\')
+      quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
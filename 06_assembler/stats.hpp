@@ -0,0 +1,38 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Collects phase timings and counters for a --stats report. A disabled Stats
+// never reads the clock and records nothing, so runs without --stats pay
+// nothing for it.
+class Stats
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  Stats(bool enabled = true);
+  bool isEnabled() const;
+  Clock::time_point now() const;
+  void addTime(const std::string &phase, Clock::duration duration);
+  void addCount(const std::string &group, const std::string &key,
+                long count = 1);
+  void setValue(const std::string &name, long value);
+  void print(std::ostream &os) const;
+  void printJson(std::ostream &os) const;
+
+  static long peakMemoryKb();
+
+private:
+  bool enabled;
+  std::vector<std::pair<std::string, Clock::duration>> phases;
+  std::map<std::string, std::map<std::string, long>> counts;
+  std::vector<std::pair<std::string, long>> values;
+};
+
+#endif
@@ -51,6 +51,8 @@ int SymbolTable::getSymbolValue(const std::string &symbol) const
   return map.at(symbol);
 }
 
+size_t SymbolTable::size() const { return map.size(); }
+
 std::ostream &operator<<(std::ostream &os, const SymbolTable &symbolTable)
 {
   for (std::pair<std::string, int> element : symbolTable.map)
@@ -11,6 +11,7 @@ public:
   bool contains(const std::string &symbol) const;
   void addSymbol(const std::string &symbol, int value);
   int getSymbolValue(const std::string &symbol) const;
+  size_t size() const;
 
   friend std::ostream &operator<<(std::ostream &os,
                                   const SymbolTable &symbolTable);
@@ -1,8 +1,14 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 #include "parser.hpp"
+#include "sourcemap.hpp"
+#include "stats.hpp"
 #include "symboltable.hpp"
 
 /*
-These are the unit tests for the symbol table and parser modules.
+These are the unit tests for the symbol table, parser, source map and stats
+modules.
 
 Each fuction performs unit tests on a specific module and returns 0 if they
 pass, and 1 otherwise.
@@ -127,9 +133,110 @@ int parserTest() {
   return 0;
 }
 
+int sourceMapTest() {
+  const std::string asmPath{"sourcemap.test.asm"};
+  const std::string mapPath{"sourcemap.test.smap"};
+  {
+    std::ofstream asmFile{asmPath};
+    asmFile << "// @source Main.vm:3\n@7\nD=A\n(LOOP)\n"
+               "// @source Sys.vm:12\n@LOOP\n0;JMP\n";
+  }
+
+  // The parser follows source comments and counts every line
+  Parser parser{asmPath};
+  if (parser.getLineNumber() != 2 || parser.getSourceFile() != "Main.vm" ||
+      parser.getSourceLine() != 3)
+    return fail("'@7' should come from line 2 and Main.vm:3");
+  for (int i = 0; i < 3; i++) parser.advanceCommand();
+  if (parser.getLineNumber() != 6 || parser.getSourceFile() != "Sys.vm" ||
+      parser.getSourceLine() != 12)
+    return fail("'@LOOP' should come from line 6 and Sys.vm:12");
+  parser.reset();
+  if (parser.getSourceFile() != "Main.vm")
+    return fail("parser.reset() should restart source comments");
+
+  // Written maps read back the same, addresses past the end are unknown
+  SourceMap sourceMap{};
+  const int mainFile{sourceMap.addFile("Main.vm")};
+  const int sysFile{sourceMap.addFile("Sys.vm")};
+  if (sourceMap.addFile("Main.vm") != mainFile || sysFile != mainFile + 1)
+    return fail("Source files should be added once");
+  sourceMap.addLocation({2, mainFile, 3});
+  sourceMap.addLocation({9, SourceMap::NO_FILE, 0});
+  sourceMap.addLocation({70000, sysFile, 100000});
+  sourceMap.write(mapPath);
+
+  const SourceMap readMap{SourceMap::read(mapPath)};
+  std::remove(asmPath.c_str());
+  std::remove(mapPath.c_str());
+  if (readMap.size() != 3)
+    return fail("Source map should have 3 addresses");
+  if (readMap.at(0).asmLine != 2 || readMap.at(0).sourceLine != 3 ||
+      readMap.getFileName(readMap.at(0).sourceFile) != "Main.vm")
+    return fail("Address 0 should map to line 2 and Main.vm:3");
+  if (readMap.at(1).sourceFile != SourceMap::NO_FILE)
+    return fail("Address 1 should have no source file");
+  if (readMap.at(2).asmLine != 70000 || readMap.at(2).sourceLine != 100000 ||
+      readMap.getFileName(readMap.at(2).sourceFile) != "Sys.vm")
+    return fail("Address 2 should map to line 70000 and Sys.vm:100000");
+  if (readMap.at(3).asmLine != 0 || readMap.at(-1).asmLine != 0)
+    return fail("Addresses outside the map should be unknown");
+
+  return 0;
+}
+
+int statsTest() {
+  Stats stats{};
+
+  // addCount(), counts add up per group and key
+  stats.addCount("commands", "A instructions");
+  stats.addCount("commands", "A instructions", 2);
+  stats.addCount("commands", "C instructions", 4);
+  stats.setValue("symbols", 23);
+
+  // addTime(), phases add up and keep the order they were first timed in
+  stats.addTime("read/parse", std::chrono::milliseconds{2});
+  stats.addTime("codegen", std::chrono::microseconds{500});
+  stats.addTime("read/parse", std::chrono::milliseconds{1});
+
+  std::ostringstream json;
+  stats.printJson(json);
+  const std::string expected{
+      "{\"phases_ms\":{\"read/parse\":3.000,\"codegen\":0.500},"
+      "\"counts\":{\"commands\":{\"A instructions\":3,"
+      "\"C instructions\":4}},\"values\":{\"symbols\":23},"
+      "\"peak_memory_kb\":"};
+  if (json.str().compare(0, expected.size(), expected) != 0 ||
+      json.str().substr(json.str().size() - 2) != "}\n")
+    return fail("Stats JSON should be " + expected + "...}, not " +
+                json.str());
+
+  std::ostringstream text;
+  stats.print(text);
+  if (text.str().find("total") == std::string::npos ||
+      text.str().find("3.500 ms") == std::string::npos)
+    return fail("Stats report should total the phases to 3.500 ms");
+
+  // A disabled Stats reads no clock and records nothing
+  Stats disabled{false};
+  disabled.addCount("commands", "labels");
+  disabled.addTime("codegen", std::chrono::milliseconds{1});
+  disabled.setValue("symbols", 1);
+  std::ostringstream empty;
+  disabled.printJson(empty);
+  if (disabled.now() != Stats::Clock::time_point{} ||
+      empty.str().find("{\"phases_ms\":{},\"counts\":{},\"values\":{},") !=
+          0)
+    return fail("A disabled Stats should record nothing");
+
+  return 0;
+}
+
 int main() {
   if (symbolTableTest()) return 1;
   if (parserTest()) return 1;
+  if (sourceMapTest()) return 1;
+  if (statsTest()) return 1;
 
   printf("Success");
   return 0;
@@ -0,0 +1,74 @@
+#include "cache.hpp"
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+// Bump whenever the layout of entries changes
+const char CACHE_FORMAT[]{"vm-translator-cache-5"};
+// Entries are only reused by the build of the translator that wrote them, so
+// a change to the Translator never splices stale code into a new build
+const char TRANSLATOR_BUILD[]{__DATE__ " " __TIME__};
+
+static uint64_t hashBytes(uint64_t hash, const std::string &bytes);
+
+TranslationCache::TranslationCache(const std::filesystem::path &cacheDirectory)
+    : directory{cacheDirectory}
+{
+  std::filesystem::create_directories(directory);
+}
+
+// Keys are a 64-bit FNV-1a hash of the translator's build, the file's
+// contents and every translator option that affects the generated code
+std::string TranslationCache::makeKey(const std::string &contents,
+                                      const std::string &options)
+{
+  uint64_t hash{0xcbf29ce484222325};
+  hash = hashBytes(hash, CACHE_FORMAT);
+  hash = hashBytes(hash, TRANSLATOR_BUILD);
+  hash = hashBytes(hash, options);
+  hash = hashBytes(hash, contents);
+
+  std::ostringstream key;
+  key << std::hex << hash;
+  return key.str();
+}
+
+bool TranslationCache::lookup(const std::string &key,
+                              std::string &translation) const
+{
+  std::ifstream entry{directory / (key + ".asm"), std::ios::binary};
+  if (!entry.is_open())
+    return false;
+
+  translation.assign(std::istreambuf_iterator<char>(entry),
+                     std::istreambuf_iterator<char>());
+  return true;
+}
+
+// Entries are written under a temporary name and renamed into place, so a
+// concurrent or interrupted build never sees half an entry
+void TranslationCache::store(const std::string &key,
+                             const std::string &translation) const
+{
+  const std::filesystem::path entryPath{directory / (key + ".asm")};
+  const std::filesystem::path temporaryPath{directory / (key + ".tmp")};
+  {
+    std::ofstream entry{temporaryPath, std::ios::binary};
+    entry << translation;
+  }
+  std::filesystem::rename(temporaryPath, entryPath);
+}
+
+static uint64_t hashBytes(uint64_t hash, const std::string &bytes)
+{
+  for (unsigned char byte : bytes)
+  {
+    hash ^= byte;
+    hash *= 0x100000001b3;
+  }
+  // Separate consecutive fields so "ab" + "c" and "a" + "bc" differ
+  hash ^= 0xFF;
+  hash *= 0x100000001b3;
+  return hash;
+}
@@ -0,0 +1,20 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <filesystem>
+#include <string>
+
+class TranslationCache
+{
+public:
+  TranslationCache(const std::filesystem::path &cacheDirectory);
+  static std::string makeKey(const std::string &contents,
+                             const std::string &options);
+  bool lookup(const std::string &key, std::string &translation) const;
+  void store(const std::string &key, const std::string &translation) const;
+
+private:
+  std::filesystem::path directory;
+};
+
+#endif
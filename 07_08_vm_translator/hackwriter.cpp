@@ -0,0 +1,122 @@
+#include "hackwriter.hpp"
+#include <bitset>
+#include <cctype>
+#include <stdexcept>
+#include "../06_assembler/code.hpp"
+#include "../06_assembler/littleendian.hpp"
+
+const std::string FUNCTION_COMMENT{"// function "};
+const std::string SOURCE_COMMENT{"// @source "};
+
+HackWriter::HackWriter() : object{}, sourceLine{0}, cInstructionCache{} {}
+
+// Encodes a single line of Hack assembly as emitted by the Translator.
+// Labels are recorded at the current address, symbolic A instructions are
+// left as a reference for the Linker to resolve. A "// function" comment
+// marks a function's entry point and "$ret." labels mark return sites.
+// "// @source file:line" comments give the .vm line of the following words.
+void HackWriter::writeLine(const std::string &line)
+{
+  ++object.lineCount;
+  if (line.empty())
+    return;
+
+  if (line.compare(0, 2, "//") == 0)
+  {
+    if (line.compare(0, FUNCTION_COMMENT.size(), FUNCTION_COMMENT) == 0)
+      object.functions.emplace_back(line.substr(FUNCTION_COMMENT.size()),
+                                    object.code.size());
+    else if (line.compare(0, SOURCE_COMMENT.size(), SOURCE_COMMENT) == 0)
+    {
+      const size_t colon{line.rfind(':')};
+      object.sourceFile = line.substr(SOURCE_COMMENT.size(),
+                                      colon - SOURCE_COMMENT.size());
+      sourceLine = std::stoi(line.substr(colon + 1));
+    }
+    return;
+  }
+
+  if (line[0] == '(')
+  {
+    const std::string label{line.substr(1, line.size() - 2)};
+    object.labels.emplace_back(label, object.code.size());
+    if (label.find("$ret.") != std::string::npos)
+      object.returnSites.emplace_back(label, object.code.size());
+    return;
+  }
+
+  if (line[0] == '@')
+  {
+    if (isdigit(line[1]))
+      addWord(std::stoi(line.substr(1)));
+    else
+    {
+      object.references.emplace_back(object.code.size(), line.substr(1));
+      addWord(0);
+    }
+    return;
+  }
+
+  addWord(encodeCInstruction(line));
+}
+
+int HackWriter::getInstructionNumber() const { return object.code.size(); }
+
+const ObjectFile &HackWriter::getObject() const { return object; }
+
+// Writes the ROM in the assembler's .hack text format
+void HackWriter::writeHack(std::ostream &os, const std::vector<uint16_t> &rom)
+{
+  for (uint16_t word : rom)
+    os << std::bitset<16>(word).to_string() << '\n';
+}
+
+// Writes the ROM as packed little endian 16-bit words
+void HackWriter::writeBinary(std::ostream &os, const std::vector<uint16_t> &rom)
+{
+  for (uint16_t word : rom)
+    writeU16(os, word);
+}
+
+void HackWriter::addWord(uint16_t word)
+{
+  object.code.push_back(word);
+  object.sourceLines.emplace_back(object.lineCount, sourceLine);
+}
+
+// Looks up the comp, dest and jmp fields in the assembler's tables. The
+// Translator only ever emits a few dozen distinct C instructions, so each one
+// is encoded once and cached.
+uint16_t HackWriter::encodeCInstruction(const std::string &line)
+{
+  std::unordered_map<std::string, uint16_t>::const_iterator cached{
+      cInstructionCache.find(line)};
+  if (cached != cInstructionCache.end())
+    return cached->second;
+
+  size_t destFieldSplitter{line.find('=')};
+  size_t jmpFieldSplitter{line.find(';')};
+  size_t compStart{0};
+  size_t compEnd{line.size()};
+
+  std::string dest{"000"};
+  if (destFieldSplitter != std::string::npos)
+  {
+    dest = destMap.at(line.substr(0, destFieldSplitter));
+    compStart = destFieldSplitter + 1;
+  }
+
+  std::string jmp{"000"};
+  if (jmpFieldSplitter != std::string::npos)
+  {
+    jmp = jmpMap.at(line.substr(jmpFieldSplitter + 1));
+    compEnd = jmpFieldSplitter;
+  }
+
+  std::string comp{compMap.at(line.substr(compStart, compEnd - compStart))};
+
+  uint16_t word = std::bitset<16>("111" + comp + dest + jmp).to_ulong();
+  cInstructionCache[line] = word;
+
+  return word;
+}
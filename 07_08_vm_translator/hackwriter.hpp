@@ -0,0 +1,30 @@
+#ifndef HACK_WRITER_HPP
+#define HACK_WRITER_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "objectfile.hpp"
+
+class HackWriter
+{
+public:
+  HackWriter();
+  void writeLine(const std::string &line);
+  int getInstructionNumber() const;
+  const ObjectFile &getObject() const;
+
+  static void writeHack(std::ostream &os, const std::vector<uint16_t> &rom);
+  static void writeBinary(std::ostream &os, const std::vector<uint16_t> &rom);
+
+private:
+  ObjectFile object;
+  int sourceLine;
+  std::unordered_map<std::string, uint16_t> cInstructionCache;
+  uint16_t encodeCInstruction(const std::string &line);
+  void addWord(uint16_t word);
+};
+
+#endif
@@ -0,0 +1,409 @@
+#include "interpreter.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+const uint16_t ADDRESS_MASK{0x7FFF};
+const int STATIC_BASE_ADDRESS{0x10};
+const int STATIC_LIMIT_ADDRESS{0xFF};
+const int POINTER_BASE_ADDRESS{3};
+const int TEMP_BASE_ADDRESS{5};
+const int TEMP_SIZE{8};
+
+Interpreter::Interpreter()
+    : code{}, labels{}, functions{}, statics{}, fixups{}, linked{false},
+      ram(RAM_SIZE, 0), frames{}, pc{0}, halted{false}, instructionCount{0}
+{
+}
+
+// Appends a .vm file's code. Labels are scoped to the function they appear
+// in, as the translator scopes them.
+void Interpreter::load(const std::string &inputFilename)
+{
+  if (linked)
+    throw std::logic_error("Cannot load files after linking");
+
+  const std::string fileName{
+      std::filesystem::path(inputFilename).stem().string()};
+  std::string currentFunction;
+
+  for (Parser parser{inputFilename}; parser.moreInstructions();
+       parser.advanceInstruction())
+  {
+    const Parser::Instruction &instruction{parser.getCurrentInstruction()};
+    switch (instruction.type)
+    {
+    case Parser::PUSH_INSTRUCTION:
+    case Parser::POP_INSTRUCTION:
+      code.push_back(makeSegmentOp(instruction, fileName));
+      break;
+    case Parser::ARITHMETIC_INSTRUCTION:
+    {
+      static const std::unordered_map<std::string, OPCODES> arithmetic{
+          {"add", ADD}, {"sub", SUB}, {"neg", NEG}, {"eq", EQ}, {"gt", GT},
+          {"lt", LT},   {"and", AND}, {"or", OR},   {"not", NOT}};
+      code.push_back({arithmetic.at(instruction.op), 0, -1});
+      break;
+    }
+    case Parser::LABEL_INSTRUCTION:
+      labels[currentFunction + "$" + instruction.symbol] = code.size();
+      break;
+    case Parser::GOTO_INSTRUCTION:
+    case Parser::IF_INSTRUCTION:
+      fixups.push_back(
+          {code.size(), currentFunction + "$" + instruction.symbol, false});
+      code.push_back(
+          {instruction.type == Parser::GOTO_INSTRUCTION ? GOTO : IF_GOTO, 0,
+           -1});
+      break;
+    case Parser::FN_DECL_INSTRUCTION:
+      currentFunction = instruction.symbol;
+      functions[currentFunction] = code.size();
+      code.push_back({FUNCTION, instruction.indexOrConstant, -1});
+      break;
+    case Parser::CALL_INSTRUCTION:
+      fixups.push_back({code.size(), instruction.symbol, true});
+      code.push_back({CALL, instruction.indexOrConstant, -1});
+      break;
+    case Parser::RETURN_INSTRUCTION:
+      code.push_back({RETURN, 0, -1});
+      break;
+    default:
+      throw std::runtime_error("Unknown instruction '" +
+                               parser.getRawInstruction() + "' in " +
+                               inputFilename + ":" +
+                               std::to_string(parser.getLineNumber()));
+    }
+  }
+}
+
+// Resolves every goto and call to the index of the op it continues at
+void Interpreter::link()
+{
+  for (const Fixup &fixup : fixups)
+  {
+    const std::unordered_map<std::string, int> &targets{
+        fixup.function ? functions : labels};
+    const auto target{targets.find(fixup.symbol)};
+    if (target == targets.end())
+      throw std::runtime_error(
+          std::string(fixup.function ? "Undefined function "
+                                     : "Undefined label ") +
+          fixup.symbol);
+    code[fixup.op].target = target->second;
+  }
+  fixups.clear();
+
+  // Code that runs off its end, and the entry function's return, halt here
+  code.push_back({HALT, 0, -1});
+  linked = true;
+  reset();
+}
+
+// Clears RAM and the call stack and points SP at the stack base
+void Interpreter::reset()
+{
+  std::fill(ram.begin(), ram.end(), 0);
+  ram[0] = STACK_BASE;
+  frames.clear();
+  pc = 0;
+  halted = false;
+  instructionCount = 0;
+}
+
+// Calls function with no arguments like the bootstrap code calls Sys.init.
+// Without a call to start() execution begins at the first loaded op.
+void Interpreter::start(const std::string &function)
+{
+  if (!hasFunction(function))
+    throw std::runtime_error("Undefined function " + function);
+
+  frames.push_back({static_cast<int>(code.size()) - 1,
+                    static_cast<uint16_t>(ram[1]),
+                    static_cast<uint16_t>(ram[2]), ram[3], ram[4]});
+  ram[2] = ram[0];
+  pc = functions.at(function);
+  halted = false;
+}
+
+// Executes up to maxInstructions VM instructions, stopping early when the
+// program halts: on a goto to itself, when the entry function returns or
+// when execution runs off the end of the code. Returns the number of
+// instructions executed.
+uint64_t Interpreter::run(uint64_t maxInstructions)
+{
+  if (!linked)
+    throw std::logic_error("Cannot run before linking");
+  if (halted)
+    return 0;
+
+  static const void *const handlers[]{
+      &&pushConstant, &&pushLocal,   &&pushArgument, &&pushThis,
+      &&pushThat,     &&pushRam,     &&popLocal,     &&popArgument,
+      &&popThis,      &&popThat,     &&popRam,       &&add,
+      &&sub,          &&neg,         &&eq,           &&gt,
+      &&lt,           &&bitAnd,      &&bitOr,        &&bitNot,
+      &&jump,         &&jumpIf,      &&call,         &&function,
+      &&functionReturn, &&halt};
+
+  int16_t *memory{ram.data()};
+  const Op *ops{code.data()};
+  const Op *op{ops + pc};
+  uint16_t sp = memory[0];
+  uint16_t lcl = memory[1];
+  uint16_t arg = memory[2];
+  uint64_t remaining{maxInstructions};
+
+// Stack accesses wrap around the address space like they do on Hack
+#define TOP memory[(sp - 1) & ADDRESS_MASK]
+#define SECOND memory[(sp - 2) & ADDRESS_MASK]
+#define DISPATCH()                                                             \
+  do                                                                           \
+  {                                                                            \
+    if (remaining == 0)                                                        \
+      goto done;                                                               \
+    --remaining;                                                               \
+    goto *handlers[op->code];                                                  \
+  } while (0)
+#define NEXT()                                                                 \
+  do                                                                           \
+  {                                                                            \
+    ++op;                                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+#define BINARY(expression)                                                     \
+  do                                                                           \
+  {                                                                            \
+    SECOND = (expression);                                                     \
+    --sp;                                                                      \
+    NEXT();                                                                    \
+  } while (0)
+
+  DISPATCH();
+
+pushConstant:
+  memory[sp++ & ADDRESS_MASK] = op->operand;
+  NEXT();
+pushLocal:
+  memory[sp++ & ADDRESS_MASK] = memory[(lcl + op->operand) & ADDRESS_MASK];
+  NEXT();
+pushArgument:
+  memory[sp++ & ADDRESS_MASK] = memory[(arg + op->operand) & ADDRESS_MASK];
+  NEXT();
+pushThis:
+  memory[sp++ & ADDRESS_MASK] =
+      memory[(static_cast<uint16_t>(memory[3]) + op->operand) & ADDRESS_MASK];
+  NEXT();
+pushThat:
+  memory[sp++ & ADDRESS_MASK] =
+      memory[(static_cast<uint16_t>(memory[4]) + op->operand) & ADDRESS_MASK];
+  NEXT();
+pushRam:
+  memory[sp++ & ADDRESS_MASK] = memory[op->operand];
+  NEXT();
+popLocal:
+  memory[(lcl + op->operand) & ADDRESS_MASK] = memory[--sp & ADDRESS_MASK];
+  NEXT();
+popArgument:
+  memory[(arg + op->operand) & ADDRESS_MASK] = memory[--sp & ADDRESS_MASK];
+  NEXT();
+popThis:
+  memory[(static_cast<uint16_t>(memory[3]) + op->operand) & ADDRESS_MASK] =
+      memory[--sp & ADDRESS_MASK];
+  NEXT();
+popThat:
+  memory[(static_cast<uint16_t>(memory[4]) + op->operand) & ADDRESS_MASK] =
+      memory[--sp & ADDRESS_MASK];
+  NEXT();
+popRam:
+  memory[op->operand] = memory[--sp & ADDRESS_MASK];
+  NEXT();
+
+add:
+  BINARY(SECOND + TOP);
+sub:
+  BINARY(SECOND - TOP);
+eq:
+  BINARY(SECOND == TOP ? -1 : 0);
+gt:
+  BINARY(SECOND > TOP ? -1 : 0);
+lt:
+  BINARY(SECOND < TOP ? -1 : 0);
+bitAnd:
+  BINARY(SECOND & TOP);
+bitOr:
+  BINARY(SECOND | TOP);
+neg:
+  TOP = -TOP;
+  NEXT();
+bitNot:
+  TOP = ~TOP;
+  NEXT();
+
+jump:
+  // label X; goto X is the idiom programs halt with
+  if (ops + op->target == op)
+  {
+    halted = true;
+    goto done;
+  }
+  op = ops + op->target;
+  DISPATCH();
+jumpIf:
+  op = memory[--sp & ADDRESS_MASK] ? ops + op->target : op + 1;
+  DISPATCH();
+
+call:
+  frames.push_back({static_cast<int>(op - ops) + 1, lcl, arg, memory[3],
+                    memory[4]});
+  arg = sp - op->operand;
+  op = ops + op->target;
+  DISPATCH();
+function:
+  lcl = sp;
+  for (int i = 0; i < op->operand; i++)
+    memory[sp++ & ADDRESS_MASK] = 0;
+  NEXT();
+functionReturn:
+{
+  memory[arg & ADDRESS_MASK] = TOP;
+  sp = arg + 1;
+  if (frames.empty())
+  {
+    ++op;
+    halted = true;
+    goto done;
+  }
+  const Frame &frame{frames.back()};
+  lcl = frame.lcl;
+  arg = frame.arg;
+  memory[3] = frame.pointerThis;
+  memory[4] = frame.pointerThat;
+  op = ops + frame.returnIndex;
+  frames.pop_back();
+  DISPATCH();
+}
+
+halt:
+  // Reaching the final HALT is not an instruction of the program
+  ++remaining;
+  halted = true;
+
+#undef BINARY
+#undef NEXT
+#undef DISPATCH
+#undef SECOND
+#undef TOP
+
+done:
+  memory[0] = sp;
+  memory[1] = lcl;
+  memory[2] = arg;
+  pc = op - ops;
+  const uint64_t executed{maxInstructions - remaining};
+  instructionCount += executed;
+  return executed;
+}
+
+// Pushes the arguments and runs function until it returns, then pops and
+// returns its result. Meant for calling single functions from unit tests.
+int16_t Interpreter::call(const std::string &function,
+                          const std::vector<int16_t> &arguments,
+                          uint64_t maxInstructions)
+{
+  if (!hasFunction(function))
+    throw std::runtime_error("Undefined function " + function);
+
+  const int savedPc{pc};
+  uint16_t sp = ram[0];
+  for (int16_t argument : arguments)
+    ram[sp++ & ADDRESS_MASK] = argument;
+  frames.push_back({static_cast<int>(code.size()) - 1,
+                    static_cast<uint16_t>(ram[1]),
+                    static_cast<uint16_t>(ram[2]), ram[3], ram[4]});
+  ram[0] = sp;
+  ram[2] = sp - arguments.size();
+  pc = functions.at(function);
+  halted = false;
+
+  run(maxInstructions);
+  if (!halted || pc != static_cast<int>(code.size()) - 1)
+    throw std::runtime_error(function + " did not return");
+
+  pc = savedPc;
+  halted = false;
+  sp = ram[0] - 1;
+  ram[0] = sp;
+  return ram[sp & ADDRESS_MASK];
+}
+
+bool Interpreter::isHalted() const { return halted; }
+
+bool Interpreter::hasFunction(const std::string &function) const
+{
+  return functions.count(function) != 0;
+}
+
+uint64_t Interpreter::getInstructionCount() const { return instructionCount; }
+
+int16_t Interpreter::peek(int address) const
+{
+  return ram[address & ADDRESS_MASK];
+}
+
+void Interpreter::poke(int address, int16_t value)
+{
+  ram[address & ADDRESS_MASK] = value;
+}
+
+Interpreter::Op Interpreter::makeSegmentOp(
+    const Parser::Instruction &instruction, const std::string &fileName)
+{
+  const bool push{instruction.type == Parser::PUSH_INSTRUCTION};
+  const int index{instruction.indexOrConstant};
+
+  switch (instruction.segment)
+  {
+  case Parser::CONSTANT_SEGMENT:
+    if (!push)
+      throw std::runtime_error("Cannot pop to the constant segment");
+    return {PUSH_CONSTANT, index, -1};
+  case Parser::LOCAL_SEGMENT:
+    return {push ? PUSH_LOCAL : POP_LOCAL, index, -1};
+  case Parser::ARGUMENT_SEGMENT:
+    return {push ? PUSH_ARGUMENT : POP_ARGUMENT, index, -1};
+  case Parser::THIS_SEGMENT:
+    return {push ? PUSH_THIS : POP_THIS, index, -1};
+  case Parser::THAT_SEGMENT:
+    return {push ? PUSH_THAT : POP_THAT, index, -1};
+  case Parser::POINTER_SEGMENT:
+    if (index < 0 || index > 1)
+      throw std::runtime_error("Invalid pointer index " +
+                               std::to_string(index));
+    return {push ? PUSH_RAM : POP_RAM, POINTER_BASE_ADDRESS + index, -1};
+  case Parser::TEMP_SEGMENT:
+    if (index < 0 || index >= TEMP_SIZE)
+      throw std::runtime_error("Invalid temp index " + std::to_string(index));
+    return {push ? PUSH_RAM : POP_RAM, TEMP_BASE_ADDRESS + index, -1};
+  case Parser::STATIC_SEGMENT:
+    return {push ? PUSH_RAM : POP_RAM,
+            staticAddress(fileName + "." + std::to_string(index)), -1};
+  default:
+    throw std::runtime_error("Invalid segment");
+  }
+}
+
+// Statics get addresses from 16 in order of first use, which is the order
+// the linker allocates their symbols in
+int Interpreter::staticAddress(const std::string &symbol)
+{
+  const auto existing{statics.find(symbol)};
+  if (existing != statics.end())
+    return existing->second;
+
+  const int address{STATIC_BASE_ADDRESS + static_cast<int>(statics.size())};
+  if (address > STATIC_LIMIT_ADDRESS)
+    throw std::runtime_error("Too many static variables");
+  statics[symbol] = address;
+  return address;
+}
@@ -0,0 +1,111 @@
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "parser.hpp"
+
+// Executes VM code directly, without translating it to Hack. Segments and
+// statics live in a Hack sized RAM at the addresses the translator gives
+// them, and the stack grows from 256 as usual, but call frames are kept
+// natively instead of as five words on the stack.
+class Interpreter
+{
+public:
+  static constexpr int RAM_SIZE{0x8000};
+  static constexpr int STACK_BASE{256};
+
+  Interpreter();
+  void load(const std::string &inputFilename);
+  void link();
+  void reset();
+  void start(const std::string &function);
+  uint64_t run(uint64_t maxInstructions);
+  int16_t call(const std::string &function,
+               const std::vector<int16_t> &arguments,
+               uint64_t maxInstructions);
+  bool isHalted() const;
+  bool hasFunction(const std::string &function) const;
+  uint64_t getInstructionCount() const;
+  int16_t peek(int address) const;
+  void poke(int address, int16_t value);
+
+private:
+  enum OPCODES : uint8_t
+  {
+    PUSH_CONSTANT,
+    PUSH_LOCAL,
+    PUSH_ARGUMENT,
+    PUSH_THIS,
+    PUSH_THAT,
+    // pointer, temp and static, whose address is known when loading
+    PUSH_RAM,
+    POP_LOCAL,
+    POP_ARGUMENT,
+    POP_THIS,
+    POP_THAT,
+    POP_RAM,
+    ADD,
+    SUB,
+    NEG,
+    EQ,
+    GT,
+    LT,
+    AND,
+    OR,
+    NOT,
+    GOTO,
+    IF_GOTO,
+    CALL,
+    FUNCTION,
+    RETURN,
+    HALT
+  };
+
+  struct Op
+  {
+    OPCODES code;
+    int operand;
+    // Index of the op a goto, if-goto or call continues at
+    int target;
+  };
+
+  struct Frame
+  {
+    int returnIndex;
+    uint16_t lcl;
+    uint16_t arg;
+    int16_t pointerThis;
+    int16_t pointerThat;
+  };
+
+  // A reference to a label or function, resolved by link()
+  struct Fixup
+  {
+    size_t op;
+    std::string symbol;
+    bool function;
+  };
+
+  Op makeSegmentOp(const Parser::Instruction &instruction,
+                   const std::string &fileName);
+  int staticAddress(const std::string &symbol);
+
+  std::vector<Op> code;
+  std::unordered_map<std::string, int> labels;
+  std::unordered_map<std::string, int> functions;
+  std::unordered_map<std::string, int> statics;
+  std::vector<Fixup> fixups;
+  bool linked;
+
+  std::vector<int16_t> ram;
+  std::vector<Frame> frames;
+  int pc;
+  bool halted;
+  uint64_t instructionCount;
+};
+
+#endif
@@ -0,0 +1,298 @@
+#include "lexer.hpp"
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::string_view stripComment(std::string_view line);
+static std::string_view trim(std::string_view string);
+static std::string_view nextToken(std::string_view &string);
+static int parseInt(std::string_view string);
+static Parser::SEGMENTS parseSegmentType(std::string_view string);
+
+// Keywords are told apart by their length and first two characters, which
+// is unique for every VM keyword
+static constexpr uint32_t keywordHash(size_t length, char first, char second)
+{
+  return (length << 16) | (static_cast<unsigned char>(first) << 8) |
+         static_cast<unsigned char>(second);
+}
+
+Lexer::Lexer(const std::string &inputFilename)
+    : data{nullptr}, size{0}, position{0}, lineNumber{0}, rawInstruction{}
+{
+  int fd{open(inputFilename.c_str(), O_RDONLY)};
+  if (fd < 0)
+    throw std::runtime_error("Invalid input file " + inputFilename);
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+  {
+    size = fileStat.st_size;
+    void *mapping{mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)};
+    if (mapping == MAP_FAILED)
+    {
+      close(fd);
+      throw std::runtime_error("Could not map input file " + inputFilename);
+    }
+    data = static_cast<const char *>(mapping);
+  }
+  close(fd);
+}
+
+Lexer::~Lexer()
+{
+  if (data)
+    munmap(const_cast<char *>(data), size);
+}
+
+// Advances to the next line holding an instruction. Returns false once the
+// end of the file is reached.
+bool Lexer::nextInstruction(Instruction &instruction)
+{
+  while (position < size)
+  {
+    const char *lineStart{data + position};
+    const char *lineEnd{static_cast<const char *>(
+        memchr(lineStart, '\n', size - position))};
+    if (!lineEnd)
+      lineEnd = data + size;
+
+    position = lineEnd - data + 1;
+    ++lineNumber;
+
+    std::string_view line{trim(stripComment(
+        std::string_view(lineStart, lineEnd - lineStart)))};
+    if (line.empty())
+      continue;
+
+    rawInstruction = line;
+    parseInstruction(line, instruction);
+    return true;
+  }
+  return false;
+}
+
+void Lexer::reset()
+{
+  position = 0;
+  lineNumber = 0;
+  rawInstruction = {};
+}
+
+std::string_view Lexer::getRawInstruction() const { return rawInstruction; }
+
+// 1-based line number of the current instruction in the input file
+int Lexer::getLineNumber() const { return lineNumber; }
+
+void Lexer::parseInstruction(std::string_view line, Instruction &instruction)
+{
+  instruction.type = Parser::NONE_INSTRUCTION;
+  instruction.segment = Parser::NONE_SEGMENT;
+  instruction.indexOrConstant = 0;
+  instruction.op = {};
+  instruction.symbol = {};
+
+  std::string_view keyword{nextToken(line)};
+  if (keyword.size() < 2)
+    return;
+
+  // Find the only keyword the line can hold, then confirm it
+  const char *expected;
+  Parser::INSTRUCTION_TYPES type;
+  switch (keywordHash(keyword.size(), keyword[0], keyword[1]))
+  {
+  case keywordHash(3, 'a', 'd'):
+    expected = "add";
+    type = Parser::ARITHMETIC_INSTRUCTION;
+    break;
+  case keywordHash(3, 's', 'u'):
+    expected = "sub";
+    type = Parser::ARITHMETIC_INSTRUCTION;
+    break;
+  case keywordHash(3, 'n', 'e'):
+    expected = "neg";
+    type = Parser::ARITHMETIC_INSTRUCTION;
+    break;
+  case keywordHash(2, 'e', 'q'):
+    expected = "eq";
+    type = Parser::ARITHMETIC_INSTRUCTION;
+    break;
+  case keywordHash(2, 'g', 't'):
+    expected = "gt";
+    type = Parser::ARITHMETIC_INSTRUCTION;
+    break;
+  case keywordHash(2, 'l', 't'):
+    expected = "lt";
+    type = Parser::ARITHMETIC_INSTRUCTION;
+    break;
+  case keywordHash(3, 'a', 'n'):
+    expected = "and";
+    type = Parser::ARITHMETIC_INSTRUCTION;
+    break;
+  case keywordHash(2, 'o', 'r'):
+    expected = "or";
+    type = Parser::ARITHMETIC_INSTRUCTION;
+    break;
+  case keywordHash(3, 'n', 'o'):
+    expected = "not";
+    type = Parser::ARITHMETIC_INSTRUCTION;
+    break;
+  case keywordHash(4, 'p', 'u'):
+    expected = "push";
+    type = Parser::PUSH_INSTRUCTION;
+    break;
+  case keywordHash(3, 'p', 'o'):
+    expected = "pop";
+    type = Parser::POP_INSTRUCTION;
+    break;
+  case keywordHash(5, 'l', 'a'):
+    expected = "label";
+    type = Parser::LABEL_INSTRUCTION;
+    break;
+  case keywordHash(7, 'i', 'f'):
+    expected = "if-goto";
+    type = Parser::IF_INSTRUCTION;
+    break;
+  case keywordHash(4, 'g', 'o'):
+    expected = "goto";
+    type = Parser::GOTO_INSTRUCTION;
+    break;
+  case keywordHash(8, 'f', 'u'):
+    expected = "function";
+    type = Parser::FN_DECL_INSTRUCTION;
+    break;
+  case keywordHash(4, 'c', 'a'):
+    expected = "call";
+    type = Parser::CALL_INSTRUCTION;
+    break;
+  case keywordHash(6, 'r', 'e'):
+    expected = "return";
+    type = Parser::RETURN_INSTRUCTION;
+    break;
+  default:
+    return;
+  }
+
+  // Unknown instruction
+  if (keyword != expected)
+    return;
+
+  instruction.type = type;
+  switch (type)
+  {
+  case Parser::ARITHMETIC_INSTRUCTION:
+    instruction.op = keyword;
+    break;
+  case Parser::PUSH_INSTRUCTION:
+  case Parser::POP_INSTRUCTION:
+    instruction.segment = parseSegmentType(nextToken(line));
+    instruction.indexOrConstant = parseInt(nextToken(line));
+    break;
+  case Parser::LABEL_INSTRUCTION:
+  case Parser::IF_INSTRUCTION:
+  case Parser::GOTO_INSTRUCTION:
+    instruction.symbol = nextToken(line);
+    break;
+  case Parser::FN_DECL_INSTRUCTION:
+  case Parser::CALL_INSTRUCTION:
+    instruction.symbol = nextToken(line);
+    instruction.indexOrConstant = parseInt(nextToken(line));
+    break;
+  default:
+    break;
+  }
+}
+
+static std::string_view stripComment(std::string_view line)
+{
+  size_t commentBegin{line.find("//")};
+  if (commentBegin == std::string_view::npos)
+    return line;
+  return line.substr(0, commentBegin);
+}
+
+static bool isSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static std::string_view trim(std::string_view string)
+{
+  while (!string.empty() && isSpace(string.front()))
+    string.remove_prefix(1);
+  while (!string.empty() && isSpace(string.back()))
+    string.remove_suffix(1);
+  return string;
+}
+
+// Splits the first whitespace separated token off the front of string
+static std::string_view nextToken(std::string_view &string)
+{
+  string = trim(string);
+  size_t tokenEnd{0};
+  while (tokenEnd < string.size() && !isSpace(string[tokenEnd]))
+    ++tokenEnd;
+
+  std::string_view token{string.substr(0, tokenEnd)};
+  string.remove_prefix(tokenEnd);
+  return token;
+}
+
+// Throws on anything but a whole number, as std::stoi did
+static int parseInt(std::string_view string)
+{
+  int value{0};
+  const char *end{string.data() + string.size()};
+  const std::from_chars_result result{
+      std::from_chars(string.data(), end, value)};
+  if (result.ec != std::errc{} || result.ptr != end)
+    throw std::invalid_argument("Invalid number '" + std::string{string} +
+                                "'");
+  return value;
+}
+
+static Parser::SEGMENTS parseSegmentType(std::string_view string)
+{
+  if (string.size() < 4)
+    return Parser::NONE_SEGMENT;
+
+  switch (string[0])
+  {
+  case 'c':
+    if (string == "constant")
+      return Parser::CONSTANT_SEGMENT;
+    break;
+  case 'l':
+    if (string == "local")
+      return Parser::LOCAL_SEGMENT;
+    break;
+  case 'a':
+    if (string == "argument")
+      return Parser::ARGUMENT_SEGMENT;
+    break;
+  case 't':
+    if (string == "this")
+      return Parser::THIS_SEGMENT;
+    if (string == "that")
+      return Parser::THAT_SEGMENT;
+    if (string == "temp")
+      return Parser::TEMP_SEGMENT;
+    break;
+  case 'p':
+    if (string == "pointer")
+      return Parser::POINTER_SEGMENT;
+    break;
+  case 's':
+    if (string == "static")
+      return Parser::STATIC_SEGMENT;
+    break;
+  }
+  return Parser::NONE_SEGMENT;
+}
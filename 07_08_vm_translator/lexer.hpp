@@ -0,0 +1,42 @@
+#ifndef LEXER_HPP
+#define LEXER_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "parser.hpp"
+
+// Reads VM instructions straight out of a memory mapped file. Symbols and
+// ops are views into the mapping, so no allocation happens per line.
+class Lexer
+{
+public:
+  struct Instruction
+  {
+    Parser::INSTRUCTION_TYPES type;
+    Parser::SEGMENTS segment;
+    int indexOrConstant;
+    std::string_view op;
+    std::string_view symbol;
+  };
+
+  Lexer(const std::string &inputFilename);
+  Lexer(const Lexer &) = delete;
+  Lexer &operator=(const Lexer &) = delete;
+  ~Lexer();
+  bool nextInstruction(Instruction &instruction);
+  void reset();
+  std::string_view getRawInstruction() const;
+  int getLineNumber() const;
+
+  static void parseInstruction(std::string_view line, Instruction &instruction);
+
+private:
+  const char *data;
+  size_t size;
+  size_t position;
+  int lineNumber;
+  std::string_view rawInstruction;
+};
+
+#endif
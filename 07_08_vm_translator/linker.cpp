@@ -0,0 +1,108 @@
+#include "linker.hpp"
+#include <stdexcept>
+#include <unordered_map>
+#include "../06_assembler/symboltable.hpp"
+
+const int VARIABLE_BASE_ADDRESS{0x10};
+
+static std::string objectName(const ObjectFile &object);
+
+Linker::Linker()
+    : objects{}, symbolCount{0}, functions{}, returnSites{} {}
+
+void Linker::addObject(const ObjectFile &object) { objects.push_back(object); }
+
+// Places the objects one after another in ROM, then resolves every reference
+// with the same semantics as the assembler: labels first, anything left over
+// (static variables) is allocated a RAM address from 16 onwards. A label
+// defined twice, or shadowing a predefined symbol, is an error.
+std::vector<uint16_t> Linker::link()
+{
+  SymbolTable symbolTable{};
+  std::vector<uint16_t> rom;
+  std::unordered_map<std::string, const ObjectFile *> definitions;
+  functions.clear();
+  returnSites.clear();
+
+  for (const ObjectFile &object : objects)
+  {
+    const int base = rom.size();
+    for (const std::pair<std::string, int> &label : object.labels)
+    {
+      const auto definition{definitions.emplace(label.first, &object)};
+      if (!definition.second)
+        throw std::runtime_error("Duplicate symbol " + label.first + " in " +
+                                 objectName(*definition.first->second) +
+                                 " and " + objectName(object));
+      if (symbolTable.contains(label.first))
+        throw std::runtime_error("Label " + label.first + " in " +
+                                 objectName(object) +
+                                 " is a predefined symbol");
+      symbolTable.addSymbol(label.first, base + label.second);
+    }
+    for (const std::pair<std::string, int> &function : object.functions)
+      functions.emplace_back(function.first, base + function.second);
+    for (const std::pair<std::string, int> &returnSite : object.returnSites)
+      returnSites.emplace_back(returnSite.first, base + returnSite.second);
+    rom.insert(rom.end(), object.code.begin(), object.code.end());
+  }
+
+  int nextVariableAddress{VARIABLE_BASE_ADDRESS};
+  int base{0};
+  for (const ObjectFile &object : objects)
+  {
+    for (const std::pair<int, std::string> &reference : object.references)
+    {
+      if (!symbolTable.contains(reference.second))
+        symbolTable.addSymbol(reference.second, nextVariableAddress++);
+      rom[base + reference.first] =
+          symbolTable.getSymbolValue(reference.second);
+    }
+    base += object.code.size();
+  }
+
+  symbolCount = symbolTable.size();
+  return rom;
+}
+
+// Size of the symbol table after the last link(), including predefined
+// symbols
+size_t Linker::getSymbolCount() const { return symbolCount; }
+
+// ROM addresses of every function's entry point after the last link()
+const std::vector<std::pair<std::string, int>> &Linker::getFunctions() const
+{
+  return functions;
+}
+
+// ROM addresses of every call's return label after the last link()
+const std::vector<std::pair<std::string, int>> &Linker::getReturnSites() const
+{
+  return returnSites;
+}
+
+// Listing and .vm lines of every ROM address, in the order link() places the
+// objects. Listing lines count from the start of the whole program's listing.
+SourceMap Linker::getSourceMap() const
+{
+  SourceMap sourceMap{};
+  int lineBase{0};
+  for (const ObjectFile &object : objects)
+  {
+    const int file{object.sourceFile.empty()
+                       ? SourceMap::NO_FILE
+                       : sourceMap.addFile(object.sourceFile)};
+    for (const std::pair<int, int> &sourceLine : object.sourceLines)
+      sourceMap.addLocation({lineBase + sourceLine.first,
+                             sourceLine.second ? file : SourceMap::NO_FILE,
+                             sourceLine.second});
+    lineBase += object.lineCount;
+  }
+  return sourceMap;
+}
+
+// The .vm file an object was translated from, for errors
+static std::string objectName(const ObjectFile &object)
+{
+  return object.sourceFile.empty() ? "(bootstrap)" : object.sourceFile;
+}
@@ -0,0 +1,29 @@
+#ifndef LINKER_HPP
+#define LINKER_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "objectfile.hpp"
+#include "../06_assembler/sourcemap.hpp"
+
+class Linker
+{
+public:
+  Linker();
+  void addObject(const ObjectFile &object);
+  std::vector<uint16_t> link();
+  size_t getSymbolCount() const;
+  const std::vector<std::pair<std::string, int>> &getFunctions() const;
+  const std::vector<std::pair<std::string, int>> &getReturnSites() const;
+  SourceMap getSourceMap() const;
+
+private:
+  std::vector<ObjectFile> objects;
+  size_t symbolCount;
+  std::vector<std::pair<std::string, int>> functions;
+  std::vector<std::pair<std::string, int>> returnSites;
+};
+
+#endif
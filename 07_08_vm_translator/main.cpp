@@ -1,37 +1,132 @@
 #include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <vector>
+#include "cache.hpp"
+#include "hackwriter.hpp"
+#include "interpreter.hpp"
+#include "linker.hpp"
+#include "objectfile.hpp"
 #include "parser.hpp"
 #include "translator.hpp"
+#include "../06_assembler/stats.hpp"
 
 const int STACK_BASE_ADDR = 0x100;
 
-int main(int, const char *argv[])
+static std::string translateInstruction(Translator &translator,
+                                        const Parser::Instruction &instruction);
+static std::string segmentStackPointer(Parser::SEGMENTS segment);
+static std::string instructionName(const Parser::Instruction &instruction);
+static std::string translationOptions(const std::filesystem::path &inputFile,
+                                      bool encode);
+static int runInterpreter(const std::vector<std::filesystem::path> &inputFiles,
+                          uint64_t maxSteps, int dumpFirst, int dumpLast);
+static void parseRange(const std::string &range, int &first, int &last);
+static void writeSymbolMap(std::ostream &os, const Linker &linker,
+                           size_t romSize);
+
+int main(int argc, const char *argv[])
 {
-  if (!argv[1])
-    throw std::invalid_argument("No input file given");
+  // Parse options
+  bool writeHack{false};
+  bool writeBinary{false};
+  bool writeSymbols{false};
+  bool writeSourceMap{false};
+  bool writeListing{false};
+  bool incremental{false};
+  bool useCache{false};
+  bool printStats{false};
+  bool printStatsJson{false};
+  bool runVm{false};
+  uint64_t maxSteps{std::numeric_limits<uint64_t>::max()};
+  int dumpFirst{0};
+  int dumpLast{-1};
+  std::filesystem::path inputPath;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg{argv[i]};
+    if (arg == "--hack")
+      writeHack = true;
+    else if (arg == "--bin")
+      writeBinary = true;
+    else if (arg == "--sym")
+      writeSymbols = true;
+    else if (arg == "--source-map")
+      writeSourceMap = true;
+    else if (arg == "--listing")
+      writeListing = true;
+    else if (arg == "--incremental")
+      incremental = true;
+    else if (arg == "--cache")
+      useCache = true;
+    else if (arg == "--stats")
+      printStats = true;
+    else if (arg == "--stats=json")
+      printStatsJson = true;
+    else if (arg == "--run")
+      runVm = true;
+    else if (arg == "--steps" && i + 1 < argc)
+      maxSteps = std::stoull(argv[++i]);
+    else if (arg == "--dump" && i + 1 < argc)
+      parseRange(argv[++i], dumpFirst, dumpLast);
+    else
+      inputPath = arg;
+  }
 
-  const std::filesystem::path inputPath{argv[1]};
+  if (inputPath.empty())
+    throw std::invalid_argument("No input file given");
 
   // Create list of files to read
   std::vector<std::filesystem::path> inputFiles;
   std::filesystem::path outputPath{std::filesystem::canonical(inputPath)};
 
   if (std::filesystem::is_directory(inputPath))
+  {
     for (std::filesystem::path entry : std::filesystem::directory_iterator(inputPath))
       if (std::filesystem::is_regular_file(entry) && entry.extension() == ".vm")
         inputFiles.push_back(entry);
-  else {
+  }
+  else
+  {
     inputFiles.push_back(inputPath);
   }
 
+  if (runVm)
+    return runInterpreter(inputFiles, maxSteps, dumpFirst, dumpLast);
+
+  // Machine code is encoded in-process when a .hack or binary ROM is
+  // requested, the assembly text is then only kept as a debug listing. Each
+  // file is encoded into its own relocatable object and linked at the end.
+  const bool encode{writeHack || writeBinary};
+  const bool collectStats{printStats || printStatsJson};
+  Stats stats{collectStats};
+  Stats::Clock::duration parseTime{};
+  Stats::Clock::duration codegenTime{};
+  Stats::Clock::duration outputTime{};
+  Stats::Clock::time_point phaseStart{stats.now()};
+  Linker linker{};
+  HackWriter bootstrapWriter{};
   Translator translator{};
-  outputPath.replace_extension(".asm");
-  std::ofstream outputFile{outputPath};
+  if (encode)
+    translator.setWriter(&bootstrapWriter);
+
+  std::ofstream outputFile;
+  if (!encode || writeListing)
+  {
+    outputPath.replace_extension(".asm");
+    outputFile.open(outputPath);
+  }
 
   // Initialize stack pointer
   std::string instruction{translator.initializeStackPointer(STACK_BASE_ADDR)};
@@ -45,244 +140,386 @@ int main(int, const char *argv[])
             << instruction << std::endl;
   outputFile << instruction;
 
+  linker.addObject(bootstrapWriter.getObject());
+  stats.addCount("hack words", "bootstrap",
+                 translator.getCurrentInstructionNumber());
+  codegenTime += stats.now() - phaseStart;
+
+  // Translations are cached per file next to the output, keyed by the file's
+  // contents and the symbol prefix it is translated with
+  std::unique_ptr<TranslationCache> cache;
+  if (useCache)
+    cache = std::make_unique<TranslationCache>(outputPath.parent_path() /
+                                               ".vm_cache");
+
   for (size_t i = 0; i < inputFiles.size(); i++)
   {
     const std::filesystem::path inputFile = inputFiles[i];
-    Parser parser{inputFile};
+    const std::string fileName{inputFile.filename().string()};
+    phaseStart = stats.now();
 
-    // Set new prefix to use for symbols
-    translator.setSymbolPrefix(inputFile.stem());
+    // Cached translations and reused objects are keyed by the file's
+    // contents and the options it is translated with
+    std::string sourceKey;
+    if (cache || (encode && incremental))
+    {
+      std::ifstream vmFile{inputFile, std::ios::binary};
+      const std::string contents{std::istreambuf_iterator<char>(vmFile),
+                                 std::istreambuf_iterator<char>()};
+      sourceKey = TranslationCache::makeKey(
+          contents, translationOptions(inputFile, encode));
+    }
 
-    // Iterate through instructions
-    for (; parser.moreInstructions(); parser.advanceInstruction())
+    // Reuse the file's object if it was translated from the same key
+    std::filesystem::path objectPath{inputFile};
+    objectPath.replace_extension(".hobj");
+    ObjectFile object{};
+    if (encode && incremental && !writeListing &&
+        ObjectFile::readIfCurrent(objectPath, sourceKey, object))
     {
-      Parser::Instruction currentInstruction{parser.getCurrentInstruction()};
+      std::cout << "OBJECT: " << objectPath.string() << std::endl;
+      translator.advanceInstructionNumber(object.code.size());
+      linker.addObject(object);
+      stats.addCount("files", "objects reused");
+      parseTime += stats.now() - phaseStart;
+      continue;
+    }
 
-      std::cout << "INSTRUCTION: " << parser.getRawInstruction() << std::endl;
-      std::cout << "Instruction number: "
-                << translator.getCurrentInstructionNumber() << std::endl;
+    HackWriter writer{};
+    if (encode)
+      translator.setWriter(&writer);
 
-      // Push instruction
-      if (currentInstruction.type == Parser::PUSH_INSTRUCTION)
+    // Splice in the file's cached translation if there is one
+    if (cache)
+    {
+      std::string translation;
+      if (cache->lookup(sourceKey, translation))
       {
-        if (currentInstruction.segment == Parser::CONSTANT_SEGMENT)
-        {
-          std::string instruction = translator.generatePushConstantInstruction(
-              currentInstruction.indexOrConstant);
-
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
-
-        else if (currentInstruction.segment == Parser::LOCAL_SEGMENT)
-        {
-          std::string instruction = translator.generatePushInstruction(
-              "LCL", currentInstruction.indexOrConstant);
-
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
-
-        else if (currentInstruction.segment == Parser::ARGUMENT_SEGMENT)
-        {
-          std::string instruction = translator.generatePushInstruction(
-              "ARG", currentInstruction.indexOrConstant);
-
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
-
-        else if (currentInstruction.segment == Parser::THIS_SEGMENT)
+        std::cout << "CACHED: " << inputFile.string() << std::endl;
+        outputFile << translation;
+
+        // The writer counts the entry's instructions even without encode
+        std::istringstream lines{translation};
+        std::string line;
+        while (std::getline(lines, line))
+          writer.writeLine(line);
+        translator.advanceInstructionNumber(writer.getInstructionNumber());
+        if (encode)
         {
-          std::string instruction = translator.generatePushInstruction(
-              "THIS", currentInstruction.indexOrConstant);
-
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
+          object = writer.getObject();
+          object.sourceKey = sourceKey;
+          linker.addObject(object);
+          if (incremental)
+            object.write(objectPath);
         }
+        stats.addCount("files", "cached");
+        stats.addTime("cache", stats.now() - phaseStart);
+        continue;
+      }
+    }
 
-        else if (currentInstruction.segment == Parser::THAT_SEGMENT)
-        {
-          std::string instruction = translator.generatePushInstruction(
-              "THAT", currentInstruction.indexOrConstant);
+    if (cache)
+      stats.addTime("cache", stats.now() - phaseStart);
+    stats.addCount("files", "translated");
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
+    // Parsing, code generation and output are interleaved, so each is timed
+    // separately per instruction
+    phaseStart = stats.now();
+    Parser parser{inputFile};
+    std::string translation;
 
-        else if (currentInstruction.segment == Parser::POINTER_SEGMENT)
-        {
-          std::string instruction = translator.generatePushPointerInstruction(
-              currentInstruction.indexOrConstant);
+    // Set new prefix to use for symbols
+    translator.setSymbolPrefix(inputFile.stem());
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
+    // Iterate through instructions
+    for (; parser.moreInstructions(); parser.advanceInstruction())
+    {
+      Stats::Clock::time_point codegenStart{stats.now()};
+      parseTime += codegenStart - phaseStart;
 
-        else if (currentInstruction.segment == Parser::TEMP_SEGMENT)
-        {
-          std::string instruction = translator.generatePushTempInstruction(
-              currentInstruction.indexOrConstant);
+      std::cout << "INSTRUCTION: " << parser.getRawInstruction() << std::endl;
+      std::cout << "Instruction number: "
+                << translator.getCurrentInstructionNumber() << std::endl;
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
+      if (parser.getCurrentInstruction().type == Parser::NONE_INSTRUCTION)
+      {
+        std::cout << "UNKNOWN INSTRUCTION: " << parser.getRawInstruction()
+                  << std::endl;
+        phaseStart = stats.now();
+        continue;
+      }
 
-        else if (currentInstruction.segment == Parser::STATIC_SEGMENT)
-        {
-          std::string instruction = translator.generatePushStaticInstruction(
-              currentInstruction.indexOrConstant);
+      const int firstWord{translator.getCurrentInstructionNumber()};
+      instruction =
+          translator.generateSourceComment(fileName, parser.getLineNumber());
+      instruction +=
+          translateInstruction(translator, parser.getCurrentInstruction());
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
-      }
+      Stats::Clock::time_point outputStart{stats.now()};
+      codegenTime += outputStart - codegenStart;
 
-      // Pop Instruction
-      else if (currentInstruction.type == Parser::POP_INSTRUCTION)
+      if (collectStats)
       {
-        if (currentInstruction.segment == Parser::LOCAL_SEGMENT)
-        {
-          std::string instruction = translator.generatePopInstruction(
-              "LCL", currentInstruction.indexOrConstant);
+        const std::string name{instructionName(parser.getCurrentInstruction())};
+        const int words{translator.getCurrentInstructionNumber() - firstWord};
+        stats.addCount(fileName + " instructions", name);
+        stats.addCount(fileName + " hack words", name, words);
+        stats.addCount("hack words", name, words);
+      }
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
+      outputFile << instruction;
+      std::cout << instruction << std::endl;
+      if (cache)
+        translation += instruction;
 
-        else if (currentInstruction.segment == Parser::ARGUMENT_SEGMENT)
-        {
-          std::string instruction = translator.generatePopInstruction(
-              "ARG", currentInstruction.indexOrConstant);
+      phaseStart = stats.now();
+      outputTime += phaseStart - outputStart;
+    }
+    parseTime += stats.now() - phaseStart;
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
+    if (cache)
+      cache->store(sourceKey, translation);
 
-        else if (currentInstruction.segment == Parser::THIS_SEGMENT)
-        {
-          std::string instruction = translator.generatePopInstruction(
-              "THIS", currentInstruction.indexOrConstant);
+    if (encode)
+    {
+      object = writer.getObject();
+      object.sourceKey = sourceKey;
+      linker.addObject(object);
+      if (incremental)
+        object.write(objectPath);
+    }
+  }
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
+  phaseStart = stats.now();
+  outputFile.close();
 
-        else if (currentInstruction.segment == Parser::THAT_SEGMENT)
-        {
-          std::string instruction = translator.generatePopInstruction(
-              "THAT", currentInstruction.indexOrConstant);
+  if (encode)
+  {
+    const std::vector<uint16_t> rom{linker.link()};
+    stats.setValue("rom words", rom.size());
+    stats.setValue("symbols", linker.getSymbolCount());
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
+    if (writeHack)
+    {
+      outputPath.replace_extension(".hack");
+      std::ofstream hackFile{outputPath};
+      HackWriter::writeHack(hackFile, rom);
+    }
 
-        else if (currentInstruction.segment == Parser::POINTER_SEGMENT)
-        {
-          std::string instruction = translator.generatePopPointerInstruction(
-              currentInstruction.indexOrConstant);
+    if (writeBinary)
+    {
+      outputPath.replace_extension(".bin");
+      std::ofstream binaryFile{outputPath, std::ios::binary};
+      HackWriter::writeBinary(binaryFile, rom);
+    }
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
+    if (writeSymbols)
+    {
+      outputPath.replace_extension(".sym");
+      std::ofstream symbolFile{outputPath};
+      writeSymbolMap(symbolFile, linker, rom.size());
+    }
 
-        else if (currentInstruction.segment == Parser::TEMP_SEGMENT)
-        {
-          std::string instruction = translator.generatePopTempInstruction(
-              currentInstruction.indexOrConstant);
+    if (writeSourceMap)
+    {
+      outputPath.replace_extension(".smap");
+      linker.getSourceMap().write(outputPath);
+    }
+  }
+  outputTime += stats.now() - phaseStart;
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
+  stats.addTime("read/parse", parseTime);
+  stats.addTime("codegen", codegenTime);
+  stats.addTime("output", outputTime);
+  if (printStats)
+    stats.print(std::cerr);
+  if (printStatsJson)
+    stats.printJson(std::cerr);
 
-        else if (currentInstruction.segment == Parser::STATIC_SEGMENT)
-        {
-          std::string instruction = translator.generatePopStaticInstruction(
-              currentInstruction.indexOrConstant);
+  return 0;
+}
 
-          outputFile << instruction;
-          std::cout << instruction << std::endl;
-        }
-      }
+// Generates the assembly for a single parsed VM instruction
+static std::string translateInstruction(Translator &translator,
+                                        const Parser::Instruction &instruction)
+{
+  // Push instruction
+  if (instruction.type == Parser::PUSH_INSTRUCTION)
+  {
+    if (instruction.segment == Parser::CONSTANT_SEGMENT)
+      return translator.generatePushConstantInstruction(
+          instruction.indexOrConstant);
+    if (instruction.segment == Parser::POINTER_SEGMENT)
+      return translator.generatePushPointerInstruction(
+          instruction.indexOrConstant);
+    if (instruction.segment == Parser::TEMP_SEGMENT)
+      return translator.generatePushTempInstruction(
+          instruction.indexOrConstant);
+    if (instruction.segment == Parser::STATIC_SEGMENT)
+      return translator.generatePushStaticInstruction(
+          instruction.indexOrConstant);
+    return translator.generatePushInstruction(
+        segmentStackPointer(instruction.segment), instruction.indexOrConstant);
+  }
 
-      // Arithmetic/Logical Instruction
-      else if (currentInstruction.type == Parser::ARITHMETIC_INSTRUCTION)
-      {
-        std::string instruction =
-            translator.generateArithmeticInstruction(currentInstruction.op);
+  // Pop Instruction
+  if (instruction.type == Parser::POP_INSTRUCTION)
+  {
+    if (instruction.segment == Parser::POINTER_SEGMENT)
+      return translator.generatePopPointerInstruction(
+          instruction.indexOrConstant);
+    if (instruction.segment == Parser::TEMP_SEGMENT)
+      return translator.generatePopTempInstruction(
+          instruction.indexOrConstant);
+    if (instruction.segment == Parser::STATIC_SEGMENT)
+      return translator.generatePopStaticInstruction(
+          instruction.indexOrConstant);
+    return translator.generatePopInstruction(
+        segmentStackPointer(instruction.segment), instruction.indexOrConstant);
+  }
 
-        outputFile << instruction;
-        std::cout << instruction << std::endl;
-      }
+  // Arithmetic/Logical Instruction
+  if (instruction.type == Parser::ARITHMETIC_INSTRUCTION)
+    return translator.generateArithmeticInstruction(instruction.op);
 
-      // Label instruction
-      else if (currentInstruction.type == Parser::LABEL_INSTRUCTION)
-      {
-        std::string instruction =
-            translator.generateLabelInstruction(currentInstruction.symbol);
+  // Label instruction
+  if (instruction.type == Parser::LABEL_INSTRUCTION)
+    return translator.generateLabelInstruction(instruction.symbol);
 
-        outputFile << instruction;
-        std::cout << instruction << std::endl;
-      }
+  // Conditional jump instruction
+  if (instruction.type == Parser::IF_INSTRUCTION)
+    return translator.generateConditionalGotoInstruction(instruction.symbol);
 
-      // Conditional jump instruction
-      else if (currentInstruction.type == Parser::IF_INSTRUCTION)
-      {
-        std::string instruction = translator.generateConditionalGotoInstruction(
-            currentInstruction.symbol);
+  // Goto instruction
+  if (instruction.type == Parser::GOTO_INSTRUCTION)
+    return translator.generateGotoInstruction(instruction.symbol);
 
-        outputFile << instruction;
-        std::cout << instruction << std::endl;
-      }
+  // Function declaration instruction
+  if (instruction.type == Parser::FN_DECL_INSTRUCTION)
+    return translator.generateFnDeclInstruction(instruction.symbol,
+                                                instruction.indexOrConstant);
 
-      // Goto instruction
-      else if (currentInstruction.type == Parser::GOTO_INSTRUCTION)
-      {
-        std::string instruction =
-            translator.generateGotoInstruction(currentInstruction.symbol);
+  // Function call instruction
+  if (instruction.type == Parser::CALL_INSTRUCTION)
+    return translator.generateCallInstruction(instruction.symbol,
+                                              instruction.indexOrConstant);
 
-        outputFile << instruction;
-        std::cout << instruction << std::endl;
-      }
+  // Function return instruction
+  if (instruction.type == Parser::RETURN_INSTRUCTION)
+    return translator.generateReturnInstruction();
 
-      // Function declaration instruction
-      else if (currentInstruction.type == Parser::FN_DECL_INSTRUCTION)
-      {
-        std::string instruction = translator.generateFnDeclInstruction(
-            currentInstruction.symbol, currentInstruction.indexOrConstant);
+  return "";
+}
 
-        outputFile << instruction;
-        std::cout << instruction << std::endl;
-      }
+// Names an instruction by its type, and segment or op, for --stats
+static std::string instructionName(const Parser::Instruction &instruction)
+{
+  static const char *segmentNames[]{"constant", "local", "argument",
+                                    "this", "that", "pointer",
+                                    "temp", "static", "none"};
+
+  if (instruction.type == Parser::PUSH_INSTRUCTION)
+    return std::string{"push "} + segmentNames[instruction.segment];
+  if (instruction.type == Parser::POP_INSTRUCTION)
+    return std::string{"pop "} + segmentNames[instruction.segment];
+  if (instruction.type == Parser::ARITHMETIC_INSTRUCTION)
+    return instruction.op;
+  if (instruction.type == Parser::LABEL_INSTRUCTION)
+    return "label";
+  if (instruction.type == Parser::IF_INSTRUCTION)
+    return "if-goto";
+  if (instruction.type == Parser::GOTO_INSTRUCTION)
+    return "goto";
+  if (instruction.type == Parser::FN_DECL_INSTRUCTION)
+    return "function";
+  if (instruction.type == Parser::CALL_INSTRUCTION)
+    return "call";
+  if (instruction.type == Parser::RETURN_INSTRUCTION)
+    return "return";
+  return "unknown";
+}
 
-      // Function call instruction
-      else if (currentInstruction.type == Parser::CALL_INSTRUCTION)
-      {
-        std::string instruction = translator.generateCallInstruction(
-            currentInstruction.symbol, currentInstruction.indexOrConstant);
+// Everything besides a file's contents that its translation, or its object,
+// depends on: the symbol prefix, the file name its @source comments give and
+// whether it is encoded for --hack or --bin
+static std::string translationOptions(const std::filesystem::path &inputFile,
+                                      bool encode)
+{
+  return inputFile.stem().string() + "\n" + inputFile.filename().string() +
+         (encode ? "\nencode" : "");
+}
 
-        outputFile << instruction;
-        std::cout << instruction << std::endl;
-      }
+// Returns the register holding the base address of a memory segment
+static std::string segmentStackPointer(Parser::SEGMENTS segment)
+{
+  if (segment == Parser::LOCAL_SEGMENT)
+    return "LCL";
+  if (segment == Parser::ARGUMENT_SEGMENT)
+    return "ARG";
+  if (segment == Parser::THIS_SEGMENT)
+    return "THIS";
+  if (segment == Parser::THAT_SEGMENT)
+    return "THAT";
+  throw std::invalid_argument("Segment has no base address register");
+}
 
-      // Function return instruction
-      else if (currentInstruction.type == Parser::RETURN_INSTRUCTION)
-      {
-        std::string instruction = translator.generateReturnInstruction();
+// Runs the VM code directly, from Sys.init if there is one and from the
+// first instruction otherwise
+static int runInterpreter(const std::vector<std::filesystem::path> &inputFiles,
+                          uint64_t maxSteps, int dumpFirst, int dumpLast)
+{
+  Interpreter interpreter{};
+  for (const std::filesystem::path &inputFile : inputFiles)
+    interpreter.load(inputFile);
+  interpreter.link();
+  if (interpreter.hasFunction("Sys.init"))
+    interpreter.start("Sys.init");
+
+  const std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  interpreter.run(maxSteps);
+  const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+  for (int address = dumpFirst; address <= dumpLast; address++)
+    std::cout << "RAM[" << address << "] = " << interpreter.peek(address)
+              << std::endl;
+
+  std::cerr << (interpreter.isHalted() ? "Halted" : "Stopped") << " after "
+            << interpreter.getInstructionCount() << " VM instructions in "
+            << elapsed.count() << " s" << std::endl;
+  return 0;
+}
 
-        outputFile << instruction;
-        std::cout << instruction << std::endl;
-      }
+// Writes the ROM address range of every function, sorted by address, as
+// "F start end name" lines, followed by "R address label" lines for every
+// call's return site. Ranges end where the next function starts.
+static void writeSymbolMap(std::ostream &os, const Linker &linker,
+                           size_t romSize)
+{
+  std::vector<std::pair<std::string, int>> functions{linker.getFunctions()};
+  std::stable_sort(functions.begin(), functions.end(),
+                   [](const std::pair<std::string, int> &left,
+                      const std::pair<std::string, int> &right)
+                   { return left.second < right.second; });
 
-      else
-      {
-        std::cout << "UNKNOWN INSTRUCTION: " << parser.getRawInstruction()
-                  << std::endl;
-      }
-    }
+  for (size_t i = 0; i < functions.size(); i++)
+  {
+    const int end = i + 1 < functions.size() ? functions[i + 1].second
+                                             : static_cast<int>(romSize);
+    os << "F " << functions[i].second << ' ' << end << ' '
+       << functions[i].first << '\n';
   }
+  for (const std::pair<std::string, int> &returnSite : linker.getReturnSites())
+    os << "R " << returnSite.second << ' ' << returnSite.first << '\n';
+}
 
-  outputFile.close();
-
-  return 0;
+// Parses "first-last" or a single address
+static void parseRange(const std::string &range, int &first, int &last)
+{
+  const size_t dash{range.find('-')};
+  first = std::stoi(range.substr(0, dash));
+  last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+  if (first < 0 || last >= Interpreter::RAM_SIZE || first > last)
+    throw std::invalid_argument("Invalid RAM range " + range);
 }
@@ -0,0 +1,174 @@
+#include "objectfile.hpp"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include "../06_assembler/littleendian.hpp"
+
+// Object files are laid out as:
+//   "HOBJ", version, source key
+//   code word count, code words
+//   label count, (name, offset) pairs
+//   reference count, (offset, name) pairs
+//   function count, (name, offset) pairs
+//   return site count, (name, offset) pairs
+//   source file name, listing line count
+//   code word count (listing line, source line) pairs
+// All integers are little endian, names are prefixed with their length.
+const char OBJECT_FILE_MAGIC[4]{'H', 'O', 'B', 'J'};
+const uint16_t OBJECT_FILE_VERSION{4};
+
+static void writeString(std::ostream &os, const std::string &string);
+static void writeNamedOffsets(
+    std::ostream &os,
+    const std::vector<std::pair<std::string, int>> &namedOffsets);
+
+static std::string readString(std::istream &is);
+static bool readHeader(std::istream &is);
+static ObjectFile readBody(std::istream &is, const std::string &inputFilename);
+static std::vector<std::pair<std::string, int>>
+readNamedOffsets(std::istream &is);
+
+void ObjectFile::write(const std::string &outputFilename) const
+{
+  std::ofstream outputFile{outputFilename, std::ios::binary};
+  if (!outputFile.is_open())
+    throw std::runtime_error("Could not write object file " + outputFilename);
+
+  outputFile.write(OBJECT_FILE_MAGIC, sizeof(OBJECT_FILE_MAGIC));
+  writeU16(outputFile, OBJECT_FILE_VERSION);
+  writeString(outputFile, sourceKey);
+
+  writeU32(outputFile, code.size());
+  for (uint16_t word : code)
+    writeU16(outputFile, word);
+
+  writeNamedOffsets(outputFile, labels);
+
+  writeU32(outputFile, references.size());
+  for (const std::pair<int, std::string> &reference : references)
+  {
+    writeU32(outputFile, reference.first);
+    writeString(outputFile, reference.second);
+  }
+
+  writeNamedOffsets(outputFile, functions);
+  writeNamedOffsets(outputFile, returnSites);
+
+  writeString(outputFile, sourceFile);
+  writeU32(outputFile, lineCount);
+  for (const std::pair<int, int> &sourceLine : sourceLines)
+  {
+    writeU32(outputFile, sourceLine.first);
+    writeU32(outputFile, sourceLine.second);
+  }
+}
+
+ObjectFile ObjectFile::read(const std::string &inputFilename)
+{
+  std::ifstream inputFile{inputFilename, std::ios::binary};
+  if (!readHeader(inputFile))
+    throw std::runtime_error("Invalid object file " + inputFilename);
+
+  const std::string sourceKey{readString(inputFile)};
+  ObjectFile object{readBody(inputFile, inputFilename)};
+  object.sourceKey = sourceKey;
+  return object;
+}
+
+// Reads the object only if it is in the current format and has the given
+// source key, so --incremental never links code from an older translator
+// or from other contents or options
+bool ObjectFile::readIfCurrent(const std::string &inputFilename,
+                               const std::string &sourceKey,
+                               ObjectFile &object)
+{
+  std::ifstream inputFile{inputFilename, std::ios::binary};
+  if (!readHeader(inputFile) || readString(inputFile) != sourceKey)
+    return false;
+
+  object = readBody(inputFile, inputFilename);
+  object.sourceKey = sourceKey;
+  return true;
+}
+
+static void writeString(std::ostream &os, const std::string &string)
+{
+  writeU16(os, string.size());
+  os.write(string.data(), string.size());
+}
+
+static void writeNamedOffsets(
+    std::ostream &os,
+    const std::vector<std::pair<std::string, int>> &namedOffsets)
+{
+  writeU32(os, namedOffsets.size());
+  for (const std::pair<std::string, int> &namedOffset : namedOffsets)
+  {
+    writeString(os, namedOffset.first);
+    writeU32(os, namedOffset.second);
+  }
+}
+
+static std::string readString(std::istream &is)
+{
+  std::string string(readU16(is), '\0');
+  is.read(string.data(), string.size());
+  return string;
+}
+
+static std::vector<std::pair<std::string, int>>
+readNamedOffsets(std::istream &is)
+{
+  std::vector<std::pair<std::string, int>> namedOffsets(readU32(is));
+  for (std::pair<std::string, int> &namedOffset : namedOffsets)
+  {
+    namedOffset.first = readString(is);
+    namedOffset.second = readU32(is);
+  }
+  return namedOffsets;
+}
+
+// The magic and the current version
+static bool readHeader(std::istream &is)
+{
+  char magic[sizeof(OBJECT_FILE_MAGIC)];
+  return is.read(magic, sizeof(magic)) &&
+         std::equal(magic, magic + sizeof(magic), OBJECT_FILE_MAGIC) &&
+         readU16(is) == OBJECT_FILE_VERSION;
+}
+
+// Everything after the source key
+static ObjectFile readBody(std::istream &is, const std::string &inputFilename)
+{
+  ObjectFile object{};
+
+  object.code.resize(readU32(is));
+  for (uint16_t &word : object.code)
+    word = readU16(is);
+
+  object.labels = readNamedOffsets(is);
+
+  object.references.resize(readU32(is));
+  for (std::pair<int, std::string> &reference : object.references)
+  {
+    reference.first = readU32(is);
+    reference.second = readString(is);
+  }
+
+  object.functions = readNamedOffsets(is);
+  object.returnSites = readNamedOffsets(is);
+
+  object.sourceFile = readString(is);
+  object.lineCount = readU32(is);
+  object.sourceLines.resize(object.code.size());
+  for (std::pair<int, int> &sourceLine : object.sourceLines)
+  {
+    sourceLine.first = readU32(is);
+    sourceLine.second = readU32(is);
+  }
+
+  if (!is)
+    throw std::runtime_error("Truncated object file " + inputFilename);
+
+  return object;
+}
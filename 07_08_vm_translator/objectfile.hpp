@@ -0,0 +1,36 @@
+#ifndef OBJECT_FILE_HPP
+#define OBJECT_FILE_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Relocatable machine code for a single .vm file. Label offsets and
+// reference offsets are relative to the start of the object's code.
+struct ObjectFile
+{
+  std::vector<uint16_t> code;
+  std::vector<std::pair<std::string, int>> labels;
+  std::vector<std::pair<int, std::string>> references;
+  // Entry points of the VM functions defined in the file, and the return
+  // labels of the calls it makes, for the symbol map
+  std::vector<std::pair<std::string, int>> functions;
+  std::vector<std::pair<std::string, int>> returnSites;
+  // The .vm file the code was translated from, and for every code word its
+  // line in the assembly listing, counted from the object's first line, and
+  // in the .vm file, for the source map
+  std::string sourceFile;
+  std::vector<std::pair<int, int>> sourceLines;
+  int lineCount;
+  // TranslationCache::makeKey of the .vm file's contents and the options it
+  // was translated with, which --incremental reuses the object for
+  std::string sourceKey;
+
+  void write(const std::string &outputFilename) const;
+  static ObjectFile read(const std::string &inputFilename);
+  static bool readIfCurrent(const std::string &inputFilename,
+                            const std::string &sourceKey, ObjectFile &object);
+};
+
+#endif
@@ -1,9 +1,11 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
-#include <fstream>
+#include <memory>
 #include <string>
 
+class Lexer;
+
 class Parser
 {
 public:
@@ -50,14 +52,14 @@ public:
   void reset();
   void advanceInstruction();
   std::string getRawInstruction();
+  int getLineNumber() const;
 
 private:
-  std::ifstream inputFile;
+  std::unique_ptr<Lexer> lexer;
   std::string inputFileBasename;
   bool _moreInstructions;
   Instruction currentInstruction;
   std::string rawInstruction;
-  void parseInstruction(const std::string &line);
 };
 
 bool operator==(const Parser::Instruction &left,
@@ -1,7 +1,19 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "cache.hpp"
+#include "hackwriter.hpp"
+#include "interpreter.hpp"
+#include "lexer.hpp"
+#include "linker.hpp"
 #include "parser.hpp"
+#include "translator.hpp"
 
 /*
-These are the unit tests for the parser module.
+These are the unit tests for the lexer, parser, hack writer, linker, cache,
+interpreter and stats modules.
 The translator module is not unit tested as there are a
 multitude of valid solutions for each method and I can't think of an elegant way
 to unit test them. These are better left for manual and integration testing.
@@ -12,6 +24,62 @@ pass, and 1 otherwise.
 
 int fail(const std::string &reason);
 
+int lexerTest()
+{
+  Lexer::Instruction instruction;
+
+  // parseInstruction()
+  Lexer::parseInstruction("push  constant 17", instruction);
+  if (instruction.type != Parser::PUSH_INSTRUCTION ||
+      instruction.segment != Parser::CONSTANT_SEGMENT ||
+      instruction.indexOrConstant != 17)
+    return fail("'push  constant 17' was not lexed as a push instruction");
+
+  Lexer::parseInstruction("if-goto LOOP_START", instruction);
+  if (instruction.type != Parser::IF_INSTRUCTION ||
+      instruction.symbol != "LOOP_START")
+    return fail("'if-goto LOOP_START' was not lexed as an if instruction");
+
+  Lexer::parseInstruction("lt", instruction);
+  if (instruction.type != Parser::ARITHMETIC_INSTRUCTION ||
+      instruction.op != "lt")
+    return fail("'lt' was not lexed as an arithmetic instruction");
+
+  // Unknown keywords that share a length and prefix with a real one
+  Lexer::parseInstruction("adx", instruction);
+  if (instruction.type != Parser::NONE_INSTRUCTION)
+    return fail("'adx' should not be lexed as an instruction");
+
+  // Malformed indices are errors rather than truncated numbers
+  for (const char *malformed :
+       {"push constant abc", "pop local 12x", "call Main.main 2y"})
+  {
+    bool thrown{false};
+    try
+    {
+      Lexer::parseInstruction(malformed, instruction);
+    }
+    catch (const std::invalid_argument &)
+    {
+      thrown = true;
+    }
+    if (!thrown)
+      return fail("'" + std::string{malformed} + "' should not be lexed");
+  }
+
+  // nextInstruction(), comments and blank lines are skipped
+  Lexer lexer{"test.vm"};
+  if (!lexer.nextInstruction(instruction) ||
+      instruction.type != Parser::FN_DECL_INSTRUCTION ||
+      instruction.symbol != "SimpleFunction.test" ||
+      instruction.indexOrConstant != 2)
+    return fail("First lexed instruction should be the function declaration");
+  if (lexer.getLineNumber() != 2)
+    return fail("Function declaration should be on line 2");
+
+  return 0;
+}
+
 int parserTest()
 {
   Parser parser{"test.vm"};
@@ -53,10 +121,287 @@ int parserTest()
   return 0;
 }
 
+int hackWriterTest()
+{
+  HackWriter writer{};
+
+  // writeLine(), labels don't take up an address
+  writer.writeLine("@LOOP");
+  writer.writeLine("(LOOP)");
+  writer.writeLine("@256");
+  writer.writeLine("D=A");
+  writer.writeLine("@SP");
+  writer.writeLine("AM=M-1;JMP");
+  writer.writeLine("@Main.0");
+  writer.writeLine("@Main.1");
+  writer.writeLine("@Main.0");
+  if (writer.getInstructionNumber() != 8)
+    return fail("Writer should have encoded 8 instructions");
+
+  // link(), labels resolve to their address and variables are allocated
+  // from 16 onwards
+  Linker linker{};
+  linker.addObject(writer.getObject());
+  std::vector<uint16_t> rom{linker.link()};
+  if (rom[0] != 1)
+    return fail("Label 'LOOP' should resolve to address 1");
+  if (rom[1] != 256)
+    return fail("'@256' should be encoded as 256");
+  if (rom[2] != 0xEC10)
+    return fail("'D=A' should be encoded as 1110110000010000");
+  if (rom[3] != 0)
+    return fail("'@SP' should resolve to 0");
+  if (rom[4] != 0xFCAF)
+    return fail("'AM=M-1;JMP' should be encoded as 1111110010101111");
+  if (rom[5] != 16 || rom[6] != 17 || rom[7] != 16)
+    return fail("Variables should be allocated from address 16");
+
+  return 0;
+}
+
+int linkerTest()
+{
+  HackWriter first{};
+  first.writeLine("@Second.start");
+  first.writeLine("0;JMP");
+  first.writeLine("@First.0");
+
+  HackWriter second{};
+  second.writeLine("// @source Second.vm:4");
+  second.writeLine("// function Second.start");
+  second.writeLine("(Second.start)");
+  second.writeLine("@Second.0");
+  second.writeLine("// @source Second.vm:5");
+  second.writeLine("(Second.start$ret.0)");
+  second.writeLine("@First.0");
+
+  // write()/read(), objects survive a round trip through a file
+  ObjectFile written{second.getObject()};
+  written.sourceKey = "key";
+  written.write("test.hobj");
+  ObjectFile object{ObjectFile::read("test.hobj")};
+  if (object.code != second.getObject().code ||
+      object.labels != second.getObject().labels ||
+      object.references != second.getObject().references ||
+      object.functions != second.getObject().functions ||
+      object.returnSites != second.getObject().returnSites ||
+      object.sourceFile != second.getObject().sourceFile ||
+      object.sourceLines != second.getObject().sourceLines ||
+      object.lineCount != second.getObject().lineCount ||
+      object.sourceKey != "key")
+    return fail("Object read back from file does not match the written one");
+
+  // readIfCurrent(), only objects with the same source key are reused
+  ObjectFile current{};
+  const bool stale{ObjectFile::readIfCurrent("test.hobj", "other", current)};
+  if (stale || !ObjectFile::readIfCurrent("test.hobj", "key", current) ||
+      current.code != object.code)
+    return fail("Objects should only be reused for the same source key");
+  std::remove("test.hobj");
+  if (ObjectFile::readIfCurrent("test.hobj", "key", current))
+    return fail("A missing object should not be reused");
+
+  // link(), labels are relocated by the size of the preceding objects and
+  // statics are shared between objects
+  Linker linker{};
+  linker.addObject(first.getObject());
+  linker.addObject(object);
+  std::vector<uint16_t> rom{linker.link()};
+  if (rom.size() != 5)
+    return fail("Linked ROM should hold 5 instructions");
+  if (rom[0] != 3)
+    return fail("Label 'Second.start' should be relocated to address 3");
+  if (rom[2] != 16 || rom[3] != 17 || rom[4] != 16)
+    return fail("Static variables should be allocated from address 16");
+
+  // getFunctions()/getReturnSites(), relocated like labels
+  if (linker.getFunctions().size() != 1 ||
+      linker.getFunctions()[0].first != "Second.start" ||
+      linker.getFunctions()[0].second != 3)
+    return fail("Function 'Second.start' should be recorded at address 3");
+  if (linker.getReturnSites().size() != 1 ||
+      linker.getReturnSites()[0].first != "Second.start$ret.0" ||
+      linker.getReturnSites()[0].second != 4)
+    return fail("Return site 'Second.start$ret.0' should be at address 4");
+
+  // getSourceMap(), listing lines continue across objects
+  const SourceMap sourceMap{linker.getSourceMap()};
+  if (sourceMap.size() != 5 ||
+      sourceMap.at(0).sourceFile != SourceMap::NO_FILE ||
+      sourceMap.at(2).asmLine != 3)
+    return fail("The first object's words should have no .vm lines");
+  if (sourceMap.at(3).asmLine != 7 || sourceMap.at(3).sourceLine != 4 ||
+      sourceMap.getFileName(sourceMap.at(3).sourceFile) != "Second.vm" ||
+      sourceMap.at(4).asmLine != 10 || sourceMap.at(4).sourceLine != 5)
+    return fail("Second.vm's words should map to listing lines 7 and 10");
+
+  // link(), a label defined twice names both objects
+  HackWriter duplicate{};
+  duplicate.writeLine("// @source Other.vm:1");
+  duplicate.writeLine("(Second.start)");
+  duplicate.writeLine("0;JMP");
+  linker.addObject(duplicate.getObject());
+  try
+  {
+    linker.link();
+    return fail("A label defined twice should not link");
+  }
+  catch (const std::runtime_error &error)
+  {
+    if (std::string{error.what()} !=
+        "Duplicate symbol Second.start in Second.vm and Other.vm")
+      return fail("Duplicate symbols should name both objects, not: " +
+                  std::string{error.what()});
+  }
+
+  return 0;
+}
+
+int cacheTest()
+{
+  // makeKey(), keys depend on both the contents and the options
+  const std::string key{TranslationCache::makeKey("push constant 1", "Main")};
+  if (key != TranslationCache::makeKey("push constant 1", "Main"))
+    return fail("Cache keys should be stable");
+  if (key == TranslationCache::makeKey("push constant 1", "Sys") ||
+      key == TranslationCache::makeKey("push constant 2", "Main"))
+    return fail("Cache keys should change with contents and options");
+
+  // store()/lookup()
+  TranslationCache cache{"test_cache"};
+  std::string translation;
+  if (cache.lookup(key, translation))
+    return fail("Empty cache should not contain any translation");
+  cache.store(key, "@1\nD=A\n");
+  bool found{cache.lookup(key, translation)};
+  std::filesystem::remove_all("test_cache");
+  if (!found || translation != "@1\nD=A\n")
+    return fail("Cache should return the stored translation");
+
+  // A file outside any function translates the same whatever was translated
+  // before it, so its cached translation can be spliced in after any file
+  const auto translate = [](Translator &translator, const std::string &file)
+  {
+    translator.setSymbolPrefix(file);
+    return translator.generateArithmeticInstruction("eq") +
+           translator.generateCallInstruction("Sys.halt");
+  };
+  Translator alone{};
+  Translator afterFirst{};
+  const std::string first{translate(afterFirst, "First")};
+  const std::string second{translate(afterFirst, "Second")};
+  if (second != translate(alone, "Second") ||
+      second.find("(Second.EQ.0)") == std::string::npos ||
+      second.find("(Second$ret.0)") == std::string::npos ||
+      first.find("(First.EQ.0)") == std::string::npos)
+    return fail("Labels outside functions should be named after their file");
+
+  // advanceInstructionNumber(), splicing in First's cached translation
+  // leaves later instruction numbers as translating it does
+  HackWriter cached{};
+  std::istringstream lines{first};
+  std::string line;
+  while (std::getline(lines, line))
+    cached.writeLine(line);
+  Translator spliced{};
+  spliced.advanceInstructionNumber(cached.getInstructionNumber());
+  translate(spliced, "Second");
+  if (spliced.getCurrentInstructionNumber() !=
+      afterFirst.getCurrentInstructionNumber())
+    return fail("A spliced translation should advance the instruction number");
+
+  return 0;
+}
+
+int interpreterTest()
+{
+  // call(), a leaf function with locals and arguments
+  Interpreter simple{};
+  simple.load("test.vm");
+  simple.link();
+  if (simple.call("SimpleFunction.test", {1234, 37}, 100) != 1196)
+    return fail("SimpleFunction.test(1234, 37) should return 1196");
+  if (simple.peek(0) != Interpreter::STACK_BASE)
+    return fail("call() should leave the stack as it found it");
+
+  // Recursion, branches and statics, run from Sys.init
+  {
+    std::ofstream vmFile{"test_interpreter.vm"};
+    vmFile << "function Sys.init 0\n"
+              "push constant 20\n"
+              "call Sys.fibonacci 1\n"
+              "pop static 3\n"
+              "label WHILE\n"
+              "goto WHILE\n"
+              "function Sys.fibonacci 0\n"
+              "push argument 0\n"
+              "push constant 2\n"
+              "lt\n"
+              "if-goto BASE\n"
+              "push argument 0\n"
+              "push constant 1\n"
+              "sub\n"
+              "call Sys.fibonacci 1\n"
+              "push argument 0\n"
+              "push constant 2\n"
+              "sub\n"
+              "call Sys.fibonacci 1\n"
+              "add\n"
+              "return\n"
+              "label BASE\n"
+              "push argument 0\n"
+              "return\n";
+  }
+  Interpreter fibonacci{};
+  fibonacci.load("test_interpreter.vm");
+  std::filesystem::remove("test_interpreter.vm");
+  fibonacci.link();
+  if (fibonacci.call("Sys.fibonacci", {10}, 100000) != 55)
+    return fail("Sys.fibonacci(10) should return 55");
+
+  fibonacci.start("Sys.init");
+  if (fibonacci.run(1000) != 1000 || fibonacci.isHalted())
+    return fail("run() should stop after the given number of instructions");
+  fibonacci.run(1000000);
+  if (!fibonacci.isHalted() || fibonacci.peek(16) != 6765)
+    return fail("Sys.init should halt with fibonacci(20) in static 3");
+
+  // link() rejects calls to functions that were never loaded
+  {
+    std::ofstream vmFile{"test_interpreter.vm"};
+    vmFile << "function Main.main 0\n"
+              "call Math.multiply 2\n"
+              "return\n";
+  }
+  Interpreter undefined{};
+  undefined.load("test_interpreter.vm");
+  std::filesystem::remove("test_interpreter.vm");
+  try
+  {
+    undefined.link();
+    return fail("link() should reject an undefined function");
+  }
+  catch (const std::runtime_error &)
+  {
+  }
+
+  return 0;
+}
+
 int main()
 {
+  if (lexerTest())
+    return 1;
   if (parserTest())
     return 1;
+  if (hackWriterTest())
+    return 1;
+  if (linkerTest())
+    return 1;
+  if (cacheTest())
+    return 1;
+  if (interpreterTest())
+    return 1;
 
   printf("Success");
   return 0;
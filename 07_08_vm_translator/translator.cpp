@@ -6,13 +6,22 @@ Translator::Translator()
       callSymbolId{0},
       instructionCount{0},
       symbolPrefix{""},
-      currentFunctionName{""} {}
+      currentFunctionName{""},
+      writer{nullptr} {}
 
+// Code before a file's first function is labeled after the file, so a
+// file's translation never depends on the files translated before it and can
+// be spliced in from the cache
 void Translator::setSymbolPrefix(const std::string &prefix)
 {
   symbolPrefix = prefix;
+  setCurrentFunctionName(prefix);
 }
 
+// Every generated line is also handed to the writer, which encodes it
+// straight to Hack machine code
+void Translator::setWriter(HackWriter *hackWriter) { writer = hackWriter; }
+
 // Initializes stack pointer to a passed address
 std::string Translator::initializeStackPointer(const int stackAddress)
 {
@@ -203,9 +212,9 @@ std::string Translator::generateArithmeticInstruction(const std::string &op)
     else if (op == "sub")
       instruction += makeLine("M=M-D");
     else if (op == "and")
-      instruction += makeLine("M=M&D");
+      instruction += makeLine("M=D&M");
     else if (op == "or")
-      instruction += makeLine("M=M|D");
+      instruction += makeLine("M=D|M");
     else if (op == "eq")
       instruction +=
           equalityCheck(Translator::EQ_CHECK, getNextEqualitySymbolId());
@@ -244,7 +253,11 @@ std::string Translator::generateConditionalGotoInstruction(
 
 std::string Translator::generateGotoInstruction(const std::string &symbol)
 {
-  return selectRegister(currentFunctionName + "." + symbol) + makeLine("0;JMP");
+  std::string instruction{
+      selectRegister(currentFunctionName + "." + symbol)};
+  instruction += makeLine("0;JMP");
+
+  return instruction;
 }
 
 std::string Translator::generateFnDeclInstruction(const std::string &symbol,
@@ -252,7 +265,9 @@ std::string Translator::generateFnDeclInstruction(const std::string &symbol,
 {
   setCurrentFunctionName(symbol);
 
-  std::string instruction{addLabel(/*symbolPrefix + "." + */ symbol)};
+  // Marks the entry point for the symbol map
+  std::string instruction{makeLine("// function " + symbol, true)};
+  instruction += addLabel(/*symbolPrefix + "." + */ symbol);
   for (int i = 0; i < localVars; i++)
     instruction += generatePushZeroToStackInstruction();
 
@@ -262,7 +277,9 @@ std::string Translator::generateFnDeclInstruction(const std::string &symbol,
 std::string Translator::generateCallInstruction(
     const std::string &symbol, const int pushedVars /* = 0 */)
 {
-  std::string returnAddrSymbolName{symbol + ".return." +
+  // Return labels are numbered per calling function so that the code
+  // generated for a file doesn't depend on the files translated before it
+  std::string returnAddrSymbolName{currentFunctionName + "$ret." +
                                    std::to_string(callSymbolId)};
   ++callSymbolId;
 
@@ -390,15 +407,34 @@ std::string Translator::generateReturnInstruction()
   return instruction;
 }
 
+// Records the .vm line the following instructions are translated from, for
+// the source map
+std::string Translator::generateSourceComment(const std::string &fileName,
+                                              const int lineNumber)
+{
+  return makeLine("// @source " + fileName + ":" + std::to_string(lineNumber),
+                  true);
+}
+
 int Translator::getCurrentInstructionNumber() { return instructionCount; }
 
-// Appends a newline to the end of string. That's it.
+// Counts instructions that were not generated here, like a cached
+// translation or a reused object, so later instruction numbers are the same
+// as when every file is translated
+void Translator::advanceInstructionNumber(const int count)
+{
+  instructionCount += count;
+}
+
+// Appends a newline to the end of string and passes it on to the writer
 std::string Translator::makeLine(
     const std::string &string,
     bool dontIncreaseInstructionNumber /* = false */)
 {
   if (!dontIncreaseInstructionNumber)
     ++instructionCount;
+  if (writer)
+    writer->writeLine(string);
   return string + "\n";
 }
 
@@ -424,19 +460,28 @@ std::string Translator::selectStackPointer() { return selectRegister("SP"); }
 // Selects the SP register and increases it by 1
 std::string Translator::incrementStackPointer()
 {
-  return selectStackPointer() + makeLine("M=M+1");
+  std::string instruction{selectStackPointer()};
+  instruction += makeLine("M=M+1");
+
+  return instruction;
 }
 
 // Selects the SP register and decreases it by 1
 std::string Translator::decrementStackPointer()
 {
-  return selectStackPointer() + makeLine("M=M-1");
+  std::string instruction{selectStackPointer()};
+  instruction += makeLine("M=M-1");
+
+  return instruction;
 }
 
 // Selects the register at the top of the stack
 std::string Translator::selectStack()
 {
-  return selectStackPointer() + makeLine("A=M");
+  std::string instruction{selectStackPointer()};
+  instruction += makeLine("A=M");
+
+  return instruction;
 }
 
 // Generates a label
@@ -498,4 +543,5 @@ void Translator::setCurrentFunctionName(const std::string &string)
 {
   currentFunctionName = string;
   equalitySymbolId = 0;
+  callSymbolId = 0;
 }
\ No newline at end of file
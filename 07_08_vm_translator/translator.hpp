@@ -2,6 +2,7 @@
 #define TRANSLATOR_HPP
 
 #include <string>
+#include "hackwriter.hpp"
 #include "parser.hpp"
 
 class Translator
@@ -16,6 +17,7 @@ public:
 
   Translator();
   void setSymbolPrefix(const std::string &prefix);
+  void setWriter(HackWriter *hackWriter);
   std::string initializeStackPointer(const int stackAddress);
   std::string generatePushInstruction(const std::string &segmentStackPointer,
                                       const int index);
@@ -38,7 +40,10 @@ public:
   std::string generateCallInstruction(const std::string &symbol,
                                       const int pushedVars = 0);
   std::string generateReturnInstruction();
+  std::string generateSourceComment(const std::string &fileName,
+                                    const int lineNumber);
   int getCurrentInstructionNumber();
+  void advanceInstructionNumber(const int count);
 
 private:
   int equalitySymbolId;
@@ -46,6 +51,7 @@ private:
   int instructionCount;
   std::string symbolPrefix;
   std::string currentFunctionName;
+  HackWriter *writer;
   std::string makeLine(const std::string &string,
                        bool dontIncreaseInstructionNumber = false);
   std::string getNextEqualitySymbolId();